@@ -0,0 +1,203 @@
+#ifndef NATIVE_ARDUINO
+#define NATIVE_ARDUINO
+
+/**
+ * @brief the subset of the Arduino(-Pico) core API the firmware uses,
+ *        implemented on top of the native HAL.
+ */
+
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <climits>
+#include <string>
+#include "hal.h"
+
+using std::abs;
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+#define LOW 0
+#define HIGH 1
+
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+
+#define CHANGE HAL_INTERRUPT_CHANGE
+#define FALLING HAL_INTERRUPT_FALLING
+#define RISING HAL_INTERRUPT_RISING
+
+// RPi Pico W pin numbers
+#define LED_BUILTIN 25
+#define D0 0
+#define D1 1
+#define D2 2
+#define D3 3
+#define D4 4
+#define D5 5
+#define D6 6
+#define D7 7
+#define D8 8
+#define D9 9
+#define A0 26
+#define A1 27
+#define A2 28
+
+#define HEX 16
+
+// 133MHz (@see platformio.ini)
+#ifndef F_CPU
+#define F_CPU 133000000L
+#endif
+
+// 32bit, like on the board, so that they wrap as they do there (@see src/monotonicTime.h)
+inline unsigned long micros()
+{
+    return (unsigned long)uint32_t(Hal::clock);
+}
+
+inline unsigned long millis()
+{
+    return (unsigned long)uint32_t(Hal::clock / 1000);
+}
+
+inline void delay(unsigned long ms)
+{
+    Hal::advance(uint64_t(ms) * 1000);
+}
+
+inline void delayMicroseconds(unsigned int us)
+{
+    Hal::advance(us);
+}
+
+inline void randomSeed(unsigned long seed)
+{
+    srand((unsigned int)seed);
+}
+
+inline long random(long max)
+{
+    return max > 0 ? long(rand() % max) : 0;
+}
+
+inline long random(long min, long max)
+{
+    return min + random(max - min);
+}
+
+inline void pinMode(int pin, int mode)
+{
+    (void)pin;
+    (void)mode;
+}
+
+inline int digitalRead(int pin)
+{
+    return Hal::digitalValues[pin];
+}
+
+inline void digitalWrite(int pin, int value)
+{
+    Hal::setDigital(pin, value);
+}
+
+inline int digitalPinToInterrupt(int pin)
+{
+    return pin;
+}
+
+inline void attachInterrupt(int interrupt, void (*handler)(), int mode)
+{
+    Hal::attachInterrupt(interrupt, handler, mode);
+}
+
+inline void detachInterrupt(int interrupt)
+{
+    Hal::attachInterrupt(interrupt, nullptr, 0);
+}
+
+inline int analogRead(int pin)
+{
+    return Hal::analogValues[pin];
+}
+
+inline void analogReadResolution(int bits)
+{
+    (void)bits;
+}
+
+/**
+ * @brief the pico SDK panic(): prints the message and halts (aborts, on the host)
+ */
+inline void panic(const char *format, ...)
+{
+    va_list arguments;
+    va_start(arguments, format);
+    vfprintf(stderr, format, arguments);
+    va_end(arguments);
+    fputc('\n', stderr);
+    abort();
+}
+
+/**
+ * @brief the cycle counter of the core (SysTick on the board),
+ * on the virtual clock (like micros()), scaled to F_CPU cycles.
+ * the host time would be more telling, but reading it on every task costs more than the tasks themselves.
+ * and its hardware random number generator.
+ */
+class RP2040
+{
+public:
+    uint32_t getCycleCount() { return uint32_t(Hal::clock * (F_CPU / 1000000)); }
+    // deterministic, so that the runs can be repeated
+    uint32_t hwrand32() { return uint32_t(rand()); }
+};
+
+inline RP2040 rp2040;
+
+/**
+ * @brief minimal Arduino String, backed by std::string
+ */
+class String
+{
+public:
+    String() {}
+    String(const char *value) : value(value) {}
+    String(const std::string &value) : value(value) {}
+    String(int value) : value(std::to_string(value)) {}
+    String(unsigned int value) : value(std::to_string(value)) {}
+    String(long value) : value(std::to_string(value)) {}
+    String(unsigned long value) : value(std::to_string(value)) {}
+    String(float value, unsigned char decimals = 2) : value(format(value, decimals)) {}
+    String(double value, unsigned char decimals = 2) : value(format(value, decimals)) {}
+
+    const char *c_str() const { return value.c_str(); }
+    unsigned int length() const { return value.length(); }
+
+    String &operator+=(const String &other)
+    {
+        value += other.value;
+        return *this;
+    }
+    friend String operator+(const String &lhs, const String &rhs) { return String(lhs.value + rhs.value); }
+    friend String operator+(const char *lhs, const String &rhs) { return String(lhs + rhs.value); }
+    friend String operator+(const String &lhs, const char *rhs) { return String(lhs.value + rhs); }
+    bool operator==(const char *other) const { return value == other; }
+
+private:
+    std::string value;
+
+    static std::string format(double value, unsigned char decimals)
+    {
+        char buffer[32];
+        snprintf(buffer, sizeof(buffer), "%.*f", decimals, value);
+        return buffer;
+    }
+};
+
+#endif // NATIVE_ARDUINO
@@ -0,0 +1,301 @@
+#ifndef NATIVE_ARDUINO_HA
+#define NATIVE_ARDUINO_HA
+
+/**
+ * @brief the subset of the ArduinoHA library the firmware uses.
+ *        every state update is published through the native HAL, using the entity's unique ID as the topic.
+ * @see https://dawidchyrzynski.github.io/arduino-home-assistant/
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "Arduino.h"
+#include "ESP8266WiFi.h"
+
+class HADevice
+{
+public:
+    HADevice(const char *uniqueId) : _uniqueId(uniqueId) {}
+    void setName(const char *) {}
+    void setSoftwareVersion(const char *) {}
+    void enableSharedAvailability() {}
+    void enableLastWill() {}
+
+private:
+    const char *_uniqueId;
+};
+
+class HAMqtt
+{
+public:
+    // like the library, in milliseconds
+    static const uint16_t ReconnectInterval = 10000;
+
+    HAMqtt(WiFiClient &client, HADevice &, unsigned int) : client(client) { instance = this; }
+
+    /**
+     * @brief like the library, it only sets up the client, it connects (and reconnects) within loop()
+     */
+    bool begin(const IPAddress &, uint16_t, const char *, const char *)
+    {
+        started = true;
+        return true;
+    }
+
+    /**
+     * @brief like the library, when not connected (or it just got disconnected), it tries to connect,
+     * no more than once every ReconnectInterval.
+     * the attempt is synchronous: when the broker can not be reached (but the WiFi is up), it takes as long as the timeout of the client.
+     */
+    void loop()
+    {
+        if (!started || (connected && WiFi.status() == WL_CONNECTED && Hal::brokerAvailable))
+        {
+            return;
+        }
+        connected = false;
+        if (hasAttempted && Hal::clock - lastAttempt < uint64_t(ReconnectInterval) * 1000)
+        {
+            skippedAttempts++;
+            return;
+        }
+        attempts++;
+        hasAttempted = true;
+        lastAttempt = Hal::clock;
+        if (WiFi.status() != WL_CONNECTED)
+        {
+            // no route, it fails right away
+            return;
+        }
+        if (Hal::brokerAvailable)
+        {
+            connected = true;
+            return;
+        }
+        Hal::advance(uint64_t(client.getTimeout()) * 1000);
+    }
+    bool isConnected() const { return connected; }
+    bool publish(const char *topic, const char *payload, bool retain = false)
+    {
+        (void)retain;
+        return connected && Hal::publish(topic, payload);
+    }
+
+    /**
+     * @brief like the library, a (binary) message of a known length can be written in parts
+     */
+    bool beginPublish(const char *topic, uint16_t payloadLength, bool retained = false)
+    {
+        (void)retained;
+        pendingTopic = topic;
+        pendingPayload.clear();
+        pendingPayload.reserve(payloadLength);
+        pendingLength = payloadLength;
+        return connected;
+    }
+    void writePayload(const char *data, const uint16_t length)
+    {
+        pendingPayload.insert(pendingPayload.end(), (const uint8_t *)data, (const uint8_t *)data + length);
+    }
+    bool endPublish()
+    {
+        return connected && pendingPayload.size() == pendingLength && Hal::publish(pendingTopic.c_str(), pendingPayload.data(), pendingPayload.size());
+    }
+
+    static HAMqtt *instance;
+
+    // the connect attempts made and the calls to loop() (while not connected) that the interval skipped
+    unsigned long attempts = 0;
+    unsigned long skippedAttempts = 0;
+
+private:
+    WiFiClient &client;
+    bool started = false;
+    bool connected = false;
+    bool hasAttempted = false;
+    uint64_t lastAttempt = 0;
+    std::string pendingTopic;
+    std::vector<uint8_t> pendingPayload;
+    size_t pendingLength = 0;
+};
+
+inline HAMqtt *HAMqtt::instance = nullptr;
+
+class HABaseDeviceType
+{
+public:
+    enum NumberPrecision
+    {
+        PrecisionP0 = 0,
+        PrecisionP1,
+        PrecisionP2,
+        PrecisionP3
+    };
+
+    HABaseDeviceType(const char *uniqueId) : _uniqueId(uniqueId) {}
+    const char *uniqueId() const { return _uniqueId; }
+    void setName(const char *) {}
+    void setIcon(const char *) {}
+    void setDeviceClass(const char *) {}
+    void setUnitOfMeasurement(const char *) {}
+    void setStateClass(const char *) {}
+    void setEntityCategory(const char *) {}
+    void setForceUpdate(bool) {}
+
+protected:
+    const char *_uniqueId;
+
+    bool publish(const char *payload)
+    {
+        return HAMqtt::instance != nullptr && HAMqtt::instance->publish(_uniqueId, payload);
+    }
+};
+
+class HASensor : public HABaseDeviceType
+{
+public:
+    HASensor(const char *uniqueId) : HABaseDeviceType(uniqueId) {}
+    bool setValue(const char *value) { return publish(value); }
+};
+
+class HASensorNumber : public HABaseDeviceType
+{
+public:
+    HASensorNumber(const char *uniqueId, NumberPrecision precision = PrecisionP0) : HABaseDeviceType(uniqueId), precision(precision) {}
+
+    template <typename T>
+    bool setValue(T value, bool force = false)
+    {
+        const double newValue = double(value);
+        if (!force && hasValue && newValue == currentValue)
+        {
+            return true;
+        }
+
+        char payload[32];
+        snprintf(payload, sizeof(payload), "%.*f", int(precision), newValue);
+        if (publish(payload))
+        {
+            hasValue = true;
+            currentValue = newValue;
+            return true;
+        }
+        return false;
+    }
+
+private:
+    NumberPrecision precision;
+    bool hasValue = false;
+    double currentValue = 0.0;
+};
+
+class HABinarySensor : public HABaseDeviceType
+{
+public:
+    HABinarySensor(const char *uniqueId) : HABaseDeviceType(uniqueId) {}
+
+    bool setState(bool state, bool force = false)
+    {
+        (void)force;
+        currentState = state;
+        return publish(state ? "ON" : "OFF");
+    }
+    void setCurrentState(bool state) { currentState = state; }
+    bool getCurrentState() const { return currentState; }
+
+private:
+    bool currentState = false;
+};
+
+class HASwitch : public HABaseDeviceType
+{
+public:
+    HASwitch(const char *uniqueId) : HABaseDeviceType(uniqueId) {}
+
+    void onCommand(void (*callback)(bool state, HASwitch *sender)) { commandCallback = callback; }
+    bool setState(bool state, bool force = false)
+    {
+        (void)force;
+        currentState = state;
+        return publish(state ? "ON" : "OFF");
+    }
+    bool getCurrentState() const { return currentState; }
+
+    /**
+     * @brief native only. simulates a command sent from the controller
+     */
+    void command(bool state)
+    {
+        if (commandCallback != nullptr)
+        {
+            commandCallback(state, this);
+        }
+    }
+
+private:
+    bool currentState = false;
+    void (*commandCallback)(bool state, HASwitch *sender) = nullptr;
+};
+
+class HANumeric
+{
+public:
+    HANumeric() : value(0.0f), set(false) {}
+    HANumeric(float value) : value(value), set(true) {}
+
+    bool isSet() const { return set; }
+    float toFloat() const { return value; }
+
+private:
+    float value;
+    bool set;
+};
+
+class HANumber : public HABaseDeviceType
+{
+public:
+    enum Mode
+    {
+        ModeAuto = 0,
+        ModeBox,
+        ModeSlider
+    };
+
+    HANumber(const char *uniqueId, NumberPrecision precision = PrecisionP0) : HABaseDeviceType(uniqueId), precision(precision) {}
+
+    void setMin(float) {}
+    void setMax(float) {}
+    void setStep(float) {}
+    void setMode(Mode) {}
+    void setRetain(bool) {}
+    void onCommand(void (*callback)(HANumeric number, HANumber *sender)) { commandCallback = callback; }
+    bool setState(float state, bool force = false)
+    {
+        (void)force;
+        currentState = HANumeric(state);
+        char payload[32];
+        snprintf(payload, sizeof(payload), "%.*f", int(precision), double(state));
+        return publish(payload);
+    }
+    HANumeric getCurrentState() const { return currentState; }
+
+    /**
+     * @brief native only. simulates a command sent from the controller
+     */
+    void command(float value)
+    {
+        if (commandCallback != nullptr)
+        {
+            commandCallback(HANumeric(value), this);
+        }
+    }
+
+private:
+    NumberPrecision precision;
+    HANumeric currentState;
+    void (*commandCallback)(HANumeric number, HANumber *sender) = nullptr;
+};
+
+#endif // NATIVE_ARDUINO_HA
@@ -0,0 +1,38 @@
+#ifndef NATIVE_ARDUINO_OTA
+#define NATIVE_ARDUINO_OTA
+
+/**
+ * @brief OTA is not available on the host. Accepts the configuration and ignores it.
+ */
+
+#include <functional>
+
+#define U_FLASH 0
+#define U_FS 100
+
+typedef enum
+{
+    OTA_AUTH_ERROR,
+    OTA_BEGIN_ERROR,
+    OTA_CONNECT_ERROR,
+    OTA_RECEIVE_ERROR,
+    OTA_END_ERROR
+} ota_error_t;
+
+class NativeArduinoOTA
+{
+public:
+    void setHostname(const char *) {}
+    void setPassword(const char *) {}
+    void onStart(std::function<void()>) {}
+    void onEnd(std::function<void()>) {}
+    void onProgress(std::function<void(unsigned int, unsigned int)>) {}
+    void onError(std::function<void(ota_error_t)>) {}
+    int getCommand() { return U_FLASH; }
+    void begin() {}
+    void handle() {}
+};
+
+inline NativeArduinoOTA ArduinoOTA;
+
+#endif // NATIVE_ARDUINO_OTA
@@ -0,0 +1,102 @@
+#ifndef NATIVE_ESP8266_WIFI
+#define NATIVE_ESP8266_WIFI
+
+/**
+ * @brief the subset of the WiFi API the firmware uses,
+ *        implemented on top of the native HAL network availability.
+ */
+
+#include <cstdint>
+#include "Arduino.h"
+
+#define WL_MAC_ADDR_LENGTH 6
+
+enum wl_status_t
+{
+    WL_IDLE_STATUS = 0,
+    WL_NO_SSID_AVAIL = 1,
+    WL_CONNECTED = 3,
+    WL_CONNECT_FAILED = 4,
+    WL_CONNECTION_LOST = 5,
+    WL_DISCONNECTED = 6
+};
+
+class IPAddress
+{
+public:
+    IPAddress() : octets{0, 0, 0, 0} {}
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : octets{a, b, c, d} {}
+    uint8_t operator[](int index) const { return octets[index]; }
+
+private:
+    uint8_t octets[4];
+};
+
+class WiFiClient
+{
+public:
+    // in milliseconds, like Stream
+    void setTimeout(unsigned long timeout) { this->timeout = timeout; }
+    unsigned long getTimeout() const { return timeout; }
+
+private:
+    unsigned long timeout = 1000;
+};
+
+class NativeWiFi
+{
+public:
+    int begin(const char *ssid, const char *password)
+    {
+        beginNoBlock(ssid, password);
+        // wait to connect...
+        Hal::advance(Hal::wifiConnectTime);
+        return status();
+    }
+    /**
+     * @brief starts connecting, it connects Hal::wifiConnectTime later (if the WiFi is available)
+     */
+    int beginNoBlock(const char *ssid, const char *password)
+    {
+        (void)ssid;
+        (void)password;
+        connecting = true;
+        connectTime = Hal::clock;
+        return status();
+    }
+    int status()
+    {
+        if (connecting && Hal::wifiAvailable && Hal::clock - connectTime >= Hal::wifiConnectTime)
+        {
+            connecting = false;
+            connected = true;
+        }
+        if (!Hal::wifiAvailable)
+        {
+            connected = false;
+        }
+        return connected ? WL_CONNECTED : WL_DISCONNECTED;
+    }
+    void disconnect()
+    {
+        connecting = false;
+        connected = false;
+    }
+    void macAddress(byte *mac)
+    {
+        for (int i = 0; i < WL_MAC_ADDR_LENGTH; i++)
+        {
+            mac[i] = 0;
+        }
+    }
+    IPAddress localIP() { return IPAddress(127, 0, 0, 1); }
+
+private:
+    bool connecting = false;
+    bool connected = false;
+    uint64_t connectTime = 0;
+};
+
+inline NativeWiFi WiFi;
+
+#endif // NATIVE_ESP8266_WIFI
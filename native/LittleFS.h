@@ -0,0 +1,219 @@
+#ifndef NATIVE_LITTLE_FS
+#define NATIVE_LITTLE_FS
+
+/**
+ * @brief the subset of the (arduino-pico) LittleFS API the firmware uses,
+ *        as an in-memory filesystem, so that the runs stay deterministic and leave nothing behind.
+ *        like the flash, it is statically allocated (a few fixed size files), so it never touches the heap.
+ *        the bytes written are counted, to measure the flash wear,
+ *        and a power loss can be injected after any number of bytes (a torn write).
+ */
+
+#include <cstdint>
+#include <cstring>
+
+/**
+ * @brief max number of files and the max size of every file, in bytes
+ */
+#define NATIVE_FS_FILES 8
+#define NATIVE_FS_FILE_SIZE 65536
+#define NATIVE_FS_PATH_SIZE 32
+
+/**
+ * @brief native only. a file of the (simulated) flash
+ */
+struct NativeFlashFile
+{
+    char path[NATIVE_FS_PATH_SIZE];
+    uint8_t data[NATIVE_FS_FILE_SIZE];
+    size_t size;
+    bool isUsed;
+};
+
+/**
+ * @brief native only. the power of the (simulated) flash
+ */
+struct NativeFlash
+{
+    // the bytes that can still be written before the power gets lost, or negative for never
+    static inline long powerLossAfterBytes = -1;
+    // once lost, nothing gets written, opened, renamed or removed until powerOn()
+    static inline bool isPoweredOff = false;
+
+    static void powerOn()
+    {
+        powerLossAfterBytes = -1;
+        isPoweredOff = false;
+    }
+};
+
+class File
+{
+public:
+    File() : file(nullptr) {}
+    File(NativeFlashFile *file, bool append) : file(file), position(append ? file->size : 0) {}
+
+    explicit operator bool() const { return file != nullptr; }
+
+    size_t write(const uint8_t *buffer, size_t size)
+    {
+        if (file == nullptr || NativeFlash::isPoweredOff)
+        {
+            return 0;
+        }
+        if (position + size > NATIVE_FS_FILE_SIZE)
+        {
+            // full
+            size = position < NATIVE_FS_FILE_SIZE ? NATIVE_FS_FILE_SIZE - position : 0;
+        }
+        if (NativeFlash::powerLossAfterBytes >= 0)
+        {
+            if (long(size) > NativeFlash::powerLossAfterBytes)
+            {
+                // only the first bytes make it
+                size = size_t(NativeFlash::powerLossAfterBytes);
+                NativeFlash::isPoweredOff = true;
+            }
+            NativeFlash::powerLossAfterBytes -= long(size);
+        }
+        memcpy(file->data + position, buffer, size);
+        position += size;
+        file->size = position > file->size ? position : file->size;
+        bytesWritten += size;
+        return size;
+    }
+
+    size_t read(uint8_t *buffer, size_t size)
+    {
+        if (file == nullptr || position >= file->size)
+        {
+            return 0;
+        }
+        const size_t count = size < file->size - position ? size : file->size - position;
+        memcpy(buffer, file->data + position, count);
+        position += count;
+        return count;
+    }
+
+    bool seek(uint32_t offset)
+    {
+        if (file == nullptr || offset > file->size)
+        {
+            return false;
+        }
+        position = offset;
+        return true;
+    }
+
+    size_t size() const { return file != nullptr ? file->size : 0; }
+    void close() { file = nullptr; }
+
+    // total bytes written to all files (flash wear)
+    static inline unsigned long bytesWritten = 0;
+
+private:
+    NativeFlashFile *file;
+    size_t position = 0;
+};
+
+class NativeLittleFS
+{
+public:
+    bool begin() { return true; }
+
+    /**
+     * @param mode "r", "w" or "a"
+     */
+    File open(const char *path, const char *mode)
+    {
+        if (NativeFlash::isPoweredOff)
+        {
+            return File();
+        }
+        NativeFlashFile *file = find(path);
+        if (mode[0] == 'r')
+        {
+            return file != nullptr ? File(file, false) : File();
+        }
+        if (file == nullptr)
+        {
+            file = create(path);
+            if (file == nullptr)
+            {
+                return File();
+            }
+        }
+        if (mode[0] == 'w')
+        {
+            file->size = 0;
+        }
+        return File(file, mode[0] == 'a');
+    }
+
+    bool exists(const char *path) { return find(path) != nullptr; }
+
+    bool remove(const char *path)
+    {
+        NativeFlashFile *file = find(path);
+        if (NativeFlash::isPoweredOff || file == nullptr)
+        {
+            return false;
+        }
+        file->isUsed = false;
+        return true;
+    }
+
+    /**
+     * @brief atomic, replaces the destination (like littlefs)
+     */
+    bool rename(const char *from, const char *to)
+    {
+        NativeFlashFile *file = find(from);
+        if (NativeFlash::isPoweredOff || file == nullptr)
+        {
+            return false;
+        }
+        NativeFlashFile *replaced = find(to);
+        if (replaced != nullptr)
+        {
+            replaced->isUsed = false;
+        }
+        strncpy(file->path, to, NATIVE_FS_PATH_SIZE - 1);
+        return true;
+    }
+
+private:
+    NativeFlashFile files[NATIVE_FS_FILES] = {};
+
+    NativeFlashFile *find(const char *path)
+    {
+        for (NativeFlashFile &file : files)
+        {
+            if (file.isUsed && strcmp(file.path, path) == 0)
+            {
+                return &file;
+            }
+        }
+        return nullptr;
+    }
+
+    NativeFlashFile *create(const char *path)
+    {
+        for (NativeFlashFile &file : files)
+        {
+            if (!file.isUsed)
+            {
+                strncpy(file.path, path, NATIVE_FS_PATH_SIZE - 1);
+                file.path[NATIVE_FS_PATH_SIZE - 1] = '\0';
+                file.size = 0;
+                file.isUsed = true;
+                return &file;
+            }
+        }
+        return nullptr;
+    }
+};
+
+inline NativeLittleFS LittleFS;
+
+#endif // NATIVE_LITTLE_FS
@@ -0,0 +1,6 @@
+#ifndef NATIVE_WIFI_UDP
+#define NATIVE_WIFI_UDP
+
+// nothing of the UDP API is used directly by the firmware
+
+#endif // NATIVE_WIFI_UDP
@@ -0,0 +1,74 @@
+/**
+ * @brief the host part of the AdcSampler: a stand-in for the free-running ADC and DMA.
+ * it generates the conversions that are due on the virtual clock (at ADC_SAMPLER_RATE),
+ * either from the file of raw samples (Hal::adcSamples) or from the analog pin values (zero-order hold).
+ */
+#include "Arduino.h"
+#include "hal.h"
+#include "ArduinoHA.h"
+#include "../src/device.h"
+#include "../src/adcSampler.h"
+
+// virtual time (micros) the sampler started
+static uint64_t startTime = 0;
+
+// number of conversions generated so far
+static uint64_t conversions = 0;
+
+// the buffer being filled and the position in it
+static int buffer = 0;
+static int position = 0;
+
+// the samples of the current file line
+static int lineSamples[ADC_SAMPLER_CHANNELS];
+
+/**
+ * @brief the next conversion of a channel
+ */
+static uint16_t convert(int channel)
+{
+    if (Hal::adcSamples != nullptr && channel == 0)
+    {
+        char line[64];
+        if (fgets(line, sizeof(line), Hal::adcSamples) == nullptr || sscanf(line, "%d,%d", &lineSamples[0], &lineSamples[1]) != ADC_SAMPLER_CHANNELS)
+        {
+            fclose(Hal::adcSamples);
+            Hal::adcSamples = nullptr;
+        }
+    }
+    if (Hal::adcSamples != nullptr)
+    {
+        return uint16_t(lineSamples[channel]);
+    }
+
+    // the pin values are in the ANALOG_READ_RESOLUTION (as they would be returned by analogRead())
+    return uint16_t(Hal::analogValues[AdcSampler::pins[channel]] << (ADC_SAMPLER_RESOLUTION - ANALOG_READ_RESOLUTION));
+}
+
+void AdcSampler::start()
+{
+    startTime = Hal::clock;
+    conversions = 0;
+    buffer = 0;
+    position = 0;
+}
+
+/**
+ * @brief generates the conversions that are due by now
+ */
+void AdcSampler::service()
+{
+    const uint64_t due = (Hal::clock - startTime) * ADC_SAMPLER_RATE / 1000000;
+    while (conversions < due)
+    {
+        AdcSampler::buffers[buffer][position] = convert(position % ADC_SAMPLER_CHANNELS);
+        conversions++;
+        position++;
+        if (position == ADC_SAMPLER_BLOCK_SIZE)
+        {
+            position = 0;
+            buffer = 1 - buffer;
+            AdcSampler::onBlockComplete();
+        }
+    }
+}
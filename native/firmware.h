@@ -0,0 +1,36 @@
+#ifndef FIRMWARE
+#define FIRMWARE
+
+/**
+ * @brief the firmware entry points (src/main.cpp).
+ *
+ * on the board, each core runs its own loop concurrently.
+ * on the host, both "cores" run on the same thread, one iteration of each at a time,
+ * on the same virtual clock.
+ */
+
+// core 0
+void setup();
+void loop();
+
+// core 1
+void setup1();
+void loop1();
+
+/**
+ * @brief on the board, both setups run concurrently.
+ * on the host, core 1 is set up afterwards, so that its sampling starts on the time the loops do.
+ */
+inline void firmwareSetup()
+{
+    setup();
+    setup1();
+}
+
+inline void firmwareLoop()
+{
+    loop1();
+    loop();
+}
+
+#endif // FIRMWARE
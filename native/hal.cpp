@@ -0,0 +1,199 @@
+#include <cstring>
+#include "hal.h"
+
+/**
+ * @brief the virtual clock in microseconds since boot
+ */
+uint64_t Hal::clock = 0;
+
+/**
+ * @brief the raw value each analog pin will return
+ */
+int Hal::analogValues[HAL_PINS] = {};
+
+/**
+ * @brief the level of each digital pin.
+ *        defaults to HIGH (1), as if the pins were pulled up
+ */
+int Hal::digitalValues[HAL_PINS] = {1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1};
+
+/**
+ * @brief the interrupt handler attached to each pin (if any)
+ */
+void (*Hal::interruptHandlers[HAL_PINS])() = {};
+
+/**
+ * @brief the edge(s) that trigger each pin's interrupt handler
+ */
+int Hal::interruptModes[HAL_PINS] = {};
+
+/**
+ * @brief when set, the AdcSampler blocks are generated from this file, instead of the analog pin values.
+ * every line holds the raw (12bit) samples of the sampled pins, in ascending pin order, ie. "A0,A1".
+ * it gets closed and reset to nullptr, when it runs out of samples.
+ * @see native/adcSamplerNative.cpp
+ */
+FILE *Hal::adcSamples = nullptr;
+
+/**
+ * @brief if false, the WiFi will refuse to connect and report itself as disconnected
+ */
+bool Hal::wifiAvailable = true;
+
+/**
+ * @brief time in microseconds the WiFi takes to connect (when available)
+ */
+uint64_t Hal::wifiConnectTime = 0;
+
+/**
+ * @brief if false, the MQTT broker will refuse connections and drop publishes
+ */
+bool Hal::brokerAvailable = true;
+
+/**
+ * @brief number of messages that reached the broker
+ */
+unsigned long Hal::publishCount = 0;
+
+/**
+ * @brief the payload bytes of all the messages that reached the "broker"
+ */
+unsigned long Hal::publishedBytes = 0;
+
+/**
+ * @brief optional handler that receives every message that reached the broker
+ */
+std::function<void(const char *topic, const char *payload)> Hal::onPublish;
+
+/**
+ * @brief the handler of the binary messages that reach the "broker"
+ */
+std::function<void(const char *topic, const uint8_t *payload, size_t length)> Hal::onPublishBinary;
+
+/**
+ * @brief steps the simulated hardware (if any) on every move of the virtual clock
+ */
+std::function<void(uint64_t micros)> Hal::onAdvance;
+
+/**
+ * @brief moves the virtual clock forward
+ *
+ * @param micros
+ */
+void Hal::advance(uint64_t micros)
+{
+    Hal::clock += micros;
+    if (Hal::onAdvance)
+    {
+        Hal::onAdvance(micros);
+    }
+}
+
+void Hal::setAnalog(int pin, int value)
+{
+    if (pin >= 0 && pin < HAL_PINS)
+    {
+        Hal::analogValues[pin] = value;
+    }
+}
+
+/**
+ * @brief sets the level of a digital pin and
+ * calls its interrupt handler (synchronously), when the change matches its edge
+ *
+ * @param pin
+ * @param value
+ */
+void Hal::setDigital(int pin, int value)
+{
+    if (pin < 0 || pin >= HAL_PINS)
+    {
+        return;
+    }
+
+    const int previous = Hal::digitalValues[pin];
+    Hal::digitalValues[pin] = value;
+    if (Hal::interruptHandlers[pin] == nullptr || previous == value)
+    {
+        return;
+    }
+
+    const int mode = Hal::interruptModes[pin];
+    if (mode == HAL_INTERRUPT_CHANGE || (mode == HAL_INTERRUPT_FALLING && value == 0) || (mode == HAL_INTERRUPT_RISING && value != 0))
+    {
+        Hal::interruptHandlers[pin]();
+    }
+}
+
+void Hal::attachInterrupt(int pin, void (*handler)(), int mode)
+{
+    if (pin >= 0 && pin < HAL_PINS)
+    {
+        Hal::interruptHandlers[pin] = handler;
+        Hal::interruptModes[pin] = mode;
+    }
+}
+
+/**
+ * @brief delivers a message to the "broker"
+ *
+ * @return true when the network and broker are available
+ * @return false when the message got dropped
+ */
+bool Hal::publish(const char *topic, const char *payload)
+{
+    if (!Hal::wifiAvailable || !Hal::brokerAvailable)
+    {
+        return false;
+    }
+
+    Hal::publishCount++;
+    Hal::publishedBytes += strlen(payload);
+    if (Hal::onPublish)
+    {
+        Hal::onPublish(topic, payload);
+    }
+    return true;
+}
+
+/**
+ * @brief delivers a binary message to the "broker"
+ *
+ * @return true when the network and broker are available
+ * @return false when the message got dropped
+ */
+bool Hal::publish(const char *topic, const uint8_t *payload, size_t length)
+{
+    if (!Hal::wifiAvailable || !Hal::brokerAvailable)
+    {
+        return false;
+    }
+
+    Hal::publishCount++;
+    Hal::publishedBytes += length;
+    if (Hal::onPublishBinary)
+    {
+        Hal::onPublishBinary(topic, payload, length);
+    }
+    return true;
+}
+
+/**
+ * @brief restores the power-on state of the hardware (not the firmware)
+ */
+void Hal::reset()
+{
+    Hal::clock = 0;
+    for (int pin = 0; pin < HAL_PINS; pin++)
+    {
+        Hal::analogValues[pin] = 0;
+        Hal::digitalValues[pin] = 1;
+        Hal::interruptHandlers[pin] = nullptr;
+        Hal::interruptModes[pin] = 0;
+    }
+    Hal::wifiAvailable = true;
+    Hal::wifiConnectTime = 0;
+    Hal::brokerAvailable = true;
+    Hal::publishCount = 0;
+    Hal::publishedBytes = 0;
+}
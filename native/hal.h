@@ -0,0 +1,65 @@
+#ifndef HAL
+#define HAL
+
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+
+/**
+ * @author Antonios Karagiannis (antokarag@gmail.com)
+ * @brief the hardware abstraction layer of the native (host) build.
+ *        the Arduino / ArduinoHA / WiFi shims of the native/ directory forward all their hardware access here,
+ *        so that the unmodified sensor logic of src/ can run (and be measured) on Linux.
+ *
+ *        - clock: a virtual clock in microseconds, that only moves when advanced (or on delay())
+ *        - ADC: the value each analog pin will return on analogRead() (and the AdcSampler blocks),
+ *               or a file of raw samples, to generate the AdcSampler blocks from
+ *        - GPIO: the level of each digital pin and its edge interrupt handler
+ *        - simulated hardware, that moves along with the clock (the onAdvance handler, ie. the valve of native/valveSimulator.h)
+ *        - network: the WiFi and MQTT broker availability
+ *        - MQTT publish: every message that reaches the "broker" is passed to the onPublish handler
+ *                        (or onPublishBinary, for the binary ones)
+ */
+
+/**
+ * @brief the number of GPIO/ADC pins we emulate (GP0-GP29)
+ */
+#define HAL_PINS 30
+
+/**
+ * @brief the edges that trigger a pin interrupt (same values as the Arduino core)
+ */
+#define HAL_INTERRUPT_CHANGE 1
+#define HAL_INTERRUPT_FALLING 2
+#define HAL_INTERRUPT_RISING 3
+
+class Hal
+{
+public:
+    // properties
+    static uint64_t clock;
+    static int analogValues[HAL_PINS];
+    static int digitalValues[HAL_PINS];
+    static void (*interruptHandlers[HAL_PINS])();
+    static int interruptModes[HAL_PINS];
+    static FILE *adcSamples;
+    static bool wifiAvailable;
+    static uint64_t wifiConnectTime;
+    static bool brokerAvailable;
+    static unsigned long publishCount;
+    static unsigned long publishedBytes;
+    static std::function<void(const char *topic, const char *payload)> onPublish;
+    static std::function<void(const char *topic, const uint8_t *payload, size_t length)> onPublishBinary;
+    static std::function<void(uint64_t micros)> onAdvance;
+
+    // methods
+    static void advance(uint64_t micros);
+    static void setAnalog(int pin, int value);
+    static void setDigital(int pin, int value);
+    static void attachInterrupt(int pin, void (*handler)(), int mode);
+    static bool publish(const char *topic, const char *payload);
+    static bool publish(const char *topic, const uint8_t *payload, size_t length);
+    static void reset();
+};
+
+#endif // HAL
@@ -0,0 +1,16 @@
+#ifndef NATIVE_HARDWARE_TIMER
+#define NATIVE_HARDWARE_TIMER
+
+#include <cstdint>
+#include "hal.h"
+
+/**
+ * @brief the 64bit microsecond timer of the (pico SDK) hardware, on the virtual clock.
+ * unlike micros() and millis(), it never wraps.
+ */
+inline uint64_t time_us_64()
+{
+    return Hal::clock;
+}
+
+#endif // NATIVE_HARDWARE_TIMER
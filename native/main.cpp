@@ -0,0 +1,1983 @@
+/**
+ * @author Antonios Karagiannis (antokarag@gmail.com)
+ * @brief entry point of the native (host) build.
+ *        runs the firmware's setup() once and then loop() for a number of iterations on the virtual clock,
+ *        measuring the (host) cost of every loop() iteration.
+ *
+ *        usage:
+ *          program [loop iterations] [virtual microseconds per iteration]
+ *          program replay <trace.csv> [virtual microseconds per iteration]
+ *          program synthetic [hours] [seed] [virtual microseconds per iteration]
+ *          program adc <samples.csv> [virtual microseconds per iteration]
+ *          program stress [iterations]
+ *          program detector [samples]
+ *          program math [iterations]
+ *          program filter [blocks] [samples.csv]
+ *          program leak [decay psi/min] [minutes]
+ *          program network [hours] [outage minutes] [seed]
+ *          program totalizer [boots] [seed]
+ *          program config
+ *          program leaks [days] [seed]
+ *          program events [hours] [seed]
+ *          program report [hours] [seed]
+ *          program fusion [seed]
+ *          program calibration [IR noise] [initial hysteresis] [days] [seed]
+ *          program pulses [seed]
+ *
+ * @see replay.h
+ * @see stress.h
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <LittleFS.h>
+#include "firmware.h"
+#include "hal.h"
+#include "replay.h"
+#include "stress.h"
+#include "soak.h"
+#include "../src/adcSampler.h"
+#include "../src/flowDetector.h"
+#include "../src/flowEstimator.h"
+#include "../src/irCalibration.h"
+#include <ArduinoHA.h>
+#include "../src/pressureSensor.h"
+#include "../src/pulseSensor.h"
+#include "../src/pulseCapture.h"
+#include "../src/leakTest.h"
+#include "../src/offlineStore.h"
+#include "../src/scheduler.h"
+#include "../src/connection.h"
+#include "../src/telemetry.h"
+#include "../src/totalizer.h"
+#include "../src/config.h"
+#include "../src/leakDetector.h"
+#include "../src/usageEvents.h"
+#include "../src/reportPolicy.h"
+#include "../src/switches.h"
+#include "../src/flowDetector.h"
+#include "../src/valve.h"
+#include "valveSimulator.h"
+
+
+/**
+ * @brief default number of loop() iterations to run
+ */
+#define NATIVE_LOOP_ITERATIONS 1000000
+
+/**
+ * @brief default virtual time in microseconds, that passes on every loop() iteration
+ */
+#define NATIVE_LOOP_PERIOD_US 100
+
+/**
+ * @brief default virtual time in microseconds, that passes on every loop() iteration during a replay.
+ *        this is also the sample period of the synthetic traces.
+ */
+#define REPLAY_LOOP_PERIOD_US 1000
+
+/**
+ * @brief default hours of synthetic trace to replay
+ */
+#define SYNTHETIC_HOURS 24
+
+/**
+ * @brief the max (absolute) error of the sensor conversions (@see src/sensorMath.h),
+ * against the float/double reference, for the math mode to pass
+ */
+#define MATH_MAX_PSI_ERROR 0.01
+#define MATH_MAX_GPM_ERROR 0.001
+
+/**
+ * @brief the synthetic pressure of the filter mode: its (12bit) input value,
+ * the (gaussian) noise and a glitch (a whole block off) every FILTER_GLITCH_BLOCKS blocks
+ */
+#define FILTER_INPUT_VALUE 2684
+#define FILTER_NOISE 3.0
+#define FILTER_GLITCH 60
+#define FILTER_GLITCH_BLOCKS 97
+
+/**
+ * @brief the starting pressure (PSI) of the leak mode
+ */
+#define LEAK_PSI 60.0
+
+/**
+ * @brief the WiFi outages of the network mode start this many minutes into every hour
+ * and the broker outages (with the WiFi up) this many
+ */
+#define NETWORK_OUTAGE_START 20
+#define NETWORK_BROKER_OUTAGE_START 40
+
+/**
+ * @brief the (virtual) time in microseconds the WiFi takes to connect, in the network mode
+ */
+#define NETWORK_WIFI_CONNECT_TIME 2000000
+
+/**
+ * @brief the max (virtual) time in microseconds a loop iteration may take, in the network mode,
+ * on top of an attempt to reach the broker (up to CONNECTION_MQTT_TIMEOUT)
+ */
+#define NETWORK_MAX_LOOP_STALL 1000
+
+/**
+ * @brief the max share (in percent) of the broker outages, the loop may spend on the (backed off) attempts to reach the broker, in the network mode
+ */
+#define NETWORK_MAX_STALL_SHARE 2
+
+/**
+ * @brief the leaks mode: the hours of the quiet nights, the virtual time in microseconds that passes on every loop iteration
+ * and the leaks, on top of the usage: a burst (day 2, 14:00), a running toilet (day 3, 09:00) and a micro leak (from day 4)
+ */
+#define LEAKS_QUIET_HOURS 6
+#define LEAKS_LOOP_PERIOD_US 5000
+#define LEAKS_BURST_GPM 5.0
+#define LEAKS_BURST_MINUTES 30
+#define LEAKS_TOILET_GPM 0.3
+#define LEAKS_TOILET_MINUTES 180
+#define LEAKS_MICRO_GPM 0.05
+
+/**
+ * @brief the max (virtual) seconds every boot of the totalizer mode runs for, before its power gets lost
+ */
+#define TOTALIZER_BOOT_SECONDS 7200
+
+/**
+ * @brief runs the firmware and prints the (host) cost of every loop iteration
+ *
+ * @param iterations max number of loop iterations
+ * @param period virtual time in microseconds, that passes on every loop iteration
+ * @param untilAdcSamplesEnd if true, it stops as soon as the file of ADC samples (Hal::adcSamples) runs out
+ */
+int bench(unsigned long iterations, unsigned long period, bool untilAdcSamplesEnd)
+{
+    // the last diagnostics the firmware sent (@see src/diagnostics.h)
+    static std::vector<std::pair<std::string, std::string>> diagnostics;
+    Hal::onPublish = [](const char *topic, const char *payload)
+    {
+        if (strncmp(topic, "waterMonitorLoopTime", 20) == 0 || strcmp(topic, "waterMonitorAdcRate") == 0 ||
+            strcmp(topic, "waterMonitorMissedPulses") == 0 || strcmp(topic, "waterMonitorCpuUsage") == 0)
+        {
+            diagnostics.push_back({topic, payload});
+        }
+    };
+    firmwareSetup();
+
+    std::vector<long long> durations;
+    for (unsigned long i = 0; i < iterations && (!untilAdcSamplesEnd || Hal::adcSamples != nullptr); i++)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        firmwareLoop();
+        const auto end = std::chrono::steady_clock::now();
+        durations.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+        Hal::advance(period);
+    }
+
+    if (durations.empty())
+    {
+        return 0;
+    }
+
+    long long total = 0;
+    for (const long long duration : durations)
+    {
+        total += duration;
+    }
+    std::sort(durations.begin(), durations.end());
+
+    printf("loop iterations: %zu\n", durations.size());
+    printf("virtual time: %.3f s\n", double(Hal::clock) / 1e6);
+    printf("publishes: %lu\n", Hal::publishCount);
+    printf("adc blocks: %u, overruns: %lu\n", AdcSampler::completedBlocks, AdcSampler::overruns);
+    printf("loop ns min: %lld, avg: %lld, p99: %lld, max: %lld\n",
+           durations.front(),
+           total / (long long)durations.size(),
+           durations[durations.size() * 99 / 100],
+           durations.back());
+    // the scheduler measures on the (virtual) clock, so the runtimes only show the delays
+    for (int i = 0; i < Scheduler::taskCount; i++)
+    {
+        const SchedulerTask &task = Scheduler::tasks[i];
+        printf("task %s: runs: %lu, max runtime: %lu us, max jitter: %lu ms, overruns: %lu\n",
+               task.name, task.runs, task.maxRuntime, task.maxJitter, task.overruns);
+    }
+    for (const auto &diagnostic : diagnostics)
+    {
+        printf("%s: %s\n", diagnostic.first.c_str(), diagnostic.second.c_str());
+    }
+
+    return 0;
+}
+
+/**
+ * @brief measures the (host) cost per sample of the flow detector, on a synthetic dial signal
+ *
+ * @param samples
+ */
+int detectorBench(unsigned long samples)
+{
+    // ~39 samples per second (one per ADC block), a 1Hz dial with some noise
+    const unsigned long period = 1000000UL * ADC_SAMPLER_BLOCK_SIZE / ADC_SAMPLER_RATE;
+    std::vector<int> values(samples);
+    unsigned int noise = 1;
+    for (unsigned long i = 0; i < samples; i++)
+    {
+        noise = noise * 1103515245 + 12345;
+        values[i] = 500 + int(20.0 * sin(2.0 * M_PI * double(i * period) / 1e6)) + int((noise >> 16) % 3) - 1;
+    }
+
+    FlowDetector::reset();
+    unsigned long active = 0;
+    const auto start = std::chrono::steady_clock::now();
+#if defined(__x86_64__) || defined(__i386__)
+    const unsigned long long startCycles = __builtin_ia32_rdtsc();
+#endif
+    for (unsigned long i = 0; i < samples; i++)
+    {
+        FlowDetector::update(values[i], Instant::fromMicros(i * period));
+        active += FlowDetector::isActive ? 1 : 0;
+    }
+#if defined(__x86_64__) || defined(__i386__)
+    const unsigned long long cycles = __builtin_ia32_rdtsc() - startCycles;
+#endif
+    const auto end = std::chrono::steady_clock::now();
+
+    const double ns = double(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+    printf("samples: %lu, active: %lu, frequency: %u mHz\n", samples, active, FlowDetector::frequency(Instant::fromMicros((samples - 1) * period)));
+    printf("ns per sample: %.2f\n", ns / samples);
+#if defined(__x86_64__) || defined(__i386__)
+    printf("cycles (TSC) per sample: %.2f\n", double(cycles) / samples);
+#endif
+    return 0;
+}
+
+// keep the benchmarked conversions from being optimized away
+static volatile int32_t sinkRaw;
+static volatile float sinkFloat;
+
+/**
+ * @brief checks the accuracy of the sensor conversions (@see src/sensorMath.h) against the double reference
+ * and measures their (host) cost, next to the float ones.
+ * note: the host has an FPU, so the float timings are far from the (software float) RP2040 ones.
+ *
+ * @param iterations
+ * @return int non zero, if any conversion is off by more than its max error
+ */
+int mathBench(unsigned long iterations)
+{
+    double psiError = 0.0;
+    const size_t points = sizeof(PressureSensor::calibrationPoints) / sizeof(CalibrationPoint);
+    const double rawScale = double(MAX_ANALOG_PIN_RANGE) / PRESSURE_SENSOR_CALIBRATION_RANGE;
+    for (int raw = 0; raw <= MAX_ANALOG_PIN_RANGE; raw++)
+    {
+        // the segment of the raw value, interpolated in double
+        size_t segment = 1;
+        while (segment < points - 1 && raw > PressureSensor::calibrationPoints[segment].raw * rawScale)
+        {
+            segment++;
+        }
+        const CalibrationPoint &from = PressureSensor::calibrationPoints[segment - 1];
+        const CalibrationPoint &to = PressureSensor::calibrationPoints[segment];
+        const double expected = from.value + (raw - from.raw * rawScale) * (to.value - from.value) / ((to.raw - from.raw) * rawScale);
+        psiError = std::max(psiError, fabs(SensorMath::toFloat(PressureSensor::toPsi(raw)) - expected));
+    }
+
+    double gpmError = 0.0;
+    // from the flow timeout (MIN_GPM) down to 100 GPM
+    for (uint32_t millis = 600; millis <= TARGET_RATE_TIME / MIN_GPM; millis++)
+    {
+        const double expected = TARGET_RATE_TIME / millis / PULSE_RATE;
+        gpmError = std::max(gpmError, fabs(SensorMath::toFloat(SensorMath::divide<uint32_t(TARGET_RATE_TIME / PULSE_RATE)>(millis)) - expected));
+    }
+    for (uint32_t micros = 600000; micros <= TARGET_RATE_TIME * 1000.0 / MIN_GPM; micros += 997)
+    {
+        const double expected = TARGET_RATE_TIME * 1000.0 / micros / PULSE_RATE;
+        gpmError = std::max(gpmError, fabs(SensorMath::toFloat(SensorMath::divide<uint32_t(TARGET_RATE_TIME * 1000.0 / PULSE_RATE)>(micros)) - expected));
+    }
+    for (uint32_t milli = 0; milli <= 100000; milli++)
+    {
+        gpmError = std::max(gpmError, fabs(SensorMath::toFloat(SensorMath::fromMilli(milli)) - milli / 1000.0));
+    }
+
+    // the cost per conversion, float against SensorReal
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned long i = 0; i < iterations; i++)
+    {
+        const int raw = int(i & MAX_ANALOG_PIN_RANGE);
+        // a single multiplier conversion, for comparison
+        sinkFloat = (raw - 170.0f) * 0.1193f +
+                    float(TARGET_RATE_TIME) / float(600 + raw) / float(PULSE_RATE);
+    }
+    const double floatNs = double(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+    start = std::chrono::steady_clock::now();
+    for (unsigned long i = 0; i < iterations; i++)
+    {
+        const int raw = int(i & MAX_ANALOG_PIN_RANGE);
+        const SensorReal value = PressureSensor::toPsi(raw) + SensorMath::divide<uint32_t(TARGET_RATE_TIME / PULSE_RATE)>(600 + raw);
+#ifdef SENSOR_MATH_FIXED_POINT
+        sinkRaw = value.raw;
+#else
+        sinkFloat = value;
+#endif
+    }
+    const double sensorRealNs = double(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+
+#ifdef SENSOR_MATH_FIXED_POINT
+    printf("sensor math: fixed point (Q16.16)\n");
+#else
+    printf("sensor math: float\n");
+#endif
+    printf("max PSI error: %.6f (max %.6f)\n", psiError, MATH_MAX_PSI_ERROR);
+    printf("max GPM error: %.6f (max %.6f)\n", gpmError, MATH_MAX_GPM_ERROR);
+    printf("ns per PSI+GPM conversion, float: %.2f, sensor math: %.2f\n", floatNs / iterations, sensorRealNs / iterations);
+    return psiError <= MATH_MAX_PSI_ERROR && gpmError <= MATH_MAX_GPM_ERROR ? 0 : 1;
+}
+
+/**
+ * @brief feeds blocks of a constant pressure with noise (synthetic or recorded) to the pressure sensor
+ * and compares the spread of its filtered PSI, to the one of the plain block average.
+ *
+ * @param blocks
+ * @param samples optional, raw samples (lines of A0,A1) of a constant pressure
+ * @return int non zero, if the filtered PSI spreads more than the water leak test delta
+ */
+int filterBench(unsigned long blocks, FILE *samples)
+{
+    uint16_t buffer[ADC_SAMPLER_BLOCK_SIZE];
+    AdcSampler::pins[0] = PRESSURE_SENSOR_PIN;
+    AdcSampler::pins[1] = IR_SENSOR_PIN;
+    PressureSensor::filter.reset();
+
+    // skip the settling of the filter
+    const unsigned long settle = (1UL << PRESSURE_SENSOR_EMA_SHIFT) * 4;
+    unsigned int noise = 1;
+    double rawMin = 1e9, rawMax = -1e9, filteredMin = 1e9, filteredMax = -1e9;
+    double rawSum = 0.0, rawSquares = 0.0, filteredSum = 0.0, filteredSquares = 0.0;
+    unsigned long count = 0, sends = 0;
+    double lastSent = 0.0;
+    unsigned long block = 0;
+    for (; block < blocks; block++)
+    {
+        for (int i = 0; i < ADC_SAMPLER_BLOCK_SIZE; i += ADC_SAMPLER_CHANNELS)
+        {
+            int pressure, ir;
+            char line[64];
+            if (samples != nullptr)
+            {
+                if (fgets(line, sizeof(line), samples) == nullptr || sscanf(line, "%d,%d", &pressure, &ir) != 2)
+                {
+                    blocks = block;
+                    break;
+                }
+            }
+            else
+            {
+                // Box-Muller
+                noise = noise * 1103515245 + 12345;
+                const double u1 = ((noise >> 8) + 1.0) / 16777217.0;
+                noise = noise * 1103515245 + 12345;
+                const double u2 = (noise >> 8) / 16777216.0;
+                const double gaussian = sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+                pressure = FILTER_INPUT_VALUE + int(lround(FILTER_NOISE * gaussian)) + (block % FILTER_GLITCH_BLOCKS == FILTER_GLITCH_BLOCKS - 1 ? FILTER_GLITCH : 0);
+                ir = 2048;
+            }
+            buffer[i] = uint16_t(pressure);
+            buffer[i + 1] = uint16_t(ir);
+        }
+        if (block == blocks)
+        {
+            break;
+        }
+
+        const AdcBlock adcBlock = {buffer, Instant()};
+        PressureSensor::sample(adcBlock);
+        PressureReading reading = {0, 0};
+        PressureSensor::readings.read(reading);
+        if (block < settle)
+        {
+            lastSent = SensorMath::toFloat(reading.psi);
+            continue;
+        }
+
+        const double raw = SensorMath::toFloat(PressureSensor::toPsi(reading.raw));
+        const double filtered = SensorMath::toFloat(reading.psi);
+        rawMin = std::min(rawMin, raw);
+        rawMax = std::max(rawMax, raw);
+        filteredMin = std::min(filteredMin, filtered);
+        filteredMax = std::max(filteredMax, filtered);
+        rawSum += raw;
+        rawSquares += raw * raw;
+        filteredSum += filtered;
+        filteredSquares += filtered * filtered;
+        count++;
+        if (fabs(filtered - lastSent) >= PRESSURE_SENSOR_DELTA_WATER_LEAK_TEST_ACTIVE)
+        {
+            lastSent = filtered;
+            sends++;
+        }
+    }
+    if (count == 0)
+    {
+        fprintf(stderr, "not enough blocks: %lu\n", block);
+        return 1;
+    }
+
+    const double rawMean = rawSum / count;
+    const double filteredMean = filteredSum / count;
+    printf("blocks: %lu (after %lu settling)\n", count, settle);
+    printf("block average PSI: %.4f, std dev: %.4f, peak to peak: %.4f\n", rawMean, sqrt(std::max(0.0, rawSquares / count - rawMean * rawMean)), rawMax - rawMin);
+    printf("filtered PSI: %.4f, std dev: %.4f, peak to peak: %.4f\n", filteredMean, sqrt(std::max(0.0, filteredSquares / count - filteredMean * filteredMean)), filteredMax - filteredMin);
+    printf("changes of %.2f PSI (water leak test delta): %lu\n", PRESSURE_SENSOR_DELTA_WATER_LEAK_TEST_ACTIVE, sends);
+    return filteredMax - filteredMin < PRESSURE_SENSOR_DELTA_WATER_LEAK_TEST_ACTIVE ? 0 : 1;
+}
+
+/**
+ * @brief the (12bit) input value of a pressure, by inverting the calibration points
+ */
+static double inputValue(double psi)
+{
+    const size_t points = sizeof(PressureSensor::calibrationPoints) / sizeof(CalibrationPoint);
+    size_t segment = 1;
+    while (segment < points - 1 && psi > PressureSensor::calibrationPoints[segment].value)
+    {
+        segment++;
+    }
+    const CalibrationPoint &from = PressureSensor::calibrationPoints[segment - 1];
+    const CalibrationPoint &to = PressureSensor::calibrationPoints[segment];
+    const double raw = from.raw + (psi - from.value) * (to.raw - from.raw) / (to.value - from.value);
+    return raw * double(1 << ADC_SAMPLER_RESOLUTION) / (PRESSURE_SENSOR_CALIBRATION_RANGE + 1);
+}
+
+/**
+ * @brief runs the leak test on a (synthetic) decaying pressure with noise
+ *
+ * @param decay PSI per minute
+ * @param minutes
+ * @return int non zero, if the verdict is missing or wrong
+ */
+int leakBench(double decay, double minutes)
+{
+    uint16_t buffer[ADC_SAMPLER_BLOCK_SIZE];
+    AdcSampler::pins[0] = PRESSURE_SENSOR_PIN;
+    AdcSampler::pins[1] = IR_SENSOR_PIN;
+    PressureSensor::filter.reset();
+    LeakTest::start();
+
+    const unsigned long period = 1000000UL * ADC_SAMPLER_BLOCK_SIZE / ADC_SAMPLER_RATE;
+    const unsigned long blocks = (unsigned long)(minutes * 60e6 / period);
+    unsigned int noise = 1;
+    LeakTestResult result = {LeakTestIdle, 0.0, 0.0, 0.0, 0};
+    double verdictTime = -1.0;
+    for (unsigned long block = 0; block < blocks; block++)
+    {
+        const double time = double(block) * period;
+        const double value = inputValue(LEAK_PSI - decay * time / 60e6);
+        for (int i = 0; i < ADC_SAMPLER_BLOCK_SIZE; i += ADC_SAMPLER_CHANNELS)
+        {
+            noise = noise * 1103515245 + 12345;
+            const double u1 = ((noise >> 8) + 1.0) / 16777217.0;
+            noise = noise * 1103515245 + 12345;
+            const double u2 = (noise >> 8) / 16777216.0;
+            buffer[i] = uint16_t(lround(value + FILTER_NOISE * sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2)));
+            buffer[i + 1] = 2048;
+        }
+        const AdcBlock adcBlock = {buffer, Instant::fromMicros(uint64_t(time))};
+        PressureSensor::sample(adcBlock);
+        LeakTest::results.read(result);
+        if (verdictTime < 0.0 && (result.status == LeakTestPass || result.status == LeakTestFail))
+        {
+            verdictTime = time / 1e6;
+        }
+    }
+    LeakTest::stop();
+
+    const LeakTestStatus expected = decay > LEAK_TEST_MAX_DECAY ? LeakTestFail : LeakTestPass;
+    printf("decay: %.3f psi/min, max: %.3f psi/min, expected: %s\n", decay, LEAK_TEST_MAX_DECAY, LeakTest::statusName(expected));
+    printf("first verdict after: %.1f s\n", verdictTime);
+    printf("result: %s, rate: %.4f psi/min, confidence: %.1f%%, drop: %.3f psi, points: %lu\n",
+           LeakTest::statusName(result.status), result.rate, result.confidence, result.drop, result.points);
+    return result.status == expected ? 0 : 1;
+}
+
+/**
+ * @brief runs a replay and prints its report
+ */
+int replay(TraceSource &source, uint64_t period)
+{
+    const auto start = std::chrono::steady_clock::now();
+    Replay::run(source, period);
+    const auto end = std::chrono::steady_clock::now();
+    Replay::report(std::chrono::duration<double>(end - start).count());
+    return 0;
+}
+
+/**
+ * @brief replays a synthetic trace with a WiFi and a broker outage every hour and checks that
+ * the loop only waits for the broker (once per backed off attempt), no pulse gets lost, it always reconnects
+ * and the readings taken while disconnected get replayed (without dropping any).
+ *
+ * @return int non zero, if any of the above fails
+ */
+int network(double hours, double outageMinutes, unsigned int seed)
+{
+    for (unsigned long hour = 0; hour + 1 < hours; hour++)
+    {
+        const uint64_t start = (hour * 60 + NETWORK_OUTAGE_START) * 60000000ULL;
+        Replay::outages.push_back({start, start + uint64_t(outageMinutes * 60e6)});
+        const uint64_t brokerStart = (hour * 60 + NETWORK_BROKER_OUTAGE_START) * 60000000ULL;
+        Replay::outages.push_back({brokerStart, brokerStart + uint64_t(outageMinutes * 60e6), true});
+    }
+    Hal::wifiConnectTime = NETWORK_WIFI_CONNECT_TIME;
+
+    SyntheticTraceSource source(uint64_t(hours * 3600e6), REPLAY_LOOP_PERIOD_US, seed);
+    const int result = replay(source, REPLAY_LOOP_PERIOD_US);
+
+    double gallons = 0.0;
+    for (const Replay::Event &event : Replay::gallonsEvents)
+    {
+        gallons += event.value;
+    }
+    // the gallons metered at the end of the trace may still be buffered (not sent yet)
+    // and the gallons metered while disconnected, should also be replayed from the offline store
+    uint64_t brokerOutages = 0;
+    for (const Outage &outage : Replay::outages)
+    {
+        brokerOutages += outage.isBroker ? outage.end - outage.start : 0;
+    }
+    const bool passed = Replay::maxLoopStall <= CONNECTION_MQTT_TIMEOUT * 1000ULL + NETWORK_MAX_LOOP_STALL &&
+                        Replay::totalLoopStall <= brokerOutages * NETWORK_MAX_STALL_SHARE / 100 &&
+                        PulseSensor::pulses == Replay::pulses &&
+                        Replay::reconnectLatencies.size() == Replay::outages.size() &&
+                        (unsigned long)gallons + PulseSensor::gallonsCounterBuffer == Replay::pulses &&
+                        (unsigned long)Replay::offlineGallons == Replay::offlinePulses &&
+                        OfflineStore::droppedRecords == 0 &&
+                        Device::mqtt.skippedAttempts == 0;
+    printf("mqtt connect attempts: %lu, skipped: %lu\n", Device::mqtt.attempts, Device::mqtt.skippedAttempts);
+    printf("network: %s\n", passed ? "passed" : "failed");
+    return result == 0 && passed ? 0 : 1;
+}
+
+/**
+ * @brief checks that the telemetry frames decode back to the samples they were encoded from
+ * (including the edge values) and that invalid frames get rejected
+ *
+ * @return the number of failures
+ */
+static int telemetryRoundTrip()
+{
+    const TelemetrySample samples[] = {
+        {0xFFFFFF00, 0, 0, 0, 0, false},
+        {0xFFFFFF64, 65535, 65535, 4095, 4095, true},
+        {0x00000100, 1250, 5510, 2684, 2048, true},
+        {0x0000FEFF, 1, 1, 1, 0, false}};
+    const int count = sizeof(samples) / sizeof(samples[0]);
+    uint8_t frame[TELEMETRY_FRAME_SIZE];
+    const size_t length = Telemetry::encode(samples, count, frame);
+
+    int failures = 0;
+    TelemetrySample decoded[TELEMETRY_FRAME_SAMPLES];
+    if (length != size_t(TELEMETRY_HEADER_SIZE + count * TELEMETRY_SAMPLE_SIZE) || Telemetry::decode(frame, length, decoded, TELEMETRY_FRAME_SAMPLES) != count)
+    {
+        return 1;
+    }
+    for (int i = 0; i < count; i++)
+    {
+        const TelemetrySample &a = samples[i];
+        const TelemetrySample &b = decoded[i];
+        failures += a.time != b.time || a.milliGpm != b.milliGpm || a.centiPsi != b.centiPsi || a.rawPressure != b.rawPressure || a.rawIr != b.rawIr || a.isIrActive != b.isIrActive ? 1 : 0;
+    }
+    // truncated, too many samples and unknown version
+    failures += Telemetry::decode(frame, length - 1, decoded, TELEMETRY_FRAME_SAMPLES) != -1 ? 1 : 0;
+    failures += Telemetry::decode(frame, length, decoded, count - 1) != -1 ? 1 : 0;
+    frame[0]++;
+    failures += Telemetry::decode(frame, length, decoded, TELEMETRY_FRAME_SAMPLES) != -1 ? 1 : 0;
+    return failures;
+}
+
+/**
+ * @brief round-trips the telemetry frames and replays a synthetic trace, while it decodes
+ * every frame the firmware publishes and checks that the samples keep coming at TELEMETRY_SAMPLE_PERIOD.
+ *
+ * @return int non zero, if any frame does not decode, or samples are missing or dropped
+ */
+int telemetry(double hours, unsigned int seed)
+{
+    const int roundTripFailures = telemetryRoundTrip();
+    printf("round trip failures: %d\n", roundTripFailures);
+
+    static unsigned long frames = 0;
+    static unsigned long invalidFrames = 0;
+    static unsigned long samples = 0;
+    static unsigned long frameBytes = 0;
+    static unsigned long maxGap = 0;
+    static unsigned long flowingSamples = 0;
+    static uint32_t lastTime = 0;
+    Hal::onPublishBinary = [](const char *topic, const uint8_t *payload, size_t length)
+    {
+        if (strcmp(topic, TELEMETRY_MQTT_TOPIC) != 0)
+        {
+            return;
+        }
+        TelemetrySample decoded[TELEMETRY_FRAME_SAMPLES];
+        const int count = Telemetry::decode(payload, length, decoded, TELEMETRY_FRAME_SAMPLES);
+        if (count < 0)
+        {
+            invalidFrames++;
+            return;
+        }
+        frames++;
+        frameBytes += length;
+        for (int i = 0; i < count; i++)
+        {
+            if (samples > 0)
+            {
+                maxGap = std::max(maxGap, (unsigned long)(decoded[i].time - lastTime));
+            }
+            lastTime = decoded[i].time;
+            flowingSamples += decoded[i].milliGpm > 0 ? 1 : 0;
+            samples++;
+        }
+    };
+
+    SyntheticTraceSource source(uint64_t(hours * 3600e6), REPLAY_LOOP_PERIOD_US, seed);
+    const int result = replay(source, REPLAY_LOOP_PERIOD_US);
+
+    unsigned long textBytes = 0;
+    for (const Replay::Event &event : Replay::gpmEvents)
+    {
+        char payload[32];
+        textBytes += snprintf(payload, sizeof(payload), "%.2f", event.value);
+    }
+    const double seconds = hours * 3600.0;
+    printf("telemetry frames: %lu (invalid: %lu), samples: %lu (%.2f per second, %lu with flow), dropped: %lu\n",
+           frames, invalidFrames, samples, samples / seconds, flowingSamples, Telemetry::droppedSamples);
+    printf("telemetry bytes: %lu (%.1f per sample), max gap: %lu ms\n", frameBytes, samples > 0 ? double(frameBytes) / samples : 0.0, maxGap);
+    printf("gpm text publishes: %zu (%lu bytes)\n", Replay::gpmEvents.size(), textBytes);
+
+    // a sample every TELEMETRY_SAMPLE_PERIOD, taken on the first block after it (plus one for the jitter)
+    const unsigned long maxGapAllowed = (TELEMETRY_SAMPLE_PERIOD + 2 * ADC_SAMPLER_BLOCK_SAMPLES * 1000000UL / (ADC_SAMPLER_RATE / ADC_SAMPLER_CHANNELS)) / 1000;
+    const bool passed = roundTripFailures == 0 && invalidFrames == 0 && Telemetry::droppedSamples == 0 &&
+                        maxGap <= maxGapAllowed && samples >= (unsigned long)(seconds * 1e6 / TELEMETRY_SAMPLE_PERIOD * 0.99);
+    printf("telemetry: %s\n", passed ? "passed" : "failed");
+    return result == 0 && passed ? 0 : 1;
+}
+
+/**
+ * @brief boots the totalizer over and over, with the water randomly running, and cuts the power at an arbitrary point:
+ * either while idle, or after an arbitrary number of bytes got written to flash (a torn record or compaction).
+ * after every boot, it checks that the recovered total is at least the last committed one,
+ * never more than the metered one and that at most a batch (TOTALIZER_COMMIT_GALLONS) got lost.
+ *
+ * @return int non zero, if any of the above fails
+ */
+int totalizer(unsigned long boots, unsigned int seed)
+{
+    std::mt19937 random(seed);
+    const unsigned long maxLoss = (unsigned long)(TOTALIZER_COMMIT_GALLONS * PULSE_RATE);
+    uint32_t metered = 0;
+    uint32_t committed = 0;
+    unsigned long failures = 0;
+    unsigned long tornWrites = 0;
+    unsigned long compactionLosses = 0;
+    unsigned long lost = 0;
+    unsigned long worstLoss = 0;
+    unsigned long commits = 0;
+    unsigned long compactions = 0;
+
+    for (unsigned long boot = 0; boot < boots; boot++)
+    {
+        compactionLosses += LittleFS.exists(TOTALIZER_COMPACT_FILE) ? 1 : 0;
+        NativeFlash::powerOn();
+        // half of the boots lose the power while writing (after a few records, or while compacting a torn log on boot)
+        if (random() % 2 == 0)
+        {
+            NativeFlash::powerLossAfterBytes = long(random() % (20 * sizeof(TotalizerRecord)));
+        }
+        PulseSensor::readings.write({0.0, 0, false});
+        Totalizer::setup();
+
+        const uint32_t recovered = Totalizer::total();
+        if (recovered < committed || recovered > metered || metered - recovered > maxLoss)
+        {
+            printf("boot %lu: recovered %u, committed %u, metered %u\n", boot, recovered, committed, metered);
+            failures++;
+        }
+        lost += metered - recovered;
+        worstLoss = std::max(worstLoss, (unsigned long)(metered - recovered));
+        metered = recovered;
+        committed = recovered;
+
+        const unsigned long seconds = 1 + random() % TOTALIZER_BOOT_SECONDS;
+        unsigned long pulses = 0;
+        bool isFlowing = false;
+        for (unsigned long second = 0; second < seconds && !NativeFlash::isPoweredOff; second++)
+        {
+            if (random() % 120 == 0)
+            {
+                isFlowing = !isFlowing;
+            }
+            // about 6 gallons per minute
+            if (isFlowing && random() % 10 == 0)
+            {
+                pulses++;
+            }
+            PulseSensor::readings.write({isFlowing ? SensorReal(6.0) : SensorReal(0.0), pulses, false});
+            Hal::advance(1000000);
+            Totalizer::loop();
+            metered = Totalizer::total();
+            committed = Totalizer::committedPulses;
+        }
+        tornWrites += NativeFlash::isPoweredOff ? 1 : 0;
+        commits += Totalizer::commits;
+        compactions += Totalizer::compactions;
+        Totalizer::commits = 0;
+        Totalizer::compactions = 0;
+    }
+
+    printf("boots: %lu, torn writes: %lu (%lu while compacting), commits: %lu, compactions: %lu\n", boots, tornWrites, compactionLosses, commits, compactions);
+    printf("gallons: %.0f, lost: %.0f (worst boot: %.0f), flash bytes written: %lu (%.1f per gallon)\n",
+           metered / PULSE_RATE, lost / PULSE_RATE, worstLoss / PULSE_RATE, File::bytesWritten, metered > 0 ? File::bytesWritten * PULSE_RATE / metered : 0.0);
+    const bool passed = failures == 0 && compactions > 0 && tornWrites > 0;
+    printf("totalizer: %s\n", passed ? "passed" : "failed");
+    return passed ? 0 : 1;
+}
+
+/**
+ * @brief counts a failed check of the config (or wrap) mode
+ */
+static int configCheck(bool passed, const char *check)
+{
+    printf("%s: %s\n", check, passed ? "ok" : "failed");
+    return passed ? 0 : 1;
+}
+
+/**
+ * @brief checks the config registry: the defaults, the validation of the values sent from the controller,
+ * that they get applied right away (on both cores, and not over the water leak test ones),
+ * saved once after a burst of changes and loaded back after a reboot,
+ * and that a corrupt file or a power loss while saving, never leaves invalid values.
+ *
+ * @return int non zero, if any of the above fails
+ */
+int config()
+{
+    int failures = 0;
+    Switches::setup();
+    Config::setup();
+    Config::applySampling();
+    bool isDefault = true;
+    for (int i = 0; i < CONFIG_PARAMETERS; i++)
+    {
+        isDefault = isDefault && Config::values[i] == Config::definitions[i].defaultValue;
+    }
+    failures += configCheck(isDefault && FlowDetector::hysteresis == FLOW_DETECTOR_HYSTERESIS && FlowDetector::maxStopTimeout == FLOW_DETECTOR_MAX_STOP_TIMEOUT &&
+                                PulseSensor::gpmReport.minInterval == Duration::millis(SEND_GPM_FREQUENCY) && SensorMath::toMilli(PressureSensor::psiReport.deadband) == int32_t(PRESSURE_SENSOR_DELTA * 1000),
+                            "defaults");
+
+    Config::numbers[ConfigFlowHysteresis].command(8);
+    Config::numbers[ConfigFlowMaxStopTimeout].command(45);
+    Config::numbers[ConfigGpmSendFrequency].command(2000);
+    Config::numbers[ConfigPressureDelta].command(0.5);
+    Config::numbers[ConfigPressureOffset].command(-1.25);
+    Config::applySampling();
+    failures += configCheck(FlowDetector::hysteresis == 8 && FlowDetector::maxStopTimeout == 45000 && PulseSensor::gpmReport.minInterval == Duration::seconds(2) &&
+                                SensorMath::toMilli(PressureSensor::psiReport.deadband) == 500 && SensorMath::toMilli(PressureSensor::psiOffset) == -1250 &&
+                                Config::numbers[ConfigPressureOffset].getCurrentState().toFloat() == -1.25f,
+                            "applied");
+
+    // out of range, off step and below the min stop timeout
+    Config::numbers[ConfigFlowHysteresis].command(0);
+    Config::numbers[ConfigFlowHysteresis].command(65);
+    Config::numbers[ConfigGpmSendFrequency].command(300);
+    Config::numbers[ConfigFlowMaxStopTimeout].command(1);
+    Config::numbers[ConfigPressureDelta].command(0.001);
+    failures += configCheck(Config::rejected == 5 && Config::get(ConfigFlowHysteresis) == 8 && Config::get(ConfigGpmSendFrequency) == 2000 &&
+                                Config::get(ConfigFlowMaxStopTimeout) == 45 && Config::get(ConfigPressureDelta) == 50 &&
+                                Config::numbers[ConfigFlowHysteresis].getCurrentState().toFloat() == 8.0f,
+                            "rejected");
+
+    Switches::waterLeakTestSwitch.command(true);
+    Config::numbers[ConfigPressureDelta].command(1.5);
+    const bool isLeakTestKept = SensorMath::toMilli(PressureSensor::psiReport.deadband) == SensorMath::toMilli(SensorReal(PRESSURE_SENSOR_DELTA_WATER_LEAK_TEST_ACTIVE));
+    Switches::waterLeakTestSwitch.command(false);
+    failures += configCheck(isLeakTestKept && SensorMath::toMilli(PressureSensor::psiReport.deadband) == 1500, "water leak test");
+
+    // a burst of changes gets saved once, CONFIG_SAVE_DELAY after the last one
+    for (int second = 0; second < CONFIG_SAVE_DELAY / 1000 * 3; second++)
+    {
+        if (second < 5)
+        {
+            Config::numbers[ConfigFlowStartCrossings].command(float(6 + second));
+        }
+        Hal::advance(1000000);
+        Config::loop();
+    }
+    failures += configCheck(Config::saves == 1 && !Config::isDirty, "saved once");
+
+    int32_t saved[CONFIG_PARAMETERS];
+    memcpy(saved, Config::values, sizeof(saved));
+    Config::setup();
+    Config::applySampling();
+    failures += configCheck(memcmp(saved, Config::values, sizeof(saved)) == 0 && FlowDetector::startCrossings == 10, "loaded");
+
+    // a power loss while saving leaves the saved values
+    Config::numbers[ConfigFlowHysteresis].command(12);
+    NativeFlash::powerLossAfterBytes = 10;
+    Config::save();
+    NativeFlash::powerOn();
+    Config::setup();
+    failures += configCheck(memcmp(saved, Config::values, sizeof(saved)) == 0, "power loss");
+
+    // a corrupt file falls back to the defaults
+    ConfigFile corrupt = {};
+    File file = LittleFS.open(CONFIG_FILE, "r");
+    file.read((uint8_t *)&corrupt, sizeof(corrupt));
+    file.close();
+    corrupt.values[0] ^= 1;
+    file = LittleFS.open(CONFIG_FILE, "w");
+    file.write((const uint8_t *)&corrupt, sizeof(corrupt));
+    file.close();
+    const bool isLoaded = Config::load();
+    failures += configCheck(!isLoaded && Config::get(ConfigFlowHysteresis) == FLOW_DETECTOR_HYSTERESIS && Config::get(ConfigPressureOffset) == 0, "corrupt");
+
+    printf("config: %s\n", failures == 0 ? "passed" : "failed");
+    return failures == 0 ? 0 : 1;
+}
+
+/**
+ * @brief the time in microseconds of an hour of a day of the trace
+ */
+static uint64_t leaksTime(int day, double hour)
+{
+    return uint64_t((day * 24 + hour) * 3600e6);
+}
+
+/**
+ * @brief replays days of synthetic usage (with quiet nights), with a burst, a running toilet and a micro leak on top of it
+ * and checks that each gets its alarm (and in time) and that there are no other alarms.
+ *
+ * @return int non zero, if an alarm is missing, late or false
+ */
+int leaks(int days, unsigned int seed)
+{
+    const uint64_t burstStart = leaksTime(2, 14);
+    const uint64_t toiletStart = leaksTime(3, 9);
+    const uint64_t microStart = leaksTime(4, 0);
+    SyntheticTraceSource source(leaksTime(days, 0), LEAKS_LOOP_PERIOD_US, seed);
+    source.addQuietNights(LEAKS_QUIET_HOURS);
+    source.leaks.push_back({burstStart, burstStart + LEAKS_BURST_MINUTES * 60000000ULL, LEAKS_BURST_GPM});
+    source.leaks.push_back({toiletStart, toiletStart + LEAKS_TOILET_MINUTES * 60000000ULL, LEAKS_TOILET_GPM});
+    source.leaks.push_back({microStart, UINT64_MAX, LEAKS_MICRO_GPM});
+    const int result = replay(source, LEAKS_LOOP_PERIOD_US);
+
+    // when every alarm got raised (in the time of the trace, the firmware boots in no time).
+    // the continuous flow may start before the toilet, when it runs into some usage
+    const char *kinds[] = {"continuous flow", "event volume", "micro leak"};
+    const uint64_t expected[][2] = {
+        {toiletStart, toiletStart + (LEAK_DETECTOR_CONTINUOUS_FLOW + 5) * 60000000ULL},
+        {burstStart, burstStart + LEAKS_BURST_MINUTES * 60000000ULL},
+        {microStart + leaksTime(0, 1), microStart + leaksTime(0, LEAK_DETECTOR_HOURS + 1)}};
+    // where they may be raised (the toilet runs long enough for an event volume alarm too, with the usage on top).
+    // the micro leak one goes off once the leak fills the last quiet hours (the days have flow every hour anyway)
+    const uint64_t allowed[][2] = {
+        {toiletStart, toiletStart + LEAKS_TOILET_MINUTES * 60000000ULL},
+        {burstStart, toiletStart + LEAKS_TOILET_MINUTES * 60000000ULL},
+        {microStart, UINT64_MAX}};
+    int failures = 0;
+    for (int kind = 0; kind < 3; kind++)
+    {
+        bool wasRaised = false;
+        bool isExpected = false;
+        unsigned long raised = 0;
+        for (const auto &alarm : Replay::leakAlarms)
+        {
+            const bool isRaised = alarm.second.find(kinds[kind]) != std::string::npos;
+            if (isRaised && !wasRaised)
+            {
+                raised++;
+                const bool isAllowed = alarm.first >= allowed[kind][0] && alarm.first <= allowed[kind][1];
+                isExpected = isExpected || (alarm.first >= expected[kind][0] && alarm.first <= expected[kind][1]);
+                printf("%s alarm: day %d, %.2f h%s\n", kinds[kind], int(alarm.first / leaksTime(1, 0)), double(alarm.first % leaksTime(1, 0)) / 3600e6, isAllowed ? "" : " (false)");
+                failures += isAllowed ? 0 : 1;
+            }
+            wasRaised = isRaised;
+        }
+        if (!isExpected)
+        {
+            printf("%s alarm: missing\n", kinds[kind]);
+            failures++;
+        }
+    }
+    printf("alarms raised: %lu, published: %zu\n", LeakDetector::raisedAlarms, Replay::leakAlarms.size());
+    printf("leaks: %s\n", failures == 0 ? "passed" : "failed");
+    return result == 0 && failures == 0 ? 0 : 1;
+}
+
+/**
+ * @brief the defaults of the calibration mode: the noise of the IR signal (more than the synthetic default, as of a noisy power supply),
+ * the hysteresis the config starts from (the default, too low for that noise) and the days to replay (with quiet nights)
+ */
+#define CALIBRATION_IR_NOISE 3.0
+#define CALIBRATION_HYSTERESIS FLOW_DETECTOR_HYSTERESIS
+#define CALIBRATION_DAYS 3
+#define CALIBRATION_QUIET_HOURS 6
+
+/**
+ * @brief counts the flow starts that got (or did not get) reported from a time on
+ *
+ * @param from the time (virtual microseconds) to count from
+ * @param starts the flow events (of the ground truth) that started since
+ * @param detected how many of them got reported
+ * @param falseStarts the flow starts reported while no water was flowing
+ */
+static void calibrationStarts(uint64_t from, unsigned long &starts, unsigned long &detected, unsigned long &falseStarts)
+{
+    starts = 0;
+    detected = 0;
+    for (const FlowSegment &segment : Replay::truth)
+    {
+        if (segment.start < from)
+        {
+            continue;
+        }
+        starts++;
+        for (const Replay::Event &event : Replay::gpmEvents)
+        {
+            if (event.time >= segment.start && event.time < segment.end && event.value > 0.0)
+            {
+                detected++;
+                break;
+            }
+        }
+    }
+    falseStarts = 0;
+    double lastValue = 0.0;
+    for (const Replay::Event &event : Replay::gpmEvents)
+    {
+        if (event.time >= from && lastValue == 0.0 && event.value > 0.0)
+        {
+            bool flowing = false;
+            for (const FlowSegment &segment : Replay::truth)
+            {
+                flowing = flowing || (event.time >= segment.start && event.time < segment.end);
+            }
+            falseStarts += flowing ? 0 : 1;
+        }
+        lastValue = event.value;
+    }
+}
+
+/**
+ * @brief replays days of synthetic usage (with quiet nights) with a noisy IR signal, from a saved hysteresis that does not fit it,
+ * and checks that the IR calibration sets one that does: on the last day every flow start gets detected and there are no false ones.
+ *
+ * @return int non zero, if the hysteresis still misses starts or detects false ones
+ */
+int calibration(double irNoise, int32_t hysteresis, int days, unsigned int seed)
+{
+    // the config the firmware boots with
+    LittleFS.begin();
+    for (int i = 0; i < CONFIG_PARAMETERS; i++)
+    {
+        Config::values[i] = Config::definitions[i].defaultValue;
+    }
+    Config::values[ConfigFlowHysteresis] = hysteresis;
+    Config::save();
+
+    SyntheticTraceSource source(leaksTime(days, 0), LEAKS_LOOP_PERIOD_US, seed);
+    source.addQuietNights(CALIBRATION_QUIET_HOURS);
+    source.irNoise = irNoise;
+    const int result = replay(source, LEAKS_LOOP_PERIOD_US);
+
+    unsigned long starts = 0;
+    unsigned long detected = 0;
+    unsigned long falseStarts = 0;
+    calibrationStarts(Hal::clock - leaksTime(1, 0), starts, detected, falseStarts);
+    const int32_t calibrated = Config::get(ConfigFlowHysteresis);
+    printf("noise level: %.1f (%lu samples), active level: %.1f (%lu samples)\n", IrCalibration::reading.noiseLevel / 2.0, (unsigned long)IrCalibration::reading.noiseSamples,
+           IrCalibration::reading.activeLevel / 2.0, (unsigned long)IrCalibration::reading.activeSamples);
+    printf("hysteresis: %d -> %d (changes: %lu)\n", int(hysteresis), int(calibrated), IrCalibration::changes);
+    printf("last day, flow events: %lu, starts detected: %lu, false starts: %lu\n", starts, detected, falseStarts);
+    const bool passed = starts > 0 && detected == starts && falseStarts == 0 && IrCalibration::changes > 0;
+    printf("calibration: %s\n", passed ? "passed" : "failed");
+    return result == 0 && passed ? 0 : 1;
+}
+
+/**
+ * @brief the boot time (virtual microseconds) of the wrap mode: an hour before millis() wraps (2^32 ms, ~49.7 days),
+ * which is also when micros() wraps for the 1000th time (every 2^32 us, ~71.6 minutes)
+ */
+#define WRAP_BOOT_TIME ((1ULL << 32) * 1000 - 3600000000ULL)
+
+/**
+ * @brief hours of synthetic trace the wrap mode replays, from its boot time
+ */
+#define WRAP_HOURS 3
+
+/**
+ * @brief checks the saturation of the monotonic time types (@see src/monotonicTime.h)
+ *
+ * @return the number of failures
+ */
+static int wrapTypes()
+{
+    int failures = 0;
+    const Instant beforeWrap = Instant::fromMicros((1ULL << 32) - 1);
+    const Instant afterWrap = beforeWrap + Duration::micros(2);
+    failures += configCheck(afterWrap > beforeWrap && afterWrap - beforeWrap == Duration::micros(2) && beforeWrap - afterWrap == -Duration::micros(2), "instants across the micros() wrap");
+    failures += configCheck(Instant() - Duration::seconds(1) == Instant() && Instant::fromMicros(5) + -Duration::micros(9) == Instant(), "instant saturates to the boot");
+    failures += configCheck(Duration::micros(-1).toMicros32() == 0 && Duration::minutes(72).toMicros32() == UINT32_MAX && Duration::minutes(72).toMillis32() == 4320000 &&
+                                Duration::millis(int64_t(1) << 33).toMillis32() == UINT32_MAX,
+                            "32bit conversions saturate");
+
+    Hal::clock = 1000;
+    failures += configCheck(MonotonicClock::since(Instant::fromMicros(1500)) == Duration() && !MonotonicClock::hasElapsed(Instant::fromMicros(1500), Duration::micros(1)),
+                            "time since a later instant is zero");
+    Hal::clock = WRAP_BOOT_TIME;
+    const Instant then = MonotonicClock::now();
+    Hal::advance(2 * 3600000000ULL);
+    failures += configCheck(MonotonicClock::since(then) == Duration::minutes(120) && MonotonicClock::hasElapsed(then, Duration::minutes(120)) &&
+                                !MonotonicClock::hasElapsed(then, Duration::minutes(121)) && uint32_t(millis()) < uint32_t((then.toMicros() / 1000)),
+                            "time since across the millis() wrap");
+    Hal::clock = 0;
+    return failures;
+}
+
+/**
+ * @brief boots the firmware right before millis() (and micros()) wrap and replays hours of synthetic usage across the wraps.
+ * checks that every pulse gets counted and reported, every flow start and stop gets detected (with no false starts or leak alarms),
+ * the scheduler keeps running every task on time and the usage events stay whole.
+ *
+ * @return int non zero, if any of the above (or a check of the time types) fails
+ */
+int wrap(double hours, unsigned int seed)
+{
+    int failures = wrapTypes();
+
+    Hal::clock = WRAP_BOOT_TIME;
+    SyntheticTraceSource source(uint64_t(hours * 3600e6), REPLAY_LOOP_PERIOD_US, seed);
+    const int result = replay(source, REPLAY_LOOP_PERIOD_US);
+    failures += configCheck(Hal::clock / 1000 > UINT32_MAX && millis() < WRAP_BOOT_TIME / 1000, "millis() wrapped");
+
+    double gallons = 0.0;
+    for (const Replay::Event &event : Replay::gallonsEvents)
+    {
+        gallons += event.value;
+    }
+    failures += configCheck(PulseSensor::pulses == Replay::pulses && (unsigned long)gallons + PulseSensor::gallonsCounterBuffer == Replay::pulses, "pulses and gallons");
+
+    unsigned long starts = 0;
+    unsigned long detected = 0;
+    unsigned long falseStarts = 0;
+    calibrationStarts(WRAP_BOOT_TIME, starts, detected, falseStarts);
+    unsigned long stops = 0;
+    unsigned long detectedStops = 0;
+    for (const FlowSegment &segment : Replay::truth)
+    {
+        if (segment.end == UINT64_MAX)
+        {
+            continue;
+        }
+        stops++;
+        for (const Replay::Event &event : Replay::gpmEvents)
+        {
+            if (event.time >= segment.end && event.value == 0.0)
+            {
+                detectedStops += event.time - segment.end < 60000000ULL ? 1 : 0;
+                break;
+            }
+        }
+    }
+    failures += configCheck(starts > 0 && detected == starts && falseStarts == 0 && detectedStops == stops, "flow starts and stops");
+    failures += configCheck(LeakDetector::raisedAlarms == 0, "no leak alarms");
+
+    // every task is due within its period (and none got postponed by a wrap)
+    bool onTime = true;
+    const Instant now = MonotonicClock::now();
+    for (int i = 0; i < Scheduler::taskCount; i++)
+    {
+        const SchedulerTask &task = Scheduler::tasks[i];
+        onTime = onTime && task.runs > 0 && task.due - now <= task.period && now - task.due < Duration::seconds(1);
+    }
+    failures += configCheck(onTime, "scheduler");
+
+    // the usage events span (at most) their actual duration
+    bool wholeEvents = !Replay::usageEvents.empty();
+    for (const auto &event : Replay::usageEvents)
+    {
+        const char *seconds = strstr(event.second.c_str(), "\"seconds\":");
+        wholeEvents = wholeEvents && seconds != nullptr && strtoul(seconds + 10, nullptr, 10) < hours * 3600;
+    }
+    failures += configCheck(wholeEvents, "usage events");
+
+    printf("wrap: %s\n", failures == 0 ? "passed" : "failed");
+    return result == 0 && failures == 0 ? 0 : 1;
+}
+
+#ifdef VALVE_ENABLED
+/**
+ * @brief the burst pipe of the valve mode: when (minutes) it starts and stops and how much it leaks.
+ * with the valve open, it goes past the event volume alarm in ~2.5 minutes.
+ */
+#define VALVE_BURST_START 60.0
+#define VALVE_BURST_END 97.0
+#define VALVE_BURST_GPM 40.0
+
+/**
+ * @brief hours of synthetic trace the valve mode replays
+ */
+#define VALVE_HOURS 2.5
+
+/**
+ * @brief the max time in milliseconds from a leak alarm to the valve motor closing, for the valve mode to pass
+ */
+#define VALVE_MAX_SHUTOFF_LATENCY 10
+
+/**
+ * @brief the max time in milliseconds the valve motor may keep running at an end (the loop iterations it takes to see the limit switch)
+ */
+#define VALVE_MAX_LIMIT_TIME 10
+
+/**
+ * @brief what the valve mode does to the valve (from the controller, or to the simulated one)
+ */
+enum ValveAction
+{
+    ValveActionOpen,
+    ValveActionClose,
+    ValveActionStick,
+    ValveActionUnstick
+};
+
+struct ValveStep
+{
+    double minutes;
+    ValveAction action;
+};
+
+/**
+ * @brief replays a burst pipe on top of synthetic usage, through a simulated valve, and commands it from the controller:
+ * the leak alarm must shut it off (within VALVE_MAX_SHUTOFF_LATENCY) and keep it closed until an override,
+ * the overrides and the commands to open are rate limited, a stuck valve faults (with the motor off) and
+ * the motor never runs both ways, reverses without a pause, or keeps running at an end.
+ *
+ * @return int non zero, if any of the above fails
+ */
+int valve(unsigned int seed)
+{
+    const ValveStep steps[] = {
+        // the first override, right away another open (too soon) and after the second shutoff (too soon for an override)
+        {90.0, ValveActionOpen},
+        {90.1, ValveActionOpen},
+        {94.0, ValveActionOpen},
+        {96.0, ValveActionOpen},
+        // reversed while closing
+        {110.0, ValveActionClose},
+        {110.05, ValveActionOpen},
+        // a seized valve faults, closes once freed and opens again
+        {120.0, ValveActionStick},
+        {120.0, ValveActionClose},
+        {122.0, ValveActionUnstick},
+        {122.0, ValveActionClose},
+        {125.0, ValveActionOpen}};
+    size_t step = 0;
+    unsigned long shutoffs = 0;
+    uint64_t maxLatency = 0;
+    uint64_t closedTime = 0;
+    unsigned long leakedPulses = 0;
+    unsigned long closedPulses = 0;
+    bool isFault = false;
+
+    SyntheticTraceSource source(uint64_t(VALVE_HOURS * 3600e6), REPLAY_LOOP_PERIOD_US, seed);
+    source.leaks.push_back({uint64_t(VALVE_BURST_START * 60e6), uint64_t(VALVE_BURST_END * 60e6), VALVE_BURST_GPM});
+    source.supply = ValveSimulator::opening;
+    ValveSimulator::attach(1.0);
+    Hal::onAdvance = [&](uint64_t micros)
+    {
+        ValveSimulator::step(micros);
+        if (Valve::shutoffs != shutoffs)
+        {
+            shutoffs = Valve::shutoffs;
+            maxLatency = std::max(maxLatency, ValveSimulator::closeTime - Valve::shutoffTime.toMicros());
+            closedTime = 0;
+        }
+        if (closedTime == 0 && Valve::isLeakShutoff && ValveSimulator::position <= 0.0)
+        {
+            closedTime = Hal::clock;
+            closedPulses = PulseSensor::pulses;
+            printf("shutoff %lu: closed in %.1f s, at %.1f min\n", shutoffs, (Hal::clock - Valve::shutoffTime.toMicros()) / 1e6, Hal::clock / 60e6);
+        }
+        // no water gets through a closed valve
+        leakedPulses += closedTime != 0 && Valve::isLeakShutoff && PulseSensor::pulses != closedPulses ? 1 : 0;
+        closedPulses = PulseSensor::pulses;
+        isFault = isFault || (Valve::state == ValveFault && Hal::digitalValues[VALVE_OPEN_PIN] == LOW && Hal::digitalValues[VALVE_CLOSE_PIN] == LOW);
+
+        for (; step < sizeof(steps) / sizeof(steps[0]) && Hal::clock >= uint64_t(steps[step].minutes * 60e6); step++)
+        {
+            switch (steps[step].action)
+            {
+            case ValveActionOpen:
+            case ValveActionClose:
+                Valve::valveSwitch.command(steps[step].action == ValveActionOpen);
+                printf("%s at %.1f min: %s (switch %s)\n", steps[step].action == ValveActionOpen ? "open" : "close", Hal::clock / 60e6,
+                       Valve::stateName(Valve::state), Valve::valveSwitch.getCurrentState() ? "on" : "off");
+                break;
+            case ValveActionStick:
+            case ValveActionUnstick:
+                ValveSimulator::isStuck = steps[step].action == ValveActionStick;
+                break;
+            }
+        }
+    };
+    const int result = replay(source, REPLAY_LOOP_PERIOD_US);
+    Hal::onAdvance = nullptr;
+
+    printf("shutoffs: %lu, overrides: %lu, rejected commands: %lu, faults: %lu, max shutoff latency: %.3f ms\n",
+           Valve::shutoffs, Valve::overrides, Valve::rejectedCommands, Valve::faults, maxLatency / 1e3);
+    printf("pulses through the shut off valve: %lu, shoot-throughs: %lu, hard reversals: %lu, max run at an end: %.1f ms\n",
+           leakedPulses, ValveSimulator::shootThroughs, ValveSimulator::hardReversals, ValveSimulator::maxLimitTime / 1e3);
+    int failures = 0;
+    failures += configCheck(Valve::shutoffs == 2 && LeakDetector::raisedAlarms == 2 && maxLatency <= VALVE_MAX_SHUTOFF_LATENCY * 1000ULL && leakedPulses == 0, "leak shutoff");
+    failures += configCheck(Valve::overrides == 2 && Valve::rejectedCommands == 2, "rate limited overrides");
+    failures += configCheck(Valve::faults == 1 && isFault, "stuck valve");
+    failures += configCheck(ValveSimulator::shootThroughs == 0 && ValveSimulator::hardReversals == 0 && ValveSimulator::maxLimitTime <= VALVE_MAX_LIMIT_TIME * 1000ULL, "motor interlocks");
+    failures += configCheck(Valve::state == ValveOpen && Valve::valveSwitch.getCurrentState() && ValveSimulator::position >= 1.0, "opened");
+    printf("valve: %s\n", failures == 0 ? "passed" : "failed");
+    return result == 0 && failures == 0 ? 0 : 1;
+}
+#endif
+
+/**
+ * @brief default hours of synthetic fixture usage to replay
+ */
+#define EVENTS_HOURS 48
+
+/**
+ * @brief the min share of the usage events that must get their fixture right, for the events mode to pass
+ */
+#define EVENTS_MIN_ACCURACY 0.9
+
+/**
+ * @brief the max (average) error of the gallons of the usage events, for the events mode to pass
+ */
+#define EVENTS_MAX_GALLONS_ERROR 0.1
+
+/**
+ * @brief how a fixture of the synthetic household runs: GPM and seconds (uniform in the ranges) and how often (weight)
+ */
+struct EventsFixture
+{
+    UsageFixture fixture;
+    double minGpm;
+    double maxGpm;
+    double minSeconds;
+    double maxSeconds;
+    double weight;
+};
+
+/**
+ * @brief replays hours of synthetic usage of known fixtures (one at a time, minutes apart)
+ * and checks that every use becomes exactly one usage event, of the right volume and (mostly) the right fixture.
+ *
+ * @return int non zero, if an event is missing, split, or false, or the fixtures or the gallons are too often wrong
+ */
+int events(double hours, unsigned int seed)
+{
+    const EventsFixture fixtures[] = {
+        {UsageToilet, 3.0, 4.5, 25.0, 40.0, 4.0},
+        {UsageFaucet, 0.5, 1.8, 15.0, 120.0, 4.0},
+        {UsageShower, 1.6, 2.6, 360.0, 900.0, 2.0},
+        {UsageBath, 4.0, 6.0, 360.0, 600.0, 0.5},
+        {UsageIrrigation, 5.0, 9.0, 1800.0, 3600.0, 0.5}};
+    std::mt19937 random(seed);
+    std::discrete_distribution<int> pick({4.0, 4.0, 2.0, 0.5, 0.5});
+    std::uniform_real_distribution<double> gap(3.0 * 60e6, 30.0 * 60e6);
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+
+    const uint64_t duration = uint64_t(hours * 3600e6);
+    SyntheticTraceSource source(duration, REPLAY_LOOP_PERIOD_US, seed);
+    source.segments.clear();
+    std::vector<UsageFixture> labels;
+    for (uint64_t time = uint64_t(gap(random)); time < duration;)
+    {
+        const EventsFixture &fixture = fixtures[pick(random)];
+        const double gpm = fixture.minGpm + (fixture.maxGpm - fixture.minGpm) * unit(random);
+        const uint64_t end = time + uint64_t((fixture.minSeconds + (fixture.maxSeconds - fixture.minSeconds) * unit(random)) * 1e6);
+        if (end + (USAGE_EVENTS_STOP_GRACE + 60000) * 1000ULL >= duration)
+        {
+            // it would not end in time
+            break;
+        }
+        source.segments.push_back({time, end, gpm});
+        labels.push_back(fixture.fixture);
+        time = end + uint64_t(gap(random));
+    }
+    const int result = replay(source, REPLAY_LOOP_PERIOD_US);
+
+    // every use gets published within the stop grace (plus the stop detection) after it ends
+    unsigned long found = 0;
+    unsigned long split = 0;
+    unsigned long right = 0;
+    double gallonsError = 0.0;
+    unsigned long matched = 0;
+    const uint64_t offset = Replay::truth.empty() ? 0 : Replay::truth.front().start - source.segments.front().start;
+    for (size_t i = 0; i < source.segments.size(); i++)
+    {
+        const FlowSegment &segment = source.segments[i];
+        unsigned long count = 0;
+        for (const auto &event : Replay::usageEvents)
+        {
+            if (event.first >= segment.end + offset && event.first <= segment.end + offset + (USAGE_EVENTS_STOP_GRACE + 60000) * 1000ULL)
+            {
+                count++;
+                matched++;
+                const double gallons = segment.gpm * double(segment.end - segment.start) / 60e6;
+                gallonsError += std::fabs(atof(strstr(event.second.c_str(), "\"gallons\":") + 10) - gallons) / gallons;
+                const std::string name = std::string("\"fixture\":\"") + UsageEvents::fixtureName(labels[i]) + "\"";
+                right += event.second.find(name) != std::string::npos ? 1 : 0;
+            }
+        }
+        found += count > 0 ? 1 : 0;
+        split += count > 1 ? 1 : 0;
+    }
+    const unsigned long falseEvents = Replay::usageEvents.size() - matched;
+    const double accuracy = matched > 0 ? double(right) / matched : 0.0;
+    gallonsError = matched > 0 ? gallonsError / matched : 1.0;
+
+    printf("uses: %zu, found: %lu, split: %lu, false events: %lu, dropped: %lu\n", source.segments.size(), found, split, falseEvents, UsageEvents::dropped);
+    printf("fixture accuracy: %.1f%% (min %.0f%%), avg gallons error: %.1f%% (max %.0f%%)\n", accuracy * 100.0, EVENTS_MIN_ACCURACY * 100.0, gallonsError * 100.0, EVENTS_MAX_GALLONS_ERROR * 100.0);
+    printf("messages, usage events: %zu, gpm: %zu\n", Replay::usageEvents.size(), Replay::gpmEvents.size());
+    const bool passed = found == source.segments.size() && split == 0 && falseEvents == 0 && UsageEvents::dropped == 0 &&
+                        accuracy >= EVENTS_MIN_ACCURACY && gallonsError <= EVENTS_MAX_GALLONS_ERROR;
+    printf("events: %s\n", passed ? "passed" : "failed");
+    return result == 0 && passed ? 0 : 1;
+}
+
+/**
+ * @brief the period in milliseconds of the signals of the report mode (the ADC blocks)
+ */
+#define REPORT_SAMPLE_PERIOD_MS 25
+
+/**
+ * @brief the share of the GPM publishes that fail in the report mode (to check that the edges still get delivered)
+ */
+#define REPORT_FAILURE_RATE 0.3
+
+/**
+ * @brief a report policy to benchmark
+ */
+struct ReportCase
+{
+    const char *name;
+    double deadband;
+    unsigned long minInterval;
+    double compression;
+    unsigned long maxSilence;
+};
+
+/**
+ * @brief runs a signal (a value every REPORT_SAMPLE_PERIOD_MS) through a report policy, with publishes that may fail at random,
+ * and prints the publishes per hour and the error of the signal, as the controller would get it:
+ * held (the last value, until the next) and interpolated (straight lines between the values)
+ *
+ * @param isEdge the samples that are an edge (ie. the flow start/stop), null for none
+ * @param failureRate the share of the publishes that fail
+ * @param maxError the max error the policy guarantees (held for the deadband, interpolated for the swinging door), 0 for none
+ * @return int non zero, if an edge did not get delivered, or the error is over the guaranteed one
+ */
+static int reportRun(const ReportCase &test, const std::vector<SensorReal> &signal, const std::vector<bool> *isEdge, double failureRate, double maxError, unsigned int seed)
+{
+    ReportPolicy<SensorReal> policy(test.deadband, Duration::millis(test.minInterval), Duration::millis(test.maxSilence), test.compression, isEdge != nullptr ? RESEND_GPM_TIMES : 0, Duration::millis(RESEND_GPM_FREQUENCY));
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<double> chance(0.0, 1.0);
+    std::vector<std::pair<size_t, double>> published;
+    size_t index = 0;
+    for (; index < signal.size(); index++)
+    {
+        const ReportEvent event = isEdge != nullptr && (*isEdge)[index] ? ReportEdge : ReportChange;
+        policy.update(signal[index], Instant() + Duration::millis(index * REPORT_SAMPLE_PERIOD_MS), event, [&](SensorReal value)
+                      {
+                          if (chance(random) < failureRate)
+                          {
+                              return false;
+                          }
+                          published.push_back({index, SensorMath::toFloat(value)});
+                          return true; });
+    }
+
+    // the error of every sample, against the reconstructed signal (before the first publish, against the first value)
+    double heldSquares = 0.0;
+    double heldMax = 0.0;
+    double linearSquares = 0.0;
+    double linearMax = 0.0;
+    size_t next = 0;
+    for (size_t i = 0; i < signal.size() && !published.empty(); i++)
+    {
+        while (next < published.size() && published[next].first <= i)
+        {
+            next++;
+        }
+        const double value = SensorMath::toFloat(signal[i]);
+        const std::pair<size_t, double> &previous = published[next > 0 ? next - 1 : 0];
+        const double held = previous.second;
+        double linear = held;
+        if (next > 0 && next < published.size())
+        {
+            const std::pair<size_t, double> &following = published[next];
+            linear = held + (following.second - held) * double(i - previous.first) / double(following.first - previous.first);
+        }
+        heldSquares += (value - held) * (value - held);
+        heldMax = std::max(heldMax, std::fabs(value - held));
+        linearSquares += (value - linear) * (value - linear);
+        linearMax = std::max(linearMax, std::fabs(value - linear));
+    }
+
+    // every edge (the flow start/stop) gets to the controller, even if its publishes failed
+    unsigned long edges = 0;
+    unsigned long deliveredEdges = 0;
+    if (isEdge != nullptr)
+    {
+        double last = 0.0;
+        for (const auto &value : published)
+        {
+            deliveredEdges += (last == 0.0) != (value.second == 0.0) ? 1 : 0;
+            last = value.second;
+        }
+        bool flowing = false;
+        for (const SensorReal &value : signal)
+        {
+            edges += flowing != (value != 0.0) ? 1 : 0;
+            flowing = value != 0.0;
+        }
+    }
+
+    const double hours = double(signal.size()) * REPORT_SAMPLE_PERIOD_MS / 3600000.0;
+    const double samples = double(signal.size());
+    const bool isErrorKept = maxError == 0.0 || (test.compression != 0.0 ? linearMax : heldMax) <= maxError;
+    const bool isDelivered = deliveredEdges == edges;
+    printf("%-28s publishes/hour: %7.1f (failed: %5lu), held error rms: %.4f max: %.4f, interpolated error rms: %.4f max: %.4f",
+           test.name, double(policy.reports) / hours, policy.failures, std::sqrt(heldSquares / samples), heldMax, std::sqrt(linearSquares / samples), linearMax);
+    if (isEdge != nullptr)
+    {
+        printf(", edges: %lu/%lu", deliveredEdges, edges);
+    }
+    printf("%s\n", isErrorKept && isDelivered ? "" : " (failed)");
+    return isErrorKept && isDelivered ? 0 : 1;
+}
+
+/**
+ * @brief benchmarks the report policies (@see src/reportPolicy.h) on synthetic GPM and PSI signals:
+ * the publishes per hour against the error of the signal the controller gets.
+ *
+ * @return int non zero, if the deadband or the swinging door do not keep their error, or an edge got lost
+ */
+int report(double hours, unsigned int seed)
+{
+    // the flow of the usage events and the pressure: a daily swing, the drop of the flow (through the pipes) and the noise
+    SyntheticTraceSource source(uint64_t(hours * 3600e6), REPORT_SAMPLE_PERIOD_MS * 1000, seed);
+    std::mt19937 random(seed);
+    std::normal_distribution<double> noise(0.0, 0.02);
+    std::vector<SensorReal> gpm;
+    std::vector<bool> isEdge;
+    std::vector<SensorReal> psi;
+    double drop = 0.0;
+    size_t segment = 0;
+    for (uint64_t time = 0; time < uint64_t(hours * 3600e3); time += REPORT_SAMPLE_PERIOD_MS)
+    {
+        while (segment < source.segments.size() && source.segments[segment].end <= time * 1000)
+        {
+            segment++;
+        }
+        const bool isFlowing = segment < source.segments.size() && source.segments[segment].start <= time * 1000;
+        // the flow measured from the pulses is not exactly steady
+        const double flow = isFlowing ? source.segments[segment].gpm * (1.0 + 0.02 * std::sin(time / 7000.0)) : 0.0;
+        isEdge.push_back(!gpm.empty() && (gpm.back() == 0.0) != (flow == 0.0));
+        gpm.push_back(SensorReal(flow));
+        drop += (0.8 * flow - drop) * REPORT_SAMPLE_PERIOD_MS / 2000.0;
+        psi.push_back(SensorReal(55.0 + 1.5 * std::sin(2.0 * M_PI * time / 86400e3) - drop + noise(random)));
+    }
+
+    int failures = 0;
+    printf("GPM (%zu samples, %.0f%% of the publishes fail):\n", gpm.size(), REPORT_FAILURE_RATE * 100.0);
+    const ReportCase gpmCases[] = {
+        {"any change, 1 s (default)", 0.0, SEND_GPM_FREQUENCY, 0.0, SEND_GPM_MAX_SILENCE},
+        {"any change, 5 s", 0.0, 5000, 0.0, SEND_GPM_MAX_SILENCE},
+        {"deadband 0.25", 0.25, 0, 0.0, SEND_GPM_MAX_SILENCE},
+        {"swinging door 0.1", 0.0, 0, 0.1, SEND_GPM_MAX_SILENCE}};
+    for (const ReportCase &test : gpmCases)
+    {
+        failures += reportRun(test, gpm, &isEdge, REPORT_FAILURE_RATE, 0.0, seed);
+    }
+
+    printf("PSI (none of the publishes fail):\n");
+    const ReportCase psiCases[] = {
+        {"delta 2, 15 s (default)", PRESSURE_SENSOR_DELTA, PRESSURE_SENSOR_SEND_FREQUENCY, 0.0, PRESSURE_SENSOR_MAX_SILENCE},
+        {"delta 0.5, 15 s", 0.5, 15000, 0.0, PRESSURE_SENSOR_MAX_SILENCE},
+        {"delta 0.1", 0.1, 0, 0.0, 0},
+        {"delta 0.25", 0.25, 0, 0.0, 0},
+        {"swinging door 0.1", 0.0, 0, 0.1, 0},
+        {"swinging door 0.25", 0.0, 0, 0.25, 0},
+        {"swinging door 0.25, 15 s", 0.0, 15000, 0.25, PRESSURE_SENSOR_MAX_SILENCE}};
+    for (const ReportCase &test : psiCases)
+    {
+        // without the rate limit (and the failures), the error is guaranteed
+        // (with the swinging door, the interpolated one is within twice the compression, give or take a sample)
+        const double maxError = test.minInterval == 0 ? (test.compression != 0.0 ? test.compression * 2.0 + 0.05 : test.deadband) : 0.0;
+        failures += reportRun(test, psi, nullptr, 0.0, maxError, seed);
+    }
+
+    printf("report: %s\n", failures == 0 ? "passed" : "failed");
+    return failures == 0 ? 0 : 1;
+}
+
+/**
+ * @brief the synthetic dial of the fusion mode: its (not learned yet) cycles per gallon,
+ * the share of the second harmonic of its IR signal (a dial that is not a perfect sine, so the crossings are not evenly spaced)
+ * and the flow it runs at first (to learn the cycles per gallon), in seconds and GPM
+ */
+#define FUSION_CYCLES_PER_GALLON 11.6
+#define FUSION_IR_HARMONIC 0.3
+#define FUSION_WARMUP_SECONDS 90
+#define FUSION_WARMUP_GPM 3.0
+
+/**
+ * @brief the max time for the fused estimate to settle within FUSION_SETTLE_ERROR (of the flow), once the flow stops changing,
+ * for the fusion mode to pass: FUSION_MAX_SETTLE_SECONDS or FUSION_MAX_SETTLE_CROSSINGS crossings (at the low flows), whichever is longer
+ */
+#define FUSION_MAX_SETTLE_SECONDS 10.0
+#define FUSION_MAX_SETTLE_CROSSINGS 4
+#define FUSION_SETTLE_ERROR 0.1
+
+/**
+ * @brief a flow profile of the fusion mode: from start to end GPM (a ramp over rampSeconds, a step for 0) and then held
+ */
+struct FusionCase
+{
+    const char *name;
+    double startGpm;
+    double endGpm;
+    double rampSeconds;
+    double holdSeconds;
+};
+
+/**
+ * @brief the error of a flow estimate over a profile
+ */
+struct FusionError
+{
+    double squares = 0.0;
+    double max = 0.0;
+    double settleTime = 0.0;
+    unsigned long samples = 0;
+
+    void add(double error)
+    {
+        squares += error * error;
+        max = std::max(max, std::fabs(error));
+        samples++;
+    }
+
+    double rms() const
+    {
+        return samples > 0 ? std::sqrt(squares / samples) : 0.0;
+    }
+};
+
+/**
+ * @brief runs a flow profile through the flow detection (one IR value per ADC block and one pulse per gallon, on time)
+ * and compares the flow estimates, every ADC block: the pulses only (the time between the pulses and its decay since the last one),
+ * the dial rotation frequency (@see FlowDetector::gpm()) and the fused one (@see FlowEstimator), all three with the pulses as fallback,
+ * as the firmware would have it before the estimates are known.
+ *
+ * @return int non zero, if the fused estimate is worse than the others, does not settle in time once the flow stops changing,
+ * or the flow detection drops (the flow never stops)
+ */
+static int fusionRun(const FusionCase &test, unsigned int seed)
+{
+    const uint64_t period = 1000000ULL * ADC_SAMPLER_BLOCK_SIZE / ADC_SAMPLER_RATE;
+    std::mt19937 random(seed);
+    std::normal_distribution<double> noise(0.0, 0.6);
+    FlowDetector::reset();
+    FlowDetector::calibrated = false;
+    FlowDetector::cyclesPerGallon = uint32_t(FLOW_DETECTOR_CYCLES_PER_GALLON) << 8;
+    FlowEstimator::reset();
+
+    const double start = FUSION_WARMUP_SECONDS;
+    const double end = start + test.rampSeconds + test.holdSeconds;
+    double gallons = 0.0;
+    uint64_t lastPulse = 0;
+    uint64_t pulseInterval = 0;
+    FusionError errors[3];
+    double unsettled[3] = {0.0, 0.0, 0.0};
+    double dropped = 0.0;
+    unsigned long pulses = 0;
+    for (uint64_t time = period; time < uint64_t(end * 1e6); time += period)
+    {
+        const double seconds = time / 1e6;
+        double flow = seconds < start - 30.0 ? FUSION_WARMUP_GPM : test.startGpm;
+        if (seconds >= start)
+        {
+            flow = test.rampSeconds > 0.0 && seconds < start + test.rampSeconds ? test.startGpm + (test.endGpm - test.startGpm) * (seconds - start) / test.rampSeconds : test.endGpm;
+        }
+
+        const double prevGallons = gallons;
+        gallons += flow * period / 60e6;
+        const double phase = 2.0 * M_PI * gallons * FUSION_CYCLES_PER_GALLON;
+        FlowDetector::update(int(std::lround(500.0 + 20.0 * (std::sin(phase) + FUSION_IR_HARMONIC * std::sin(2.0 * phase + 1.0)) + noise(random))), Instant::fromMicros(time));
+        FlowEstimator::update();
+        if (std::floor(gallons) > std::floor(prevGallons))
+        {
+            // on time, within the block
+            const uint64_t pulseTime = time - period + uint64_t(period * (std::floor(gallons) - prevGallons) / (gallons - prevGallons));
+            pulseInterval = pulses > 0 ? pulseTime - lastPulse : 0;
+            lastPulse = pulseTime;
+            pulses++;
+            FlowDetector::onPulse(Instant::fromMicros(pulseTime));
+            FlowEstimator::onPulse(Instant::fromMicros(pulseTime));
+        }
+        if (seconds < start)
+        {
+            continue;
+        }
+        if (!FlowDetector::isActive)
+        {
+            dropped += period / 1e6;
+        }
+
+        // the pulses only, as PulseSensor::updateGPMOnPulse() and PulseSensor::updateGPM() have it
+        const uint64_t since = time - lastPulse;
+        const double pulsesGpm = pulseInterval == 0 ? MIN_GPM : 60e6 / double(std::max(pulseInterval, since));
+        const double dialGpm = FlowDetector::gpm(Instant::fromMicros(time)) / 1000.0;
+        const double fusedGpm = FlowEstimator::gpm(Instant::fromMicros(time)) / 1000.0;
+        const double estimates[3] = {pulsesGpm, dialGpm > 0.0 ? dialGpm : pulsesGpm, fusedGpm > 0.0 ? fusedGpm : pulsesGpm};
+        for (int i = 0; i < 3; i++)
+        {
+            const double error = estimates[i] - flow;
+            errors[i].add(error);
+            if (seconds >= start + test.rampSeconds)
+            {
+                if (std::fabs(error) > flow * FUSION_SETTLE_ERROR)
+                {
+                    unsettled[i] = seconds;
+                }
+            }
+        }
+    }
+
+    printf("%-10s %5.2f -> %5.2f GPM over %3.0f s:", test.name, test.startGpm, test.endGpm, test.rampSeconds);
+    const char *names[3] = {"pulses", "dial", "fused"};
+    for (int i = 0; i < 3; i++)
+    {
+        errors[i].settleTime = unsettled[i] > 0.0 ? unsettled[i] - start - test.rampSeconds : 0.0;
+        printf("  %s rms %.3f max %.2f settle %5.1f s", names[i], errors[i].rms(), errors[i].max, errors[i].settleTime);
+    }
+    printf("  dropped %.1f s\n", dropped);
+
+    const FusionError &fused = errors[2];
+    const double crossingSeconds = 30.0 / (test.endGpm * FUSION_CYCLES_PER_GALLON);
+    const bool settled = fused.settleTime <= std::max(FUSION_MAX_SETTLE_SECONDS, FUSION_MAX_SETTLE_CROSSINGS * crossingSeconds);
+    // no worse than the dial rotation frequency (between the pulses) and than the pulses (when the flow changes, a steady one they get right)
+    const bool changes = test.startGpm != test.endGpm;
+    const bool better = fused.rms() <= errors[1].rms() && (!changes || fused.rms() <= errors[0].rms());
+    // the flow never stops, so the detection must not drop either
+    const bool detected = dropped == 0.0;
+    if (!settled || !better || !detected)
+    {
+        printf("%s: failed (%s)\n", test.name, !detected ? "dropped" : settled ? "worse" : "not settled");
+    }
+    return settled && better && detected ? 0 : 1;
+}
+
+/**
+ * @brief checks the fused flow estimate (@see src/flowEstimator.h) on synthetic ramps and steps of the flow,
+ * against the pulses only and the dial rotation frequency estimates
+ *
+ * @return int non zero, if any profile fails (@see fusionRun())
+ */
+int fusion(unsigned int seed)
+{
+    const FusionCase cases[] = {
+        {"ramp up", 0.5, 6.0, 120.0, 60.0},
+        {"ramp down", 6.0, 0.5, 120.0, 60.0},
+        {"slow ramp", 1.0, 2.0, 600.0, 60.0},
+        {"step up", 1.0, 5.0, 0.0, 120.0},
+        {"step down", 5.0, 2.0, 0.0, 120.0},
+        // the crossings come ten times further apart all of a sudden, while the dial keeps moving
+        {"sharp drop", 5.0, 0.5, 0.0, 180.0},
+        {"low flow", 0.4, 0.4, 0.0, 600.0},
+        {"high flow", 12.0, 12.0, 0.0, 120.0}};
+    int failures = 0;
+    for (const FusionCase &test : cases)
+    {
+        failures += fusionRun(test, seed);
+    }
+    printf("fusion: %s\n", failures == 0 ? "passed" : "failed");
+    return failures == 0 ? 0 : 1;
+}
+
+/**
+ * @brief a pulse switch profile of the pulses mode: the presses (one per gallon), how far apart and how long they are (in seconds),
+ * how many times the switch bounces on every press and release and if it chatters (short releases) while pressed,
+ * as a switch the meter stopped on may do
+ */
+struct PulseCase
+{
+    const char *name;
+    int presses;
+    double interval;
+    double pressTime;
+    int bounces;
+    bool chatters;
+};
+
+/**
+ * @brief the chatter of a pressed switch in the pulses mode: a short release (in microseconds), every PULSES_CHATTER_PERIOD (in milliseconds)
+ */
+#define PULSES_CHATTER_TIME 1000
+#define PULSES_CHATTER_PERIOD 300
+
+/**
+ * @brief switches the pulse pin to the level, after bouncing on it (random, sub-millisecond to 2 ms toggles)
+ * and drains the captured pulses as the sampling core would, counting them and their max timing error against the time of the first edge
+ */
+static void pulseSwitch(int level, int bounces, std::mt19937 &random, unsigned long &pulses, double &maxError)
+{
+    std::uniform_int_distribution<int> bounceTime(100, 2000);
+    const Instant edgeTime = MonotonicClock::now();
+    for (int i = 0; i < bounces; i++)
+    {
+        Hal::setDigital(PULSE_SENSOR_PIN, level);
+        Hal::advance(bounceTime(random));
+        Hal::setDigital(PULSE_SENSOR_PIN, level == LOW ? HIGH : LOW);
+        Hal::advance(bounceTime(random));
+    }
+    Hal::setDigital(PULSE_SENSOR_PIN, level);
+
+    Instant pulseTime;
+    Duration interval;
+    while (PulseCapture::nextPulse(pulseTime, interval))
+    {
+        pulses++;
+        maxError = std::max(maxError, std::fabs((pulseTime - edgeTime).toMicros() / 1e3));
+    }
+}
+
+/**
+ * @brief runs a pulse switch profile through the pulse capture (@see src/pulseCapture.h)
+ *
+ * @return int non zero, if it does not count exactly one pulse per press, on the time of the press
+ */
+static int pulsesRun(const PulseCase &test, unsigned int seed)
+{
+    std::mt19937 random(seed);
+    Hal::setDigital(PULSE_SENSOR_PIN, HIGH);
+    PulseEdge edge;
+    while (PulseCapture::edges.pop(edge))
+    {
+    }
+    PulseCapture::setup(PULSE_SENSOR_PIN);
+    Hal::advance(uint64_t(test.interval * 1e6));
+
+    unsigned long pulses = 0;
+    double maxError = 0.0;
+    for (int i = 0; i < test.presses; i++)
+    {
+        pulseSwitch(LOW, test.bounces, random, pulses, maxError);
+        if (test.chatters)
+        {
+            for (uint64_t held = 0; held + PULSES_CHATTER_PERIOD * 1000 < test.pressTime * 1e6; held += PULSES_CHATTER_PERIOD * 1000)
+            {
+                Hal::advance(PULSES_CHATTER_PERIOD * 1000 - PULSES_CHATTER_TIME);
+                pulseSwitch(HIGH, 0, random, pulses, maxError);
+                Hal::advance(PULSES_CHATTER_TIME);
+                pulseSwitch(LOW, 0, random, pulses, maxError);
+            }
+        }
+        else
+        {
+            Hal::advance(uint64_t(test.pressTime * 1e6));
+        }
+        pulseSwitch(HIGH, test.bounces, random, pulses, maxError);
+        Hal::advance(uint64_t((test.interval - test.pressTime) * 1e6));
+    }
+
+    const bool passed = pulses == (unsigned long)test.presses && maxError < 1.0;
+    printf("%-10s presses: %d, pulses: %lu, max timing error: %.3f ms, dropped edges: %lu%s\n",
+           test.name, test.presses, pulses, maxError, PulseCapture::droppedEdges, passed ? "" : " (failed)");
+    return passed ? 0 : 1;
+}
+
+/**
+ * @brief checks the debouncing of the pulse switch (@see src/pulseCapture.h) with clean, bouncing and held presses
+ *
+ * @return int non zero, if any profile fails (@see pulsesRun())
+ */
+int pulses(unsigned int seed)
+{
+    const PulseCase cases[] = {
+        {"clean", 20, 12.0, 1.0, 0, false},
+        {"bounce", 20, 12.0, 1.0, 8, false},
+        // 30 GPM, a pulse every 2 seconds
+        {"fast", 50, 2.0, 0.3, 8, false},
+        // the meter stops on the switch for minutes, while it chatters (before, every chatter was a pulse)
+        {"hold", 3, 600.0, 590.0, 8, true}};
+    int failures = 0;
+    for (const PulseCase &test : cases)
+    {
+        failures += pulsesRun(test, seed);
+    }
+    printf("pulses: %s\n", failures == 0 ? "passed" : "failed");
+    return failures == 0 ? 0 : 1;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 2 && strcmp(argv[1], "replay") == 0)
+    {
+        FILE *file = fopen(argv[2], "r");
+        if (file == nullptr)
+        {
+            fprintf(stderr, "could not open trace: %s\n", argv[2]);
+            return 1;
+        }
+        CsvTraceSource source(file);
+        const int result = replay(source, argc > 3 ? strtoull(argv[3], nullptr, 10) : REPLAY_LOOP_PERIOD_US);
+        fclose(file);
+        return result;
+    }
+
+    if (argc > 2 && strcmp(argv[1], "adc") == 0)
+    {
+        Hal::adcSamples = fopen(argv[2], "r");
+        if (Hal::adcSamples == nullptr)
+        {
+            fprintf(stderr, "could not open ADC samples: %s\n", argv[2]);
+            return 1;
+        }
+        return bench(ULONG_MAX, argc > 3 ? strtoul(argv[3], nullptr, 10) : NATIVE_LOOP_PERIOD_US, true);
+    }
+
+    if (argc > 1 && strcmp(argv[1], "detector") == 0)
+    {
+        return detectorBench(argc > 2 ? strtoul(argv[2], nullptr, 10) : NATIVE_LOOP_ITERATIONS * 10);
+    }
+
+    if (argc > 1 && strcmp(argv[1], "math") == 0)
+    {
+        return mathBench(argc > 2 ? strtoul(argv[2], nullptr, 10) : NATIVE_LOOP_ITERATIONS * 10);
+    }
+
+    if (argc > 1 && strcmp(argv[1], "filter") == 0)
+    {
+        FILE *samples = nullptr;
+        if (argc > 3 && (samples = fopen(argv[3], "r")) == nullptr)
+        {
+            fprintf(stderr, "could not open ADC samples: %s\n", argv[3]);
+            return 1;
+        }
+        const int result = filterBench(argc > 2 ? strtoul(argv[2], nullptr, 10) : 10000, samples);
+        if (samples != nullptr)
+        {
+            fclose(samples);
+        }
+        return result;
+    }
+
+    if (argc > 1 && strcmp(argv[1], "leak") == 0)
+    {
+        return leakBench(argc > 2 ? atof(argv[2]) : 0.0, argc > 3 ? atof(argv[3]) : 5.0);
+    }
+
+    if (argc > 1 && strcmp(argv[1], "stress") == 0)
+    {
+        return stress(argc > 2 ? strtoul(argv[2], nullptr, 10) : NATIVE_LOOP_ITERATIONS) == 0 ? 0 : 1;
+    }
+
+    if (argc > 1 && strcmp(argv[1], "network") == 0)
+    {
+        return network(argc > 2 ? atof(argv[2]) : 4.0, argc > 3 ? atof(argv[3]) : 10.0, argc > 4 ? strtoul(argv[4], nullptr, 10) : 1);
+    }
+
+    if (argc > 1 && strcmp(argv[1], "leaks") == 0)
+    {
+        return leaks(argc > 2 ? std::max(atoi(argv[2]), 6) : 6, argc > 3 ? strtoul(argv[3], nullptr, 10) : 1);
+    }
+
+    if (argc > 1 && strcmp(argv[1], "report") == 0)
+    {
+        return report(argc > 2 ? atof(argv[2]) : SYNTHETIC_HOURS, argc > 3 ? strtoul(argv[3], nullptr, 10) : 1);
+    }
+
+    if (argc > 1 && strcmp(argv[1], "fusion") == 0)
+    {
+        return fusion(argc > 2 ? strtoul(argv[2], nullptr, 10) : 1);
+    }
+
+    if (argc > 1 && strcmp(argv[1], "pulses") == 0)
+    {
+        return pulses(argc > 2 ? strtoul(argv[2], nullptr, 10) : 1);
+    }
+
+    if (argc > 1 && strcmp(argv[1], "calibration") == 0)
+    {
+        return calibration(argc > 2 ? atof(argv[2]) : CALIBRATION_IR_NOISE, argc > 3 ? atoi(argv[3]) : CALIBRATION_HYSTERESIS,
+                           argc > 4 ? std::max(atoi(argv[4]), 2) : CALIBRATION_DAYS, argc > 5 ? strtoul(argv[5], nullptr, 10) : 1);
+    }
+
+#ifdef VALVE_ENABLED
+    if (argc > 1 && strcmp(argv[1], "valve") == 0)
+    {
+        return valve(argc > 2 ? strtoul(argv[2], nullptr, 10) : 1);
+    }
+#endif
+
+    if (argc > 1 && strcmp(argv[1], "wrap") == 0)
+    {
+        return wrap(argc > 2 ? atof(argv[2]) : WRAP_HOURS, argc > 3 ? strtoul(argv[3], nullptr, 10) : 1);
+    }
+
+    if (argc > 1 && strcmp(argv[1], "events") == 0)
+    {
+        return events(argc > 2 ? atof(argv[2]) : EVENTS_HOURS, argc > 3 ? strtoul(argv[3], nullptr, 10) : 1);
+    }
+
+    if (argc > 1 && strcmp(argv[1], "config") == 0)
+    {
+        return config();
+    }
+
+    if (argc > 1 && strcmp(argv[1], "totalizer") == 0)
+    {
+        return totalizer(argc > 2 ? strtoul(argv[2], nullptr, 10) : 2000, argc > 3 ? strtoul(argv[3], nullptr, 10) : 1);
+    }
+
+    if (argc > 1 && strcmp(argv[1], "telemetry") == 0)
+    {
+        return telemetry(argc > 2 ? atof(argv[2]) : 1.0, argc > 3 ? strtoul(argv[3], nullptr, 10) : 1);
+    }
+
+    if (argc > 1 && strcmp(argv[1], "soak") == 0)
+    {
+        return soak(argc > 2 ? atof(argv[2]) : SYNTHETIC_HOURS, REPLAY_LOOP_PERIOD_US, argc > 3 ? strtoul(argv[3], nullptr, 10) : 1);
+    }
+
+    if (argc > 1 && strcmp(argv[1], "synthetic") == 0)
+    {
+        const double hours = argc > 2 ? atof(argv[2]) : SYNTHETIC_HOURS;
+        const unsigned int seed = argc > 3 ? strtoul(argv[3], nullptr, 10) : 1;
+        const uint64_t period = argc > 4 ? strtoull(argv[4], nullptr, 10) : REPLAY_LOOP_PERIOD_US;
+        SyntheticTraceSource source(uint64_t(hours * 3600e6), period, seed);
+        return replay(source, period);
+    }
+
+    return bench(argc > 1 ? strtoul(argv[1], nullptr, 10) : NATIVE_LOOP_ITERATIONS,
+                 argc > 2 ? strtoul(argv[2], nullptr, 10) : NATIVE_LOOP_PERIOD_US,
+                 false);
+}
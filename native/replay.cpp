@@ -0,0 +1,348 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include "firmware.h"
+#include "hal.h"
+#include "replay.h"
+#include "ArduinoHA.h"
+#include "../src/pulseSensor.h"
+#include "../src/connection.h"
+#include "../src/offlineStore.h"
+
+
+CsvTraceSource::CsvTraceSource(FILE *file) : file(file)
+{
+}
+
+bool CsvTraceSource::next(TraceSample &sample)
+{
+    char line[128];
+    while (fgets(line, sizeof(line), CsvTraceSource::file) != nullptr)
+    {
+        double time;
+        int flow = -1;
+        const int fields = sscanf(line, "%lf,%d,%d,%d", &time, &sample.pulse, &sample.ir, &flow);
+        if (fields >= 3)
+        {
+            sample.time = uint64_t(time * 1000.0);
+            sample.flow = flow;
+            return true;
+        }
+    }
+    return false;
+}
+
+SyntheticTraceSource::SyntheticTraceSource(uint64_t duration, uint64_t samplePeriod, unsigned int seed)
+    : duration(duration), samplePeriod(samplePeriod), random(seed), noise(0.0, 1.0)
+{
+    // a water usage event every 5-40 minutes, lasting 20 seconds to 10 minutes, at 0.2-6 GPM
+    std::uniform_real_distribution<double> gap(5.0 * 60e6, 40.0 * 60e6);
+    std::uniform_real_distribution<double> length(20e6, 10.0 * 60e6);
+    std::uniform_real_distribution<double> rate(0.2, 6.0);
+    uint64_t time = uint64_t(gap(SyntheticTraceSource::random));
+    while (time < duration)
+    {
+        const uint64_t end = time + uint64_t(length(SyntheticTraceSource::random));
+        SyntheticTraceSource::segments.push_back({time, end < duration ? end : duration, rate(SyntheticTraceSource::random)});
+        time = end + uint64_t(gap(SyntheticTraceSource::random));
+    }
+}
+
+/**
+ * @brief removes the water usage events of the first hours of every day (the trace starts at midnight)
+ */
+void SyntheticTraceSource::addQuietNights(double hours)
+{
+    std::vector<FlowSegment> segments;
+    for (const FlowSegment &segment : SyntheticTraceSource::segments)
+    {
+        const uint64_t dayStart = segment.start / 86400000000ULL * 86400000000ULL;
+        const uint64_t nightEnd = dayStart + uint64_t(hours * 3600e6);
+        if (segment.start >= nightEnd && segment.end <= dayStart + 86400000000ULL)
+        {
+            segments.push_back(segment);
+        }
+    }
+    SyntheticTraceSource::segments = segments;
+}
+
+bool SyntheticTraceSource::next(TraceSample &sample)
+{
+    if (SyntheticTraceSource::time >= SyntheticTraceSource::duration)
+    {
+        return false;
+    }
+
+    // find the water usage event we are in (if any)
+    while (SyntheticTraceSource::segment < SyntheticTraceSource::segments.size() && SyntheticTraceSource::segments[SyntheticTraceSource::segment].end <= SyntheticTraceSource::time)
+    {
+        SyntheticTraceSource::segment++;
+    }
+    double gpm = 0.0;
+    if (SyntheticTraceSource::segment < SyntheticTraceSource::segments.size() && SyntheticTraceSource::segments[SyntheticTraceSource::segment].start <= SyntheticTraceSource::time)
+    {
+        gpm = SyntheticTraceSource::segments[SyntheticTraceSource::segment].gpm;
+    }
+    for (const FlowSegment &leak : SyntheticTraceSource::leaks)
+    {
+        gpm += SyntheticTraceSource::time >= leak.start && SyntheticTraceSource::time < leak.end ? leak.gpm : 0.0;
+    }
+    gpm *= SyntheticTraceSource::supply != nullptr ? SyntheticTraceSource::supply() : 1.0;
+
+    // integrate the flow into gallons and dial revolutions
+    const double gallons = gpm * double(SyntheticTraceSource::samplePeriod) / 60e6;
+    SyntheticTraceSource::gallons += gallons;
+    SyntheticTraceSource::dialPhase += 2.0 * M_PI * gallons * SYNTHETIC_DIAL_REVOLUTIONS_PER_GALLON;
+
+    sample.time = SyntheticTraceSource::time;
+    sample.flow = gpm > 0.0 ? 1 : 0;
+    sample.pulse = SyntheticTraceSource::gallons - std::floor(SyntheticTraceSource::gallons) < SYNTHETIC_PULSE_DUTY && SyntheticTraceSource::gallons >= 1.0 ? LOW : HIGH;
+    sample.ir = int(std::lround(SyntheticTraceSource::irBase + SyntheticTraceSource::irAmplitude * std::sin(SyntheticTraceSource::dialPhase) + SyntheticTraceSource::irNoise * SyntheticTraceSource::noise(SyntheticTraceSource::random)));
+
+    SyntheticTraceSource::time += SyntheticTraceSource::samplePeriod;
+    return true;
+}
+
+// GPM values the firmware published
+std::vector<Replay::Event> Replay::gpmEvents;
+
+// gallon counter values the firmware published
+std::vector<Replay::Event> Replay::gallonsEvents;
+
+// the ground truth water usage events of the trace
+std::vector<FlowSegment> Replay::truth;
+
+// number of pulses (falling edges) in the trace
+unsigned long Replay::pulses = 0;
+
+// the periods the WiFi is not available
+std::vector<Outage> Replay::outages;
+
+// the time it took to reconnect, after the end of every outage
+std::vector<uint64_t> Replay::reconnectLatencies;
+
+// the longest (virtual) time a single loop iteration took and the time of all of them
+uint64_t Replay::maxLoopStall = 0;
+uint64_t Replay::totalLoopStall = 0;
+
+// number of pulses in the trace, while the firmware was disconnected
+unsigned long Replay::offlinePulses = 0;
+
+// the stored readings the firmware published once reconnected and the gallons among them
+unsigned long Replay::offlineRecords = 0;
+double Replay::offlineGallons = 0.0;
+
+// the leak alarm descriptions the firmware published
+std::vector<std::pair<uint64_t, std::string>> Replay::leakAlarms;
+
+// the usage event summaries the firmware published
+std::vector<std::pair<uint64_t, std::string>> Replay::usageEvents;
+
+/**
+ * @brief boots the firmware and runs its loop() every loopPeriod microseconds of virtual time,
+ *        while applying the trace samples to the pins, as their time comes.
+ *
+ * @param source
+ * @param loopPeriod in microseconds
+ */
+void Replay::run(TraceSource &source, uint64_t loopPeriod)
+{
+    Hal::onPublish = [](const char *topic, const char *payload)
+    {
+        if (strcmp(topic, REPLAY_GPM_TOPIC) == 0)
+        {
+            Replay::gpmEvents.push_back({Hal::clock, atof(payload)});
+        }
+        else if (strcmp(topic, REPLAY_GALLONS_TOPIC) == 0)
+        {
+            Replay::gallonsEvents.push_back({Hal::clock, atof(payload)});
+        }
+        else if (strcmp(topic, REPLAY_LEAK_ALARM_TOPIC) == 0)
+        {
+            Replay::leakAlarms.push_back({Hal::clock, payload});
+        }
+        else if (strcmp(topic, REPLAY_USAGE_EVENT_TOPIC) == 0)
+        {
+            Replay::usageEvents.push_back({Hal::clock, payload});
+        }
+        else if (strcmp(topic, REPLAY_OFFLINE_TOPIC) == 0)
+        {
+            // [[seconds ago,"type",value],...]
+            for (const char *record = strchr(payload + 1, '['); record != nullptr; record = strchr(record + 1, '['))
+            {
+                Replay::offlineRecords++;
+                const char *value = strchr(strchr(record, '"') + 1, '"') + 2;
+                if (strncmp(strchr(record, '"') + 1, "gallons", 7) == 0)
+                {
+                    Replay::offlineGallons += atof(value);
+                }
+            }
+        }
+    };
+
+    firmwareSetup();
+
+    // the trace starts, when the firmware starts looping
+    const uint64_t offset = Hal::clock;
+    TraceSample sample;
+    int lastPulse = HIGH;
+    int lastFlow = 0;
+    uint64_t outageEnd = 0;
+    bool hasSample = source.next(sample);
+    while (hasSample)
+    {
+        bool wifiAvailable = true;
+        bool brokerAvailable = true;
+        for (const Outage &outage : Replay::outages)
+        {
+            const bool available = Hal::clock - offset < outage.start || Hal::clock - offset >= outage.end;
+            wifiAvailable = wifiAvailable && (outage.isBroker || available);
+            brokerAvailable = brokerAvailable && (!outage.isBroker || available);
+        }
+        if (wifiAvailable != Hal::wifiAvailable || brokerAvailable != Hal::brokerAvailable)
+        {
+            Hal::wifiAvailable = wifiAvailable;
+            Hal::brokerAvailable = brokerAvailable;
+            outageEnd = wifiAvailable && brokerAvailable ? Hal::clock : 0;
+        }
+
+        while (hasSample && sample.time + offset <= Hal::clock)
+        {
+            if (sample.pulse == LOW && lastPulse != LOW)
+            {
+                Replay::pulses++;
+                Replay::offlinePulses += Connection::isConnected() ? 0 : 1;
+            }
+            lastPulse = sample.pulse;
+            Hal::setDigital(PULSE_SENSOR_PIN, sample.pulse);
+            Hal::setAnalog(IR_SENSOR_PIN, sample.ir);
+
+            if (sample.flow == 1 && lastFlow != 1)
+            {
+                Replay::truth.push_back({sample.time + offset, UINT64_MAX, 0.0});
+            }
+            else if (sample.flow == 0 && lastFlow == 1)
+            {
+                Replay::truth.back().end = sample.time + offset;
+            }
+            lastFlow = sample.flow;
+
+            hasSample = source.next(sample);
+        }
+        const unsigned long connects = Connection::connects;
+        const uint64_t loopStart = Hal::clock;
+        firmwareLoop();
+        // the virtual clock only moves within the loop, when it waits (delay())
+        Replay::maxLoopStall = std::max(Replay::maxLoopStall, Hal::clock - loopStart);
+        Replay::totalLoopStall += Hal::clock - loopStart;
+        if (Connection::connects != connects && outageEnd != 0)
+        {
+            Replay::reconnectLatencies.push_back(Hal::clock - outageEnd);
+            outageEnd = 0;
+        }
+        Hal::advance(loopPeriod);
+    }
+}
+
+/**
+ * @brief prints the summary of the last run
+ *
+ * @param wallSeconds the (host) time the run took
+ */
+void Replay::report(double wallSeconds)
+{
+    double gallons = 0.0;
+    for (const Event &event : Replay::gallonsEvents)
+    {
+        gallons += event.value;
+    }
+
+    unsigned long detectedStarts = 0;
+    unsigned long detectedStops = 0;
+    double startLatency = 0.0;
+    double stopLatency = 0.0;
+    double maxStartLatency = 0.0;
+    double maxStopLatency = 0.0;
+    for (size_t i = 0; i < Replay::truth.size(); i++)
+    {
+        const FlowSegment &segment = Replay::truth[i];
+        const uint64_t nextStart = i + 1 < Replay::truth.size() ? Replay::truth[i + 1].start : UINT64_MAX;
+        bool started = false;
+        for (const Event &event : Replay::gpmEvents)
+        {
+            if (!started && event.time >= segment.start && event.time < segment.end && event.value > 0.0)
+            {
+                started = true;
+                detectedStarts++;
+                const double latency = double(event.time - segment.start) / 1e6;
+                startLatency += latency;
+                maxStartLatency = std::fmax(maxStartLatency, latency);
+            }
+            else if (segment.end != UINT64_MAX && event.time >= segment.end && event.time < nextStart && event.value == 0.0)
+            {
+                detectedStops++;
+                const double latency = double(event.time - segment.end) / 1e6;
+                stopLatency += latency;
+                maxStopLatency = std::fmax(maxStopLatency, latency);
+                break;
+            }
+        }
+    }
+
+    // flow starts that were reported while no water was flowing
+    unsigned long falseStarts = 0;
+    double lastValue = 0.0;
+    for (const Event &event : Replay::gpmEvents)
+    {
+        if (lastValue == 0.0 && event.value > 0.0)
+        {
+            bool flowing = false;
+            for (const FlowSegment &segment : Replay::truth)
+            {
+                flowing = flowing || (event.time >= segment.start && event.time < segment.end);
+            }
+            falseStarts += flowing ? 0 : 1;
+        }
+        lastValue = event.value;
+    }
+
+    const double virtualSeconds = double(Hal::clock) / 1e6;
+    printf("virtual time: %.1f s, wall time: %.3f s (%.0fx real-time)\n", virtualSeconds, wallSeconds, wallSeconds > 0.0 ? virtualSeconds / wallSeconds : 0.0);
+    printf("pulses: %lu, gallons reported: %.0f\n", Replay::pulses, gallons);
+    printf("gpm events: %zu, gallons events: %zu\n", Replay::gpmEvents.size(), Replay::gallonsEvents.size());
+    if (!Replay::truth.empty())
+    {
+        printf("flow events: %zu, starts detected: %lu, stops detected: %lu, false starts: %lu\n", Replay::truth.size(), detectedStarts, detectedStops, falseStarts);
+        printf("start latency avg: %.1f s, max: %.1f s\n", detectedStarts > 0 ? startLatency / detectedStarts : 0.0, maxStartLatency);
+        printf("stop latency avg: %.1f s, max: %.1f s\n", detectedStops > 0 ? stopLatency / detectedStops : 0.0, maxStopLatency);
+    }
+    if (!Replay::outages.empty())
+    {
+        uint64_t latency = 0;
+        uint64_t maxLatency = 0;
+        for (uint64_t reconnectLatency : Replay::reconnectLatencies)
+        {
+            latency += reconnectLatency;
+            maxLatency = std::max(maxLatency, reconnectLatency);
+        }
+        printf("outages: %zu, reconnects: %zu, pulses sampled: %lu\n", Replay::outages.size(), Replay::reconnectLatencies.size(), PulseSensor::pulses);
+        printf("reconnect latency avg: %.1f s, max: %.1f s\n", Replay::reconnectLatencies.empty() ? 0.0 : latency / 1e6 / Replay::reconnectLatencies.size(), maxLatency / 1e6);
+        printf("offline pulses: %lu, stored readings replayed: %lu (gallons: %.0f), spills: %lu, dropped: %lu, left: %lu\n",
+               Replay::offlinePulses, Replay::offlineRecords, Replay::offlineGallons, OfflineStore::spills, OfflineStore::droppedRecords, OfflineStore::size());
+    }
+    if (!Replay::usageEvents.empty())
+    {
+        // {"fixture":"shower",...}
+        std::string fixtures;
+        for (const char *fixture : {"toilet", "faucet", "shower", "bath", "irrigation", "other"})
+        {
+            const std::string name = std::string("\"fixture\":\"") + fixture + "\"";
+            const size_t count = std::count_if(Replay::usageEvents.begin(), Replay::usageEvents.end(), [&](const std::pair<uint64_t, std::string> &event)
+                                               { return event.second.find(name) != std::string::npos; });
+            fixtures += (fixtures.empty() ? "" : ", ") + std::string(fixture) + ": " + std::to_string(count);
+        }
+        printf("usage events: %zu (%s)\n", Replay::usageEvents.size(), fixtures.c_str());
+    }
+    printf("max loop stall: %.3f ms, total: %.3f s\n", Replay::maxLoopStall / 1e3, Replay::totalLoopStall / 1e6);
+}
@@ -0,0 +1,155 @@
+#ifndef REPLAY
+#define REPLAY
+
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+/**
+ * @author Antonios Karagiannis (antokarag@gmail.com)
+ * @brief deterministic trace-replay simulator of the native build.
+ *        drives the firmware loop() from a recorded or synthetic trace of the pulse (D2) and infrared (A1) pins
+ *        on the virtual clock and reports the GPM / gallons events it emitted and the flow start/stop detection latency.
+ */
+
+/**
+ * @brief the MQTT topics (entity unique IDs) the replay listens to
+ */
+#define REPLAY_GPM_TOPIC "waterMonitorFlow"
+#define REPLAY_GALLONS_TOPIC "waterMonitorGallonsCounter"
+#define REPLAY_OFFLINE_TOPIC "waterMonitor:offline"
+#define REPLAY_LEAK_ALARM_TOPIC "waterMonitorLeakAlarm"
+#define REPLAY_USAGE_EVENT_TOPIC "waterMonitor:usageEvent"
+
+/**
+ * @brief dial (flow indicator) revolutions per gallon of the synthetic meter
+ */
+#define SYNTHETIC_DIAL_REVOLUTIONS_PER_GALLON 12.0
+
+/**
+ * @brief the fraction of every gallon (meter revolution), that the synthetic pulse switch stays closed (LOW)
+ */
+#define SYNTHETIC_PULSE_DUTY 0.1
+
+/**
+ * @brief one timestamped sample of the sensor inputs
+ *
+ * flow is the ground truth (1 when water flows, 0 when not), or -1 when unknown
+ */
+struct TraceSample
+{
+    uint64_t time;
+    int pulse;
+    int ir;
+    int flow;
+};
+
+class TraceSource
+{
+public:
+    virtual ~TraceSource() {}
+    virtual bool next(TraceSample &sample) = 0;
+};
+
+/**
+ * @brief reads a recorded trace from a CSV file with lines of:
+ *        time in milliseconds,pulse pin level,IR ADC value[,ground truth flow]
+ *        lines that do not start with a number (ie. headers or comments) are skipped.
+ */
+class CsvTraceSource : public TraceSource
+{
+public:
+    CsvTraceSource(FILE *file);
+    bool next(TraceSample &sample) override;
+
+private:
+    FILE *file;
+};
+
+/**
+ * @brief a water usage event of the synthetic trace
+ */
+struct FlowSegment
+{
+    uint64_t start;
+    uint64_t end;
+    double gpm;
+};
+
+/**
+ * @brief generates a trace of random water usage events (deterministic for a given seed),
+ *        with a sinusoidal IR signal at the dial rotation frequency plus gaussian noise
+ *        and one pulse per gallon.
+ *        leaks (ie. a running toilet) flow on top of the usage events.
+ */
+class SyntheticTraceSource : public TraceSource
+{
+public:
+    SyntheticTraceSource(uint64_t duration, uint64_t samplePeriod, unsigned int seed);
+    bool next(TraceSample &sample) override;
+    void addQuietNights(double hours);
+
+    std::vector<FlowSegment> segments;
+    std::vector<FlowSegment> leaks;
+    int irBase = 500;
+    double irAmplitude = 20.0;
+    double irNoise = 0.6;
+    // the share of the flow the (simulated) shutoff valve lets through, null without one
+    double (*supply)() = nullptr;
+
+private:
+    uint64_t duration;
+    uint64_t samplePeriod;
+    uint64_t time = 0;
+    size_t segment = 0;
+    double gallons = 0.0;
+    double dialPhase = 0.0;
+    std::mt19937 random;
+    std::normal_distribution<double> noise;
+};
+
+/**
+ * @brief a period (relative to the start of the trace) that the WiFi (or only the broker) is not available
+ */
+struct Outage
+{
+    uint64_t start;
+    uint64_t end;
+    bool isBroker = false;
+};
+
+class Replay
+{
+public:
+    /**
+     * @brief a message published by the firmware, at virtual time
+     */
+    struct Event
+    {
+        uint64_t time;
+        double value;
+    };
+
+    // properties
+    static std::vector<Event> gpmEvents;
+    static std::vector<Event> gallonsEvents;
+    static std::vector<FlowSegment> truth;
+    static unsigned long pulses;
+    static std::vector<Outage> outages;
+    static std::vector<uint64_t> reconnectLatencies;
+    static uint64_t maxLoopStall;
+    static uint64_t totalLoopStall;
+    static unsigned long offlinePulses;
+    static unsigned long offlineRecords;
+    static double offlineGallons;
+    static std::vector<std::pair<uint64_t, std::string>> leakAlarms;
+    static std::vector<std::pair<uint64_t, std::string>> usageEvents;
+
+    // methods
+    static void run(TraceSource &source, uint64_t loopPeriod);
+    static void report(double wallSeconds);
+};
+
+#endif // REPLAY
@@ -0,0 +1,125 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <malloc.h>
+#include "firmware.h"
+#include "hal.h"
+#include "replay.h"
+#include "soak.h"
+#include "ArduinoHA.h"
+#include "../src/pulseSensor.h"
+#include "../src/pressureSensor.h"
+#include "../src/device.h"
+#include "../src/switches.h"
+
+/**
+ * @brief virtual time in microseconds, before the allocations count (ie. OTA gets set up on the first connection)
+ */
+#define SOAK_WARM_UP 60000000ULL
+
+/**
+ * @brief the pressure (raw 10bit input) swings between these, every SOAK_PRESSURE_PERIOD microseconds,
+ * so that the pressure debug messages keep coming
+ */
+#define SOAK_PRESSURE_LOW 600
+#define SOAK_PRESSURE_HIGH 660
+#define SOAK_PRESSURE_PERIOD 20000000ULL
+
+/**
+ * @brief the leak test runs for the first minutes of every hour
+ */
+#define SOAK_LEAK_TEST_MINUTES 10
+
+// if the firmware loops are running (only then the allocations count)
+static bool isCounting = false;
+static unsigned long allocations = 0;
+static unsigned long deallocations = 0;
+static unsigned long debugMessages = 0;
+
+void *operator new(size_t size)
+{
+    allocations += isCounting ? 1 : 0;
+    void *pointer = malloc(size > 0 ? size : 1);
+    if (pointer == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+
+void operator delete(void *pointer) noexcept
+{
+    deallocations += isCounting && pointer != nullptr ? 1 : 0;
+    free(pointer);
+}
+
+void operator delete(void *pointer, size_t) noexcept
+{
+    operator delete(pointer);
+}
+
+int soak(double hours, uint64_t period, unsigned int seed)
+{
+    Hal::onPublish = [](const char *topic, const char *)
+    {
+        debugMessages += strncmp(topic, "debug:", 6) == 0 ? 1 : 0;
+    };
+
+    // (the first print allocates the stdout buffer, so it must come before the heap gets sampled)
+    printf("soak: %.1f hours\n", hours);
+    firmwareSetup();
+    Switches::debugSwitch.command(true);
+
+    SyntheticTraceSource source(uint64_t(hours * 3600e6), period, seed);
+    const uint64_t offset = Hal::clock;
+    TraceSample sample;
+    bool hasSample = source.next(sample);
+    bool isLeakTestActive = false;
+    size_t warmHeap = 0;
+    size_t maxHeap = 0;
+    unsigned long hour = 0;
+    unsigned long warmAllocations = 0;
+    while (hasSample)
+    {
+        while (hasSample && sample.time + offset <= Hal::clock)
+        {
+            Hal::setDigital(PULSE_SENSOR_PIN, sample.pulse);
+            Hal::setAnalog(IR_SENSOR_PIN, sample.ir);
+            hasSample = source.next(sample);
+        }
+        const uint64_t time = Hal::clock - offset;
+        Hal::setAnalog(PRESSURE_SENSOR_PIN, (time / SOAK_PRESSURE_PERIOD) % 2 == 0 ? SOAK_PRESSURE_LOW : SOAK_PRESSURE_HIGH);
+        const bool leakTest = time % 3600000000ULL < SOAK_LEAK_TEST_MINUTES * 60000000ULL;
+        if (leakTest != isLeakTestActive)
+        {
+            isLeakTestActive = leakTest;
+            Switches::waterLeakTestSwitch.command(leakTest);
+        }
+
+        isCounting = true;
+        firmwareLoop();
+        isCounting = false;
+
+        if (warmHeap == 0 && time >= SOAK_WARM_UP)
+        {
+            warmHeap = mallinfo2().uordblks;
+            warmAllocations = allocations;
+        }
+        if (time / 3600000000ULL != hour)
+        {
+            hour = time / 3600000000ULL;
+            const size_t heap = mallinfo2().uordblks;
+            maxHeap = heap > maxHeap ? heap : maxHeap;
+            printf("hour %lu: heap in use: %zu bytes, allocations: %lu, debug messages: %lu\n", hour, heap, allocations, debugMessages);
+        }
+        Hal::advance(period);
+    }
+
+    const bool passed = allocations == warmAllocations && maxHeap <= warmHeap;
+    printf("debug messages: %lu, dropped: %lu\n", debugMessages, Device::droppedDebugMessages);
+    printf("allocations after warm-up: %lu (in total: %lu, freed: %lu), heap in use after warm-up: %zu, max: %zu bytes\n",
+           allocations - warmAllocations, allocations, deallocations, warmHeap, maxHeap);
+    printf("soak: %s\n", passed ? "passed" : "failed");
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,19 @@
+#ifndef SOAK
+#define SOAK
+
+#include <cstdint>
+
+/**
+ * @brief host soak test of the heap usage.
+ * replays a synthetic trace with the debug switch on (and a leak test every hour),
+ * so that every debug message path runs over and over, while it counts the heap allocations
+ * the firmware loops make (global operator new/delete) and samples the heap in use every hour.
+ *
+ * @param hours of synthetic trace
+ * @param period virtual time in microseconds, that passes on every loop iteration (and the sample period of the trace)
+ * @param seed of the synthetic trace
+ * @return int non zero, if the loops allocated after the warm-up, or the heap in use grew
+ */
+int soak(double hours, uint64_t period, unsigned int seed);
+
+#endif // SOAK
@@ -0,0 +1,87 @@
+#include <atomic>
+#include <cstdio>
+#include <thread>
+#include "stress.h"
+#include "../src/mailbox.h"
+#include "../src/ringBuffer.h"
+
+/**
+ * @brief a value that can be validated for tearing
+ */
+struct StressValue
+{
+    unsigned long sequence;
+    unsigned long inverted;
+    double payload;
+};
+
+unsigned long stress(unsigned long iterations)
+{
+    Mailbox<StressValue> mailbox;
+    RingBuffer<unsigned long, 64> ring;
+    std::atomic<bool> done{false};
+    unsigned long violations = 0;
+
+    // producer ("core 1")
+    std::thread producer([&]()
+                         {
+                             for (unsigned long i = 1; i <= iterations; i++)
+                             {
+                                 mailbox.write({i, ~i, double(i) * 0.5});
+                                 // wait for room, so that every event must arrive
+                                 while (!ring.push(i))
+                                 {
+                                     std::this_thread::yield();
+                                 }
+                             }
+                             done.store(true, std::memory_order_release); });
+
+    // consumer ("core 0")
+    unsigned long lastSequence = 0;
+    unsigned long lastEvent = 0;
+    unsigned long reads = 0;
+    unsigned long events = 0;
+    while (true)
+    {
+        const bool finished = done.load(std::memory_order_acquire);
+
+        StressValue value;
+        if (mailbox.read(value))
+        {
+            reads++;
+            if (value.inverted != ~value.sequence || value.payload != double(value.sequence) * 0.5 || value.sequence < lastSequence)
+            {
+                violations++;
+            }
+            lastSequence = value.sequence;
+        }
+
+        unsigned long event;
+        while (ring.pop(event))
+        {
+            events++;
+            if (event <= lastEvent)
+            {
+                violations++;
+            }
+            lastEvent = event;
+        }
+
+        if (finished && ring.empty())
+        {
+            break;
+        }
+        std::this_thread::yield();
+    }
+    producer.join();
+
+    if (events != iterations || lastSequence != iterations)
+    {
+        violations++;
+    }
+
+    printf("mailbox writes: %lu, reads: %lu\n", iterations, reads);
+    printf("ring events: %lu, received: %lu\n", iterations, events);
+    printf("violations: %lu\n", violations);
+    return violations;
+}
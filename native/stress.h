@@ -0,0 +1,14 @@
+#ifndef STRESS
+#define STRESS
+
+/**
+ * @brief host harness of the inter-core message passing (src/mailbox.h, src/ringBuffer.h).
+ * runs a producer and a consumer on two real threads and checks that
+ * no value is ever torn (mailbox) and every event arrives once and in order (ring buffer).
+ *
+ * @param iterations number of values/events the producer posts
+ * @return the number of violations found (0 on success)
+ */
+unsigned long stress(unsigned long iterations);
+
+#endif // STRESS
@@ -0,0 +1,100 @@
+#include <algorithm>
+#include "hal.h"
+#include "valveSimulator.h"
+#include "Arduino.h"
+#include "../src/valve.h"
+
+// from 0 (closed) to 1 (open)
+double ValveSimulator::position = 1.0;
+
+// the motor runs, but the valve does not move (ie. a seized ball)
+bool ValveSimulator::isStuck = false;
+
+// where the motor runs (1 to open, -1 to close, 0 when off) and where it ran last
+int ValveSimulator::direction = 0;
+int ValveSimulator::lastDirection = 0;
+
+// when the motor last stopped and last started closing (virtual microseconds)
+uint64_t ValveSimulator::stopTime = 0;
+uint64_t ValveSimulator::closeTime = 0;
+
+// how long the motor has been running at an end (and the longest)
+uint64_t ValveSimulator::limitTime = 0;
+uint64_t ValveSimulator::maxLimitTime = 0;
+
+// both motor pins HIGH, and reversals within VALVE_REVERSE_DELAY of the motor stop
+unsigned long ValveSimulator::shootThroughs = 0;
+unsigned long ValveSimulator::hardReversals = 0;
+
+/**
+ * @brief puts the valve at a position and steps it along with the virtual clock
+ *
+ * @param position from 0 (closed) to 1 (open)
+ */
+void ValveSimulator::attach(double position)
+{
+    ValveSimulator::position = position;
+    ValveSimulator::updateLimits();
+    Hal::onAdvance = ValveSimulator::step;
+}
+
+void ValveSimulator::updateLimits()
+{
+    Hal::setDigital(VALVE_OPENED_PIN, ValveSimulator::position >= 1.0 ? LOW : HIGH);
+    Hal::setDigital(VALVE_CLOSED_PIN, ValveSimulator::position <= 0.0 ? LOW : HIGH);
+}
+
+/**
+ * @brief moves the valve by the motor pins, over the time that passed
+ *
+ * @param micros
+ */
+void ValveSimulator::step(uint64_t micros)
+{
+    const bool isOpening = Hal::digitalValues[VALVE_OPEN_PIN] == HIGH;
+    const bool isClosing = Hal::digitalValues[VALVE_CLOSE_PIN] == HIGH;
+    ValveSimulator::shootThroughs += isOpening && isClosing ? 1 : 0;
+    const int direction = isOpening == isClosing ? 0 : (isOpening ? 1 : -1);
+
+    // the pins changed within the loop iteration before this step
+    const uint64_t changeTime = Hal::clock - micros;
+    if (direction != ValveSimulator::direction)
+    {
+        if (direction == 0)
+        {
+            ValveSimulator::stopTime = changeTime;
+        }
+        else
+        {
+            // reversed while running, or within VALVE_REVERSE_DELAY of the stop
+            const bool isReversal = ValveSimulator::lastDirection == -direction;
+            const bool isHard = ValveSimulator::direction != 0 || changeTime - ValveSimulator::stopTime < VALVE_REVERSE_DELAY * 1000ULL;
+            ValveSimulator::hardReversals += isReversal && isHard ? 1 : 0;
+            ValveSimulator::closeTime = direction < 0 ? changeTime : ValveSimulator::closeTime;
+            ValveSimulator::lastDirection = direction;
+        }
+        ValveSimulator::direction = direction;
+    }
+
+    if (direction == 0)
+    {
+        ValveSimulator::limitTime = 0;
+        return;
+    }
+    if (!ValveSimulator::isStuck)
+    {
+        ValveSimulator::position = std::clamp(ValveSimulator::position + direction * double(micros) / VALVE_SIMULATOR_TRAVEL_TIME, 0.0, 1.0);
+    }
+    const bool isAtEnd = (direction > 0 && ValveSimulator::position >= 1.0) || (direction < 0 && ValveSimulator::position <= 0.0);
+    ValveSimulator::limitTime = isAtEnd ? ValveSimulator::limitTime + micros : 0;
+    ValveSimulator::maxLimitTime = std::max(ValveSimulator::maxLimitTime, ValveSimulator::limitTime);
+    ValveSimulator::updateLimits();
+}
+
+/**
+ * @brief the share of the flow the valve lets through
+ */
+double ValveSimulator::opening()
+{
+    return ValveSimulator::position;
+}
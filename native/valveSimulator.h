@@ -0,0 +1,41 @@
+#ifndef VALVE_SIMULATOR
+#define VALVE_SIMULATOR
+
+#include <cstdint>
+
+/**
+ * @brief virtual time in microseconds of a full travel of the simulated valve (open to closed, or back)
+ */
+#define VALVE_SIMULATOR_TRAVEL_TIME 6000000ULL
+
+/**
+ * @brief host simulation of the motorized shutoff valve (@see src/valve.h), on the GPIO pins of the HAL.
+ * while one of the motor pins is HIGH, the valve moves (linearly, over VALVE_SIMULATOR_TRAVEL_TIME) on the virtual clock
+ * and the limit switch pins go LOW at the ends. it also counts what must never happen to a real valve:
+ * both motor pins HIGH, the motor reversing without a pause and the motor running on, at an end.
+ */
+class ValveSimulator
+{
+public:
+    // properties
+    static double position;
+    static bool isStuck;
+    static int direction;
+    static int lastDirection;
+    static uint64_t stopTime;
+    static uint64_t closeTime;
+    static uint64_t limitTime;
+    static uint64_t maxLimitTime;
+    static unsigned long shootThroughs;
+    static unsigned long hardReversals;
+
+    // methods
+    static void attach(double position);
+    static void step(uint64_t micros);
+    static double opening();
+
+private:
+    static void updateLimits();
+};
+
+#endif // VALVE_SIMULATOR
@@ -0,0 +1,121 @@
+#include <Arduino.h>
+#include "device.h"
+#include "adcSampler.h"
+
+// the double buffers (written by DMA)
+uint16_t AdcSampler::buffers[2][ADC_SAMPLER_BLOCK_SIZE];
+
+// the sampled pins, in ascending order (that's the round-robin order of the ADC)
+int AdcSampler::pins[ADC_SAMPLER_CHANNELS];
+
+// number of blocks completed so far (written by the DMA interrupt)
+volatile uint32_t AdcSampler::completedBlocks = 0;
+
+// time (monotonic microseconds) the last block completed
+volatile uint64_t AdcSampler::completedTime = 0;
+
+// number of blocks handed to the consumer so far
+uint32_t AdcSampler::consumedBlocks = 0;
+
+// number of blocks the consumer missed, because it was too slow
+unsigned long AdcSampler::overruns = 0;
+
+/**
+ * @brief should be called once, from the setup1() function (core 1)
+ *
+ * @param firstPin analog pin (A0-A2)
+ * @param secondPin analog pin (A0-A2)
+ */
+void AdcSampler::setup(int firstPin, int secondPin)
+{
+    AdcSampler::pins[0] = firstPin < secondPin ? firstPin : secondPin;
+    AdcSampler::pins[1] = firstPin < secondPin ? secondPin : firstPin;
+    AdcSampler::start();
+}
+
+/**
+ * @brief called (from the interrupt handler) every time a buffer fills up.
+ * the buffer that just completed, is the one of the previous block count.
+ */
+void AdcSampler::onBlockComplete()
+{
+    AdcSampler::completedTime = MonotonicClock::now().toMicros();
+    AdcSampler::completedBlocks = AdcSampler::completedBlocks + 1;
+}
+
+/**
+ * @brief hands over the latest completed block, if there's a new one
+ *
+ * @param block
+ * @return true when there is a new block
+ * @return false when no block completed since the last call
+ */
+bool AdcSampler::nextBlock(AdcBlock &block)
+{
+    AdcSampler::service();
+
+    // the (64bit) time takes two reads, so read it again if the interrupt completed another block meanwhile
+    uint32_t completed;
+    uint64_t completedTime;
+    do
+    {
+        completed = AdcSampler::completedBlocks;
+        completedTime = AdcSampler::completedTime;
+    } while (completed != AdcSampler::completedBlocks);
+    if (completed == AdcSampler::consumedBlocks)
+    {
+        return false;
+    }
+
+    // we can only hand over the latest block, the older ones have already been overwritten
+    AdcSampler::overruns += completed - AdcSampler::consumedBlocks - 1;
+    AdcSampler::consumedBlocks = completed;
+
+    block.samples = AdcSampler::buffers[(completed - 1) & 1];
+    block.time = Instant::fromMicros(completedTime);
+    return true;
+}
+
+/**
+ * @brief the average of the samples of a pin within the block,
+ * scaled to the ANALOG_READ_RESOLUTION (as if it was an analogRead()).
+ *
+ * @param block
+ * @param pin one of the sampled pins
+ * @return the average value or -1 if the pin is not sampled
+ */
+int AdcSampler::mean(const AdcBlock &block, int pin)
+{
+    return AdcSampler::oversample(block, pin, 0);
+}
+
+/**
+ * @brief the average of the samples of a pin within the block (oversampling and decimation),
+ * scaled to the ANALOG_READ_RESOLUTION, while keeping extraBits of fraction.
+ * averaging N samples of (white) noise lowers it by sqrt(N), so with 256 samples per block
+ * it is worth up to 4 extra bits, on top of the 2 the ADC has over the 10bit ANALOG_READ_RESOLUTION.
+ *
+ * @param block
+ * @param pin one of the sampled pins
+ * @param extraBits the fraction bits to keep (up to 8)
+ * @return the average value (with extraBits of fraction) or -1 if the pin is not sampled
+ */
+int AdcSampler::oversample(const AdcBlock &block, int pin, int extraBits)
+{
+    int channel = 0;
+    while (channel < ADC_SAMPLER_CHANNELS && AdcSampler::pins[channel] != pin)
+    {
+        channel++;
+    }
+    if (channel == ADC_SAMPLER_CHANNELS)
+    {
+        return -1;
+    }
+
+    uint32_t sum = 0;
+    for (int i = channel; i < ADC_SAMPLER_BLOCK_SIZE; i += ADC_SAMPLER_CHANNELS)
+    {
+        sum += block.samples[i];
+    }
+    return int((sum << extraBits) / (ADC_SAMPLER_BLOCK_SAMPLES << (ADC_SAMPLER_RESOLUTION - ANALOG_READ_RESOLUTION)));
+}
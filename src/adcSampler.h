@@ -0,0 +1,84 @@
+#ifndef ADC_SAMPLER
+#define ADC_SAMPLER
+
+#include <stdint.h>
+#include "monotonicTime.h"
+
+/**
+ * @brief total ADC conversions per second (shared, round-robin, by all the channels).
+ * with 2 channels, each one is sampled at half that rate.
+ */
+#define ADC_SAMPLER_RATE 20000
+
+/**
+ * @brief number of analog pins sampled (round-robin)
+ */
+#define ADC_SAMPLER_CHANNELS 2
+
+/**
+ * @brief samples per channel, in every block.
+ * a block is completed every ADC_SAMPLER_BLOCK_SAMPLES * ADC_SAMPLER_CHANNELS / ADC_SAMPLER_RATE seconds
+ * (25.6ms with the defaults), which is also the time a consumer has, to process it.
+ */
+#define ADC_SAMPLER_BLOCK_SAMPLES 256
+
+/**
+ * @brief samples (of all channels, interleaved) in every block
+ */
+#define ADC_SAMPLER_BLOCK_SIZE (ADC_SAMPLER_BLOCK_SAMPLES * ADC_SAMPLER_CHANNELS)
+
+/**
+ * @brief the resolution of the ADC itself. the samples are stored as-is
+ * and scaled down to ANALOG_READ_RESOLUTION, when read.
+ */
+#define ADC_SAMPLER_RESOLUTION 12
+
+/**
+ * @brief a full block of evenly spaced samples.
+ * it remains valid for one block period, after that, it gets overwritten.
+ */
+struct AdcBlock
+{
+    // the interleaved samples of all the channels (in ascending pin order)
+    const uint16_t *samples;
+    // the time the block completed
+    Instant time;
+};
+
+/**
+ * @brief free-running ADC sampling engine.
+ *
+ * the ADC converts the analog pins round-robin at a fixed rate (ADC_SAMPLER_RATE)
+ * and DMA moves the conversions into two (double) buffers, without any CPU involvement.
+ * every time a buffer fills up, it gets handed to the consumer as a block, while DMA fills up the other one.
+ * that way, the sample rate no longer depends on whatever else the loop is doing.
+ *
+ * the hardware specific part (start/service) lives in src/adcSamplerDma.cpp for the board
+ * and in native/adcSamplerNative.cpp for the host.
+ *
+ * must only be used from core 1. while it runs, analogRead() must not be used.
+ */
+class AdcSampler
+{
+public:
+    // properties
+    static uint16_t buffers[2][ADC_SAMPLER_BLOCK_SIZE];
+    static int pins[ADC_SAMPLER_CHANNELS];
+    static volatile uint32_t completedBlocks;
+    static volatile uint64_t completedTime;
+    static uint32_t consumedBlocks;
+    static unsigned long overruns;
+
+    // methods
+    static void setup(int firstPin, int secondPin);
+    static void onBlockComplete();
+    static bool nextBlock(AdcBlock &block);
+    static int mean(const AdcBlock &block, int pin);
+    static int oversample(const AdcBlock &block, int pin, int extraBits);
+
+    // hardware specific
+    static void start();
+    static void service();
+};
+
+#endif // ADC_SAMPLER
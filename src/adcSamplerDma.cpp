@@ -0,0 +1,82 @@
+/**
+ * @brief the RP2040 (board) part of the AdcSampler: free-running ADC + two chained DMA channels.
+ * excluded from the native build (@see platformio.ini).
+ *
+ * @see https://datasheets.raspberrypi.com/rp2040/rp2040-datasheet.pdf (4.9 ADC and Temperature Sensor)
+ */
+#include <Arduino.h>
+#include <hardware/adc.h>
+#include <hardware/dma.h>
+#include <hardware/irq.h>
+#include "adcSampler.h"
+
+/**
+ * @brief the ADC clock, in Hz
+ */
+#define ADC_SAMPLER_ADC_CLOCK 48000000.0f
+
+// one DMA channel per buffer, each one chained to the other, so that there's no gap between the blocks
+static int dmaChannels[2];
+
+/**
+ * @brief DMA_IRQ_1 handler. re-arms the channel that just completed (to start over at its buffer, when chained to again)
+ * and lets the sampler know.
+ */
+static void onDmaComplete()
+{
+    for (int i = 0; i < 2; i++)
+    {
+        if (dma_channel_get_irq1_status(dmaChannels[i]))
+        {
+            dma_channel_acknowledge_irq1(dmaChannels[i]);
+            dma_channel_set_write_addr(dmaChannels[i], AdcSampler::buffers[i], false);
+            AdcSampler::onBlockComplete();
+        }
+    }
+}
+
+void AdcSampler::start()
+{
+    adc_init();
+    uint round_robin_mask = 0;
+    for (int i = 0; i < ADC_SAMPLER_CHANNELS; i++)
+    {
+        adc_gpio_init(AdcSampler::pins[i]);
+        round_robin_mask |= 1u << (AdcSampler::pins[i] - A0);
+    }
+    // start from the first pin, so that the samples are interleaved in ascending pin order
+    adc_select_input(AdcSampler::pins[0] - A0);
+    adc_set_round_robin(round_robin_mask);
+    // write every conversion to the FIFO and request DMA on every sample, keep all 12 bits
+    adc_fifo_setup(true, true, 1, false, false);
+    // a conversion every (1 + div) cycles of the 48MHz ADC clock
+    adc_set_clkdiv(ADC_SAMPLER_ADC_CLOCK / ADC_SAMPLER_RATE - 1);
+
+    dmaChannels[0] = dma_claim_unused_channel(true);
+    dmaChannels[1] = dma_claim_unused_channel(true);
+    for (int i = 0; i < 2; i++)
+    {
+        dma_channel_config config = dma_channel_get_default_config(dmaChannels[i]);
+        channel_config_set_transfer_data_size(&config, DMA_SIZE_16);
+        channel_config_set_read_increment(&config, false);
+        channel_config_set_write_increment(&config, true);
+        channel_config_set_dreq(&config, DREQ_ADC);
+        channel_config_set_chain_to(&config, dmaChannels[1 - i]);
+        dma_channel_configure(dmaChannels[i], &config, AdcSampler::buffers[i], &adc_hw->fifo, ADC_SAMPLER_BLOCK_SIZE, false);
+        dma_channel_set_irq1_enabled(dmaChannels[i], true);
+    }
+
+    // DMA_IRQ_0 is left to the core/WiFi libraries
+    irq_add_shared_handler(DMA_IRQ_1, onDmaComplete, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+    irq_set_enabled(DMA_IRQ_1, true);
+
+    dma_channel_start(dmaChannels[0]);
+    adc_run(true);
+}
+
+/**
+ * @brief nothing to do, DMA runs on its own
+ */
+void AdcSampler::service()
+{
+}
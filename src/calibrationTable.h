@@ -0,0 +1,87 @@
+#ifndef CALIBRATION_TABLE
+#define CALIBRATION_TABLE
+
+#include <stddef.h>
+#include "sensorMath.h"
+
+/**
+ * @brief a measured calibration point: the raw input value of a sensor, for a known value
+ */
+struct CalibrationPoint
+{
+    int raw;
+    double value;
+};
+
+/**
+ * @brief a lookup table of SIZE entries (one for every raw input value),
+ * generated at compile time, by piecewise-linear interpolation between (sorted) calibration points.
+ * raw input values outside of the calibration points, get extrapolated from the first/last segment.
+ *
+ * that way, converting a raw input value is a single table load and
+ * the table itself is a constant, so it gets stored in flash.
+ *
+ * @tparam SIZE the number of raw input values (ie. MAX_ANALOG_PIN_RANGE + 1)
+ */
+template <size_t SIZE>
+class CalibrationTable
+{
+public:
+    SensorReal values[SIZE];
+
+    /**
+     * @brief generates the table (meant for constexpr)
+     *
+     * @param points the calibration points, sorted by raw input value (at least 2)
+     * @param rawScale the multiplier of the raw input value of the points, to the one of the table
+     *        (ie. when the points were measured at a different resolution)
+     */
+    template <size_t POINTS>
+    static constexpr CalibrationTable from(const CalibrationPoint (&points)[POINTS], double rawScale)
+    {
+        static_assert(POINTS >= 2, "CalibrationTable needs at least 2 calibration points");
+
+        CalibrationTable table = {};
+        size_t segment = 0;
+        for (size_t raw = 0; raw < SIZE; raw++)
+        {
+            // the segment this raw input value falls in (or the last one)
+            while (segment < POINTS - 2 && raw > points[segment + 1].raw * rawScale)
+            {
+                segment++;
+            }
+            const double fromRaw = points[segment].raw * rawScale;
+            const double toRaw = points[segment + 1].raw * rawScale;
+            const double value = points[segment].value + (raw - fromRaw) * (points[segment + 1].value - points[segment].value) / (toRaw - fromRaw);
+            table.values[raw] = SensorReal(value);
+        }
+        return table;
+    }
+
+    /**
+     * @brief the calibrated value of the raw input value (clamped to the table)
+     */
+    constexpr SensorReal operator[](int raw) const
+    {
+        return this->values[raw < 0 ? 0 : (raw >= int(SIZE) ? int(SIZE) - 1 : raw)];
+    }
+
+    /**
+     * @brief the calibrated value of a raw input value with fraction bits (ie. oversampled),
+     * interpolated between the table entries
+     *
+     * @param value the raw input value * 2^fractionBits
+     * @param fractionBits
+     */
+    constexpr SensorReal interpolate(uint32_t value, int fractionBits) const
+    {
+        const uint32_t raw = value >> fractionBits;
+        if (raw >= SIZE - 1)
+        {
+            return this->values[SIZE - 1];
+        }
+        return this->values[raw] + SensorMath::fraction(this->values[raw + 1] - this->values[raw], value & ((uint32_t(1) << fractionBits) - 1), fractionBits);
+    }
+};
+
+#endif // CALIBRATION_TABLE
@@ -0,0 +1,278 @@
+#include <ArduinoHA.h>
+#include <LittleFS.h>
+#include <math.h>
+#include "device.h"
+#include "crc.h"
+#include "config.h"
+#include "switches.h"
+#include "pulseSensor.h"
+#include "pressureSensor.h"
+#include "flowDetector.h"
+#include "leakDetector.h"
+
+// the parameters, in the order of ConfigParameter
+const ConfigDefinition Config::definitions[CONFIG_PARAMETERS] = {
+    {"Flow Hysteresis", "", HABaseDeviceType::PrecisionP0, 1, 64, 1, FLOW_DETECTOR_HYSTERESIS},
+    {"Flow Auto Hysteresis", "", HABaseDeviceType::PrecisionP0, 0, 1, 1, 1},
+    {"Flow Start Crossings", "", HABaseDeviceType::PrecisionP0, 2, 32, 1, FLOW_DETECTOR_START_CROSSINGS},
+    {"Flow Max Stop Timeout", "s", HABaseDeviceType::PrecisionP0, FLOW_DETECTOR_MIN_STOP_TIMEOUT / 1000, 120, 1, FLOW_DETECTOR_MAX_STOP_TIMEOUT / 1000},
+    {"GPM Send Frequency", "ms", HABaseDeviceType::PrecisionP0, 250, 60000, 250, SEND_GPM_FREQUENCY},
+    {"Pressure Delta", "psi", HABaseDeviceType::PrecisionP2, 1, 1000, 1, int32_t(PRESSURE_SENSOR_DELTA * 100)},
+    {"Pressure Send Frequency", "s", HABaseDeviceType::PrecisionP0, 1, 3600, 1, PRESSURE_SENSOR_SEND_FREQUENCY / 1000},
+    {"Pressure Offset", "psi", HABaseDeviceType::PrecisionP2, -1000, 1000, 1, 0},
+    {"Leak Continuous Flow", "min", HABaseDeviceType::PrecisionP0, 5, 1440, 1, LEAK_DETECTOR_CONTINUOUS_FLOW},
+    {"Leak Event Gallons", "gal", HABaseDeviceType::PrecisionP0, 10, 2000, 1, LEAK_DETECTOR_EVENT_GALLONS}};
+
+// the entities, in the order of ConfigParameter (with the precision of the definitions)
+HANumber Config::numbers[CONFIG_PARAMETERS] = {
+    HANumber("waterMonitorConfigFlowHysteresis", HANumber::PrecisionP0),
+    HANumber("waterMonitorConfigFlowAutoHysteresis", HANumber::PrecisionP0),
+    HANumber("waterMonitorConfigFlowStartCrossings", HANumber::PrecisionP0),
+    HANumber("waterMonitorConfigFlowMaxStopTimeout", HANumber::PrecisionP0),
+    HANumber("waterMonitorConfigGpmSendFrequency", HANumber::PrecisionP0),
+    HANumber("waterMonitorConfigPressureDelta", HANumber::PrecisionP2),
+    HANumber("waterMonitorConfigPressureSendFrequency", HANumber::PrecisionP0),
+    HANumber("waterMonitorConfigPressureOffset", HANumber::PrecisionP2),
+    HANumber("waterMonitorConfigLeakContinuousFlow", HANumber::PrecisionP0),
+    HANumber("waterMonitorConfigLeakEventGallons", HANumber::PrecisionP0)};
+
+// the current values
+int32_t Config::values[CONFIG_PARAMETERS];
+
+// the parameters of the sampling core
+Mailbox<SamplingConfig> Config::sampling;
+
+// if there are changes to save and when the last one happened
+bool Config::isDirty = false;
+Instant Config::lastChangeTime;
+
+// if the values have been published since (re)connecting
+bool Config::isPublished = false;
+
+// the number of saves (since boot) and of the values that got rejected
+unsigned long Config::saves = 0;
+unsigned long Config::rejected = 0;
+
+/**
+ * @brief should be called once, from the setup() function, before the sampling core needs its parameters.
+ * it loads the saved values (or the defaults) and applies them.
+ */
+void Config::setup()
+{
+    for (int i = 0; i < CONFIG_PARAMETERS; i++)
+    {
+        const ConfigDefinition &definition = Config::definitions[i];
+        const float scale = float(Config::scale(ConfigParameter(i)));
+        HANumber &number = Config::numbers[i];
+        number.setName(definition.name);
+        number.setIcon("mdi:tune");
+        if (definition.unit[0] != '\0')
+        {
+            number.setUnitOfMeasurement(definition.unit);
+        }
+        number.setMin(definition.min / scale);
+        number.setMax(definition.max / scale);
+        number.setStep(definition.step / scale);
+        number.setMode(HANumber::ModeBox);
+        number.setEntityCategory("config");
+        number.onCommand(Config::onCommand);
+    }
+
+    Config::isDirty = false;
+    Config::isPublished = false;
+    Config::load();
+    Config::apply();
+}
+
+/**
+ * @brief 10^precision, the values per unit
+ */
+int32_t Config::scale(ConfigParameter parameter)
+{
+    int32_t scale = 1;
+    for (int i = 0; i < int(Config::definitions[parameter].precision); i++)
+    {
+        scale *= 10;
+    }
+    return scale;
+}
+
+/**
+ * @brief the value in its unit (ie. PSI, instead of hundredths of a PSI)
+ */
+SensorReal Config::real(ConfigParameter parameter)
+{
+    const int32_t milli = Config::values[parameter] * (1000 / Config::scale(parameter));
+    return milli < 0 ? SensorReal(0.0) - SensorMath::fromMilli(uint32_t(-milli)) : SensorMath::fromMilli(uint32_t(milli));
+}
+
+bool Config::isValid(ConfigParameter parameter, int32_t value)
+{
+    const ConfigDefinition &definition = Config::definitions[parameter];
+    return value >= definition.min && value <= definition.max && (value - definition.min) % definition.step == 0;
+}
+
+/**
+ * @brief validates and applies a value (to be saved after CONFIG_SAVE_DELAY)
+ *
+ * @return false if the value is not valid (it is left as it was)
+ */
+bool Config::set(ConfigParameter parameter, int32_t value)
+{
+    if (!Config::isValid(parameter, value))
+    {
+        Config::rejected++;
+        return false;
+    }
+    if (Config::values[parameter] != value)
+    {
+        Config::values[parameter] = value;
+        Config::isDirty = true;
+        Config::lastChangeTime = MonotonicClock::now();
+        Config::apply();
+    }
+    return true;
+}
+
+/**
+ * @brief a value sent from the controller.
+ * the entity gets the value that is in effect, the new one or (when rejected) the current one.
+ */
+void Config::onCommand(HANumeric number, HANumber *sender)
+{
+    const ConfigParameter parameter = ConfigParameter(sender - Config::numbers);
+    const float scale = float(Config::scale(parameter));
+    if (number.isSet())
+    {
+        Config::set(parameter, int32_t(lroundf(number.toFloat() * scale)));
+    }
+    sender->setState(Config::values[parameter] / scale);
+}
+
+/**
+ * @brief applies the values (core 0) and posts the ones of the sampling core.
+ * the pressure ones only apply in normal mode, the water leak test has its own (@see src/switches.cpp)
+ */
+void Config::apply()
+{
+    PulseSensor::gpmReport.minInterval = Duration::millis(Config::values[ConfigGpmSendFrequency]);
+    if (!Switches::isWaterLeakTestActive)
+    {
+        PressureSensor::psiReport.deadband = Config::real(ConfigPressureDelta);
+        PressureSensor::psiReport.minInterval = Duration::seconds(Config::values[ConfigPressureSendFrequency]);
+        PressureSensor::psiReport.compression = PRESSURE_SENSOR_COMPRESSION;
+    }
+    Config::sampling.write({Config::values[ConfigFlowHysteresis],
+                            (unsigned long)Config::values[ConfigFlowStartCrossings],
+                            (unsigned long)Config::values[ConfigFlowMaxStopTimeout] * 1000,
+                            Config::real(ConfigPressureOffset)});
+}
+
+/**
+ * @brief should be called for every new ADC block, before it gets sampled (core 1).
+ * it applies the latest parameters of the sampling core.
+ */
+void Config::applySampling()
+{
+    SamplingConfig config;
+    if (!Config::sampling.read(config))
+    {
+        return;
+    }
+    FlowDetector::hysteresis = config.flowHysteresis;
+    FlowDetector::startCrossings = config.flowStartCrossings;
+    FlowDetector::maxStopTimeout = config.flowMaxStopTimeout;
+    PressureSensor::psiOffset = config.psiOffset;
+}
+
+/**
+ * @brief reads the saved values, or the defaults (all of them, when the file is not valid, or the invalid ones)
+ *
+ * @return true if the file was valid
+ */
+bool Config::load()
+{
+    for (int i = 0; i < CONFIG_PARAMETERS; i++)
+    {
+        Config::values[i] = Config::definitions[i].defaultValue;
+    }
+
+    ConfigFile config;
+    File file = LittleFS.begin() ? LittleFS.open(CONFIG_FILE, "r") : File();
+    if (!file)
+    {
+        return false;
+    }
+    const size_t read = file.read((uint8_t *)&config, sizeof(config));
+    file.close();
+    if (read != sizeof(config) || config.version != CONFIG_VERSION || config.crc != Crc::crc32((const uint8_t *)&config, offsetof(ConfigFile, crc)))
+    {
+        return false;
+    }
+
+    bool isValid = true;
+    for (int i = 0; i < CONFIG_PARAMETERS; i++)
+    {
+        if (Config::isValid(ConfigParameter(i), config.values[i]))
+        {
+            Config::values[i] = config.values[i];
+        }
+        else
+        {
+            // ie. the range changed, without a new version
+            isValid = false;
+        }
+    }
+    return isValid;
+}
+
+/**
+ * @brief writes the values aside and renames them over the saved ones (atomic),
+ * so a power loss leaves either the old or the new values
+ */
+bool Config::save()
+{
+    ConfigFile config;
+    config.version = CONFIG_VERSION;
+    memcpy(config.values, Config::values, sizeof(config.values));
+    config.crc = Crc::crc32((const uint8_t *)&config, offsetof(ConfigFile, crc));
+
+    File file = LittleFS.open(CONFIG_NEW_FILE, "w");
+    if (!file)
+    {
+        return false;
+    }
+    const size_t written = file.write((const uint8_t *)&config, sizeof(config));
+    file.close();
+    if (written != sizeof(config) || !LittleFS.rename(CONFIG_NEW_FILE, CONFIG_FILE))
+    {
+        return false;
+    }
+    Config::saves++;
+    return true;
+}
+
+/**
+ * @brief publishes the values once (re)connected and saves the changes, CONFIG_SAVE_DELAY after the last one.
+ * it is scheduled every CONFIG_LOOP_FREQUENCY, also while disconnected (@see src/main.cpp)
+ */
+void Config::loop()
+{
+    if (!Device::isConnected())
+    {
+        Config::isPublished = false;
+    }
+    else if (!Config::isPublished)
+    {
+        Config::isPublished = true;
+        for (int i = 0; i < CONFIG_PARAMETERS; i++)
+        {
+            Config::numbers[i].setState(Config::values[i] / float(Config::scale(ConfigParameter(i))));
+        }
+    }
+
+    if (Config::isDirty && MonotonicClock::hasElapsed(Config::lastChangeTime, Duration::millis(CONFIG_SAVE_DELAY)) && Config::save())
+    {
+        Config::isDirty = false;
+    }
+}
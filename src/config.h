@@ -0,0 +1,138 @@
+#ifndef CONFIG
+#define CONFIG
+
+#include <ArduinoHA.h>
+#include <stdint.h>
+#include "mailbox.h"
+#include "sensorMath.h"
+#include "monotonicTime.h"
+
+/**
+ * @brief the file (LittleFS) of the tuned parameters and the file it gets written to first (atomic rename)
+ */
+#define CONFIG_FILE "/config.bin"
+#define CONFIG_NEW_FILE "/config.new"
+
+/**
+ * @brief the version of the file. bump it when the parameters change, so that the old files get ignored
+ */
+#define CONFIG_VERSION 3
+
+/**
+ * @brief time in milliseconds without a change, before the parameters get saved to flash,
+ * so that dragging a slider on the controller does not write on every step
+ */
+#define CONFIG_SAVE_DELAY 10000
+
+/**
+ * @brief frequency in milliseconds, to check if a save is due (the period of the config task)
+ */
+#define CONFIG_LOOP_FREQUENCY 1000
+
+/**
+ * @brief the parameters that can be tuned from the controller
+ */
+enum ConfigParameter
+{
+    // @see FLOW_DETECTOR_HYSTERESIS (ADC counts)
+    ConfigFlowHysteresis = 0,
+    // 1 to set the hysteresis from the learned noise (@see src/irCalibration.h), 0 to keep it as set
+    ConfigFlowAutoHysteresis,
+    // @see FLOW_DETECTOR_START_CROSSINGS
+    ConfigFlowStartCrossings,
+    // @see FLOW_DETECTOR_MAX_STOP_TIMEOUT (seconds)
+    ConfigFlowMaxStopTimeout,
+    // @see SEND_GPM_FREQUENCY (milliseconds)
+    ConfigGpmSendFrequency,
+    // @see PRESSURE_SENSOR_DELTA (hundredths of a PSI)
+    ConfigPressureDelta,
+    // @see PRESSURE_SENSOR_SEND_FREQUENCY (seconds)
+    ConfigPressureSendFrequency,
+    // added to the calibrated pressure (hundredths of a PSI)
+    ConfigPressureOffset,
+    // @see LEAK_DETECTOR_CONTINUOUS_FLOW (minutes)
+    ConfigLeakContinuousFlow,
+    // @see LEAK_DETECTOR_EVENT_GALLONS
+    ConfigLeakEventGallons
+};
+
+#define CONFIG_PARAMETERS 10
+
+/**
+ * @brief a parameter and its valid values.
+ * the values are integers, in the units of the precision (ie. hundredths for PrecisionP2)
+ */
+struct ConfigDefinition
+{
+    const char *name;
+    const char *unit;
+    HABaseDeviceType::NumberPrecision precision;
+    int32_t min;
+    int32_t max;
+    int32_t step;
+    int32_t defaultValue;
+};
+
+/**
+ * @brief the parameters of the sampling core (core 1), posted to it on every change
+ */
+struct SamplingConfig
+{
+    int32_t flowHysteresis;
+    unsigned long flowStartCrossings;
+    // in milliseconds
+    unsigned long flowMaxStopTimeout;
+    SensorReal psiOffset;
+};
+
+/**
+ * @brief the file the parameters are saved to
+ */
+struct ConfigFile
+{
+    uint32_t version;
+    int32_t values[CONFIG_PARAMETERS];
+    // CRC-32 of the above
+    uint32_t crc;
+};
+
+/**
+ * @brief the registry of the parameters that can be tuned at runtime (core 0),
+ * as number entities of the controller (config category), without a new build or a reboot.
+ * a value gets validated (range and step) and applied right away (the sampling core gets it through a mailbox),
+ * or rejected (the entity snaps back to the current value). the values get saved to flash
+ * (CONFIG_SAVE_DELAY after the last change) and loaded on boot, falling back to the defaults (the #defines)
+ * when the file is missing, corrupt, or of another version.
+ */
+class Config
+{
+public:
+    // properties
+    static const ConfigDefinition definitions[CONFIG_PARAMETERS];
+    static HANumber numbers[CONFIG_PARAMETERS];
+    static int32_t values[CONFIG_PARAMETERS];
+    static Mailbox<SamplingConfig> sampling;
+    static bool isDirty;
+    static Instant lastChangeTime;
+    static bool isPublished;
+    static unsigned long saves;
+    static unsigned long rejected;
+
+    // methods
+    static void setup();
+    static void loop();
+    static bool set(ConfigParameter parameter, int32_t value);
+    static int32_t get(ConfigParameter parameter) { return Config::values[parameter]; }
+    static SensorReal real(ConfigParameter parameter);
+    static bool isValid(ConfigParameter parameter, int32_t value);
+    static void apply();
+    static void applySampling();
+    static bool save();
+    static bool load();
+
+private:
+    static void onCommand(HANumeric number, HANumber *sender);
+    static int32_t scale(ConfigParameter parameter);
+};
+
+#endif // CONFIG
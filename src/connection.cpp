@@ -0,0 +1,222 @@
+#include <ArduinoHA.h>
+#include <ESP8266WiFi.h>
+#include "secrets.h"
+#include "device.h"
+#include "connection.h"
+
+static_assert(CONNECTION_MQTT_BACKOFF_MIN / 2 >= HAMqtt::ReconnectInterval, "CONNECTION_MQTT_BACKOFF_MIN must be at least twice HAMqtt::ReconnectInterval");
+
+// the current state
+ConnectionState Connection::state = ConnectionDisconnected;
+
+// the time each state was last entered
+Instant Connection::stateTimes[CONNECTION_STATES];
+
+// the time the current state was entered
+Instant Connection::lastStateTime;
+
+// last time we checked if the WiFi is still connected
+Instant Connection::lastWifiCheck;
+
+// the consecutive failed attempts to connect to the WiFi (reset when it connects) and to the broker (reset when connected)
+unsigned long Connection::failedAttempts = 0;
+unsigned long Connection::failedMqttAttempts = 0;
+
+// the current backoff time
+Duration Connection::backoff;
+
+// the time the MQTT client last tried to connect to the broker and may next try
+Instant Connection::lastMqttAttempt;
+Instant Connection::nextMqttAttempt;
+
+// the number of times we got connected (including the first)
+unsigned long Connection::connects = 0;
+
+// the MQTT client only needs to begin once, it reconnects on its own (within mqtt.loop())
+bool Connection::isMqttStarted = false;
+
+const char *Connection::stateName(ConnectionState state)
+{
+    switch (state)
+    {
+    case ConnectionWifiConnecting:
+        return "wifi connecting";
+    case ConnectionMqttConnecting:
+        return "mqtt connecting";
+    case ConnectionConnected:
+        return "connected";
+    case ConnectionBackoff:
+        return "backoff";
+    default:
+        return "disconnected";
+    }
+}
+
+void Connection::setState(ConnectionState state)
+{
+#ifdef SERIAL_DEBUG
+    Serial.print("Connection: ");
+    Serial.print(Connection::stateName(Connection::state));
+    Serial.print(" -> ");
+    Serial.println(Connection::stateName(state));
+#endif
+    Connection::state = state;
+    Connection::lastStateTime = MonotonicClock::now();
+    Connection::stateTimes[state] = Connection::lastStateTime;
+}
+
+/**
+ * @brief starts connecting to the WiFi (without waiting for it)
+ */
+void Connection::connectToWifi()
+{
+#ifdef SERIAL_DEBUG
+    Serial.print("Attempting to connect to WPA SSID: ");
+    Serial.println(WIFI_SSID);
+#endif
+    WiFi.beginNoBlock(WIFI_SSID, WIFI_PASSWORD);
+    Connection::setState(ConnectionWifiConnecting);
+}
+
+/**
+ * @brief drops the WiFi and waits (backoff) before the next attempt.
+ */
+void Connection::retry()
+{
+    WiFi.disconnect();
+    Connection::backoff = Connection::nextBackoff(Connection::failedAttempts, CONNECTION_BACKOFF_MIN);
+    Connection::setState(ConnectionBackoff);
+}
+
+/**
+ * @brief counts a failed attempt and returns the time to wait before the next one.
+ * full backoff = minBackoff * 2^failedAttempts (up to CONNECTION_BACKOFF_MAX),
+ * the actual wait is a random time between half of it and all of it (jitter).
+ *
+ * @param failedAttempts the consecutive failed attempts of the WiFi or of the broker
+ * @param minBackoff the full backoff (milliseconds) after the first failed attempt
+ */
+Duration Connection::nextBackoff(unsigned long &failedAttempts, unsigned long minBackoff)
+{
+    unsigned long fullBackoff = minBackoff;
+    for (unsigned long i = 0; i < failedAttempts && fullBackoff < CONNECTION_BACKOFF_MAX; i++)
+    {
+        fullBackoff *= 2;
+    }
+    if (fullBackoff > CONNECTION_BACKOFF_MAX)
+    {
+        fullBackoff = CONNECTION_BACKOFF_MAX;
+    }
+    failedAttempts++;
+    return Duration::millis(fullBackoff / 2 + random(fullBackoff / 2 + 1));
+}
+
+/**
+ * @brief if everything is connected and therefore, "safe" to send data to the controller
+ */
+bool Connection::isConnected()
+{
+    return Connection::state == ConnectionConnected;
+}
+
+/**
+ * @brief if the WiFi is connected (the MQTT client may or may not be)
+ */
+bool Connection::isWifiConnected()
+{
+    return Connection::state == ConnectionMqttConnecting || Connection::state == ConnectionConnected;
+}
+
+/**
+ * @brief should be called on every iteration of the main loop() function.
+ * it takes (at most) one step and never waits.
+ *
+ * @return true only on the iteration the connection got (re)established
+ */
+bool Connection::loop()
+{
+    const Duration timeInState = MonotonicClock::since(Connection::lastStateTime);
+    switch (Connection::state)
+    {
+    case ConnectionDisconnected:
+        Connection::connectToWifi();
+        break;
+
+    case ConnectionWifiConnecting:
+        if (WiFi.status() == WL_CONNECTED)
+        {
+#ifdef SERIAL_DEBUG
+            Serial.print("Connected to: ");
+            Serial.print(WIFI_SSID);
+            Serial.print(", with IP: ");
+            Serial.println(WiFi.localIP());
+#endif
+            Connection::failedAttempts = 0;
+            Connection::nextMqttAttempt = MonotonicClock::now();
+            if (!Connection::isMqttStarted)
+            {
+                // an unreachable broker should not stall the loop for the default (seconds long) socket timeout
+                Device::client.setTimeout(CONNECTION_MQTT_TIMEOUT);
+                // it should be called after the device, controls and sensors have been defined.
+                Connection::isMqttStarted = Device::mqtt.begin(BROKER_ADDR, BROKER_PORT, BROKER_USERNAME, BROKER_PASSWORD);
+            }
+            else if (Connection::nextMqttAttempt < Connection::lastMqttAttempt + Duration::millis(HAMqtt::ReconnectInterval))
+            {
+                // the WiFi came back soon after the last attempt, the client would skip this one
+                Connection::nextMqttAttempt = Connection::lastMqttAttempt + Duration::millis(HAMqtt::ReconnectInterval);
+            }
+            Connection::setState(ConnectionMqttConnecting);
+        }
+        else if (timeInState > Duration::millis(WAIT_FOR_WIFI))
+        {
+            Connection::retry();
+        }
+        break;
+
+    case ConnectionMqttConnecting:
+    case ConnectionConnected:
+        if (MonotonicClock::since(Connection::lastWifiCheck) > Duration::millis(WIFI_CHECK_FREQUENCY))
+        {
+            Connection::lastWifiCheck = MonotonicClock::now();
+            if (WiFi.status() != WL_CONNECTED)
+            {
+                Connection::retry();
+                break;
+            }
+        }
+        if (Connection::state == ConnectionMqttConnecting)
+        {
+            if (MonotonicClock::now() < Connection::nextMqttAttempt)
+            {
+                break;
+            }
+            // the client connects within its loop() and waits (up to CONNECTION_MQTT_TIMEOUT) for the broker
+            Connection::lastMqttAttempt = MonotonicClock::now();
+            Device::mqtt.loop();
+            if (Device::mqtt.isConnected())
+            {
+                Connection::failedMqttAttempts = 0;
+                Connection::connects++;
+                Connection::setState(ConnectionConnected);
+                return true;
+            }
+            Connection::nextMqttAttempt = MonotonicClock::now() + Connection::nextBackoff(Connection::failedMqttAttempts, CONNECTION_MQTT_BACKOFF_MIN);
+            break;
+        }
+        if (!Device::mqtt.isConnected())
+        {
+            // the client would retry on every mqtt.loop(), so it only gets to, after the backoff
+            Connection::nextMqttAttempt = MonotonicClock::now() + Connection::nextBackoff(Connection::failedMqttAttempts, CONNECTION_MQTT_BACKOFF_MIN);
+            Connection::setState(ConnectionMqttConnecting);
+        }
+        break;
+
+    case ConnectionBackoff:
+        if (timeInState > Connection::backoff)
+        {
+            Connection::connectToWifi();
+        }
+        break;
+    }
+    return false;
+}
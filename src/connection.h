@@ -0,0 +1,91 @@
+#ifndef CONNECTION
+#define CONNECTION
+
+#include "monotonicTime.h"
+
+/**
+ * @brief the MQTT topic for debugging the connection
+ */
+#define CONNECTION_DEBUG_MQTT_TOPIC "debug:waterMonitor:connection"
+
+/**
+ * @brief time in milliseconds to wait before retrying to connect to the WiFi, after the first failed attempt.
+ * it doubles on every consecutive failed attempt, up to CONNECTION_BACKOFF_MAX.
+ */
+#define CONNECTION_BACKOFF_MIN 1000
+
+/**
+ * @brief time in milliseconds to wait before retrying to connect to the broker, after the first failed attempt.
+ * it doubles on every consecutive failed attempt, up to CONNECTION_BACKOFF_MAX.
+ * the MQTT client skips the attempts within HAMqtt::ReconnectInterval (10 seconds) of its last one,
+ * so this is twice that: even the shortest (jittered) wait ends in a real attempt.
+ */
+#define CONNECTION_MQTT_BACKOFF_MIN 20000
+
+/**
+ * @brief max time in milliseconds to wait before retrying to connect
+ */
+#define CONNECTION_BACKOFF_MAX 60000
+
+/**
+ * @brief time in milliseconds the WiFi client may wait for the broker to accept the MQTT connection (the socket timeout).
+ * the MQTT client connects synchronously, so while the broker is unreachable, every (backed off) attempt stalls the loop this long.
+ */
+#define CONNECTION_MQTT_TIMEOUT 500
+
+/**
+ * @brief the states of the connection, in the order they are normally stepped through
+ */
+enum ConnectionState
+{
+    // nothing started yet (boot)
+    ConnectionDisconnected = 0,
+    // waiting for the WiFi to connect (up to WAIT_FOR_WIFI)
+    ConnectionWifiConnecting,
+    // WiFi connected, the MQTT client tries to connect to the broker (with backoff)
+    ConnectionMqttConnecting,
+    ConnectionConnected,
+    // waiting (backoff) to retry the WiFi
+    ConnectionBackoff
+};
+
+#define CONNECTION_STATES 5
+
+/**
+ * @brief the non-blocking WiFi/MQTT connection manager.
+ * it steps through its states on every loop() iteration, without ever waiting,
+ * so the rest of the loop keeps running, while the link is down.
+ * failed attempts are retried with an exponential backoff (with jitter).
+ * the only wait is the (synchronous) attempt of the MQTT client to reach the broker, up to CONNECTION_MQTT_TIMEOUT,
+ * so the client only gets to try when the backoff allows it.
+ */
+class Connection
+{
+public:
+    // properties
+    static ConnectionState state;
+    static Instant stateTimes[CONNECTION_STATES];
+    static Instant lastStateTime;
+    static Instant lastWifiCheck;
+    static unsigned long failedAttempts;
+    static unsigned long failedMqttAttempts;
+    static Duration backoff;
+    static Instant lastMqttAttempt;
+    static Instant nextMqttAttempt;
+    static unsigned long connects;
+    static bool isMqttStarted;
+
+    // methods
+    static bool loop();
+    static bool isConnected();
+    static bool isWifiConnected();
+    static const char *stateName(ConnectionState state);
+
+private:
+    static void setState(ConnectionState state);
+    static void connectToWifi();
+    static void retry();
+    static Duration nextBackoff(unsigned long &failedAttempts, unsigned long minBackoff);
+};
+
+#endif // CONNECTION
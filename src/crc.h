@@ -0,0 +1,31 @@
+#ifndef CRC
+#define CRC
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief the checksums of what gets persisted to flash
+ */
+class Crc
+{
+public:
+    /**
+     * @brief CRC-32 (IEEE 802.3), bitwise since it only covers a few bytes at a time
+     */
+    static uint32_t crc32(const uint8_t *data, size_t length)
+    {
+        uint32_t crc = 0xFFFFFFFF;
+        for (size_t i = 0; i < length; i++)
+        {
+            crc ^= data[i];
+            for (int bit = 0; bit < 8; bit++)
+            {
+                crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+            }
+        }
+        return ~crc;
+    }
+};
+
+#endif // CRC
@@ -0,0 +1,133 @@
+#ifndef DEBUG_FORMATTER
+#define DEBUG_FORMATTER
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief an allocation-free text formatter, for the debug messages.
+ * it appends to a caller provided (ie. stack or static) buffer and truncates what does not fit,
+ * so unlike String concatenation, it never touches the heap.
+ * the numbers are formatted by hand (without printf), since the newlib float formatting allocates.
+ *
+ * @example char payload[DEBUG_MESSAGE_SIZE];
+ *          DebugFormatter(payload, sizeof(payload)).text("PSI: ").milli(SensorMath::toMilli(psi), 2);
+ */
+class DebugFormatter
+{
+public:
+    DebugFormatter(char *buffer, size_t size) : buffer(buffer), size(size), length(0)
+    {
+        if (size > 0)
+        {
+            buffer[0] = '\0';
+        }
+    }
+
+    DebugFormatter &text(const char *value)
+    {
+        while (*value != '\0')
+        {
+            this->append(*value++);
+        }
+        return *this;
+    }
+
+    DebugFormatter &number(unsigned long value)
+    {
+        // the digits, in reverse
+        char digits[20];
+        int count = 0;
+        do
+        {
+            digits[count++] = char('0' + value % 10);
+            value /= 10;
+        } while (value > 0);
+        while (count > 0)
+        {
+            this->append(digits[--count]);
+        }
+        return *this;
+    }
+
+    DebugFormatter &number(long value)
+    {
+        if (value < 0)
+        {
+            this->append('-');
+            return this->number(0UL - (unsigned long)value);
+        }
+        return this->number((unsigned long)value);
+    }
+
+    DebugFormatter &number(int value) { return this->number(long(value)); }
+    DebugFormatter &number(unsigned int value) { return this->number((unsigned long)value); }
+
+    /**
+     * @param value in thousandths (ie. milli-PSI)
+     * @param decimals 0 to 3, the rest get rounded
+     */
+    DebugFormatter &milli(int32_t value, int decimals)
+    {
+        int64_t rounded = value;
+        int64_t divider = 1;
+        for (int i = decimals; i < 3; i++)
+        {
+            divider *= 10;
+        }
+        rounded = (rounded + (rounded < 0 ? -divider / 2 : divider / 2)) / divider;
+        if (rounded < 0)
+        {
+            this->append('-');
+            rounded = -rounded;
+        }
+        int64_t scale = 1;
+        for (int i = 0; i < decimals; i++)
+        {
+            scale *= 10;
+        }
+        this->number((unsigned long)(rounded / scale));
+        if (decimals > 0)
+        {
+            this->append('.');
+            // the fraction, with its leading zeros
+            for (int64_t digit = scale / 10; digit > 0; digit /= 10)
+            {
+                this->append(char('0' + (rounded / digit) % 10));
+            }
+        }
+        return *this;
+    }
+
+    /**
+     * @brief a float, rounded to decimals (0 to 3)
+     */
+    DebugFormatter &real(float value, int decimals)
+    {
+        return this->milli(int32_t(value * 1000.0f + (value < 0 ? -0.5f : 0.5f)), decimals);
+    }
+
+    const char *c_str() const { return this->buffer; }
+    size_t getLength() const { return this->length; }
+    // if something did not fit
+    bool isTruncated() const { return this->truncated; }
+
+private:
+    char *buffer;
+    size_t size;
+    size_t length;
+    bool truncated = false;
+
+    void append(char value)
+    {
+        if (this->length + 1 >= this->size)
+        {
+            this->truncated = true;
+            return;
+        }
+        this->buffer[this->length++] = value;
+        this->buffer[this->length] = '\0';
+    }
+};
+
+#endif // DEBUG_FORMATTER
@@ -4,6 +4,8 @@
 #include <ArduinoOTA.h>
 #include "secrets.h"
 #include "device.h"
+#include "connection.h"
+#include "totalizer.h"
 
 /**
  * @author Antonios Karagiannis (antokarag@gmail.com)
@@ -15,29 +17,6 @@
  *
  */
 
-/**
- * @brief the number of which we need to multiply voltage by,
- *        in order to get the expected input pin value, when we know the expected voltage.
- *        This is useful in finding the min/max/current input pin value, a sensor should provide.
- *
- * @example with MAX_ANALOG_PIN_RANGE 1023
- *          and MAX_ANALOG_PIN_RANGE_VOLTAGE 3.3
- *          analogInputValueMultiplier will be 310
- *
- *          let's say our sensor reports a minimum of 0.53v at its 0 and 3.33v max at its 100.
- *          to get our adjusted pin input value, we will do:
- *          adjustedMinInputValue = analogInputValueMultiplier * 0.53 = 164.3
- *          adjustedInputValue = inputValue - adjustedMinInputValue = 164.3 - 164.3 = 0
- *          that way, our adjusted input will now be 0, which should align with the min of the sensor.
- */
-const float Device::analogInputValueMultiplier = float(MAX_ANALOG_PIN_RANGE / MAX_ANALOG_PIN_RANGE_VOLTAGE);
-
-/**
- * @brief Wifi status as of last check.
- * Hence, it may not be up to date on every loop iteration.
- */
-int Device::wifiStatus;
-
 /**
  * @brief the wifi client
  *
@@ -53,7 +32,7 @@ HADevice Device::device(DEVICE_ID);
 
 // increase the device types limit, otherwise, some of the sensors/switches will not get registered
 // @see https://dawidchyrzynski.github.io/arduino-home-assistant/documents/library/device-types.html#limitations
-HAMqtt Device::mqtt(Device::client, Device::device, 7);
+HAMqtt Device::mqtt(Device::client, Device::device, 31);
 
 /**
  * @brief a status string sensor
@@ -72,74 +51,29 @@ bool Device::firstLoop = true;
 bool Device::reconnected = false;
 
 /**
- * @brief last time we performed a wifi check (ie. if still connected or not)
+ * @brief OTA can only start once the WiFi is connected
  */
-unsigned long Device::lastWifiCheck = millis();
+bool Device::isOtaStarted = false;
 
 /**
- * @brief last time we sent a heartbit to the controller
+ * @brief if the ready status is waiting to be sent, after the connected/reconnected one
  */
-unsigned long Device::lastHeartbit = millis();
-
-void Device::connectToWifi()
-{
-  // get our WiFi's mac address
-  byte mac[WL_MAC_ADDR_LENGTH];
-  WiFi.macAddress(mac);
+bool Device::isReadyPending = false;
 
-  // connect to WiFi
-  while (Device::wifiStatus != WL_CONNECTED)
-  {
-#ifdef SERIAL_DEBUG
-    Serial.print("Attempting to connect to WPA SSID: ");
-    Serial.println(WIFI_SSID);
-#endif
-    Device::wifiStatus = WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
-    // wait to connect...
-    delay(WAIT_FOR_WIFI);
-  }
+/**
+ * @brief last time we got connected to the controller
+ */
+Instant Device::connectedTime;
 
-#ifdef SERIAL_DEBUG
-  Serial.print("Connected to: ");
-  Serial.print(WIFI_SSID);
-  Serial.print(", with IP: ");
-  Serial.print(WiFi.localIP());
-  Serial.print(" and mac: ");
-  Serial.print(mac[5], HEX);
-  Serial.print(":");
-  Serial.print(mac[4], HEX);
-  Serial.print(":");
-  Serial.print(mac[3], HEX);
-  Serial.print(":");
-  Serial.print(mac[2], HEX);
-  Serial.print(":");
-  Serial.print(mac[1], HEX);
-  Serial.print(":");
-  Serial.println(mac[0], HEX);
-#endif
-}
+/**
+ * @brief debug messages of the sampling core (core 1), waiting to be published by core 0
+ */
+RingBuffer<DebugMessage, DEBUG_QUEUE_SIZE> Device::debugQueue;
 
 /**
- * @brief connects to the MQTT broker.
- *        it should be called after the device, controls and sensors have been defined.
- *
+ * @brief the debug messages dropped, because the queue was full (written by core 1 only)
  */
-void Device::connectToMQTT()
-{
-#ifdef SERIAL_DEBUG
-  Serial.print("Connecting to MQTT\n");
-#endif
-  while (Device::mqtt.begin(BROKER_ADDR, BROKER_PORT, BROKER_USERNAME, BROKER_PASSWORD) != true)
-  {
-    delay(WAIT_FOR_MQTT);
-#ifdef SERIAL_DEBUG
-    Serial.print("Could not connect to MQTT broker");
-#endif
-  }
-#ifdef SERIAL_DEBUG
-  Serial.print("Connected to MQTT broker");
-#endif
-}
+volatile unsigned long Device::droppedDebugMessages = 0;
 
 /**
  * @brief enables OTA (over the air updates)
@@ -161,6 +95,9 @@ void Device::setupOTA()
                          type = "filesystem";
                        }
 
+                       // the gallons metered since the last commit would get lost on the reboot
+                       Totalizer::commit();
+
 // NOTE: if updating FS this would be the place to unmount FS using FS.end()
 #ifdef SERIAL_DEBUG
                        Serial.println("Start updating " + type);
@@ -216,15 +153,23 @@ void Device::setupOTA()
  */
 bool Device::isConnected()
 {
-  return Device::wifiStatus == WL_CONNECTED;
+  return Connection::isConnected();
+}
+
+/**
+ * @brief the opposite of isConnected(), for the tasks that only run while disconnected
+ */
+bool Device::isDisconnected()
+{
+  return !Connection::isConnected();
 }
 
 /**
- * @brief checks periodically if the WiFi connection is still connected and
- * attempts to reconnect if not connected.
+ * @brief steps the connection (it never waits) and
+ * sends the connected/reconnected status, when the connection gets established.
  *
  */
-void Device::wifiLoop()
+void Device::connectionLoop()
 {
   if (Device::reconnected)
   {
@@ -232,38 +177,78 @@ void Device::wifiLoop()
     Device::reconnected = false;
   }
 
-  if (abs(long(millis() - Device::lastWifiCheck)) > WIFI_CHECK_FREQUENCY)
+  if (Connection::loop())
   {
-    Device::lastWifiCheck = millis();
-    Device::wifiStatus = WiFi.status();
-    if (!Device::isConnected())
+    if (Device::firstLoop)
     {
-      WiFi.disconnect();
-      Device::connectToWifi();
-      // we just reconnected to the WiFi
+      /**
+       * @brief only on the first connection,
+       *        swap the status to force an update of the status sensor,
+       *        in order to have a record of the time the device rebooted...
+       *
+       */
+      Device::firstLoop = false;
+      Device::statusSensor.setValue(STATUS_CONNECTED);
+    }
+    else
+    {
+      // we just reconnected
       // set this flag, it will be reset on the next iteration (see above)
       // this flag lets the whole application know, when a reconnection just took place
       Device::reconnected = true;
-      // send the reconnected status
       Device::statusSensor.setValue(STATUS_RECONNECTED);
-      // allow mqtt to send the "reconnected" value, before changing it to "ready"
-      Device::mqtt.loop();
-      delay(250);
-      Device::statusSensor.setValue(STATUS_READY);
     }
+    // allow mqtt to send the "connected" value, before changing it to "ready"
+    Device::isReadyPending = true;
+    Device::connectedTime = MonotonicClock::now();
+  }
+
+  if (Device::isReadyPending && Device::isConnected() && MonotonicClock::since(Device::connectedTime) > Duration::millis(STATUS_READY_DELAY))
+  {
+    Device::isReadyPending = false;
+    Device::statusSensor.setValue(STATUS_READY);
   }
 }
 
 /**
- * @brief checks periodically if we need to send a heartbit status
- * to the controller and if yes, it sends it
+ * @brief sends a heartbit status to the controller.
+ * it is scheduled every HEARTBIT_FREQUENCY, while connected (@see src/main.cpp)
  */
 void Device::heartbitLoop()
 {
-  if (abs(long(millis() - Device::lastHeartbit)) > HEARTBIT_FREQUENCY)
+  Device::statusSensor.setValue(STATUS_READY);
+}
+
+/**
+ * @brief queues a debug message, to be published by the main loop.
+ * the MQTT client is not safe to use from core 1, so the sampling code must use this, instead of mqtt.publish().
+ * it must only be called from core 1 (the single producer of the queue), never from core 0:
+ * the code of the main loop (core 0) publishes with mqtt.publish() directly.
+ *
+ * @param topic must be a string literal (or otherwise outlive the message)
+ * @param payload gets copied (and truncated to DEBUG_MESSAGE_SIZE)
+ */
+void Device::queueDebug(const char *topic, const char *payload)
+{
+  DebugMessage message;
+  message.topic = topic;
+  strncpy(message.payload, payload, DEBUG_MESSAGE_SIZE - 1);
+  message.payload[DEBUG_MESSAGE_SIZE - 1] = '\0';
+  if (!Device::debugQueue.push(message))
   {
-    Device::lastHeartbit = millis();
-    Device::statusSensor.setValue(STATUS_READY);
+    Device::droppedDebugMessages = Device::droppedDebugMessages + 1;
+  }
+}
+
+/**
+ * @brief publishes the queued debug messages, up to DEBUG_DRAIN_MESSAGES per call
+ */
+void Device::debugLoop()
+{
+  DebugMessage message;
+  for (int i = 0; i < DEBUG_DRAIN_MESSAGES && Device::debugQueue.pop(message); i++)
+  {
+    Device::mqtt.publish(message.topic, message.payload);
   }
 }
 
@@ -276,14 +261,15 @@ void Device::setup()
   // @see https://arduino-pico.readthedocs.io/en/latest/analog.html#void-analogreadresolution-int-bits
   analogReadResolution(ANALOG_READ_RESOLUTION);
 
+  // every device should jitter its reconnection attempts differently (@see Connection::nextBackoff())
+  randomSeed(rp2040.hwrand32());
+
 #ifdef SERIAL_DEBUG
   Serial.begin(9600);
   delay(500); // Give the serial terminal a chance to connect, if present
   Serial.print("Device::Setup()");
 #endif
 
-  Device::connectToWifi();
-
   // set device's details
   Device::device.setName(DEVICE_NAME);
   Device::device.setSoftwareVersion(FIRMWARE_VERSION);
@@ -318,42 +304,41 @@ void Device::setup()
   Device::statusSensor.setName("Status");
   Device::statusSensor.setIcon("mdi:check-circle");
   Device::statusSensor.setForceUpdate(true);
-
-  // enable OTA
-  Device::setupOTA();
 }
 
 /**
- * @brief should be called on every iteration of the main loop() function
+ * @brief should be called on every iteration of the main loop() function.
+ * it never waits for the network, so the loop keeps running while disconnected.
  *
  */
 void Device::loop()
 {
-  // process any pending mqtt messages
-  Device::mqtt.loop();
+  // connect/reconnect, one step at a time
+  Device::connectionLoop();
 
-  // process any incoming OTA requests
-  ArduinoOTA.handle();
+  if (!Connection::isWifiConnected())
+  {
+    // nothing to process without the WiFi
+    // (the MQTT client would block, trying to reach the broker)
+    return;
+  }
 
-  /**
-   * @brief only on the first loop,
-   *        swap the status to force an update of the status sensor,
-   *        in order to have a record of the time the device rebooted...
-   *
-   */
-  if (Device::firstLoop)
+  if (!Device::isOtaStarted)
+  {
+    // enable OTA
+    Device::isOtaStarted = true;
+    Device::setupOTA();
+  }
+
+  // process any pending mqtt messages.
+  // while disconnected from the broker, the connection lets the client retry, only when the backoff allows it
+  if (Connection::isConnected())
   {
-    Device::firstLoop = false;
-    Device::statusSensor.setValue(STATUS_CONNECTED);
-    // allow mqtt to send the "connected" value before changing it to "ready"
     Device::mqtt.loop();
-    delay(250);
-    Device::statusSensor.setValue(STATUS_READY);
   }
 
-  // check if wifi is still connected, etc.
-  Device::wifiLoop();
+  // process any incoming OTA requests
+  ArduinoOTA.handle();
 
-  // check if we need to send heartbit to controller
-  Device::heartbitLoop();
-}
\ No newline at end of file
+  // the heartbit and the debug messages are separate (scheduled) tasks
+}
@@ -4,6 +4,8 @@
 #include <ArduinoHA.h>
 #include <ESP8266WiFi.h>
 #include <WiFiUdp.h>
+#include "ringBuffer.h"
+#include "monotonicTime.h"
 
 #define DEVICE_ID "waterMonitor"
 #define DEVICE_NAME "Water Monitor"
@@ -33,17 +35,12 @@
 #define MAX_ANALOG_PIN_RANGE_VOLTAGE 3.3
 
 /**
- * @brief time in milliseconds to wait for the WiFi to connect
- *
+ * @brief time in milliseconds to wait for the WiFi to connect,
+ * before dropping the attempt and retrying (with backoff)
+ * @see src/connection.h
  */
 #define WAIT_FOR_WIFI 5000
 
-/**
- * @brief time in milliseconds to wait for the MQTT to connect/reconnect
- *
- */
-#define WAIT_FOR_MQTT 2500
-
 /**
  * @brief frequence in milliseconds,
  * to check for the Wifi connection status
@@ -52,7 +49,7 @@
 
 /**
  * @brief frequence in milliseconds,
- * to send a heartbit status update to the controller
+ * to send a heartbit status update to the controller (the period of its task)
  */
 #define HEARTBIT_FREQUENCY 15000
 
@@ -74,27 +71,62 @@
  */
 #define STATUS_READY "ready"
 
+/**
+ * @brief time in milliseconds to allow the connected/reconnected status to be sent,
+ * before changing it to ready
+ */
+#define STATUS_READY_DELAY 250
+
+/**
+ * @brief max length (including the terminator) of a debug message,
+ * queued by the sampling core. longer messages get truncated.
+ */
+#define DEBUG_MESSAGE_SIZE 192
+
+/**
+ * @brief number of debug messages that can be waiting to be published.
+ * when full, new messages get dropped. must be a power of 2.
+ */
+#define DEBUG_QUEUE_SIZE 8
+
+/**
+ * @brief max number of debug messages to publish per loop iteration,
+ * so that a burst of them does not stall the loop (the rest wait for the next iterations)
+ */
+#define DEBUG_DRAIN_MESSAGES 2
+
+/**
+ * @brief a debug message, waiting to be published by the main loop (core 0)
+ */
+struct DebugMessage
+{
+    const char *topic;
+    char payload[DEBUG_MESSAGE_SIZE];
+};
+
 class Device
 {
 public:
     // properties
-    static const float analogInputValueMultiplier;
-    static int wifiStatus;
     static WiFiClient client;
     static HADevice device;
     static HAMqtt mqtt;
     static HASensor statusSensor;
     static bool firstLoop;
     static bool reconnected;
-    static unsigned long lastWifiCheck;
-    static unsigned long lastHeartbit;
+    static bool isOtaStarted;
+    static bool isReadyPending;
+    static Instant connectedTime;
+    static RingBuffer<DebugMessage, DEBUG_QUEUE_SIZE> debugQueue;
+    static volatile unsigned long droppedDebugMessages;
 
     // methods
-    static void connectToMQTT();
-    static void connectToWifi();
     static bool isConnected();
-    static void wifiLoop();
+    static bool isDisconnected();
+    static void connectionLoop();
     static void heartbitLoop();
+    static void queueDebug(const char *topic, const char *payload);
+    static void debugLoop();
     static void setupOTA();
     static void setup();
     static void loop();
@@ -0,0 +1,234 @@
+#include <ArduinoHA.h>
+#include "device.h"
+#include "adcSampler.h"
+#include "flowDetector.h"
+#include "scheduler.h"
+#include "diagnostics.h"
+
+// the names of the sampling subsystems (core 1)
+static const char *samplingNames[SAMPLING_SUBSYSTEMS] = {"ir", "pressure", "pulse"};
+
+// the loop times (microseconds) since the last send, in log2 buckets
+uint32_t Diagnostics::histogram[DIAGNOSTICS_HISTOGRAM_BUCKETS] = {};
+unsigned long Diagnostics::loops = 0;
+unsigned long Diagnostics::minLoopTime = ULONG_MAX;
+unsigned long Diagnostics::maxLoopTime = 0;
+unsigned long long Diagnostics::totalLoopTime = 0;
+
+// the counters of the sampling core (core 1 only)
+SamplingDiagnostics Diagnostics::sampling = {};
+
+// if a missed pulse got suspected since the last pulse (core 1 only), to count it once
+bool Diagnostics::isMissedPulseSuspected = false;
+
+// the counters of the sampling core, posted for the main loop
+Mailbox<SamplingDiagnostics> Diagnostics::samplingReadings;
+
+// the counters on the last send, to report the difference
+SamplingDiagnostics Diagnostics::lastSampling = {};
+uint64_t Diagnostics::lastTaskCycles[SCHEDULER_MAX_TASKS] = {};
+uint32_t Diagnostics::lastBlocks = 0;
+Instant Diagnostics::lastSendTime;
+
+HASensorNumber Diagnostics::loopTimeMinSensor("waterMonitorLoopTimeMin", HASensorNumber::PrecisionP0);
+HASensorNumber Diagnostics::loopTimeAvgSensor("waterMonitorLoopTimeAvg", HASensorNumber::PrecisionP0);
+HASensorNumber Diagnostics::loopTimeP99Sensor("waterMonitorLoopTimeP99", HASensorNumber::PrecisionP0);
+HASensorNumber Diagnostics::loopTimeMaxSensor("waterMonitorLoopTimeMax", HASensorNumber::PrecisionP0);
+HASensorNumber Diagnostics::adcRateSensor("waterMonitorAdcRate", HASensorNumber::PrecisionP0);
+HASensorNumber Diagnostics::missedPulsesSensor("waterMonitorMissedPulses", HASensorNumber::PrecisionP0);
+HASensor Diagnostics::cyclesSensor("waterMonitorCpuUsage");
+
+void Diagnostics::setup()
+{
+    Diagnostics::loopTimeMinSensor.setName("Loop Time Min");
+    Diagnostics::loopTimeAvgSensor.setName("Loop Time Avg");
+    Diagnostics::loopTimeP99Sensor.setName("Loop Time P99");
+    Diagnostics::loopTimeMaxSensor.setName("Loop Time Max");
+    HASensorNumber *loopTimeSensors[] = {&Diagnostics::loopTimeMinSensor, &Diagnostics::loopTimeAvgSensor, &Diagnostics::loopTimeP99Sensor, &Diagnostics::loopTimeMaxSensor};
+    for (HASensorNumber *sensor : loopTimeSensors)
+    {
+        sensor->setIcon("mdi:timer-outline");
+        sensor->setUnitOfMeasurement("us");
+        sensor->setStateClass("measurement");
+        sensor->setEntityCategory("diagnostic");
+    }
+
+    Diagnostics::adcRateSensor.setName("ADC Sample Rate");
+    Diagnostics::adcRateSensor.setIcon("mdi:sine-wave");
+    Diagnostics::adcRateSensor.setUnitOfMeasurement("samples/s");
+    Diagnostics::adcRateSensor.setStateClass("measurement");
+    Diagnostics::adcRateSensor.setEntityCategory("diagnostic");
+
+    Diagnostics::missedPulsesSensor.setName("Missed Pulses Suspected");
+    Diagnostics::missedPulsesSensor.setIcon("mdi:pulse");
+    Diagnostics::missedPulsesSensor.setStateClass("total_increasing");
+    Diagnostics::missedPulsesSensor.setEntityCategory("diagnostic");
+
+    Diagnostics::cyclesSensor.setName("CPU Usage");
+    Diagnostics::cyclesSensor.setIcon("mdi:cpu-32-bit");
+    Diagnostics::cyclesSensor.setEntityCategory("diagnostic");
+
+    Diagnostics::lastSendTime = MonotonicClock::now();
+}
+
+/**
+ * @brief adds the time of a main loop iteration (core 0) to the histogram
+ *
+ * @param loopTime in microseconds
+ */
+void Diagnostics::addLoopTime(unsigned long loopTime)
+{
+    // the number of bits of the loop time
+    int bucket = 0;
+    for (unsigned long value = loopTime; value > 0 && bucket < DIAGNOSTICS_HISTOGRAM_BUCKETS - 1; value >>= 1)
+    {
+        bucket++;
+    }
+    Diagnostics::histogram[bucket]++;
+    Diagnostics::loops++;
+    Diagnostics::totalLoopTime += loopTime;
+    if (loopTime < Diagnostics::minLoopTime)
+    {
+        Diagnostics::minLoopTime = loopTime;
+    }
+    if (loopTime > Diagnostics::maxLoopTime)
+    {
+        Diagnostics::maxLoopTime = loopTime;
+    }
+}
+
+/**
+ * @brief the loop time that percent of the loop iterations did not exceed,
+ * rounded up to the top of its histogram bucket (but never more than the max)
+ *
+ * @param percent
+ * @return unsigned long in microseconds
+ */
+unsigned long Diagnostics::percentile(int percent)
+{
+    const unsigned long long target = (unsigned long long)Diagnostics::loops * percent;
+    unsigned long long count = 0;
+    for (int bucket = 0; bucket < DIAGNOSTICS_HISTOGRAM_BUCKETS; bucket++)
+    {
+        count += Diagnostics::histogram[bucket];
+        if (count * 100 >= target && bucket < DIAGNOSTICS_HISTOGRAM_BUCKETS - 1)
+        {
+            const unsigned long top = (1UL << bucket) - 1;
+            return top < Diagnostics::maxLoopTime ? top : Diagnostics::maxLoopTime;
+        }
+    }
+    return Diagnostics::maxLoopTime;
+}
+
+void Diagnostics::resetLoopTimes()
+{
+    memset(Diagnostics::histogram, 0, sizeof(Diagnostics::histogram));
+    Diagnostics::loops = 0;
+    Diagnostics::minLoopTime = ULONG_MAX;
+    Diagnostics::maxLoopTime = 0;
+    Diagnostics::totalLoopTime = 0;
+}
+
+/**
+ * @brief adds the CPU cycles a sampling subsystem took (core 1)
+ *
+ * @param subsystem
+ * @param cycles
+ */
+void Diagnostics::addCycles(SamplingSubsystem subsystem, uint32_t cycles)
+{
+    Diagnostics::sampling.cycles[subsystem] += cycles;
+}
+
+/**
+ * @brief should be called for every new ADC block (core 1), after the sensors sampled it.
+ * it checks for a missed pulse and posts the counters of the sampling core.
+ */
+void Diagnostics::sample()
+{
+    // the dial kept turning for DIAGNOSTICS_MISSED_PULSE_GALLONS without a pulse
+    const bool isSuspected = FlowDetector::calibrated &&
+                             uint64_t(FlowDetector::crossingsSincePulse / 2) * 256 > uint64_t(FlowDetector::cyclesPerGallon) * DIAGNOSTICS_MISSED_PULSE_GALLONS;
+    if (isSuspected && !Diagnostics::isMissedPulseSuspected)
+    {
+        Diagnostics::sampling.missedPulses++;
+    }
+    Diagnostics::isMissedPulseSuspected = isSuspected;
+
+    Diagnostics::samplingReadings.write(Diagnostics::sampling);
+}
+
+/**
+ * @brief appends the usage of a subsystem to the CPU usage payload, ie. " pulse 1.5%",
+ * unless it is under 0.1% (or it does not fit)
+ *
+ * @param payload of DIAGNOSTICS_CYCLES_SIZE
+ * @param length of the payload, so far
+ * @param name
+ * @param cycles the CPU cycles the subsystem took
+ * @param elapsedCycles the CPU cycles that passed
+ */
+void Diagnostics::appendUsage(char *payload, int &length, const char *name, uint64_t cycles, uint64_t elapsedCycles)
+{
+    const unsigned long usage = (unsigned long)(cycles * 1000 / elapsedCycles);
+    if (usage > 0 && length < DIAGNOSTICS_CYCLES_SIZE)
+    {
+        length += snprintf(payload + length, DIAGNOSTICS_CYCLES_SIZE - length, " %s %lu.%lu%%", name, usage / 10, usage % 10);
+    }
+}
+
+/**
+ * @brief sends the diagnostics of the time since the last send.
+ * it is scheduled every DIAGNOSTICS_SEND_FREQUENCY, while connected (@see src/main.cpp)
+ */
+void Diagnostics::loop()
+{
+    // in milliseconds
+    const Instant now = MonotonicClock::now();
+    const uint64_t elapsed = uint64_t((now - Diagnostics::lastSendTime).toMillis());
+    if (elapsed == 0)
+    {
+        return;
+    }
+    Diagnostics::lastSendTime = now;
+
+    if (Diagnostics::loops > 0)
+    {
+        Diagnostics::loopTimeMinSensor.setValue(Diagnostics::minLoopTime);
+        Diagnostics::loopTimeAvgSensor.setValue((unsigned long)(Diagnostics::totalLoopTime / Diagnostics::loops));
+        Diagnostics::loopTimeP99Sensor.setValue(Diagnostics::percentile(99));
+        Diagnostics::loopTimeMaxSensor.setValue(Diagnostics::maxLoopTime);
+        Diagnostics::resetLoopTimes();
+    }
+
+    const uint32_t blocks = AdcSampler::completedBlocks;
+    Diagnostics::adcRateSensor.setValue((unsigned long)(uint64_t(blocks - Diagnostics::lastBlocks) * ADC_SAMPLER_BLOCK_SIZE * 1000 / elapsed));
+    Diagnostics::lastBlocks = blocks;
+
+    // the CPU usage of every subsystem, in tenths of a percent of its core
+    // (the ones under 0.1% are left out, to fit)
+    const uint64_t elapsedCycles = uint64_t(elapsed) * (F_CPU / 1000);
+    char payload[DIAGNOSTICS_CYCLES_SIZE];
+    int length = snprintf(payload, sizeof(payload), "core1:");
+    SamplingDiagnostics current;
+    if (Diagnostics::samplingReadings.read(current))
+    {
+        Diagnostics::missedPulsesSensor.setValue(current.missedPulses);
+        for (int i = 0; i < SAMPLING_SUBSYSTEMS; i++)
+        {
+            Diagnostics::appendUsage(payload, length, samplingNames[i], current.cycles[i] - Diagnostics::lastSampling.cycles[i], elapsedCycles);
+        }
+        Diagnostics::lastSampling = current;
+    }
+    if (length < DIAGNOSTICS_CYCLES_SIZE)
+    {
+        length += snprintf(payload + length, DIAGNOSTICS_CYCLES_SIZE - length, "; core0:");
+    }
+    for (int i = 0; i < Scheduler::taskCount; i++)
+    {
+        const SchedulerTask &task = Scheduler::tasks[i];
+        Diagnostics::appendUsage(payload, length, task.name, task.cycles - Diagnostics::lastTaskCycles[i], elapsedCycles);
+        Diagnostics::lastTaskCycles[i] = task.cycles;
+    }
+    Diagnostics::cyclesSensor.setValue(payload);
+}
@@ -0,0 +1,103 @@
+#ifndef DIAGNOSTICS
+#define DIAGNOSTICS
+
+#include <ArduinoHA.h>
+#include <stdint.h>
+#include "mailbox.h"
+#include "scheduler.h"
+#include "monotonicTime.h"
+
+/**
+ * @brief frequency in milliseconds, to send the diagnostics to the controller.
+ * every value covers the time since the previous send.
+ */
+#define DIAGNOSTICS_SEND_FREQUENCY 300000
+
+/**
+ * @brief number of (log2) buckets of the loop time histogram.
+ * bucket i counts the loop iterations that took from 2^(i-1) up to 2^i - 1 microseconds
+ * (bucket 0 the ones below 1 microsecond) and the last one, everything longer.
+ */
+#define DIAGNOSTICS_HISTOGRAM_BUCKETS 21
+
+/**
+ * @brief gallons the dial (IR sensor) may turn without a pulse,
+ * before a missed pulse gets suspected (once the cycles per gallon are learned)
+ * @see src/flowDetector.h
+ */
+#define DIAGNOSTICS_MISSED_PULSE_GALLONS 2
+
+/**
+ * @brief max length (including the terminator) of the CPU usage per subsystem.
+ * the controller keeps up to 255 characters of a state.
+ */
+#define DIAGNOSTICS_CYCLES_SIZE 256
+
+/**
+ * @brief the subsystems of the sampling core (core 1)
+ */
+enum SamplingSubsystem
+{
+    // the IR sensor (flow detector), on every ADC block
+    SamplingIr = 0,
+    // the pressure sensor, on every ADC block
+    SamplingPressure,
+    // the pulse sensor and the flow, on every loop1() iteration
+    SamplingPulse
+};
+
+#define SAMPLING_SUBSYSTEMS 3
+
+/**
+ * @brief the counters of the sampling core (since boot), posted for the main loop
+ */
+struct SamplingDiagnostics
+{
+    uint64_t cycles[SAMPLING_SUBSYSTEMS];
+    unsigned long missedPulses;
+};
+
+/**
+ * @brief the on-device performance, reported as diagnostic sensors at a low rate (without the debug switch):
+ * the loop time (min/avg/p99/max, from a log2 histogram), the CPU cycles of every subsystem
+ * (the scheduler tasks of core 0 and the sampling of core 1), the suspected missed pulses
+ * and the ADC sample rate.
+ */
+class Diagnostics
+{
+public:
+    // properties
+    static uint32_t histogram[DIAGNOSTICS_HISTOGRAM_BUCKETS];
+    static unsigned long loops;
+    static unsigned long minLoopTime;
+    static unsigned long maxLoopTime;
+    static unsigned long long totalLoopTime;
+    static SamplingDiagnostics sampling;
+    static bool isMissedPulseSuspected;
+    static Mailbox<SamplingDiagnostics> samplingReadings;
+    static SamplingDiagnostics lastSampling;
+    static uint64_t lastTaskCycles[SCHEDULER_MAX_TASKS];
+    static uint32_t lastBlocks;
+    static Instant lastSendTime;
+    static HASensorNumber loopTimeMinSensor;
+    static HASensorNumber loopTimeAvgSensor;
+    static HASensorNumber loopTimeP99Sensor;
+    static HASensorNumber loopTimeMaxSensor;
+    static HASensorNumber adcRateSensor;
+    static HASensorNumber missedPulsesSensor;
+    static HASensor cyclesSensor;
+
+    // methods
+    static void setup();
+    static void addLoopTime(unsigned long loopTime);
+    static unsigned long percentile(int percent);
+    static void addCycles(SamplingSubsystem subsystem, uint32_t cycles);
+    static void sample();
+    static void loop();
+
+private:
+    static void resetLoopTimes();
+    static void appendUsage(char *payload, int &length, const char *name, uint64_t cycles, uint64_t elapsedCycles);
+};
+
+#endif // DIAGNOSTICS
@@ -0,0 +1,73 @@
+#ifndef FIXED_POINT
+#define FIXED_POINT
+
+#include <stdint.h>
+
+/**
+ * @brief a signed 32bit fixed point number, with FRACTION_BITS fractional bits (ie. Q16.16 for 16).
+ *
+ * the RP2040's Cortex-M0+ has no FPU, so every float operation is a (slow) software routine,
+ * while these are plain integer operations (and the 32bit divisions use the hardware divider).
+ * constructing one from a constant (ie. Fixed<16>(0.1)) is constexpr, so it gets folded at compile time.
+ *
+ * @tparam FRACTION_BITS
+ */
+template <int FRACTION_BITS>
+class Fixed
+{
+    static_assert(FRACTION_BITS > 0 && FRACTION_BITS < 31, "Fixed FRACTION_BITS must be within 1-30");
+
+public:
+    static constexpr int32_t ONE = int32_t(1) << FRACTION_BITS;
+
+    int32_t raw;
+
+    constexpr Fixed() : raw(0) {}
+    constexpr Fixed(int value) : raw(int32_t(value) * ONE) {}
+    constexpr Fixed(double value) : raw(int32_t(value * ONE + (value < 0 ? -0.5 : 0.5))) {}
+
+    static constexpr Fixed fromRaw(int32_t raw)
+    {
+        Fixed value;
+        value.raw = raw;
+        return value;
+    }
+
+    /**
+     * @brief numerator / denominator, saturated to the max value
+     */
+    static constexpr Fixed ratio(int64_t numerator, int64_t denominator)
+    {
+        const int64_t raw = (numerator * ONE) / denominator;
+        return Fixed::fromRaw(raw > INT32_MAX ? INT32_MAX : (raw < INT32_MIN ? INT32_MIN : int32_t(raw)));
+    }
+
+    constexpr float toFloat() const
+    {
+        return float(this->raw) * (1.0f / ONE);
+    }
+
+    constexpr explicit operator float() const
+    {
+        return this->toFloat();
+    }
+
+    constexpr int32_t toInt() const
+    {
+        return this->raw / ONE;
+    }
+
+    constexpr Fixed operator-() const { return Fixed::fromRaw(-this->raw); }
+    constexpr Fixed operator+(Fixed other) const { return Fixed::fromRaw(this->raw + other.raw); }
+    constexpr Fixed operator-(Fixed other) const { return Fixed::fromRaw(this->raw - other.raw); }
+    constexpr Fixed operator*(Fixed other) const { return Fixed::fromRaw(int32_t((int64_t(this->raw) * other.raw) >> FRACTION_BITS)); }
+    constexpr Fixed operator/(Fixed other) const { return Fixed::fromRaw(int32_t((int64_t(this->raw) * ONE) / other.raw)); }
+    constexpr bool operator==(Fixed other) const { return this->raw == other.raw; }
+    constexpr bool operator!=(Fixed other) const { return this->raw != other.raw; }
+    constexpr bool operator<(Fixed other) const { return this->raw < other.raw; }
+    constexpr bool operator<=(Fixed other) const { return this->raw <= other.raw; }
+    constexpr bool operator>(Fixed other) const { return this->raw > other.raw; }
+    constexpr bool operator>=(Fixed other) const { return this->raw >= other.raw; }
+};
+
+#endif // FIXED_POINT
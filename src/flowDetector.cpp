@@ -0,0 +1,328 @@
+#include "flowDetector.h"
+
+// the hysteresis in ADC counts, the crossings in a row to start and the max stop timeout in milliseconds
+int32_t FlowDetector::hysteresis = FLOW_DETECTOR_HYSTERESIS;
+unsigned long FlowDetector::startCrossings = FLOW_DETECTOR_START_CROSSINGS;
+unsigned long FlowDetector::maxStopTimeout = FLOW_DETECTOR_MAX_STOP_TIMEOUT;
+
+// the DC (baseline) of the IR signal and what is left of the last sample (minus the DC), in Q8 fixed point
+int32_t FlowDetector::dc = 0;
+int32_t FlowDetector::ac = 0;
+
+// false until the first sample initializes the DC
+bool FlowDetector::hasDc = false;
+
+// which side of the hysteresis band the signal was last (1 above, -1 below, 0 not yet known)
+int8_t FlowDetector::side = 0;
+
+// the times of the most recent crossings (a ring)
+Instant FlowDetector::crossings[FLOW_DETECTOR_CROSSINGS];
+
+// how many of the crossings are valid (up to FLOW_DETECTOR_CROSSINGS)
+uint8_t FlowDetector::crossingsCount = 0;
+
+// where the next crossing goes in the ring
+uint8_t FlowDetector::crossingsHead = 0;
+
+// number of crossings in a row, no more than FLOW_DETECTOR_MAX_HALF_PERIOD apart
+unsigned long FlowDetector::consecutiveCrossings = 0;
+
+// number of crossings since the last pulse (to learn the cycles per gallon)
+unsigned long FlowDetector::crossingsSincePulse = 0;
+
+// if we had a pulse (since boot) and when
+bool FlowDetector::hasPulse = false;
+Instant FlowDetector::lastPulseTime;
+
+// the (Q8) IR value the signal last moved (by more than the hysteresis) to, in which direction (1 up, -1 down, 0 not yet known),
+// the extreme it reached since in that direction and when it moved (or the time of the last pulse, if later)
+int32_t FlowDetector::stillValue = 0;
+int8_t FlowDetector::stillDirection = 0;
+int32_t FlowDetector::stillExtreme = 0;
+Instant FlowDetector::lastMovement;
+
+// true when the flow was detected by the IR signal, all the way since the last pulse
+bool FlowDetector::activeSincePulse = false;
+
+// IR signal cycles (dial rotations) per gallon, in Q8 fixed point
+uint32_t FlowDetector::cyclesPerGallon = uint32_t(FLOW_DETECTOR_CYCLES_PER_GALLON) << 8;
+
+// true once the cycles per gallon have been learned from the pulses
+bool FlowDetector::calibrated = false;
+
+// true while there is flow
+bool FlowDetector::isActive = false;
+
+/**
+ * @brief processes the next IR sample
+ *
+ * @param irValue the IR sensor value
+ * @param time the time of the sample
+ */
+void FlowDetector::update(int irValue, Instant time)
+{
+    const int32_t value = int32_t(irValue) << 8;
+    if (!FlowDetector::hasDc)
+    {
+        FlowDetector::hasDc = true;
+        FlowDetector::dc = value;
+        FlowDetector::stillValue = value;
+        FlowDetector::stillDirection = 0;
+        FlowDetector::stillExtreme = value;
+        FlowDetector::lastMovement = time;
+    }
+
+    // remove the DC
+    FlowDetector::dc += (value - FlowDetector::dc) >> FLOW_DETECTOR_DC_SHIFT;
+    const int32_t ac = value - FlowDetector::dc;
+    FlowDetector::ac = ac;
+
+    // schmitt trigger around zero
+    const int32_t hysteresis = FlowDetector::hysteresis << 8;
+    // the dial moves, while the signal gets further than the hysteresis from where it last moved to,
+    // or back from the extreme it reached since (so that the turn at a peak does not take twice the hysteresis)
+    const int32_t moved = value - FlowDetector::stillValue;
+    const int32_t back = FlowDetector::stillDirection * (FlowDetector::stillExtreme - value);
+    if (moved > hysteresis || moved < -hysteresis || back > hysteresis)
+    {
+        FlowDetector::stillDirection = value > FlowDetector::stillValue ? 1 : -1;
+        FlowDetector::stillValue = value;
+        FlowDetector::stillExtreme = value;
+        FlowDetector::lastMovement = time;
+    }
+    else if (FlowDetector::stillDirection * (value - FlowDetector::stillExtreme) > 0)
+    {
+        FlowDetector::stillExtreme = value;
+    }
+    int8_t side = FlowDetector::side;
+    if (ac > hysteresis)
+    {
+        side = 1;
+    }
+    else if (ac < -hysteresis)
+    {
+        side = -1;
+    }
+    if (side != FlowDetector::side)
+    {
+        if (FlowDetector::side != 0)
+        {
+            FlowDetector::onCrossing(time);
+        }
+        FlowDetector::side = side;
+    }
+
+    if (!FlowDetector::isActive)
+    {
+        return;
+    }
+
+    // check for the flow stop
+    bool keepActive = false;
+    if (FlowDetector::consecutiveCrossings >= FlowDetector::startCrossings)
+    {
+        // the IR signal detects the flow, so it decides
+        keepActive = time - FlowDetector::lastCrossing() <= FlowDetector::stopTimeout() || FlowDetector::isMoving(time);
+    }
+    else if (FlowDetector::hasPulse)
+    {
+        // only a pulse detected the flow (so far)
+        keepActive = time - FlowDetector::lastPulseTime <= Duration::millis(FLOW_DETECTOR_PULSE_KEEP_ACTIVE);
+    }
+    if (!keepActive)
+    {
+        FlowDetector::setActive(false);
+    }
+}
+
+/**
+ * @brief should be called on every (debounced) pulse.
+ * the pulse is more reliable than the IR signal, so it always marks the flow as active.
+ * when the IR signal has been detecting the flow all the way since the previous pulse,
+ * the crossings since then, are the cycles of one gallon.
+ *
+ * @param time the time of the pulse
+ */
+void FlowDetector::onPulse(Instant time)
+{
+    const bool detected = FlowDetector::isActive && FlowDetector::consecutiveCrossings >= FlowDetector::startCrossings;
+    if (FlowDetector::activeSincePulse && detected && FlowDetector::crossingsSincePulse >= 4)
+    {
+        // every crossing is half a cycle (so that a fraction of a cycle per gallon is not always rounded down)
+        const uint32_t measured = uint32_t(FlowDetector::crossingsSincePulse) << 7;
+        if (!FlowDetector::calibrated)
+        {
+            FlowDetector::calibrated = true;
+            FlowDetector::cyclesPerGallon = measured;
+        }
+        else if (measured >= FlowDetector::cyclesPerGallon / 2 && measured <= FlowDetector::cyclesPerGallon * 2)
+        {
+            // smooth it out, in case a gallon started/ended at a different dial position
+            FlowDetector::cyclesPerGallon = uint32_t(int32_t(FlowDetector::cyclesPerGallon) + (int32_t(measured) - int32_t(FlowDetector::cyclesPerGallon)) / 4);
+        }
+    }
+
+    FlowDetector::crossingsSincePulse = 0;
+    FlowDetector::hasPulse = true;
+    FlowDetector::lastPulseTime = time;
+    if (time > FlowDetector::lastMovement)
+    {
+        FlowDetector::lastMovement = time;
+    }
+    FlowDetector::setActive(true);
+    FlowDetector::activeSincePulse = detected;
+}
+
+/**
+ * @brief the time of the most recent crossing (only valid when crossingsCount > 0)
+ */
+Instant FlowDetector::lastCrossing()
+{
+    return FlowDetector::crossings[(FlowDetector::crossingsHead + FLOW_DETECTOR_CROSSINGS - 1) % FLOW_DETECTOR_CROSSINGS];
+}
+
+/**
+ * @brief the average time between the recent crossings (half a dial rotation)
+ *
+ * @return 0 when unknown (less than 2 crossings)
+ */
+Duration FlowDetector::halfPeriod()
+{
+    if (FlowDetector::crossingsCount < 2)
+    {
+        return Duration();
+    }
+    const Instant oldest = FlowDetector::crossings[(FlowDetector::crossingsHead + FLOW_DETECTOR_CROSSINGS - FlowDetector::crossingsCount) % FLOW_DETECTOR_CROSSINGS];
+    return (FlowDetector::lastCrossing() - oldest) / (FlowDetector::crossingsCount - 1);
+}
+
+/**
+ * @brief the time without a crossing, after which the flow is considered stopped
+ */
+Duration FlowDetector::stopTimeout()
+{
+    Duration timeout = FlowDetector::halfPeriod() * FLOW_DETECTOR_STOP_HALF_PERIODS;
+    if (timeout < Duration::millis(FLOW_DETECTOR_MIN_STOP_TIMEOUT))
+    {
+        timeout = Duration::millis(FLOW_DETECTOR_MIN_STOP_TIMEOUT);
+    }
+    if (timeout > Duration::millis(FlowDetector::maxStopTimeout))
+    {
+        timeout = Duration::millis(FlowDetector::maxStopTimeout);
+    }
+    return timeout;
+}
+
+/**
+ * @brief whether the dial is still moving, after the stop timeout has passed without a crossing (ie. the flow dropped sharply).
+ * it is, until FLOW_DETECTOR_MAX_STOP_TIMEOUT since the last crossing, as long as the IR signal (or a pulse)
+ * moved within the stop timeout or the last FLOW_DETECTOR_STILL_SHARE of the time since the last crossing, whichever is longer.
+ *
+ * @param time now
+ */
+bool FlowDetector::isMoving(Instant time)
+{
+    const Duration sinceCrossing = time - FlowDetector::lastCrossing();
+    if (sinceCrossing > Duration::millis(FlowDetector::maxStopTimeout))
+    {
+        return false;
+    }
+    Duration still = sinceCrossing * FLOW_DETECTOR_STILL_SHARE / 100;
+    if (still < FlowDetector::stopTimeout())
+    {
+        still = FlowDetector::stopTimeout();
+    }
+    return time - FlowDetector::lastMovement <= still;
+}
+
+/**
+ * @brief the dial rotation frequency, in milli-Hz.
+ * when the time since the last crossing is longer than the half period, it uses that instead,
+ * so that the estimate decays as the dial slows down.
+ *
+ * @param time now
+ * @return 0 when there's no flow or it is unknown
+ */
+uint32_t FlowDetector::frequency(Instant time)
+{
+    Duration half = FlowDetector::halfPeriod();
+    if (!FlowDetector::isActive || half <= Duration() || FlowDetector::consecutiveCrossings < FlowDetector::startCrossings)
+    {
+        return 0;
+    }
+    const Duration sinceCrossing = time - FlowDetector::lastCrossing();
+    if (sinceCrossing > half)
+    {
+        half = sinceCrossing;
+    }
+    // 1 / (2 * half us) Hz
+    return uint32_t(500000000LL / half.toMicros());
+}
+
+/**
+ * @brief the flow estimate from the dial rotation frequency, in milli-GPM
+ *
+ * @param time now
+ * @return 0 when there's no flow, it is unknown or the cycles per gallon have not been learned yet
+ */
+uint32_t FlowDetector::gpm(Instant time)
+{
+    const uint32_t frequency = FlowDetector::frequency(time);
+    if (!FlowDetector::calibrated || frequency == 0)
+    {
+        return 0;
+    }
+    // mHz * 60 seconds / cycles per gallon (Q8)
+    return uint32_t((uint64_t(frequency) * 60 * 256) / FlowDetector::cyclesPerGallon);
+}
+
+/**
+ * @brief forgets everything but the learned cycles per gallon
+ */
+void FlowDetector::reset()
+{
+    FlowDetector::hasDc = false;
+    FlowDetector::side = 0;
+    FlowDetector::crossingsCount = 0;
+    FlowDetector::crossingsHead = 0;
+    FlowDetector::consecutiveCrossings = 0;
+    FlowDetector::crossingsSincePulse = 0;
+    FlowDetector::hasPulse = false;
+    FlowDetector::activeSincePulse = false;
+    FlowDetector::isActive = false;
+}
+
+void FlowDetector::onCrossing(Instant time)
+{
+    if (FlowDetector::crossingsCount > 0 && time - FlowDetector::lastCrossing() > Duration::millis(FLOW_DETECTOR_MAX_HALF_PERIOD))
+    {
+        // too far apart, start over
+        FlowDetector::crossingsCount = 0;
+        FlowDetector::consecutiveCrossings = 0;
+    }
+
+    FlowDetector::crossings[FlowDetector::crossingsHead] = time;
+    FlowDetector::crossingsHead = (FlowDetector::crossingsHead + 1) % FLOW_DETECTOR_CROSSINGS;
+    if (FlowDetector::crossingsCount < FLOW_DETECTOR_CROSSINGS)
+    {
+        FlowDetector::crossingsCount++;
+    }
+    FlowDetector::consecutiveCrossings++;
+    FlowDetector::crossingsSincePulse++;
+
+    if (!FlowDetector::isActive && FlowDetector::consecutiveCrossings >= FlowDetector::startCrossings)
+    {
+        FlowDetector::setActive(true);
+    }
+}
+
+void FlowDetector::setActive(bool active)
+{
+    FlowDetector::isActive = active;
+    if (!active)
+    {
+        FlowDetector::consecutiveCrossings = 0;
+        FlowDetector::crossingsCount = 0;
+        FlowDetector::activeSincePulse = false;
+    }
+}
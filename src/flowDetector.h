@@ -0,0 +1,148 @@
+#ifndef FLOW_DETECTOR
+#define FLOW_DETECTOR
+
+#include <stdint.h>
+#include "monotonicTime.h"
+
+/**
+ * @brief the DC (baseline) of the IR signal is tracked with an exponential moving average,
+ * with a smoothing factor of 1/2^FLOW_DETECTOR_DC_SHIFT per sample.
+ * with ~39 samples (ADC blocks) per second, 9 is a time constant of ~13 seconds,
+ * which must be longer than the slowest dial rotation we want to detect.
+ */
+#ifndef FLOW_DETECTOR_DC_SHIFT
+#define FLOW_DETECTOR_DC_SHIFT 9
+#endif
+
+/**
+ * @brief the hysteresis (in ADC counts, around the DC) the IR signal must cross,
+ * to count as a zero crossing. this keeps the noise from counting as crossings.
+ *
+ * the noise of the IR module depends on the power supply (worse on computer USB/power than on a clean external one),
+ * but the block averaging of the ADC samples removes most of it.
+ */
+#ifndef FLOW_DETECTOR_HYSTERESIS
+#define FLOW_DETECTOR_HYSTERESIS 4
+#endif
+
+/**
+ * @brief number of consecutive crossings (half dial rotations), for the flow to be considered started
+ */
+#ifndef FLOW_DETECTOR_START_CROSSINGS
+#define FLOW_DETECTOR_START_CROSSINGS 4
+#endif
+
+/**
+ * @brief the max time in milliseconds between two consecutive crossings.
+ * crossings further apart are not consecutive (they are noise or a dial that barely moves).
+ */
+#ifndef FLOW_DETECTOR_MAX_HALF_PERIOD
+#define FLOW_DETECTOR_MAX_HALF_PERIOD 15000
+#endif
+
+/**
+ * @brief the flow is considered stopped, when there is no crossing for
+ * FLOW_DETECTOR_STOP_HALF_PERIODS times the current half period (the time between two crossings),
+ * but no less than FLOW_DETECTOR_MIN_STOP_TIMEOUT and no more than FLOW_DETECTOR_MAX_STOP_TIMEOUT milliseconds.
+ *
+ * at normal flows, that detects a stop within a few seconds.
+ * at very low flows, the Flow Indicator propeler spins intermittently (it stops for ~10 seconds at a time),
+ * since the flow falls at the threshold of the Water Meter's minimum flow detection rate,
+ * hence the ~30 seconds max.
+ *
+ * when the flow drops sharply, the next crossing comes much later than the current half period suggests.
+ * so, while the IR signal (or a pulse) still shows the dial moving, the timeout grows with the time since the last crossing
+ * (up to FLOW_DETECTOR_MAX_STOP_TIMEOUT) and the flow is only considered stopped, once the dial has been still
+ * for longer than FLOW_DETECTOR_STILL_SHARE of that time (@see FlowDetector::isMoving()).
+ */
+#ifndef FLOW_DETECTOR_STOP_HALF_PERIODS
+#define FLOW_DETECTOR_STOP_HALF_PERIODS 3
+#endif
+#ifndef FLOW_DETECTOR_MIN_STOP_TIMEOUT
+#define FLOW_DETECTOR_MIN_STOP_TIMEOUT 2000
+#endif
+#ifndef FLOW_DETECTOR_MAX_STOP_TIMEOUT
+#define FLOW_DETECTOR_MAX_STOP_TIMEOUT 30000
+#endif
+
+/**
+ * @brief the share (in percent) of the time since the last crossing, the dial may be still before the flow is considered stopped.
+ * near the peaks of a slow dial, the IR signal barely moves for up to ~40% of the half period,
+ * while after a stop it takes about twice (share / (100 - share)) the time the dial moved since the last crossing, to notice it.
+ */
+#define FLOW_DETECTOR_STILL_SHARE 67
+
+/**
+ * @brief time in milliseconds to keep the flow active after a pulse,
+ * when the IR signal itself has not (yet) detected the flow.
+ */
+#define FLOW_DETECTOR_PULSE_KEEP_ACTIVE 30000
+
+/**
+ * @brief number of recent crossings to estimate the rotation frequency from.
+ */
+#define FLOW_DETECTOR_CROSSINGS 8
+
+/**
+ * @brief the initial number of IR signal cycles (dial rotations) per gallon.
+ * it gets learned from the pulses (@see FlowDetector::onPulse()) and
+ * no GPM estimate is provided, until it has been learned at least once.
+ */
+#define FLOW_DETECTOR_CYCLES_PER_GALLON 12
+
+/**
+ * @brief a streaming, fixed memory and integer only, flow detector of the spinning dial.
+ *
+ * instead of counting sample to sample deltas, it removes the DC of the IR signal and
+ * counts the zero crossings (with hysteresis) of what is left.
+ * every crossing is half a dial rotation, so the time between them gives the rotation frequency directly
+ * and with the cycles per gallon, a GPM estimate between the (1 per gallon) meter pulses.
+ *
+ * it must only be used from core 1 (the tunables get posted to it, @see Config::applySampling()).
+ */
+class FlowDetector
+{
+public:
+    // the tunables (@see src/config.h), FLOW_DETECTOR_HYSTERESIS, FLOW_DETECTOR_START_CROSSINGS and FLOW_DETECTOR_MAX_STOP_TIMEOUT by default
+    static int32_t hysteresis;
+    static unsigned long startCrossings;
+    static unsigned long maxStopTimeout;
+
+    // properties
+    static int32_t dc;
+    static int32_t ac;
+    static bool hasDc;
+    static int8_t side;
+    static Instant crossings[FLOW_DETECTOR_CROSSINGS];
+    static uint8_t crossingsCount;
+    static uint8_t crossingsHead;
+    static unsigned long consecutiveCrossings;
+    static unsigned long crossingsSincePulse;
+    static bool hasPulse;
+    static Instant lastPulseTime;
+    static int32_t stillValue;
+    static int8_t stillDirection;
+    static int32_t stillExtreme;
+    static Instant lastMovement;
+    static bool activeSincePulse;
+    static uint32_t cyclesPerGallon;
+    static bool calibrated;
+    static bool isActive;
+
+    // methods
+    static void update(int irValue, Instant time);
+    static void onPulse(Instant time);
+    static Instant lastCrossing();
+    static Duration halfPeriod();
+    static Duration stopTimeout();
+    static bool isMoving(Instant time);
+    static uint32_t frequency(Instant time);
+    static uint32_t gpm(Instant time);
+    static void reset();
+
+private:
+    static void onCrossing(Instant time);
+    static void setActive(bool active);
+};
+
+#endif // FLOW_DETECTOR
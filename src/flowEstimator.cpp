@@ -0,0 +1,249 @@
+#include "flowEstimator.h"
+#include "flowDetector.h"
+
+// one gallon, in Q16
+#define FLOW_ESTIMATOR_GALLON (int64_t(1) << 16)
+
+// microseconds per minute, to convert a volume over a time to GPM
+#define FLOW_ESTIMATOR_MINUTE 60000000LL
+
+// true once the rate (flow) of the current flow is known
+bool FlowEstimator::hasRate = false;
+
+// the volume (Q16 gallons) since the flow started and its rate (Q16 GPM), at time
+int64_t FlowEstimator::volume = 0;
+int64_t FlowEstimator::rate = 0;
+Instant FlowEstimator::time;
+
+// the volume (Q16 gallons) and the time of the recent crossings (a ring) and how many of them are valid,
+// if the crossings are measuring the volume (the IR signal detects the flow and has learned the cycles per gallon)
+int64_t FlowEstimator::crossingVolume[FLOW_ESTIMATOR_CROSSINGS];
+Instant FlowEstimator::crossingTime[FLOW_ESTIMATOR_CROSSINGS];
+uint8_t FlowEstimator::crossingsHead = 0;
+uint8_t FlowEstimator::crossings = 0;
+
+// the volume the pulses measured (Q16 gallons) and the time of the last pulse, if there was one since the flow started
+bool FlowEstimator::hasPulse = false;
+int64_t FlowEstimator::pulseVolume = 0;
+Instant FlowEstimator::pulseTime;
+
+/**
+ * @brief should be called for every IR sample, after FlowDetector::update().
+ * every new crossing is half a dial rotation (cycle) after the previous one.
+ * it only works on the crossings (and their times), so the sample itself is not needed.
+ */
+void FlowEstimator::update()
+{
+    if (!FlowDetector::isActive)
+    {
+        if (FlowEstimator::hasRate || FlowEstimator::hasPulse)
+        {
+            FlowEstimator::reset();
+        }
+        return;
+    }
+    if (!FlowDetector::calibrated || FlowDetector::consecutiveCrossings < FlowDetector::startCrossings)
+    {
+        // the crossings do not (yet) measure the volume
+        FlowEstimator::crossings = 0;
+        return;
+    }
+    const Instant crossing = FlowDetector::lastCrossing();
+    if (FlowEstimator::crossings > 0 && crossing == FlowEstimator::lastCrossing())
+    {
+        return;
+    }
+
+    if (!FlowEstimator::hasRate)
+    {
+        // the flow just started, from the rotation frequency of the crossings that detected it
+        FlowEstimator::rate = (int64_t(FlowDetector::gpm(crossing)) << 16) / 1000;
+        FlowEstimator::hasRate = FlowEstimator::rate > 0;
+        FlowEstimator::volume = 0;
+        FlowEstimator::time = crossing;
+    }
+    else if (FlowEstimator::crossings < 2)
+    {
+        // the crossings start measuring from where the volume is
+        FlowEstimator::predict(crossing);
+    }
+    else
+    {
+        // whole cycles (so that the uneven halves of the IR signal cancel out),
+        // over the most recent crossing at least FLOW_ESTIMATOR_MIN_BASELINE before (or the oldest one)
+        uint8_t back = 2;
+        while (back + 2 <= FlowEstimator::crossings && crossing - FlowEstimator::crossingTime[FlowEstimator::crossingIndex(back)] < Duration::millis(FLOW_ESTIMATOR_MIN_BASELINE))
+        {
+            back += 2;
+        }
+        const uint8_t index = FlowEstimator::crossingIndex(back);
+        // an overdue crossing (the flow dropped sharply) starts the correction from the bound rate, rather than from the old flow
+        FlowEstimator::rate = FlowEstimator::overdueRate(crossing);
+        FlowEstimator::correct(FlowEstimator::crossingVolume[index] + back * FlowEstimator::halfCycle(), crossing, crossing - FlowEstimator::crossingTime[index], FLOW_ESTIMATOR_IR_ALPHA, FLOW_ESTIMATOR_IR_BETA);
+    }
+    FlowEstimator::crossingVolume[FlowEstimator::crossingsHead] = FlowEstimator::volume;
+    FlowEstimator::crossingTime[FlowEstimator::crossingsHead] = crossing;
+    FlowEstimator::crossingsHead = (FlowEstimator::crossingsHead + 1) % FLOW_ESTIMATOR_CROSSINGS;
+    if (FlowEstimator::crossings < FLOW_ESTIMATOR_CROSSINGS)
+    {
+        FlowEstimator::crossings++;
+    }
+}
+
+/**
+ * @brief should be called on every (debounced) pulse, after FlowDetector::onPulse().
+ * the first pulse of a flow only marks where the gallon ended (the flow may have started anywhere within it),
+ * every next one is exactly one gallon after the previous one.
+ *
+ * @param time the time of the pulse
+ */
+void FlowEstimator::onPulse(Instant time)
+{
+    if (!FlowEstimator::hasPulse)
+    {
+        if (FlowEstimator::hasRate)
+        {
+            FlowEstimator::predict(time);
+        }
+        FlowEstimator::hasPulse = true;
+        FlowEstimator::pulseVolume = FlowEstimator::volume;
+        FlowEstimator::pulseTime = time;
+        return;
+    }
+
+    const Duration interval = time - FlowEstimator::pulseTime;
+    FlowEstimator::pulseVolume += FLOW_ESTIMATOR_GALLON;
+    FlowEstimator::pulseTime = time;
+    if (interval <= Duration())
+    {
+        return;
+    }
+    if (!FlowEstimator::hasRate)
+    {
+        // only the pulses measure the flow (so far)
+        FlowEstimator::hasRate = true;
+        FlowEstimator::rate = FLOW_ESTIMATOR_GALLON * FLOW_ESTIMATOR_MINUTE / interval.toMicros();
+        FlowEstimator::volume = FlowEstimator::pulseVolume;
+        FlowEstimator::time = time;
+        return;
+    }
+
+    const int64_t correction = FlowEstimator::correct(FlowEstimator::pulseVolume, time, interval, FLOW_ESTIMATOR_PULSE_ALPHA, FLOW_ESTIMATOR_PULSE_BETA);
+    // the crossings carry on from the corrected volume
+    for (int64_t &volume : FlowEstimator::crossingVolume)
+    {
+        volume += correction;
+    }
+}
+
+/**
+ * @brief the flow estimate, in milli-GPM
+ *
+ * @param time now
+ * @return 0 when there's no flow or it is unknown (ie. a single pulse and no learned cycles per gallon)
+ */
+uint32_t FlowEstimator::gpm(Instant time)
+{
+    if (!FlowEstimator::hasRate)
+    {
+        return 0;
+    }
+
+    return uint32_t((FlowEstimator::overdueRate(time) * 1000) >> 16);
+}
+
+/**
+ * @brief the rate (Q16 GPM) at the time, bound by the time since the last crossing (or pulse):
+ * when the next one is overdue, the flow is no more than FLOW_ESTIMATOR_OVERDUE_STEPS (percent) steps over the time since the last one
+ */
+int64_t FlowEstimator::overdueRate(Instant time)
+{
+    int64_t rate = FlowEstimator::rate;
+    const bool hasCrossing = FlowEstimator::crossings > 0;
+    const Instant last = hasCrossing ? FlowEstimator::lastCrossing() : FlowEstimator::pulseTime;
+    const int64_t step = hasCrossing ? FlowEstimator::halfCycle() : FLOW_ESTIMATOR_GALLON;
+    const Duration since = time - last;
+    if ((hasCrossing || FlowEstimator::hasPulse) && since > Duration())
+    {
+        const int64_t bound = step * FLOW_ESTIMATOR_OVERDUE_STEPS * FLOW_ESTIMATOR_MINUTE / (100 * since.toMicros());
+        rate = rate < bound ? rate : bound;
+    }
+    return rate;
+}
+
+/**
+ * @brief forgets the flow (it stopped)
+ */
+void FlowEstimator::reset()
+{
+    FlowEstimator::hasRate = false;
+    FlowEstimator::crossings = 0;
+    FlowEstimator::hasPulse = false;
+    FlowEstimator::volume = 0;
+    FlowEstimator::rate = 0;
+}
+
+/**
+ * @brief the time of the most recent crossing (only valid when crossings > 0)
+ */
+Instant FlowEstimator::lastCrossing()
+{
+    return FlowEstimator::crossingTime[FlowEstimator::crossingIndex(1)];
+}
+
+/**
+ * @brief the index (in the ring) of the crossing that many crossings back (1 for the most recent one)
+ */
+uint8_t FlowEstimator::crossingIndex(uint8_t back)
+{
+    return (FlowEstimator::crossingsHead + FLOW_ESTIMATOR_CROSSINGS - back) % FLOW_ESTIMATOR_CROSSINGS;
+}
+
+/**
+ * @brief the volume of half a dial rotation (the time between two crossings), in Q16 gallons
+ */
+int64_t FlowEstimator::halfCycle()
+{
+    // 1 gallon / (2 * cycles per gallon (Q8))
+    return (FLOW_ESTIMATOR_GALLON << 8) / (2 * int64_t(FlowDetector::cyclesPerGallon));
+}
+
+/**
+ * @brief moves the volume ahead to the time, at the current rate.
+ * a time before the current one (ie. a pulse captured before the last crossing) leaves it as is.
+ */
+void FlowEstimator::predict(Instant time)
+{
+    const Duration elapsed = time - FlowEstimator::time;
+    if (elapsed <= Duration())
+    {
+        return;
+    }
+    FlowEstimator::volume += FlowEstimator::rate * elapsed.toMicros() / FLOW_ESTIMATOR_MINUTE;
+    FlowEstimator::time = time;
+}
+
+/**
+ * @brief corrects the state with a measured volume
+ *
+ * @param measured the volume (Q16 gallons)
+ * @param time the time it was measured
+ * @param interval the time since the previous measurement of its kind
+ * @param alpha the share (in 1/256ths) of the volume error to correct
+ * @param beta the share (in 1/256ths) of the rate error (the volume error over the interval) to correct
+ * @return the volume correction
+ */
+int64_t FlowEstimator::correct(int64_t measured, Instant time, Duration interval, int32_t alpha, int32_t beta)
+{
+    FlowEstimator::predict(time);
+    const int64_t error = measured - FlowEstimator::volume;
+    const int64_t correction = error * alpha / 256;
+    FlowEstimator::volume += correction;
+    if (interval > Duration())
+    {
+        FlowEstimator::rate += error * beta * FLOW_ESTIMATOR_MINUTE / (256 * interval.toMicros());
+    }
+    const int64_t max = int64_t(FLOW_ESTIMATOR_MAX_GPM) << 16;
+    FlowEstimator::rate = FlowEstimator::rate < 0 ? 0 : (FlowEstimator::rate > max ? max : FlowEstimator::rate);
+    return correction;
+}
@@ -0,0 +1,87 @@
+#ifndef FLOW_ESTIMATOR
+#define FLOW_ESTIMATOR
+
+#include <stdint.h>
+#include "monotonicTime.h"
+
+/**
+ * @brief the gains (in 1/256ths) of the IR crossings: how much of the volume error and of the rate error
+ * (the volume error over the baseline) every crossing corrects.
+ */
+#define FLOW_ESTIMATOR_IR_ALPHA 128
+#define FLOW_ESTIMATOR_IR_BETA 192
+
+/**
+ * @brief the number of recent crossings the IR signal measures the volume over (an even number).
+ * every crossing measures the whole cycles since the most recent crossing at least FLOW_ESTIMATOR_MIN_BASELINE milliseconds before it
+ * (or the oldest one): whole cycles, since the halves of the IR signal are not even (the dial is not a perfect sine)
+ * and no less than the baseline, so that at high flows the timing of the crossings (an ADC block) does not make the estimate jitter.
+ */
+#define FLOW_ESTIMATOR_CROSSINGS 8
+#define FLOW_ESTIMATOR_MIN_BASELINE 1000
+
+/**
+ * @brief the gains (in 1/256ths) of the pulses: every pulse is exactly one gallon after the previous one,
+ * so it corrects most of the volume error and the rate error over the gallon.
+ */
+#define FLOW_ESTIMATOR_PULSE_ALPHA 192
+#define FLOW_ESTIMATOR_PULSE_BETA 96
+
+/**
+ * @brief how many (expected) measurement steps, in percent, may be missed before the estimate starts decaying.
+ * when the next crossing (or pulse) is late, the flow can not be more than
+ * FLOW_ESTIMATOR_OVERDUE_STEPS / 100 steps over the time since the last one, which brings the estimate down as the flow slows or stops,
+ * instead of waiting for the next measurement (@see FlowDetector::frequency()).
+ * one and a half, since the halves of the IR signal are not even (the dial is not a perfect sine).
+ */
+#define FLOW_ESTIMATOR_OVERDUE_STEPS 150
+
+/**
+ * @brief the max flow in GPM the estimate is clamped to
+ */
+#define FLOW_ESTIMATOR_MAX_GPM 30
+
+/**
+ * @brief fuses the IR crossings of the spinning dial (a fraction of a gallon each, once the cycles per gallon have been learned)
+ * with the meter pulses (exactly one gallon each), into a continuous flow estimate between (and at) the pulses.
+ *
+ * it is an alpha-beta tracker of the volume (and its rate, the flow) since the flow started:
+ * the state is predicted to the time of every measurement and corrected by a share of the error (alpha for the volume and beta for the rate),
+ * so that a change of the flow shows up within a few crossings (seconds), rather than a gallon later,
+ * while the pulses keep the volume (and the rate) of the crossings honest.
+ * with the pulses only (the IR signal has not learned the cycles per gallon yet), the rate is tracked from the second pulse on.
+ *
+ * it is fixed memory and integer only (Q16 gallons and GPM) and it must only be used from core 1, after the FlowDetector.
+ */
+class FlowEstimator
+{
+public:
+    // properties
+    static bool hasRate;
+    static int64_t volume;
+    static int64_t rate;
+    static Instant time;
+    static int64_t crossingVolume[FLOW_ESTIMATOR_CROSSINGS];
+    static Instant crossingTime[FLOW_ESTIMATOR_CROSSINGS];
+    static uint8_t crossingsHead;
+    static uint8_t crossings;
+    static bool hasPulse;
+    static int64_t pulseVolume;
+    static Instant pulseTime;
+
+    // methods
+    static void update();
+    static void onPulse(Instant time);
+    static uint32_t gpm(Instant time);
+    static void reset();
+
+private:
+    static Instant lastCrossing();
+    static uint8_t crossingIndex(uint8_t back);
+    static int64_t halfCycle();
+    static int64_t overdueRate(Instant time);
+    static void predict(Instant time);
+    static int64_t correct(int64_t measured, Instant time, Duration interval, int32_t alpha, int32_t beta);
+};
+
+#endif // FLOW_ESTIMATOR
@@ -0,0 +1,212 @@
+#include <ArduinoHA.h>
+#include "device.h"
+#include "debugFormatter.h"
+#include "switches.h"
+#include "config.h"
+#include "irCalibration.h"
+
+// the learned distributions of the IR signal (minus its DC, in half ADC counts) without and with flow and their samples
+uint32_t IrCalibration::noise[IR_CALIBRATION_BINS];
+uint32_t IrCalibration::active[IR_CALIBRATION_BINS];
+uint32_t IrCalibration::noiseSamples = 0;
+uint32_t IrCalibration::activeSamples = 0;
+
+// the current chunk of the quiet time (since when and its samples) and the previous one, until the current one confirms it
+uint32_t IrCalibration::chunk[IR_CALIBRATION_BINS];
+uint32_t IrCalibration::chunkSamples = 0;
+uint32_t IrCalibration::confirming[IR_CALIBRATION_BINS];
+bool IrCalibration::isConfirming = false;
+Instant IrCalibration::chunkStartTime;
+
+// the distribution since the last pulse, until the next one confirms it was flowing
+uint32_t IrCalibration::flowing[IR_CALIBRATION_BINS];
+
+// if we had a pulse (since boot) and when
+bool IrCalibration::hasPulse = false;
+Instant IrCalibration::lastPulseTime;
+
+// the levels of the distributions (written by core 1, read by core 0) and core 0's copy
+Mailbox<IrCalibrationReading> IrCalibration::readings;
+IrCalibrationReading IrCalibration::reading = {0, 0, 0, 0};
+
+// number of times the hysteresis got set (since boot)
+unsigned long IrCalibration::changes = 0;
+
+/**
+ * @brief should be called for every IR sample, after FlowDetector::update() (core 1)
+ *
+ * @param ac the IR signal minus its DC (Q8 ADC counts, @see FlowDetector::ac)
+ * @param time the time of the sample
+ */
+void IrCalibration::sample(int32_t ac, Instant time)
+{
+    const uint32_t magnitude = uint32_t(ac < 0 ? -ac : ac) >> 7;
+    const uint8_t bin = magnitude < IR_CALIBRATION_BINS - 1 ? magnitude : IR_CALIBRATION_BINS - 1;
+    IrCalibration::flowing[bin]++;
+
+    if (time - IrCalibration::lastPulseTime < Duration::millis(IR_CALIBRATION_QUIET_TIME))
+    {
+        return;
+    }
+    if (IrCalibration::chunkSamples == 0)
+    {
+        IrCalibration::chunkStartTime = time;
+    }
+    IrCalibration::chunk[bin]++;
+    IrCalibration::chunkSamples++;
+    if (time - IrCalibration::chunkStartTime < Duration::millis(IR_CALIBRATION_CHUNK))
+    {
+        return;
+    }
+
+    // the chunk ended without a pulse, so the one before it was surely noise
+    if (IrCalibration::isConfirming)
+    {
+        IrCalibration::merge(IrCalibration::noise, IrCalibration::noiseSamples, IrCalibration::confirming);
+        IrCalibration::post();
+    }
+    memcpy(IrCalibration::confirming, IrCalibration::chunk, sizeof(IrCalibration::confirming));
+    memset(IrCalibration::chunk, 0, sizeof(IrCalibration::chunk));
+    IrCalibration::isConfirming = true;
+    IrCalibration::chunkSamples = 0;
+}
+
+/**
+ * @brief should be called on every (debounced) pulse (core 1).
+ * the IR signal since the previous pulse was flowing (if it was not too long ago) and the quiet chunks (if any) were not noise.
+ *
+ * @param time the time of the pulse
+ */
+void IrCalibration::onPulse(Instant time)
+{
+    if (IrCalibration::hasPulse && time - IrCalibration::lastPulseTime <= Duration::millis(IR_CALIBRATION_FLOW_PULSE_GAP))
+    {
+        IrCalibration::merge(IrCalibration::active, IrCalibration::activeSamples, IrCalibration::flowing);
+        IrCalibration::post();
+    }
+    memset(IrCalibration::flowing, 0, sizeof(IrCalibration::flowing));
+    memset(IrCalibration::chunk, 0, sizeof(IrCalibration::chunk));
+    IrCalibration::chunkSamples = 0;
+    IrCalibration::isConfirming = false;
+    IrCalibration::hasPulse = true;
+    IrCalibration::lastPulseTime = time;
+}
+
+/**
+ * @brief adds (and clears) the samples of a distribution to a learned one.
+ * when that has too many, it gets halved, so that the old samples count less and less.
+ */
+void IrCalibration::merge(uint32_t *histogram, uint32_t &samples, uint32_t *from)
+{
+    samples = 0;
+    for (int i = 0; i < IR_CALIBRATION_BINS; i++)
+    {
+        histogram[i] += from[i];
+        from[i] = 0;
+        samples += histogram[i];
+    }
+    if (samples <= IR_CALIBRATION_MAX_SAMPLES)
+    {
+        return;
+    }
+    samples = 0;
+    for (int i = 0; i < IR_CALIBRATION_BINS; i++)
+    {
+        histogram[i] /= 2;
+        samples += histogram[i];
+    }
+}
+
+void IrCalibration::post()
+{
+    IrCalibration::readings.write({IrCalibration::noiseSamples,
+                                   IrCalibration::activeSamples,
+                                   IrCalibration::level(IrCalibration::noise, IrCalibration::noiseSamples, IR_CALIBRATION_NOISE_QUANTILE),
+                                   IrCalibration::level(IrCalibration::active, IrCalibration::activeSamples, IR_CALIBRATION_ACTIVE_QUANTILE)});
+}
+
+/**
+ * @brief the level (bin) of a distribution, that the quantile of the samples are at or under
+ *
+ * @param quantile in parts per million
+ */
+uint8_t IrCalibration::level(const uint32_t *histogram, uint32_t samples, uint32_t quantile)
+{
+    const uint32_t above = uint32_t(uint64_t(samples) * (1000000 - quantile) / 1000000);
+    uint32_t count = 0;
+    for (int i = IR_CALIBRATION_BINS - 1; i > 0; i--)
+    {
+        count += histogram[i];
+        if (count > above)
+        {
+            return i;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief the hysteresis (ADC counts) for the levels (half ADC counts):
+ * half again the noise level and a count more, but no more than half the active level, or else half way between them
+ *
+ * @return 0 when they are too close to tell apart (the noise is as strong as the dial)
+ */
+int32_t IrCalibration::hysteresis(uint8_t noiseLevel, uint8_t activeLevel)
+{
+    int32_t level = int32_t(noiseLevel) * 3 / 2 + 2;
+    if (level > activeLevel / 2)
+    {
+        if (activeLevel <= noiseLevel + 2)
+        {
+            return 0;
+        }
+        level = (int32_t(noiseLevel) + activeLevel) / 2;
+    }
+    // to whole counts, rounded up
+    const int32_t hysteresis = (level + 1) / 2;
+    return hysteresis < 1 ? 1 : hysteresis;
+}
+
+/**
+ * @brief sets the hysteresis from the latest levels of the sampling core, once it has learned enough of both.
+ * it is scheduled every IR_CALIBRATION_LOOP_FREQUENCY, also while disconnected (@see src/main.cpp)
+ */
+void IrCalibration::loop()
+{
+    if (!IrCalibration::readings.read(IrCalibration::reading))
+    {
+        return;
+    }
+    const IrCalibrationReading &reading = IrCalibration::reading;
+    if (Config::get(ConfigFlowAutoHysteresis) == 0 || reading.noiseSamples < IR_CALIBRATION_MIN_NOISE_SAMPLES || reading.activeSamples < IR_CALIBRATION_MIN_ACTIVE_SAMPLES)
+    {
+        return;
+    }
+
+    // a count off is close enough (so that a level on the edge of two bins does not wear out the flash)
+    const int32_t hysteresis = IrCalibration::hysteresis(reading.noiseLevel, reading.activeLevel);
+    const int32_t current = Config::get(ConfigFlowHysteresis);
+    if (hysteresis == 0 || (hysteresis - current <= 1 && current - hysteresis <= 1) || !Config::set(ConfigFlowHysteresis, hysteresis))
+    {
+        return;
+    }
+    IrCalibration::changes++;
+    if (Device::isConnected())
+    {
+        Config::numbers[ConfigFlowHysteresis].setState(float(hysteresis));
+    }
+    if (Switches::isDebugActive && Device::isConnected())
+    {
+        char payload[DEBUG_MESSAGE_SIZE];
+        DebugFormatter(payload, sizeof(payload))
+            .text("hysteresis: ")
+            .number(current)
+            .text(" -> ")
+            .number(hysteresis)
+            .text(", noise: ")
+            .milli(int32_t(reading.noiseLevel) * 500, 1)
+            .text(", active: ")
+            .milli(int32_t(reading.activeLevel) * 500, 1);
+        Device::mqtt.publish(IR_CALIBRATION_DEBUG_MQTT_TOPIC, payload);
+    }
+}
@@ -0,0 +1,104 @@
+#ifndef IR_CALIBRATION
+#define IR_CALIBRATION
+
+#include <stdint.h>
+#include "mailbox.h"
+#include "monotonicTime.h"
+
+/**
+ * @brief the MQTT topic for debugging the calibration (a message on every change of the hysteresis)
+ */
+#define IR_CALIBRATION_DEBUG_MQTT_TOPIC "debug:waterMonitor:irCalibration"
+
+/**
+ * @brief the number of bins of the distributions of the IR signal (minus its DC, in half ADC counts, the last one is for the rest)
+ */
+#define IR_CALIBRATION_BINS 128
+
+/**
+ * @brief time in milliseconds without a pulse, before the IR signal is considered to be noise (no flow).
+ * after that, it gets collected in chunks of IR_CALIBRATION_CHUNK milliseconds and a chunk only counts as noise,
+ * once the one after it also ends without a pulse, since a flow (of at least MIN_GPM) that starts in a chunk
+ * gets its pulse (a gallon) within IR_CALIBRATION_CHUNK.
+ */
+#define IR_CALIBRATION_QUIET_TIME 3600000
+#define IR_CALIBRATION_CHUNK 600000
+
+/**
+ * @brief the max time in milliseconds between two pulses, for the IR signal between them to be considered flowing (at least ~0.2 GPM)
+ */
+#define IR_CALIBRATION_FLOW_PULSE_GAP 300000
+
+/**
+ * @brief the noise level is the IR_CALIBRATION_NOISE_QUANTILE (parts per million) of the noise distribution (only a few samples an hour go above it)
+ * and the active level is the IR_CALIBRATION_ACTIVE_QUANTILE of the flow distribution (the peaks of the dial rotation)
+ */
+#define IR_CALIBRATION_NOISE_QUANTILE 999900
+#define IR_CALIBRATION_ACTIVE_QUANTILE 900000
+
+/**
+ * @brief the min samples (ADC blocks) of noise (~40 minutes) and of flow (~2 minutes), before a hysteresis gets set
+ * and the max of either, after which the distribution gets halved, so that it keeps up with the seasons (ie. ~1 day of noise)
+ */
+#define IR_CALIBRATION_MIN_NOISE_SAMPLES 100000
+#define IR_CALIBRATION_MIN_ACTIVE_SAMPLES 5000
+#define IR_CALIBRATION_MAX_SAMPLES 4000000
+
+/**
+ * @brief frequency in milliseconds, to check the distributions (the period of the IR calibration task)
+ */
+#define IR_CALIBRATION_LOOP_FREQUENCY 60000
+
+/**
+ * @brief the levels of the distributions the sampling core posts for the controller loop, in half ADC counts
+ */
+struct IrCalibrationReading
+{
+    uint32_t noiseSamples;
+    uint32_t activeSamples;
+    uint8_t noiseLevel;
+    uint8_t activeLevel;
+};
+
+/**
+ * @brief the online calibration of the hysteresis of the flow detection (@see FLOW_DETECTOR_HYSTERESIS),
+ * which depends on the noise of the IR module (ie. its power supply) and on how strong the dial reflection is.
+ *
+ * the sampling core (core 1) learns the distribution of the IR signal (minus its DC) while there's surely no flow
+ * (no pulses for IR_CALIBRATION_QUIET_TIME) and while there surely is (between pulses less than IR_CALIBRATION_FLOW_PULSE_GAP apart).
+ * the controller loop (core 0) sets the hysteresis well over the noise level and under the active level,
+ * through the config (so that it gets saved and the `Flow Hysteresis` entity shows it), unless the `Flow Auto Hysteresis` is off.
+ */
+class IrCalibration
+{
+public:
+    // properties
+    static uint32_t noise[IR_CALIBRATION_BINS];
+    static uint32_t active[IR_CALIBRATION_BINS];
+    static uint32_t noiseSamples;
+    static uint32_t activeSamples;
+    static uint32_t chunk[IR_CALIBRATION_BINS];
+    static uint32_t chunkSamples;
+    static uint32_t confirming[IR_CALIBRATION_BINS];
+    static bool isConfirming;
+    static Instant chunkStartTime;
+    static uint32_t flowing[IR_CALIBRATION_BINS];
+    static bool hasPulse;
+    static Instant lastPulseTime;
+    static Mailbox<IrCalibrationReading> readings;
+    static IrCalibrationReading reading;
+    static unsigned long changes;
+
+    // methods
+    static void sample(int32_t ac, Instant time);
+    static void onPulse(Instant time);
+    static void loop();
+    static int32_t hysteresis(uint8_t noiseLevel, uint8_t activeLevel);
+    static uint8_t level(const uint32_t *histogram, uint32_t samples, uint32_t quantile);
+
+private:
+    static void merge(uint32_t *histogram, uint32_t &samples, uint32_t *from);
+    static void post();
+};
+
+#endif // IR_CALIBRATION
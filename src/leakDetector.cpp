@@ -0,0 +1,165 @@
+#include <ArduinoHA.h>
+#include "device.h"
+#include "debugFormatter.h"
+#include "config.h"
+#include "leakDetector.h"
+#include "usageEvents.h"
+#include "valve.h"
+
+// on while any alarm is active
+HABinarySensor LeakDetector::leakSensor("waterMonitorLeak");
+
+// what the active alarms are about
+HASensor LeakDetector::alarmSensor("waterMonitorLeakAlarm");
+
+// the duration and the pulses of the current (or last) usage event
+Duration LeakDetector::flowDuration;
+unsigned long LeakDetector::eventPulses = 0;
+
+// which of the last (complete) hours had flow, the latest in the lowest bit, and how many hours have completed
+uint32_t LeakDetector::flowHours = 0;
+unsigned int LeakDetector::hours = 0;
+
+// the current hour: when it started, the pulses by then and if it had flow so far
+Instant LeakDetector::hourStartTime;
+unsigned long LeakDetector::hourPulses = 0;
+bool LeakDetector::hasHourFlow = false;
+
+// the active alarms (LeakAlarm flags) and the ones the controller got
+uint8_t LeakDetector::alarms = 0;
+uint8_t LeakDetector::publishedAlarms = 0;
+
+// if the alarms have been published since (re)connecting
+bool LeakDetector::isPublished = false;
+
+// the number of alarms raised (since boot)
+unsigned long LeakDetector::raisedAlarms = 0;
+
+void LeakDetector::setup()
+{
+    LeakDetector::leakSensor.setName("Leak");
+    LeakDetector::leakSensor.setIcon("mdi:pipe-leak");
+    LeakDetector::leakSensor.setDeviceClass("problem");
+    LeakDetector::leakSensor.setCurrentState(false);
+
+    LeakDetector::alarmSensor.setName("Leak Alarm");
+    LeakDetector::alarmSensor.setIcon("mdi:alert-octagon-outline");
+
+    LeakDetector::hourStartTime = MonotonicClock::now();
+}
+
+/**
+ * @brief evaluates the alarms on a reading of the sampling core
+ *
+ * @param time the time of the reading
+ */
+void LeakDetector::update(const PulseReading &reading, Instant time)
+{
+    const bool isFlowing = reading.gpm != 0.0 || reading.isIrSensorActive;
+
+    // the hours with flow (a micro leak may be too slow for the IR sensor, but it still pulses)
+    LeakDetector::hasHourFlow = LeakDetector::hasHourFlow || isFlowing || reading.pulses != LeakDetector::hourPulses;
+    while (time - LeakDetector::hourStartTime >= Duration::millis(LEAK_DETECTOR_HOUR))
+    {
+        LeakDetector::flowHours = (LeakDetector::flowHours << 1) | (LeakDetector::hasHourFlow ? 1 : 0);
+        LeakDetector::hours += LeakDetector::hours < LEAK_DETECTOR_HOURS ? 1 : 0;
+        LeakDetector::hourStartTime += Duration::millis(LEAK_DETECTOR_HOUR);
+        LeakDetector::hourPulses = reading.pulses;
+        LeakDetector::hasHourFlow = isFlowing;
+    }
+
+    // the current usage event (@see UsageEvents::update, the flow is segmented there only)
+    uint8_t alarms = 0;
+    if (UsageEvents::isFlowing)
+    {
+        LeakDetector::flowDuration = UsageEvents::lastFlowTime - UsageEvents::startTime;
+        LeakDetector::eventPulses = reading.pulses - UsageEvents::startPulses;
+        if (LeakDetector::flowDuration >= Duration::minutes(Config::get(ConfigLeakContinuousFlow)))
+        {
+            alarms |= LeakAlarmContinuousFlow;
+        }
+        if (LeakDetector::eventPulses >= Config::get(ConfigLeakEventGallons) * PULSE_RATE)
+        {
+            alarms |= LeakAlarmEventVolume;
+        }
+    }
+
+    const uint32_t mask = LEAK_DETECTOR_HOURS >= 32 ? 0xFFFFFFFF : (1UL << LEAK_DETECTOR_HOURS) - 1;
+    if (LeakDetector::hours >= LEAK_DETECTOR_HOURS && (LeakDetector::flowHours & mask) == mask)
+    {
+        alarms |= LeakAlarmMicroLeak;
+    }
+
+    // count the newly raised ones
+    for (uint8_t raised = alarms & ~LeakDetector::alarms; raised != 0; raised &= raised - 1)
+    {
+        LeakDetector::raisedAlarms++;
+    }
+    LeakDetector::alarms = alarms;
+}
+
+/**
+ * @brief describes the active alarms, ie. "continuous flow: 64 min (21 gal); micro leak: flow in each of the last 24 hours"
+ *
+ * @return the length of the description
+ */
+size_t LeakDetector::describe(char *buffer, size_t size)
+{
+    DebugFormatter alarm(buffer, size);
+    if (LeakDetector::alarms == 0)
+    {
+        return alarm.text("none").getLength();
+    }
+    if (LeakDetector::alarms & LeakAlarmContinuousFlow)
+    {
+        alarm.text("continuous flow: ").number(LeakDetector::flowDuration.toMillis32() / 60000).text(" min (").number((unsigned long)(LeakDetector::eventPulses / PULSE_RATE)).text(" gal)");
+    }
+    if (LeakDetector::alarms & LeakAlarmEventVolume)
+    {
+        alarm.text(alarm.getLength() > 0 ? "; " : "").text("event volume: ").number((unsigned long)(LeakDetector::eventPulses / PULSE_RATE)).text(" gal in ").number(LeakDetector::flowDuration.toMillis32() / 60000).text(" min");
+    }
+    if (LeakDetector::alarms & LeakAlarmMicroLeak)
+    {
+        alarm.text(alarm.getLength() > 0 ? "; " : "").text("micro leak: flow in each of the last ").number(LEAK_DETECTOR_HOURS).text(" hours");
+    }
+    return alarm.getLength();
+}
+
+void LeakDetector::publish()
+{
+    char description[LEAK_DETECTOR_ALARM_SIZE];
+    LeakDetector::describe(description, sizeof(description));
+    if (LeakDetector::alarmSensor.setValue(description) && LeakDetector::leakSensor.setState(LeakDetector::alarms != 0))
+    {
+        LeakDetector::publishedAlarms = LeakDetector::alarms;
+        LeakDetector::isPublished = true;
+    }
+}
+
+/**
+ * @brief evaluates the alarms on the latest reading of the sampling core and publishes the changes (once connected).
+ * it is scheduled every LEAK_DETECTOR_LOOP_FREQUENCY, also while disconnected (@see src/main.cpp)
+ */
+void LeakDetector::loop()
+{
+    PulseReading reading;
+    if (!PulseSensor::readings.read(reading))
+    {
+        return;
+    }
+    const uint8_t alarms = LeakDetector::alarms;
+    LeakDetector::update(reading, MonotonicClock::now());
+#ifdef VALVE_ENABLED
+    // the shutoff does not wait for the controller (nor the network)
+    Valve::onLeakAlarms(LeakDetector::alarms & ~alarms);
+#endif
+
+    if (!Device::isConnected())
+    {
+        LeakDetector::isPublished = false;
+    }
+    else if (!LeakDetector::isPublished || LeakDetector::alarms != LeakDetector::publishedAlarms)
+    {
+        LeakDetector::publish();
+    }
+}
@@ -0,0 +1,89 @@
+#ifndef LEAK_DETECTOR
+#define LEAK_DETECTOR
+
+#include <ArduinoHA.h>
+#include <stdint.h>
+#include "pulseSensor.h"
+
+/**
+ * @brief the default minutes the water may run without a stop, before the continuous flow alarm (ie. a running toilet)
+ * @see src/config.h to tune it
+ */
+#define LEAK_DETECTOR_CONTINUOUS_FLOW 60
+
+/**
+ * @brief the default gallons a single usage event (from the flow start to its stop) may take,
+ * before the event volume alarm (ie. a burst pipe, or a hose left open)
+ * @see src/config.h to tune it
+ */
+#define LEAK_DETECTOR_EVENT_GALLONS 100
+
+/**
+ * @brief the micro leak alarm goes off, when every one of the last LEAK_DETECTOR_HOURS hours had some flow
+ * (a pulse, the IR sensor or the GPM), ie. the water never stopped for a whole hour (up to 32)
+ */
+#define LEAK_DETECTOR_HOURS 24
+
+/**
+ * @brief the length of an hour, in milliseconds
+ */
+#define LEAK_DETECTOR_HOUR 3600000UL
+
+/**
+ * @brief frequency in milliseconds, to evaluate the alarms (the period of the leak detector task)
+ */
+#define LEAK_DETECTOR_LOOP_FREQUENCY 1000
+
+/**
+ * @brief max length (including the terminator) of the alarm description
+ */
+#define LEAK_DETECTOR_ALARM_SIZE 160
+
+/**
+ * @brief the alarms (bit flags)
+ */
+enum LeakAlarm : uint8_t
+{
+    LeakAlarmContinuousFlow = 1,
+    LeakAlarmEventVolume = 2,
+    LeakAlarmMicroLeak = 4
+};
+
+/**
+ * @brief the on-device leak detection (core 0), so that it does not depend on the network or the controller
+ * (@see Device::setup() for why the flow duration automations of the controller are unreliable).
+ * it tracks the duration and volume of the current usage event (the one of UsageEvents, so that the alarms judge the published events)
+ * and which of the last hours had flow,
+ * evaluates the alarms every LEAK_DETECTOR_LOOP_FREQUENCY (also while disconnected)
+ * and publishes them (the `Leak` problem sensor and the `Leak Alarm` description) once connected.
+ * the continuous flow and event volume alarms clear when the usage event ends, the micro leak one after an hour without flow.
+ */
+class LeakDetector
+{
+public:
+    // properties
+    static HABinarySensor leakSensor;
+    static HASensor alarmSensor;
+    static Duration flowDuration;
+    static unsigned long eventPulses;
+    static uint32_t flowHours;
+    static unsigned int hours;
+    static Instant hourStartTime;
+    static unsigned long hourPulses;
+    static bool hasHourFlow;
+    static uint8_t alarms;
+    static uint8_t publishedAlarms;
+    static bool isPublished;
+    static unsigned long raisedAlarms;
+
+    // methods
+    static void setup();
+    static void loop();
+    static void update(const PulseReading &reading, Instant time);
+    static size_t describe(char *buffer, size_t size);
+
+private:
+    static void publish();
+};
+
+#endif // LEAK_DETECTOR
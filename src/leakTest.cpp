@@ -0,0 +1,289 @@
+#include <ArduinoHA.h>
+#include <math.h>
+#include "device.h"
+#include "debugFormatter.h"
+#include "switches.h"
+#include "leakTest.h"
+
+// set by the controller loop (core 0), when the water leak test gets enabled/disabled
+std::atomic<bool> LeakTest::isRequested{false};
+
+// if the test is running on the sampling core (core 1)
+bool LeakTest::isRunning = false;
+
+// the time the current point started
+Instant LeakTest::pointTime;
+
+// the sum (milli-PSI) and number of the blocks of the current point
+int64_t LeakTest::pointSum = 0;
+unsigned long LeakTest::pointBlocks = 0;
+
+// the latest points (milli-PSI), the oldest gets removed from the regression sums, when the window rolls
+int32_t LeakTest::window[LEAK_TEST_WINDOW];
+
+// the number of points since the start of the test (also the time of the next point)
+unsigned long LeakTest::points = 0;
+
+// the first point of the test (milli-PSI)
+int32_t LeakTest::baseline = 0;
+
+// the regression sums of the window, time (T) in points and pressure (P) in milli-PSI
+int64_t LeakTest::sumT = 0;
+int64_t LeakTest::sumTT = 0;
+int64_t LeakTest::sumP = 0;
+int64_t LeakTest::sumTP = 0;
+int64_t LeakTest::sumPP = 0;
+
+// the status of the last evaluation (core 1)
+LeakTestStatus LeakTest::lastStatus = LeakTestIdle;
+
+// the latest result of the sampling core (written by core 1, read by core 0)
+Mailbox<LeakTestResult> LeakTest::results;
+
+// core 0's copy of the latest result
+LeakTestResult LeakTest::result = {LeakTestIdle, 0.0, 0.0, 0.0, 0};
+
+// the last status we sent
+LeakTestStatus LeakTest::lastStatusSent = LeakTestIdle;
+
+// the rate and confidence only get sent when they change (or with a new verdict), so nothing while idle
+ReportPolicy<float> LeakTest::rateReport(LEAK_TEST_RATE_DELTA, Duration::millis(LEAK_TEST_SEND_FREQUENCY));
+ReportPolicy<float> LeakTest::confidenceReport(LEAK_TEST_CONFIDENCE_DELTA, Duration::millis(LEAK_TEST_SEND_FREQUENCY));
+
+HASensor LeakTest::statusSensor("waterMonitorLeakTestResult");
+HASensorNumber LeakTest::rateSensor("waterMonitorLeakTestRate", HASensorNumber::PrecisionP3);
+HASensorNumber LeakTest::confidenceSensor("waterMonitorLeakTestConfidence", HASensorNumber::PrecisionP0);
+
+void LeakTest::setup()
+{
+    LeakTest::statusSensor.setName("Water Leak Test Result");
+    LeakTest::statusSensor.setIcon("mdi:water-check-outline");
+
+    LeakTest::rateSensor.setName("Water Leak Test Pressure Decay");
+    LeakTest::rateSensor.setIcon("mdi:chart-line-variant");
+    LeakTest::rateSensor.setUnitOfMeasurement("psi/min");
+
+    LeakTest::confidenceSensor.setName("Water Leak Test Confidence");
+    LeakTest::confidenceSensor.setIcon("mdi:percent-circle-outline");
+    LeakTest::confidenceSensor.setUnitOfMeasurement("%");
+}
+
+/**
+ * @brief starts a new test (core 0). the sampling core picks it up on its next block.
+ */
+void LeakTest::start()
+{
+    LeakTest::isRequested.store(true);
+}
+
+/**
+ * @brief stops the test (core 0)
+ */
+void LeakTest::stop()
+{
+    LeakTest::isRequested.store(false);
+}
+
+const char *LeakTest::statusName(LeakTestStatus status)
+{
+    switch (status)
+    {
+    case LeakTestTesting:
+        return LEAK_TEST_STATUS_TESTING;
+    case LeakTestPass:
+        return LEAK_TEST_STATUS_PASS;
+    case LeakTestFail:
+        return LEAK_TEST_STATUS_FAIL;
+    default:
+        return LEAK_TEST_STATUS_IDLE;
+    }
+}
+
+/**
+ * @brief resets the regression for a new test
+ *
+ * @param time
+ */
+void LeakTest::begin(Instant time)
+{
+    LeakTest::isRunning = true;
+    LeakTest::pointTime = time;
+    LeakTest::pointSum = 0;
+    LeakTest::pointBlocks = 0;
+    LeakTest::points = 0;
+    LeakTest::sumT = 0;
+    LeakTest::sumTT = 0;
+    LeakTest::sumP = 0;
+    LeakTest::sumTP = 0;
+    LeakTest::sumPP = 0;
+    LeakTest::lastStatus = LeakTestTesting;
+    LeakTest::results.write({LeakTestTesting, 0.0, 0.0, 0.0, 0});
+}
+
+/**
+ * @brief adds a point to the regression, removing the oldest one when the window is full
+ *
+ * @param milliPsi
+ */
+void LeakTest::addPoint(int32_t milliPsi)
+{
+    const int64_t t = LeakTest::points;
+    if (LeakTest::points == 0)
+    {
+        LeakTest::baseline = milliPsi;
+    }
+    if (LeakTest::points >= LEAK_TEST_WINDOW)
+    {
+        const int64_t oldT = t - LEAK_TEST_WINDOW;
+        const int64_t oldP = LeakTest::window[oldT % LEAK_TEST_WINDOW];
+        LeakTest::sumT -= oldT;
+        LeakTest::sumTT -= oldT * oldT;
+        LeakTest::sumP -= oldP;
+        LeakTest::sumTP -= oldT * oldP;
+        LeakTest::sumPP -= oldP * oldP;
+    }
+    LeakTest::window[t % LEAK_TEST_WINDOW] = milliPsi;
+    LeakTest::sumT += t;
+    LeakTest::sumTT += t * t;
+    LeakTest::sumP += milliPsi;
+    LeakTest::sumTP += t * milliPsi;
+    LeakTest::sumPP += int64_t(milliPsi) * milliPsi;
+    LeakTest::points++;
+}
+
+/**
+ * @brief the decay rate (slope), its confidence and the verdict, of the points in the window.
+ * the (n times) centered sums are exact integers, only the final ratios are floating point (once per point).
+ */
+LeakTestResult LeakTest::evaluate()
+{
+    const int64_t n = LeakTest::points < LEAK_TEST_WINDOW ? LeakTest::points : LEAK_TEST_WINDOW;
+    LeakTestResult result = {LeakTestTesting, 0.0, 0.0, float(LeakTest::baseline - LeakTest::window[(LeakTest::points - 1) % LEAK_TEST_WINDOW]) / 1000.0f, LeakTest::points};
+    if (n < LEAK_TEST_MIN_POINTS)
+    {
+        return result;
+    }
+
+    const double nSxx = double(n * LeakTest::sumTT - LeakTest::sumT * LeakTest::sumT);
+    const double nSxy = double(n * LeakTest::sumTP - LeakTest::sumT * LeakTest::sumP);
+    const double nSyy = double(n * LeakTest::sumPP - LeakTest::sumP * LeakTest::sumP);
+
+    // milli-PSI per point to PSI per minute
+    const double scale = 60e6 / LEAK_TEST_POINT_PERIOD / 1000.0;
+    const double slope = nSxy / nSxx;
+    const double residuals = nSyy - slope * nSxy > 0.0 ? (nSyy - slope * nSxy) / n : 0.0;
+    const double slopeError = sqrt(residuals / (n - 2) / (nSxx / n)) * scale;
+    const double rate = slope * scale;
+
+    // how many standard errors the rate is above (pass) or below (fail) the max decay
+    const double z = slopeError > 0.0 ? (rate + LEAK_TEST_MAX_DECAY) / slopeError : (rate + LEAK_TEST_MAX_DECAY >= 0.0 ? 1e9 : -1e9);
+    result.rate = float(rate);
+    result.confidence = float(50.0 * (1.0 + erf(fabs(z) / sqrt(2.0))));
+    if (result.confidence >= LEAK_TEST_CONFIDENCE)
+    {
+        result.status = z >= 0.0 ? LeakTestPass : LeakTestFail;
+    }
+    return result;
+}
+
+/**
+ * @brief should be called for every new ADC block (core 1), with the filtered pressure.
+ * it averages the blocks into points and evaluates the test on every new point.
+ *
+ * @param psi
+ * @param time the time of the block
+ */
+void LeakTest::sample(SensorReal psi, Instant time)
+{
+    const bool isRequested = LeakTest::isRequested.load(std::memory_order_relaxed);
+    if (isRequested != LeakTest::isRunning)
+    {
+        if (isRequested)
+        {
+            LeakTest::begin(time);
+        }
+        else
+        {
+            LeakTest::isRunning = false;
+            LeakTest::lastStatus = LeakTestIdle;
+            LeakTest::results.write({LeakTestIdle, 0.0, 0.0, 0.0, 0});
+        }
+    }
+    if (!LeakTest::isRunning)
+    {
+        return;
+    }
+
+    LeakTest::pointSum += SensorMath::toMilli(psi);
+    LeakTest::pointBlocks++;
+    if (time - LeakTest::pointTime < Duration::micros(LEAK_TEST_POINT_PERIOD))
+    {
+        return;
+    }
+
+    LeakTest::addPoint(int32_t(LeakTest::pointSum / int64_t(LeakTest::pointBlocks)));
+    LeakTest::pointTime += Duration::micros(LEAK_TEST_POINT_PERIOD);
+    LeakTest::pointSum = 0;
+    LeakTest::pointBlocks = 0;
+
+    const LeakTestResult result = LeakTest::evaluate();
+    if (result.status != LeakTest::lastStatus && Switches::isDebugActive)
+    {
+        char payload[DEBUG_MESSAGE_SIZE];
+        DebugFormatter(payload, sizeof(payload))
+            .text(LeakTest::statusName(result.status))
+            .text(" - rate (psi/min): ")
+            .real(result.rate, 3)
+            .text(", confidence: ")
+            .real(result.confidence, 2)
+            .text(", drop (psi): ")
+            .real(result.drop, 2)
+            .text(", points: ")
+            .number(result.points);
+        Device::queueDebug(LEAK_TEST_DEBUG_MQTT_TOPIC, payload);
+    }
+    LeakTest::lastStatus = result.status;
+    LeakTest::results.write(result);
+}
+
+bool LeakTest::publishRate(float rate)
+{
+    return LeakTest::rateSensor.setValue(rate, true);
+}
+
+bool LeakTest::publishConfidence(float confidence)
+{
+    return LeakTest::confidenceSensor.setValue(confidence, true);
+}
+
+/**
+ * @brief should be called on every iteration of the main loop() function (core 0).
+ * it sends verdict changes immediately and the rate/confidence when they change, at most every LEAK_TEST_SEND_FREQUENCY.
+ */
+void LeakTest::loop()
+{
+    if (!LeakTest::results.read(LeakTest::result))
+    {
+        // no test yet
+        return;
+    }
+
+    const bool statusChanged = LeakTest::result.status != LeakTest::lastStatusSent;
+    if (statusChanged || Device::reconnected)
+    {
+        if (LeakTest::statusSensor.setValue(LeakTest::statusName(LeakTest::result.status)))
+        {
+            LeakTest::lastStatusSent = LeakTest::result.status;
+        }
+    }
+    if (Device::reconnected)
+    {
+        // the controller gets the current values again
+        LeakTest::rateReport.invalidate();
+        LeakTest::confidenceReport.invalidate();
+    }
+    const Instant now = MonotonicClock::now();
+    const ReportEvent event = statusChanged ? ReportForce : ReportChange;
+    LeakTest::rateReport.update(LeakTest::result.rate, now, event, LeakTest::publishRate);
+    LeakTest::confidenceReport.update(LeakTest::result.confidence, now, event, LeakTest::publishConfidence);
+}
@@ -0,0 +1,141 @@
+#ifndef LEAK_TEST
+#define LEAK_TEST
+
+#include <atomic>
+#include <stdint.h>
+#include "mailbox.h"
+#include "sensorMath.h"
+#include "monotonicTime.h"
+#include "reportPolicy.h"
+
+/**
+ * @brief the MQTT topic for debugging the leak test
+ */
+#define LEAK_TEST_DEBUG_MQTT_TOPIC "debug:waterMonitor:leakTest"
+
+/**
+ * @brief time in microseconds, that the pressure is averaged over, for every point of the regression
+ */
+#define LEAK_TEST_POINT_PERIOD 1000000
+
+/**
+ * @brief number of (the latest) points of the rolling regression.
+ * 120 points of 1 second = the pressure decay over the last 2 minutes
+ */
+#define LEAK_TEST_WINDOW 120
+
+/**
+ * @brief minimum number of points, before there is any verdict
+ */
+#define LEAK_TEST_MIN_POINTS 10
+
+/**
+ * @brief the max pressure decay in PSI per minute, for the leak test to pass
+ */
+#define LEAK_TEST_MAX_DECAY 0.1
+
+/**
+ * @brief the confidence (%) the decay is on either side of the LEAK_TEST_MAX_DECAY,
+ * for a pass/fail verdict. below that, the test keeps running
+ */
+#define LEAK_TEST_CONFIDENCE 95
+
+/**
+ * @brief frequency in milliseconds, to allow sending of the decay rate and confidence to the controller.
+ * this frequency does not apply to verdict changes.
+ */
+#define LEAK_TEST_SEND_FREQUENCY 5000
+
+/**
+ * @brief the min change of the decay rate (PSI per minute), to be sent to the controller
+ */
+#define LEAK_TEST_RATE_DELTA 0.005
+
+/**
+ * @brief the min change of the confidence (%), to be sent to the controller
+ */
+#define LEAK_TEST_CONFIDENCE_DELTA 1
+
+#define LEAK_TEST_STATUS_IDLE "idle"
+#define LEAK_TEST_STATUS_TESTING "testing"
+#define LEAK_TEST_STATUS_PASS "pass"
+#define LEAK_TEST_STATUS_FAIL "fail"
+
+enum LeakTestStatus
+{
+    LeakTestIdle = 0,
+    LeakTestTesting,
+    LeakTestPass,
+    LeakTestFail
+};
+
+/**
+ * @brief the state the sampling core (core 1) posts for the controller loop (core 0)
+ */
+struct LeakTestResult
+{
+    LeakTestStatus status;
+    // the pressure decay in PSI per minute (negative when the pressure drops)
+    float rate;
+    // the confidence (%) of the verdict
+    float confidence;
+    // the pressure drop in PSI, since the start of the test
+    float drop;
+    // the number of points so far
+    unsigned long points;
+};
+
+/**
+ * @brief the pressure decay leak test.
+ * while the water leak test is active, it averages the (filtered) pressure into a point every LEAK_TEST_POINT_PERIOD
+ * and runs a least-squares regression of the pressure over time, on the latest LEAK_TEST_WINDOW points.
+ * the regression sums are integers (milli-PSI), added/removed as the window rolls, so every point is O(1) and they do not drift.
+ *
+ * the verdict is pass when the decay is confidently below LEAK_TEST_MAX_DECAY and fail when it is confidently above it.
+ */
+class LeakTest
+{
+public:
+    // properties
+    static std::atomic<bool> isRequested;
+    // core 1
+    static bool isRunning;
+    static Instant pointTime;
+    static int64_t pointSum;
+    static unsigned long pointBlocks;
+    static int32_t window[LEAK_TEST_WINDOW];
+    static unsigned long points;
+    static int32_t baseline;
+    static int64_t sumT;
+    static int64_t sumTT;
+    static int64_t sumP;
+    static int64_t sumTP;
+    static int64_t sumPP;
+    static LeakTestStatus lastStatus;
+    static Mailbox<LeakTestResult> results;
+    // core 0
+    static LeakTestResult result;
+    static LeakTestStatus lastStatusSent;
+    static ReportPolicy<float> rateReport;
+    static ReportPolicy<float> confidenceReport;
+    static HASensor statusSensor;
+    static HASensorNumber rateSensor;
+    static HASensorNumber confidenceSensor;
+
+    // methods
+    static void setup();
+    static void start();
+    static void stop();
+    static void sample(SensorReal psi, Instant time);
+    static void loop();
+    static const char *statusName(LeakTestStatus status);
+
+private:
+    static void begin(Instant time);
+    static void addPoint(int32_t milliPsi);
+    static LeakTestResult evaluate();
+    static bool publishRate(float rate);
+    static bool publishConfidence(float confidence);
+};
+
+#endif // LEAK_TEST
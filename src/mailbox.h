@@ -0,0 +1,78 @@
+#ifndef MAILBOX
+#define MAILBOX
+
+#include <atomic>
+#include <stdint.h>
+
+/**
+ * @brief a single-writer, lock-free "latest value" mailbox (a sequence lock),
+ * to pass the latest readings from one core to the other.
+ *
+ * the writer never waits. a reader that races with a write, simply retries,
+ * so it always gets a consistent (not torn) copy of the latest value.
+ * old values are overwritten, so this is for state (ie. current GPM) and not for events.
+ * @see src/ringBuffer.h for events
+ *
+ * @tparam T the (trivially copyable) value type
+ */
+template <typename T>
+class Mailbox
+{
+public:
+    /**
+     * @brief writer side only
+     */
+    void write(const T &value)
+    {
+        const uint32_t sequence = this->sequence.load(std::memory_order_relaxed);
+        // odd sequence: write in progress
+        this->sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        this->value = value;
+        std::atomic_thread_fence(std::memory_order_release);
+        this->sequence.store(sequence + 2, std::memory_order_release);
+    }
+
+    /**
+     * @brief reader side. may be called by any number of readers
+     *
+     * @return true when the value has been written at least once
+     * @return false when there is no value yet (value is left untouched)
+     */
+    bool read(T &value) const
+    {
+        while (true)
+        {
+            const uint32_t before = this->sequence.load(std::memory_order_acquire);
+            if (before & 1)
+            {
+                continue;
+            }
+            if (before == 0)
+            {
+                return false;
+            }
+            T copy = this->value;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (this->sequence.load(std::memory_order_relaxed) == before)
+            {
+                value = copy;
+                return true;
+            }
+        }
+    }
+
+    /**
+     * @brief the number of writes so far (wraps around)
+     */
+    uint32_t writes() const
+    {
+        return this->sequence.load(std::memory_order_acquire) / 2;
+    }
+
+private:
+    T value{};
+    std::atomic<uint32_t> sequence{0};
+};
+
+#endif // MAILBOX
@@ -3,21 +3,117 @@
 #include "pulseSensor.h"
 #include "pressureSensor.h"
 #include "switches.h"
+#include "leakTest.h"
+#include "offlineStore.h"
+#include "totalizer.h"
+#include "config.h"
+#include "leakDetector.h"
+#include "usageEvents.h"
+#include "irCalibration.h"
+#include "scheduler.h"
+#include "diagnostics.h"
+#include "telemetry.h"
+#include "adcSampler.h"
+#include "valve.h"
+
+/**
+ * @brief core 0 runs the network (WiFi, MQTT, OTA) and reports to the controller,
+ * core 1 samples the sensors, so that network stalls do not affect sampling.
+ * the cores only exchange data through lock-free mailboxes and queues.
+ */
+
+/**
+ * @brief adds a task to the scheduler, or halts when there is no room for it (@see SCHEDULER_MAX_TASKS),
+ * rather than running without it
+ */
+static void schedule(const char *name, void (*run)(), unsigned long period, SchedulerPriority priority, bool (*condition)() = nullptr)
+{
+    if (!Scheduler::add(name, run, period, priority, condition))
+    {
+        panic("scheduler: no room for the task %s", name);
+    }
+}
 
 void setup()
 {
     Device::setup();
     Switches::setup();
+    Config::setup();
     PulseSensor::setup();
     PressureSensor::setup();
-    // after everything is setup...
-    Device::connectToMQTT();
+    LeakTest::setup();
+    LeakDetector::setup();
+    UsageEvents::setup();
+    OfflineStore::setup();
+    Totalizer::setup();
+    Diagnostics::setup();
+#ifdef VALVE_ENABLED
+    Valve::setup();
+#endif
+
+    // the readings of the sampling core go first, the network and everything else, after
+    schedule("pulse", PulseSensor::loop, 0, SchedulerSensing, Device::isConnected);
+    schedule("pressure", PressureSensor::loop, 0, SchedulerSensing, Device::isConnected);
+    // while disconnected, core 1 keeps sampling and the readings get stored, to be replayed once reconnected
+    schedule("offline record", OfflineStore::record, 0, SchedulerSensing, Device::isDisconnected);
+#ifdef VALVE_ENABLED
+    // follows the limit switches also while disconnected
+    schedule("valve", Valve::loop, 0, SchedulerSensing);
+#endif
+    schedule("leak test", LeakTest::loop, 0, SchedulerReporting, Device::isConnected);
+    schedule("switches", Switches::loop, 0, SchedulerReporting, Device::isConnected);
+    schedule("offline drain", OfflineStore::loop, OFFLINE_STORE_DRAIN_FREQUENCY, SchedulerReporting, Device::isConnected);
+    // evaluates the alarms also while disconnected
+    schedule("leak detector", LeakDetector::loop, LEAK_DETECTOR_LOOP_FREQUENCY, SchedulerReporting);
+    // segments the flow also while disconnected (the events wait for the network)
+    schedule("usage events", UsageEvents::loop, USAGE_EVENTS_LOOP_FREQUENCY, SchedulerReporting);
+    // commits also while disconnected
+    schedule("totalizer", Totalizer::loop, TOTALIZER_LOOP_FREQUENCY, SchedulerReporting);
+    // the connection to the controller is established by Device::loop(), after everything is setup
+#ifdef TELEMETRY_ENABLED
+    schedule("telemetry", Telemetry::loop, TELEMETRY_FRAME_FREQUENCY, SchedulerReporting, Device::isConnected);
+#endif
+    schedule("network", Device::loop, 0, SchedulerHousekeeping);
+    schedule("debug", Device::debugLoop, 0, SchedulerHousekeeping, Device::isConnected);
+    // saves also while disconnected
+    schedule("config", Config::loop, CONFIG_LOOP_FREQUENCY, SchedulerHousekeeping);
+    // tunes the flow detection also while disconnected (the config gets saved)
+    schedule("ir calibration", IrCalibration::loop, IR_CALIBRATION_LOOP_FREQUENCY, SchedulerHousekeeping);
+    schedule("heartbit", Device::heartbitLoop, HEARTBIT_FREQUENCY, SchedulerHousekeeping, Device::isConnected);
+    schedule("diagnostics", Diagnostics::loop, DIAGNOSTICS_SEND_FREQUENCY, SchedulerHousekeeping, Device::isConnected);
+    schedule("scheduler debug", Scheduler::debugLoop, SCHEDULER_DEBUG_FREQUENCY, SchedulerHousekeeping, Device::isConnected);
 }
 
 void loop()
 {
-    Device::loop();
-    Switches::loop();
-    PulseSensor::loop();
-    PressureSensor::loop();
-}
\ No newline at end of file
+    Scheduler::loop();
+}
+
+void setup1()
+{
+    PulseSensor::setupSampling();
+    // from now on, the analog pins are sampled in blocks
+    AdcSampler::setup(PRESSURE_SENSOR_PIN, IR_SENSOR_PIN);
+}
+
+void loop1()
+{
+    AdcBlock block;
+    if (AdcSampler::nextBlock(block))
+    {
+        Config::applySampling();
+        const uint32_t start = rp2040.getCycleCount();
+        PulseSensor::sample(block);
+        const uint32_t irEnd = rp2040.getCycleCount();
+        PressureSensor::sample(block);
+        Diagnostics::addCycles(SamplingIr, irEnd - start);
+        Diagnostics::addCycles(SamplingPressure, rp2040.getCycleCount() - irEnd);
+        Diagnostics::sample();
+#ifdef TELEMETRY_ENABLED
+        Telemetry::sample(block);
+#endif
+    }
+    const uint32_t pulseStart = rp2040.getCycleCount();
+    PulseSensor::sample();
+    Diagnostics::addCycles(SamplingPulse, rp2040.getCycleCount() - pulseStart);
+}
@@ -0,0 +1,139 @@
+#ifndef MONOTONIC_TIME
+#define MONOTONIC_TIME
+
+#include <stdint.h>
+#include <hardware/timer.h>
+
+/**
+ * @brief a span of time, in microseconds.
+ * it is signed, so that the time between two instants is never wrong (ie. the order of two timestamps taken on both cores),
+ * and 64bit, so that no span of the device's life overflows it.
+ * the conversions to the 32bit values (ie. the statistics and the messages) saturate, rather than wrap.
+ */
+class Duration
+{
+public:
+    constexpr Duration() : us(0) {}
+
+    static constexpr Duration micros(int64_t value) { return Duration(value); }
+    static constexpr Duration millis(int64_t value) { return Duration(value * 1000); }
+    static constexpr Duration seconds(int64_t value) { return Duration(value * 1000000); }
+    static constexpr Duration minutes(int64_t value) { return Duration(value * 60000000); }
+
+    constexpr int64_t toMicros() const { return this->us; }
+    constexpr int64_t toMillis() const { return this->us / 1000; }
+
+    /**
+     * @brief in microseconds (or milliseconds), saturated to 0 - UINT32_MAX
+     */
+    constexpr uint32_t toMicros32() const { return Duration::saturate(this->us); }
+    constexpr uint32_t toMillis32() const { return Duration::saturate(this->us / 1000); }
+
+    constexpr Duration operator-() const { return Duration(-this->us); }
+    constexpr Duration operator+(Duration other) const { return Duration(this->us + other.us); }
+    constexpr Duration operator-(Duration other) const { return Duration(this->us - other.us); }
+    constexpr Duration operator*(int64_t factor) const { return Duration(this->us * factor); }
+    constexpr Duration operator/(int64_t divisor) const { return Duration(this->us / divisor); }
+    Duration &operator+=(Duration other)
+    {
+        this->us += other.us;
+        return *this;
+    }
+    Duration &operator-=(Duration other)
+    {
+        this->us -= other.us;
+        return *this;
+    }
+
+    constexpr bool operator==(Duration other) const { return this->us == other.us; }
+    constexpr bool operator!=(Duration other) const { return this->us != other.us; }
+    constexpr bool operator<(Duration other) const { return this->us < other.us; }
+    constexpr bool operator<=(Duration other) const { return this->us <= other.us; }
+    constexpr bool operator>(Duration other) const { return this->us > other.us; }
+    constexpr bool operator>=(Duration other) const { return this->us >= other.us; }
+
+private:
+    int64_t us;
+
+    explicit constexpr Duration(int64_t us) : us(us) {}
+
+    static constexpr uint32_t saturate(int64_t value)
+    {
+        return value < 0 ? 0 : (value > int64_t(UINT32_MAX) ? UINT32_MAX : uint32_t(value));
+    }
+};
+
+/**
+ * @brief a point in time, in microseconds since boot (@see MonotonicClock).
+ * at 64bit it never wraps (in ~584000 years), unlike millis() (~49.7 days) and micros() (~71.6 minutes),
+ * so instants compare directly and their difference is always the actual time between them.
+ */
+class Instant
+{
+public:
+    // the boot
+    constexpr Instant() : us(0) {}
+
+    static constexpr Instant fromMicros(uint64_t value) { return Instant(value); }
+
+    constexpr uint64_t toMicros() const { return this->us; }
+    constexpr uint64_t toMillis() const { return this->us / 1000; }
+
+    /**
+     * @brief the instant a duration later (or earlier, for a negative one), saturated to the boot
+     */
+    constexpr Instant operator+(Duration duration) const
+    {
+        return duration.toMicros() < 0 && uint64_t(-duration.toMicros()) > this->us ? Instant() : Instant(this->us + uint64_t(duration.toMicros()));
+    }
+    constexpr Instant operator-(Duration duration) const { return *this + -duration; }
+    constexpr Duration operator-(Instant other) const { return Duration::micros(int64_t(this->us - other.us)); }
+    Instant &operator+=(Duration duration)
+    {
+        *this = *this + duration;
+        return *this;
+    }
+
+    constexpr bool operator==(Instant other) const { return this->us == other.us; }
+    constexpr bool operator!=(Instant other) const { return this->us != other.us; }
+    constexpr bool operator<(Instant other) const { return this->us < other.us; }
+    constexpr bool operator<=(Instant other) const { return this->us <= other.us; }
+    constexpr bool operator>(Instant other) const { return this->us > other.us; }
+    constexpr bool operator>=(Instant other) const { return this->us >= other.us; }
+
+private:
+    uint64_t us;
+
+    explicit constexpr Instant(uint64_t us) : us(us) {}
+};
+
+/**
+ * @brief the monotonic time of both cores: the 64bit microsecond timer of the RP2040 (time_us_64()),
+ * which is also safe to read from an interrupt handler.
+ * use it instead of millis() / micros(), which wrap and need the `long(now - then)` care on every compare.
+ */
+class MonotonicClock
+{
+public:
+    static Instant now() { return Instant::fromMicros(time_us_64()); }
+
+    /**
+     * @brief the time since an instant, saturated to zero for an instant after now
+     * (ie. a timestamp the other core or an interrupt took, right after now was read)
+     */
+    static Duration since(Instant time)
+    {
+        const Instant now = MonotonicClock::now();
+        return now > time ? now - time : Duration();
+    }
+
+    /**
+     * @brief true once the duration has passed since the instant
+     */
+    static bool hasElapsed(Instant time, Duration duration)
+    {
+        return MonotonicClock::since(time) >= duration;
+    }
+};
+
+#endif // MONOTONIC_TIME
@@ -0,0 +1,90 @@
+#ifndef NOISE_FILTER
+#define NOISE_FILTER
+
+#include <stdint.h>
+
+/**
+ * @brief an allocation-free noise filter for (oversampled) sensor values:
+ * a median of the last MEDIAN_SIZE values (rejects the occasional glitch/spike)
+ * followed by an exponential moving average (a one-pole IIR, alpha = 1 / 2^EMA_SHIFT).
+ *
+ * the average keeps EMA_SHIFT extra bits internally, so that it does not lose resolution,
+ * while it settles within ~2^EMA_SHIFT values.
+ *
+ * @tparam MEDIAN_SIZE the (odd) number of values of the median, 1 to disable it
+ * @tparam EMA_SHIFT the smoothing of the average, 0 to disable it
+ */
+template <int MEDIAN_SIZE, int EMA_SHIFT>
+class NoiseFilter
+{
+    static_assert(MEDIAN_SIZE > 0 && (MEDIAN_SIZE & 1) == 1, "NoiseFilter MEDIAN_SIZE must be odd");
+    static_assert(EMA_SHIFT >= 0 && EMA_SHIFT < 16, "NoiseFilter EMA_SHIFT must be within 0-15");
+
+public:
+    /**
+     * @brief adds a new value
+     *
+     * @param value (up to 16bits, ie. an oversampled ADC value)
+     * @return the filtered value
+     */
+    uint32_t update(uint32_t value)
+    {
+        if (!this->hasValue)
+        {
+            // start from the first value, instead of settling from zero
+            for (int i = 0; i < MEDIAN_SIZE; i++)
+            {
+                this->window[i] = value;
+            }
+            this->average = value << EMA_SHIFT;
+            this->hasValue = true;
+        }
+
+        this->window[this->head] = value;
+        this->head = (this->head + 1) % MEDIAN_SIZE;
+
+        // EMA: average += (median - average) * alpha
+        const uint32_t median = this->median();
+        this->average = this->average - (this->average >> EMA_SHIFT) + median;
+        return this->value();
+    }
+
+    /**
+     * @brief the latest filtered value
+     */
+    uint32_t value() const
+    {
+        return (this->average + ((1 << EMA_SHIFT) >> 1)) >> EMA_SHIFT;
+    }
+
+    void reset()
+    {
+        this->hasValue = false;
+        this->head = 0;
+    }
+
+private:
+    uint32_t window[MEDIAN_SIZE] = {};
+    int head = 0;
+    // the average, with EMA_SHIFT extra bits
+    uint32_t average = 0;
+    bool hasValue = false;
+
+    uint32_t median() const
+    {
+        // insertion sort of a copy (MEDIAN_SIZE is small)
+        uint32_t sorted[MEDIAN_SIZE];
+        for (int i = 0; i < MEDIAN_SIZE; i++)
+        {
+            int j = i;
+            for (; j > 0 && sorted[j - 1] > this->window[i]; j--)
+            {
+                sorted[j] = sorted[j - 1];
+            }
+            sorted[j] = this->window[i];
+        }
+        return sorted[MEDIAN_SIZE / 2];
+    }
+};
+
+#endif // NOISE_FILTER
@@ -0,0 +1,221 @@
+#include <ArduinoHA.h>
+#include <LittleFS.h>
+#include "device.h"
+#include "pulseSensor.h"
+#include "pressureSensor.h"
+#include "offlineStore.h"
+
+// the latest readings, while offline (oldest get spilled to flash)
+RingBuffer<OfflineRecord, OFFLINE_STORE_RAM_RECORDS> OfflineStore::records;
+
+// if the filesystem could be mounted
+bool OfflineStore::isFileAvailable = false;
+
+// the readings in the flash file and how many of them have been read back
+uint32_t OfflineStore::fileRecords = 0;
+uint32_t OfflineStore::fileReadRecords = 0;
+
+// the batch being published (kept until the publish succeeds)
+OfflineRecord OfflineStore::batch[OFFLINE_STORE_BATCH_RECORDS];
+int OfflineStore::batchSize = 0;
+
+// the readings dropped, because both RAM and flash were full
+unsigned long OfflineStore::droppedRecords = 0;
+
+// the number of times readings got moved to flash
+unsigned long OfflineStore::spills = 0;
+
+// the policies of the sensors (without the heartbeat and the resends) and the last recorded pulses,
+// to only record the readings that would have been sent
+ReportPolicy<SensorReal> OfflineStore::gpmRecord(0.0, Duration::millis(SEND_GPM_FREQUENCY));
+unsigned long OfflineStore::lastPulses = 0;
+ReportPolicy<SensorReal> OfflineStore::psiRecord(PRESSURE_SENSOR_DELTA, Duration::millis(PRESSURE_SENSOR_SEND_FREQUENCY));
+
+// if we are recording (offline)
+bool OfflineStore::isRecording = false;
+
+void OfflineStore::setup()
+{
+    OfflineStore::isFileAvailable = LittleFS.begin();
+    if (OfflineStore::isFileAvailable)
+    {
+        // the times of the readings of a previous boot are meaningless
+        LittleFS.remove(OFFLINE_STORE_FILE);
+    }
+}
+
+/**
+ * @brief the number of readings waiting to be published
+ */
+unsigned long OfflineStore::size()
+{
+    return OfflineStore::records.size() + (OfflineStore::fileRecords - OfflineStore::fileReadRecords) + OfflineStore::batchSize;
+}
+
+/**
+ * @brief moves the oldest OFFLINE_STORE_SPILL_RECORDS readings from RAM to the flash file,
+ * or drops them, when the file is full too.
+ */
+void OfflineStore::spill()
+{
+    OfflineRecord spilled[OFFLINE_STORE_SPILL_RECORDS];
+    int count = 0;
+    while (count < OFFLINE_STORE_SPILL_RECORDS && OfflineStore::records.pop(spilled[count]))
+    {
+        count++;
+    }
+
+    if (!OfflineStore::isFileAvailable || OfflineStore::fileRecords + count > OFFLINE_STORE_FLASH_RECORDS)
+    {
+        OfflineStore::droppedRecords += count;
+        return;
+    }
+
+    File file = LittleFS.open(OFFLINE_STORE_FILE, "a");
+    if (!file)
+    {
+        OfflineStore::droppedRecords += count;
+        return;
+    }
+    const size_t written = file.write((const uint8_t *)spilled, count * sizeof(OfflineRecord));
+    file.close();
+    OfflineStore::fileRecords += written / sizeof(OfflineRecord);
+    OfflineStore::droppedRecords += count - written / sizeof(OfflineRecord);
+    OfflineStore::spills++;
+}
+
+void OfflineStore::add(OfflineRecordType type, int32_t value)
+{
+    const OfflineRecord record = {uint32_t(MonotonicClock::now().toMillis()), value, type};
+    if (!OfflineStore::records.push(record))
+    {
+        OfflineStore::spill();
+        OfflineStore::records.push(record);
+    }
+}
+
+bool OfflineStore::recordGpm(SensorReal gpm)
+{
+    OfflineStore::add(OfflineGpm, SensorMath::toMilli(gpm));
+    return true;
+}
+
+bool OfflineStore::recordPsi(SensorReal psi)
+{
+    OfflineStore::add(OfflinePsi, SensorMath::toMilli(psi));
+    return true;
+}
+
+/**
+ * @brief should be called on every loop iteration, while disconnected.
+ * it records the readings of the sampling core, that would have been sent
+ * (with the same report policies as the sensors).
+ */
+void OfflineStore::record()
+{
+    if (!OfflineStore::isRecording)
+    {
+        // start from what the controller got last, with the current (ie. tuned) policies
+        OfflineStore::isRecording = true;
+        OfflineStore::gpmRecord = PulseSensor::gpmReport;
+        OfflineStore::gpmRecord.maxSilence = Duration();
+        OfflineStore::gpmRecord.edgeRepeats = 0;
+        OfflineStore::gpmRecord.reset(PulseSensor::gpmReport.lastValue(), MonotonicClock::now());
+        OfflineStore::lastPulses = PulseSensor::reportedPulses;
+        OfflineStore::psiRecord = PressureSensor::psiReport;
+        OfflineStore::psiRecord.maxSilence = Duration();
+        OfflineStore::psiRecord.reset(PressureSensor::psiReport.lastValue(), MonotonicClock::now());
+    }
+
+    PulseReading pulseReading;
+    if (PulseSensor::readings.read(pulseReading))
+    {
+        if (pulseReading.pulses != OfflineStore::lastPulses)
+        {
+            OfflineStore::add(OfflineGallons, int32_t((pulseReading.pulses - OfflineStore::lastPulses) * 1000 / PULSE_RATE));
+            OfflineStore::lastPulses = pulseReading.pulses;
+        }
+        const bool flowToggled = (OfflineStore::gpmRecord.lastValue() == 0.0) != (pulseReading.gpm == 0.0);
+        OfflineStore::gpmRecord.update(pulseReading.gpm, MonotonicClock::now(), flowToggled ? ReportForce : ReportChange, OfflineStore::recordGpm);
+    }
+
+    PressureReading pressureReading;
+    if (PressureSensor::readings.read(pressureReading))
+    {
+        OfflineStore::psiRecord.update(pressureReading.psi, MonotonicClock::now(), ReportChange, OfflineStore::recordPsi);
+    }
+}
+
+/**
+ * @brief fills up the batch, oldest first (flash, then RAM) and publishes it
+ *
+ * @return true if the batch got published
+ */
+bool OfflineStore::publishBatch()
+{
+    if (OfflineStore::batchSize == 0 && OfflineStore::fileReadRecords < OfflineStore::fileRecords)
+    {
+        File file = LittleFS.open(OFFLINE_STORE_FILE, "r");
+        if (file && file.seek(OfflineStore::fileReadRecords * sizeof(OfflineRecord)))
+        {
+            const uint32_t unread = OfflineStore::fileRecords - OfflineStore::fileReadRecords;
+            const size_t read = file.read((uint8_t *)OfflineStore::batch, (unread < OFFLINE_STORE_BATCH_RECORDS ? unread : OFFLINE_STORE_BATCH_RECORDS) * sizeof(OfflineRecord));
+            OfflineStore::batchSize = read / sizeof(OfflineRecord);
+        }
+        if (file)
+        {
+            file.close();
+        }
+        OfflineStore::fileReadRecords += OfflineStore::batchSize;
+        if (OfflineStore::batchSize == 0 || OfflineStore::fileReadRecords >= OfflineStore::fileRecords)
+        {
+            // all read back (or unreadable)
+            LittleFS.remove(OFFLINE_STORE_FILE);
+            OfflineStore::fileRecords = 0;
+            OfflineStore::fileReadRecords = 0;
+        }
+    }
+    if (OfflineStore::fileRecords == 0)
+    {
+        while (OfflineStore::batchSize < OFFLINE_STORE_BATCH_RECORDS && OfflineStore::records.pop(OfflineStore::batch[OfflineStore::batchSize]))
+        {
+            OfflineStore::batchSize++;
+        }
+    }
+    if (OfflineStore::batchSize == 0)
+    {
+        return false;
+    }
+
+    char payload[OFFLINE_STORE_PAYLOAD_SIZE];
+    int length = snprintf(payload, sizeof(payload), "[");
+    for (int i = 0; i < OfflineStore::batchSize; i++)
+    {
+        const OfflineRecord &record = OfflineStore::batch[i];
+        const char *type = record.type == OfflineGpm ? "gpm" : (record.type == OfflineGallons ? "gallons" : "psi");
+        const unsigned long magnitude = record.value < 0 ? -(unsigned long)record.value : record.value;
+        length += snprintf(payload + length, sizeof(payload) - length, "%s[%lu,\"%s\",%s%lu.%03lu]", i > 0 ? "," : "", (unsigned long)(uint32_t(MonotonicClock::now().toMillis()) - record.time) / 1000, type, record.value < 0 ? "-" : "", magnitude / 1000, magnitude % 1000);
+    }
+    snprintf(payload + length, sizeof(payload) - length, "]");
+
+    if (!Device::mqtt.publish(OFFLINE_STORE_MQTT_TOPIC, payload))
+    {
+        // keep the batch, to retry
+        return false;
+    }
+    OfflineStore::batchSize = 0;
+    return true;
+}
+
+/**
+ * @brief publishes a batch of the stored readings.
+ * it is scheduled every OFFLINE_STORE_DRAIN_FREQUENCY, while connected (@see src/main.cpp)
+ */
+void OfflineStore::loop()
+{
+    OfflineStore::isRecording = false;
+    if (OfflineStore::size() > 0)
+    {
+        OfflineStore::publishBatch();
+    }
+}
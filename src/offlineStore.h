@@ -0,0 +1,115 @@
+#ifndef OFFLINE_STORE
+#define OFFLINE_STORE
+
+#include <stdint.h>
+#include "ringBuffer.h"
+#include "sensorMath.h"
+#include "reportPolicy.h"
+
+/**
+ * @brief the MQTT topic the stored readings are published to, once reconnected.
+ * every message is a batch (JSON array) of [seconds ago, "type", value] readings, oldest first:
+ * [[125,"gpm",1.25],[120,"gallons",1],[118,"psi",55.10]]
+ *
+ * note: the gallons are the history only, the totals still go through the gallons counter sensor.
+ */
+#define OFFLINE_STORE_MQTT_TOPIC "waterMonitor:offline"
+
+/**
+ * @brief number of readings kept in RAM, while offline. must be a power of 2.
+ * when full, the oldest OFFLINE_STORE_SPILL_RECORDS get moved to flash.
+ */
+#define OFFLINE_STORE_RAM_RECORDS 256
+
+/**
+ * @brief number of readings moved (written) to flash at once
+ */
+#define OFFLINE_STORE_SPILL_RECORDS 64
+
+/**
+ * @brief max number of readings kept in flash (12 bytes each).
+ * when full, the readings that would be moved to flash get dropped (and counted).
+ * the filesystem is shared with OTA, so keep it small.
+ */
+#define OFFLINE_STORE_FLASH_RECORDS 4096
+
+/**
+ * @brief the file (LittleFS) of the readings moved to flash
+ */
+#define OFFLINE_STORE_FILE "/offline.bin"
+
+/**
+ * @brief number of readings in every published batch.
+ * the payload must fit in OFFLINE_STORE_PAYLOAD_SIZE (and in the MQTT client buffer),
+ * which is up to 34 characters per reading.
+ */
+#define OFFLINE_STORE_BATCH_RECORDS 6
+
+/**
+ * @brief max length (including the terminator) of a batch payload
+ */
+#define OFFLINE_STORE_PAYLOAD_SIZE 224
+
+/**
+ * @brief frequency in milliseconds, to publish a batch (flow control, the period of the drain task).
+ * a failed publish is retried (the same batch) after that.
+ */
+#define OFFLINE_STORE_DRAIN_FREQUENCY 250
+
+enum OfflineRecordType : uint8_t
+{
+    OfflineGpm = 0,
+    OfflineGallons,
+    OfflinePsi
+};
+
+/**
+ * @brief a reading, taken while offline
+ */
+struct OfflineRecord
+{
+    // the time (monotonic milliseconds) of the reading, 32bit to keep the records small (the ages wrap safely, up to ~49 days)
+    uint32_t time;
+    // the reading in thousandths (ie. milli-GPM)
+    int32_t value;
+    OfflineRecordType type;
+};
+
+/**
+ * @brief the offline store-and-forward queue (core 0).
+ * while disconnected, it records the readings that would have been sent (with their time),
+ * in a fixed-capacity RAM ring that spills to a bounded flash file.
+ * once reconnected, it drains them (oldest first) in batches, one batch per OFFLINE_STORE_DRAIN_FREQUENCY.
+ */
+class OfflineStore
+{
+public:
+    // properties
+    static RingBuffer<OfflineRecord, OFFLINE_STORE_RAM_RECORDS> records;
+    static bool isFileAvailable;
+    static uint32_t fileRecords;
+    static uint32_t fileReadRecords;
+    static OfflineRecord batch[OFFLINE_STORE_BATCH_RECORDS];
+    static int batchSize;
+    static unsigned long droppedRecords;
+    static unsigned long spills;
+    static ReportPolicy<SensorReal> gpmRecord;
+    static unsigned long lastPulses;
+    static ReportPolicy<SensorReal> psiRecord;
+    static bool isRecording;
+
+    // methods
+    static void setup();
+    static void record();
+    static void loop();
+    static unsigned long size();
+
+private:
+    static void add(OfflineRecordType type, int32_t value);
+    static bool recordGpm(SensorReal gpm);
+    static bool recordPsi(SensorReal psi);
+    static void spill();
+    static bool publishBatch();
+};
+
+#endif // OFFLINE_STORE
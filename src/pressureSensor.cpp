@@ -1,48 +1,41 @@
 #include <ArduinoHA.h>
 #include "device.h"
+#include "debugFormatter.h"
 #include "switches.h"
 #include "pressureSensor.h"
+#include "leakTest.h"
 
 /**
- * @brief the delta in PSI that must be great or equal to,
- * between the previous reading and the current,
- * in order to consider updating it and sending it to the controller
+ * @brief when to send the pressure to the controller:
+ * a change of PRESSURE_SENSOR_DELTA (or out of the PRESSURE_SENSOR_COMPRESSION swinging door),
+ * no more than every PRESSURE_SENSOR_SEND_FREQUENCY and a heartbeat every PRESSURE_SENSOR_MAX_SILENCE
  *
  * note: this changes depending on the mode (ie. water leak test active)
  * @see src/switches.cpp
  */
-float PressureSensor::pressureDelta = PRESSURE_SENSOR_DELTA;
+ReportPolicy<SensorReal> PressureSensor::psiReport(PRESSURE_SENSOR_DELTA, Duration::millis(PRESSURE_SENSOR_SEND_FREQUENCY), Duration::millis(PRESSURE_SENSOR_MAX_SILENCE), PRESSURE_SENSOR_COMPRESSION);
 
 /**
- * @brief frequency in milliseconds,
- * to allow sending of the water pressure to the controller,
- * even if the delta is greater.
- *
- * note: this changes depending on the mode (ie. water leak test active)
- * @see src/switches.cpp
+ * @brief added to the calibrated PSI (core 1), to zero the sensor in the field
+ * @see src/config.h
  */
-unsigned int PressureSensor::sendPressureFrequency = PRESSURE_SENSOR_SEND_FREQUENCY;
+SensorReal PressureSensor::psiOffset = 0.0;
 
-// the adjusted/actual minimum/max input value the pressure sensor pin can provide,
-const float PressureSensor::adjustedMinPressureSensorInputValue = Device::analogInputValueMultiplier * MIN_PRESSURE_SENSOR_VOLTAGE;
-const float PressureSensor::adjustedMaxPressureSensorInputValue = Device::analogInputValueMultiplier * MAX_PRESSURE_SENSOR_VOLTAGE;
-
-// the adjusted/actual number we need to multiply the input value - adjustedMinPressureSensorInputValue,
-// in order to get the true PSI of the sensor
-const float PressureSensor::adjustedPressureSensorInputValueMultiplier = MAX_PRESSURE_SENSOR_PSI / PressureSensor::adjustedMaxPressureSensorInputValue * PRESSURE_SENSOR_PSI_CALIBRATION_MULTIPLIER;
+// the noise filter of the oversampled input value (core 1)
+NoiseFilter<PRESSURE_SENSOR_MEDIAN_SIZE, PRESSURE_SENSOR_EMA_SHIFT> PressureSensor::filter;
 
 // current PSI
-float PressureSensor::psi = 0.0;
-
-// previous PSI (so we only send changes)
-float PressureSensor::prevPsi = 0.0;
-
-// last time we sent the pressure
-unsigned long PressureSensor::lastPressureSendTime = 0;
+SensorReal PressureSensor::psi = 0.0;
 
 // the water pressure sensor
 HASensorNumber PressureSensor::psiSensor("waterMonitorPressure", HASensorNumber::PrecisionP2);
 
+// the latest reading of the sampling core (written by core 1, read by core 0)
+Mailbox<PressureReading> PressureSensor::readings;
+
+// core 0's copy of the latest reading
+PressureReading PressureSensor::reading = {0, 0};
+
 void PressureSensor::setup()
 {
     PressureSensor::psiSensor.setName("Water Pressure");
@@ -51,56 +44,67 @@ void PressureSensor::setup()
     PressureSensor::psiSensor.setUnitOfMeasurement("psi");
 }
 
+bool PressureSensor::publishPsi(SensorReal psi)
+{
+    // only send a minimum of zero PSI
+    // to not mess up the statistics/logs
+    return PressureSensor::psiSensor.setValue(psi > 0 ? SensorMath::toFloat(psi) : float(0.0), true);
+}
+
 /**
- * @brief if we should send the pressure to the controller.
- * a separate throttler to keep the unsolicited updated in lifeline prioritize the flow.
+ * @brief should be called for every new ADC block (core 1).
+ * it samples the sensor (oversampled and filtered) and posts the reading for the loop() to report.
  *
- * @return true
- * @return false
+ * @param block
  */
-bool PressureSensor::shouldSendPSI()
+void PressureSensor::sample(const AdcBlock &block)
 {
-    return abs(long(millis() - PressureSensor::lastPressureSendTime)) > PressureSensor::sendPressureFrequency;
+    const int oversampledInputValue = AdcSampler::oversample(block, PRESSURE_SENSOR_PIN, PRESSURE_SENSOR_OVERSAMPLING_BITS); // the block average of the input pin
+    const uint32_t filteredInputValue = PressureSensor::filter.update(oversampledInputValue);
+    const SensorReal psi = PressureSensor::toPsi(filteredInputValue, PRESSURE_SENSOR_OVERSAMPLING_BITS) + PressureSensor::psiOffset;
+    PressureSensor::readings.write({oversampledInputValue >> PRESSURE_SENSOR_OVERSAMPLING_BITS, psi});
+    LeakTest::sample(psi, block.time);
 }
 
+/**
+ * @brief should be called on every iteration of the main loop() function (core 0).
+ * it takes the latest reading of the sampling core and reports it to the controller.
+ */
 void PressureSensor::loop()
 {
-    int rawPressureSensorInputValue = analogRead(PRESSURE_SENSOR_PIN); // read the input pin
-    PressureSensor::psi = (rawPressureSensorInputValue - PressureSensor::adjustedMinPressureSensorInputValue) * PressureSensor::adjustedPressureSensorInputValueMultiplier;
-    if (abs(PressureSensor::psi - PressureSensor::prevPsi) >= PressureSensor::pressureDelta && PressureSensor::shouldSendPSI())
+    if (!PressureSensor::readings.read(PressureSensor::reading))
+    {
+        // nothing sampled yet
+        return;
+    }
+    const int rawPressureSensorInputValue = PressureSensor::reading.raw;
+    PressureSensor::psi = PressureSensor::reading.psi;
+    if (Device::reconnected)
+    {
+        /**
+         * @brief only upon reconnection (the reconnect flag lasts only one loop)
+         * send the current PSI to the controller, in case for example, it changed
+         * while we were disconnected, so that the controller gets this value "update"...
+         */
+        PressureSensor::psiReport.invalidate();
+    }
+    if (PressureSensor::psiReport.update(PressureSensor::psi, MonotonicClock::now(), ReportChange, PressureSensor::publishPsi))
     {
-        PressureSensor::prevPsi = PressureSensor::psi;
-        PressureSensor::lastPressureSendTime = millis();
-
 #ifdef SERIAL_DEBUG
         Serial.print("raw: ");
         Serial.println(rawPressureSensorInputValue);
         Serial.print("PSI: ");
-        Serial.println(PressureSensor::psi);
+        Serial.println(SensorMath::toFloat(PressureSensor::psiReport.lastValue()));
 #endif
         if (Switches::isDebugActive)
         {
-            Device::mqtt.publish(PRESSURE_SENSOR_DEBUG_MQTT_TOPIC, String("raw PSI input: " + String(rawPressureSensorInputValue) + ", PSI: " + String(PressureSensor::psi)).c_str());
-        }
-
-        // only send a minimum of zero PSI
-        // to not mess up the statistics/logs
-        if (PressureSensor::psi > 0)
-        {
-            PressureSensor::psiSensor.setValue(PressureSensor::psi);
+            char payload[DEBUG_MESSAGE_SIZE];
+            DebugFormatter(payload, sizeof(payload))
+                .text("raw PSI input: ")
+                .number(rawPressureSensorInputValue)
+                .text(", PSI: ")
+                .milli(SensorMath::toMilli(PressureSensor::psiReport.lastValue()), 2);
+            Device::mqtt.publish(PRESSURE_SENSOR_DEBUG_MQTT_TOPIC, payload);
         }
-        else
-        {
-            PressureSensor::psiSensor.setValue(float(0.0));
-        }
-    }
-    else if (Device::reconnected)
-    {
-        /**
-         * @brief only upon reconnection (the reconnect flag lasts only one loop)
-         * send the current GPM to the controller, in case for example, the flow stopped
-         * while we were disconnected, so that the controller gets this value "update"...
-         */
-        PressureSensor::psiSensor.setValue(PressureSensor::psi, true);
     }
 }
\ No newline at end of file
@@ -2,6 +2,13 @@
 #define PRESSURE_SENSOR
 
 #include <ArduinoHA.h>
+#include "mailbox.h"
+#include "adcSampler.h"
+#include "device.h"
+#include "sensorMath.h"
+#include "calibrationTable.h"
+#include "noiseFilter.h"
+#include "reportPolicy.h"
 
 /**
  * @brief the MQTT topic for debugging this sensor
@@ -13,7 +20,7 @@
  * @brief the delta that the pressure sensor needs to have between previous and current value,
  * in order to quality to be sent to the controller, during a water leak test mode.
  */
-#define PRESSURE_SENSOR_DELTA_WATER_LEAK_TEST_ACTIVE 0.1
+#define PRESSURE_SENSOR_DELTA_WATER_LEAK_TEST_ACTIVE 0.01
 
 /**
  * @brief the time frequency in milliseconds that needs to pass from the last time
@@ -35,6 +42,19 @@
  */
 #define PRESSURE_SENSOR_SEND_FREQUENCY 15000
 
+/**
+ * @brief the swinging door compression in PSI, instead of the delta, during normal operation mode (0 to use the delta).
+ * the pressure gets sent once a straight line from the last value sent, can no longer pass within it of the readings since,
+ * so that the (interpolated) history of the controller stays within it, with less updates for the slow drifts.
+ * @see src/reportPolicy.h
+ */
+#define PRESSURE_SENSOR_COMPRESSION 0
+
+/**
+ * @brief time in milliseconds without sending the pressure, before it gets sent again (heartbeat)
+ */
+#define PRESSURE_SENSOR_MAX_SILENCE 900000
+
 // the (analog) pin that we connect the pressure sensor output
 // you may use A0-A2
 #define PRESSURE_SENSOR_PIN A0
@@ -42,56 +62,94 @@
 // the max PSI the sensor itself can measure
 #define MAX_PRESSURE_SENSOR_PSI 100.0
 
+// specs of sensor
+// 0 PSI = 0.5v
+// 50 PSI = 2.5v
+// 100 PSI = 4.5v
+
+// measured output
+// 0 PSI = 0.79v instead of the 0.5v spec
+
 /**
- * @brief how much to multiply the PSI number we come up with,
- * to match the calibrated and expected reading from other sensors.
- * when we calibrate (take voltage measurements from the sensor stepped down),
+ * @brief the calibration measurements (raw input value, PSI), after the step-down.
+ * the PSI gets interpolated (piecewise-linear) between them, which also covers the non-linearity
+ * of the step-down and the offset of the ADC.
  *
  *  according to the docs:
  *  The ADC draws current (about 150μA if the temperature sense diode is disabled, which can vary between chips);
  *  there will be an inherent offset of about 150μA*200 = ~30mV. There is a small difference in current draw when the
  *  ADC is sampling (about +20μA), so that offset will also vary with sampling as well as operating temperature.
-
+ *
+ * 170 @ 0 PSI 0.4v
+ * 615 @ 50 PSI 2v
+ * 895 @ 80 PSI 2.49v
+ * 980 @ 90 PSI 2.76v
+ * 1023 @ 100 PSI 3.3v
+ *
+ * they must be sorted by the raw input value.
  */
-#define PRESSURE_SENSOR_PSI_CALIBRATION_MULTIPLIER 1.22
+#define PRESSURE_SENSOR_CALIBRATION_POINTS {{170, 0.0}, {615, 50.0}, {895, 80.0}, {980, 90.0}, {1023, 100.0}}
 
-// calibration measurements after the step-down.
-// 170 @ 0 PSI 0.4v
-// 615 @ 50 PSI 2v
-// 895 @ 80 PSI 2.49v
-// 980 @ 90 PSI 2.76v
-// 1023 @ 100 PSI 3.3v
+/**
+ * @brief the max raw input value (resolution) the calibration points were measured with.
+ * they get scaled to MAX_ANALOG_PIN_RANGE.
+ */
+#define PRESSURE_SENSOR_CALIBRATION_RANGE 1023
 
-// specs of sensor
-// 0 PSI = 0.5v
-// 50 PSI = 2.5v
-// 100 PSI = 4.5v
+/**
+ * @brief the fraction bits to keep, when averaging the samples of every ADC block (oversampling/decimation).
+ * @see AdcSampler::oversample()
+ */
+#define PRESSURE_SENSOR_OVERSAMPLING_BITS 6
 
-// measured output
-// 0 PSI = 0.79v instead of the 0.5v spec
+/**
+ * @brief the number of (block) values the median filter uses, to reject glitches (odd, 1 to disable)
+ */
+#define PRESSURE_SENSOR_MEDIAN_SIZE 5
 
-// when at 0 PSI
-#define MIN_PRESSURE_SENSOR_VOLTAGE 0.3
+/**
+ * @brief the smoothing of the average filter that follows the median, alpha = 1 / 2^PRESSURE_SENSOR_EMA_SHIFT
+ * (0 to disable). with ~39 blocks per second, 4 settles within about half a second.
+ */
+#define PRESSURE_SENSOR_EMA_SHIFT 4
 
-// when at 100 PSI
-#define MAX_PRESSURE_SENSOR_VOLTAGE 3.3
+/**
+ * @brief the reading the sampling core (core 1) posts for the controller loop (core 0)
+ */
+struct PressureReading
+{
+    // the (unfiltered) average of the last block
+    int raw;
+    // the filtered PSI
+    SensorReal psi;
+};
 
 class PressureSensor
 {
 public:
-    static float pressureDelta;
-    static unsigned int sendPressureFrequency;
-    static const float adjustedMinPressureSensorInputValue;
-    static const float adjustedMaxPressureSensorInputValue;
-    static const float adjustedPressureSensorInputValueMultiplier;
-    static float psi;
-    static float prevPsi;
-    static unsigned long lastPressureSendTime;
+    static ReportPolicy<SensorReal> psiReport;
+    static SensorReal psiOffset;
+    static constexpr CalibrationPoint calibrationPoints[] = PRESSURE_SENSOR_CALIBRATION_POINTS;
+    // the PSI of every raw input value (generated at compile time)
+    static constexpr CalibrationTable<MAX_ANALOG_PIN_RANGE + 1> psiTable = CalibrationTable<MAX_ANALOG_PIN_RANGE + 1>::from(PressureSensor::calibrationPoints, double(MAX_ANALOG_PIN_RANGE) / PRESSURE_SENSOR_CALIBRATION_RANGE);
+    static NoiseFilter<PRESSURE_SENSOR_MEDIAN_SIZE, PRESSURE_SENSOR_EMA_SHIFT> filter;
+    static SensorReal psi;
     static HASensorNumber psiSensor;
+    static Mailbox<PressureReading> readings;
+    static PressureReading reading;
 
     // methods
-    static bool shouldSendPSI();
+    static SensorReal toPsi(int rawPressureSensorInputValue)
+    {
+        return PressureSensor::psiTable[rawPressureSensorInputValue];
+    }
+    static SensorReal toPsi(uint32_t oversampledInputValue, int fractionBits)
+    {
+        return PressureSensor::psiTable.interpolate(oversampledInputValue, fractionBits);
+    }
+    static bool publishPsi(SensorReal psi);
     static void setup();
+    static void sample(const AdcBlock &block);
     static void loop();
 };
 
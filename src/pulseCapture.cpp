@@ -0,0 +1,118 @@
+#include <ArduinoHA.h>
+#include "pulseSensor.h"
+#include "pulseCapture.h"
+
+// the edges, pushed by the interrupt handler
+RingBuffer<PulseEdge, PULSE_CAPTURE_BUFFER_SIZE> PulseCapture::edges;
+
+// edges that did not fit in the buffer (the consumer fell behind)
+volatile unsigned long PulseCapture::droppedEdges = 0;
+
+// the pin of the pulse switch
+int PulseCapture::pin = 0;
+
+// if the switch is released (the last edge left the pin HIGH) and since when
+bool PulseCapture::isReleased = false;
+Instant PulseCapture::releaseTime;
+
+// timestamp of the last accepted (debounced) pulse
+Instant PulseCapture::lastPulseTime;
+
+// false until the first pulse gets accepted, since we need 2 pulses for an interval
+bool PulseCapture::hasLastPulse = false;
+
+/**
+ * @brief the interrupt handler (on every change of the pin). keep it minimal.
+ * when the switch bounces faster than the interrupt gets handled, the level is the one after the last edge.
+ */
+void PulseCapture::onEdge()
+{
+    if (!PulseCapture::edges.push({MonotonicClock::now(), digitalRead(PulseCapture::pin) == HIGH}))
+    {
+        PulseCapture::droppedEdges = PulseCapture::droppedEdges + 1;
+    }
+}
+
+/**
+ * @brief debounces an edge against the release of the switch and the last accepted pulse
+ *
+ * @param edge the edge
+ * @param debounce presses within that period from the last pulse are ignored
+ * @param interval set to the time since the previous pulse, or 0 for the very first pulse
+ * @return true if the edge is a new pulse
+ * @return false if it is a release, switch bounce, or a press that did not follow a (long enough) release
+ */
+bool PulseCapture::accept(const PulseEdge &edge, Duration debounce, Duration &interval)
+{
+    if (edge.isHigh)
+    {
+        // (re)starts the release, even after a bounce
+        PulseCapture::isReleased = true;
+        PulseCapture::releaseTime = edge.time;
+        return false;
+    }
+
+    const bool wasReleased = PulseCapture::isReleased && edge.time - PulseCapture::releaseTime >= Duration::millis(PULSE_CAPTURE_RELEASE_TIME);
+    PulseCapture::isReleased = false;
+    if (!wasReleased)
+    {
+        return false;
+    }
+
+    if (!PulseCapture::hasLastPulse)
+    {
+        PulseCapture::hasLastPulse = true;
+        PulseCapture::lastPulseTime = edge.time;
+        interval = Duration();
+        return true;
+    }
+
+    // the timestamps never wrap, so even an edge hours after the last pulse gets its actual interval
+    const Duration sinceLastPulse = edge.time - PulseCapture::lastPulseTime;
+    if (sinceLastPulse <= debounce)
+    {
+        return false;
+    }
+
+    PulseCapture::lastPulseTime = edge.time;
+    interval = sinceLastPulse;
+    return true;
+}
+
+/**
+ * @brief drains the captured edges until it finds the next (debounced) pulse.
+ * should be called from the main loop only (the single consumer).
+ *
+ * @param pulseTime set to the timestamp of the pulse
+ * @param interval set to the exact time since the previous pulse, or 0 for the very first pulse
+ * @return true when there was a new pulse
+ * @return false when there are no more pulses captured
+ */
+bool PulseCapture::nextPulse(Instant &pulseTime, Duration &interval)
+{
+    PulseEdge edge;
+    while (PulseCapture::edges.pop(edge))
+    {
+        if (PulseCapture::accept(edge, Duration::millis(PULSE_DEBOUNCE_FREQUENCY), interval))
+        {
+            pulseTime = edge.time;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief starts capturing the edges of the pin (it should already be an input).
+ * a switch that is released at this point, counts as released since now.
+ *
+ * @param pin
+ */
+void PulseCapture::setup(int pin)
+{
+    PulseCapture::pin = pin;
+    PulseCapture::isReleased = digitalRead(pin) == HIGH;
+    PulseCapture::releaseTime = MonotonicClock::now();
+    PulseCapture::hasLastPulse = false;
+    attachInterrupt(digitalPinToInterrupt(pin), PulseCapture::onEdge, CHANGE);
+}
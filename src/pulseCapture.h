@@ -0,0 +1,59 @@
+#ifndef PULSE_CAPTURE
+#define PULSE_CAPTURE
+
+#include "ringBuffer.h"
+#include "monotonicTime.h"
+
+/**
+ * @brief capacity of the pulse edge timestamps buffer.
+ * at 1 pulse per gallon (plus some switch bounce), this is plenty,
+ * even for a main loop that stalls for minutes (ie. WiFi reconnection).
+ * must be a power of 2.
+ */
+#define PULSE_CAPTURE_BUFFER_SIZE 32
+
+/**
+ * @brief time in milliseconds the pulse switch must stay released (HIGH), before the next press (falling edge) counts as a pulse.
+ * the bounce of the release, or a switch that stays pressed (ie. the meter stopped on it) but chatters,
+ * never stays released that long.
+ */
+#define PULSE_CAPTURE_RELEASE_TIME 50
+
+/**
+ * @brief an edge of the pulse switch: its (monotonic) timestamp and the level of the pin right after it
+ */
+struct PulseEdge
+{
+    Instant time;
+    bool isHigh;
+};
+
+/**
+ * @brief captures the pulse switch edges in an interrupt handler,
+ * so that no pulse gets lost or mistimed when the main loop stalls.
+ *
+ * the handler only records the timestamp and the level of every (falling and rising) edge into a lock-free ring buffer,
+ * the main loop drains it with nextPulse(), which also debounces the edges:
+ * a press is a pulse, only when the switch was released for PULSE_CAPTURE_RELEASE_TIME before it
+ * and no sooner than PULSE_DEBOUNCE_FREQUENCY after the previous pulse.
+ */
+class PulseCapture
+{
+public:
+    // properties
+    static RingBuffer<PulseEdge, PULSE_CAPTURE_BUFFER_SIZE> edges;
+    static volatile unsigned long droppedEdges;
+    static int pin;
+    static bool isReleased;
+    static Instant releaseTime;
+    static Instant lastPulseTime;
+    static bool hasLastPulse;
+
+    // methods
+    static void onEdge();
+    static bool accept(const PulseEdge &edge, Duration debounce, Duration &interval);
+    static bool nextPulse(Instant &pulseTime, Duration &interval);
+    static void setup(int pin);
+};
+
+#endif // PULSE_CAPTURE
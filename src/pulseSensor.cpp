@@ -1,7 +1,13 @@
 #include <ArduinoHA.h>
 #include "device.h"
+#include "debugFormatter.h"
 #include "switches.h"
 #include "pulseSensor.h"
+#include "pulseCapture.h"
+#include "adcSampler.h"
+#include "flowDetector.h"
+#include "flowEstimator.h"
+#include "irCalibration.h"
 
 // holds the last pulse sensor isActive state
 boolean PulseSensor::lastPulseSensorIsActive = false;
@@ -22,46 +28,45 @@ boolean PulseSensor::lastPulseSensorIsActive = false;
 // Normal Flow Range: 0.25 - 15 GPM
 // Pulse Rate is 1 Pulse/Gallon
 
-// last time we had a pulse
-unsigned long PulseSensor::lastPulseTime = 0;
+// last time we had a pulse (the boot, until the first one)
+Instant PulseSensor::lastPulseTime;
 
 // time passed between previous pulse and the current one
 // TODO: rename last/prev/current to clear things up
-unsigned long PulseSensor::prevTimePassedSinceLastPulse = 0;
+Duration PulseSensor::prevTimePassedSinceLastPulse;
 
-// current gallons per minute
-float PulseSensor::gpm = 0.0;
+// the time the current pulse took place.
+// when polling, this is the time we noticed it, when capturing, the time of the interrupt.
+Instant PulseSensor::pulseTime;
 
-// last flow GPM value we sent (to avoid let's say sending 0.0 twice in a row)
-float PulseSensor::lastGpmSent = 0.0;
+// the exact time between the current and the previous pulse
+// (only when capturing pulses, zero otherwise or when unknown)
+Duration PulseSensor::pulseInterval;
 
-// last time we sent the gpm
-unsigned long PulseSensor::lastGpmSendTime = 0;
+// current gallons per minute
+SensorReal PulseSensor::gpm = 0.0;
 
-// last time we resent the gpm
-unsigned long PulseSensor::lastGpmResendTime = 0;
+// when to send the GPM: every change, no more than every SEND_GPM_FREQUENCY (unless tuned, @see src/config.h),
+// a heartbeat every SEND_GPM_MAX_SILENCE and the stop-flow (0.0) resent RESEND_GPM_TIMES times
+ReportPolicy<SensorReal> PulseSensor::gpmReport(0.0, Duration::millis(SEND_GPM_FREQUENCY), Duration::millis(SEND_GPM_MAX_SILENCE), 0.0, RESEND_GPM_TIMES, Duration::millis(RESEND_GPM_FREQUENCY));
 
 // time that must pass without a pulse, in order to be considered no-flow
-unsigned int PulseSensor::flowTimeout = 0;
-
-// how many times we have resent, so far
-unsigned int PulseSensor::gpmResendTimes = 0;
+Duration PulseSensor::flowTimeout;
 
-// last time we got an infrared delta
-unsigned long PulseSensor::lastIrTime = 0;
+// current value (@see FlowDetector::isActive)
+bool PulseSensor::isIrSensorActive = false;
 
-// the "first" time we got an infrared delta
-unsigned long PulseSensor::fistIrTime = 0;
+// number of pulses (gallons) metered since boot (core 1)
+unsigned long PulseSensor::pulses = 0;
 
-// previous infrared value we had (since the last delta)
-int PulseSensor::prevIrValue = -1;
+// the latest readings of the sampling core (written by core 1, read by core 0)
+Mailbox<PulseReading> PulseSensor::readings;
 
-// number of delta counts that are happening, within the timeout period
-// @see IR_COUNTS_THRESHOLD
-unsigned int PulseSensor::irCounts = 0;
+// core 0's copy of the latest readings
+PulseReading PulseSensor::reading = {0.0, 0, false};
 
-// current value
-bool PulseSensor::isIrSensorActive = false;
+// number of pulses (gallons) already added to the gallons counter buffer (core 0)
+unsigned long PulseSensor::reportedPulses = 0;
 
 // gallons to increase the water meter by
 // defaults to -1 in order to send 0 at boot, in case it rebooted while last sent a value > 0
@@ -71,8 +76,8 @@ long PulseSensor::gallonsCounter = -1;
 // this is the internal counter, before we update and send the new value to the controller.
 long PulseSensor::gallonsCounterBuffer = 0;
 
-// last time we sent the gallons counter
-unsigned long PulseSensor::lastGallonsCounterSendTime = 0;
+// when to send the gallons counter: every change, no more than every SEND_GALLONS_COUNTER_FREQUENCY
+ReportPolicy<long> PulseSensor::gallonsReport(0, Duration::millis(SEND_GALLONS_COUNTER_FREQUENCY));
 
 // flag to keep track of the first loop
 bool PulseSensor::firstLoop = true;
@@ -83,89 +88,44 @@ HASensorNumber PulseSensor::gpmSensor("waterMonitorFlow", HASensorNumber::Precis
 // the water gallons counter sensor
 HASensorNumber PulseSensor::gallonsSensor("waterMonitorGallonsCounter", HASensorNumber::PrecisionP0);
 
-// for debug of gpm infrared counts
+// for debug of the infrared flow detection
 bool PulseSensor::lastIsDebugActive = false;
-unsigned int PulseSensor::minIrCounts = INT_MAX;
-unsigned int PulseSensor::maxIrCounts = 0;
-float PulseSensor::avgIrCounts = 0.0;
-unsigned int PulseSensor::deltaRounds = 0;
 unsigned long PulseSensor::loopCycles = 0;
-bool PulseSensor::activeCountsReported = false;
-
-/**
- * @brief if we should send the pressure to the controller.
- * a separate throttler to keep the unsolicited updated in lifeline prioritize the flow.
- *
- * @return true
- * @return false
- */
-bool PulseSensor::shouldSendGallonsCounter()
-{
-    return abs(long(millis() - PulseSensor::lastGallonsCounterSendTime)) > SEND_GALLONS_COUNTER_FREQUENCY;
-}
 
 /**
  * @brief checks if the gallons counter needs to be set or reset and then sent to the controller.
  *        this should be called on every loop iteration (in case we need to reset the counter).
- *
+ *        the counter alternates between the gallons metered since and zero (@see SEND_GALLONS_COUNTER_FREQUENCY),
+ *        but not when both are zero.
  */
 void PulseSensor::checkGallonsCounter()
 {
-    if (PulseSensor::shouldSendGallonsCounter() && Device::isConnected())
+    if (!Device::isConnected())
     {
-        bool send = false;
-        if (PulseSensor::gallonsCounter == 0)
-        {
-            // don't update when both counters are set to zero
-            if (PulseSensor::gallonsCounterBuffer != 0)
-            {
-                // set the exposed counter
-                PulseSensor::gallonsCounter = PulseSensor::gallonsCounterBuffer;
-                // reset the buffer
-                PulseSensor::gallonsCounterBuffer = 0;
-                send = true;
-            }
-        }
-        else
-        {
-            // reset the exposed counter
-            PulseSensor::gallonsCounter = 0;
-            send = true;
-        }
-
-        // only send when there's a new value
-        if (send)
-        {
-            // send the new value
-            PulseSensor::lastGallonsCounterSendTime = millis();
-            PulseSensor::gallonsSensor.setValue(PulseSensor::gallonsCounter);
-        }
+        return;
+    }
+    const long gallons = PulseSensor::gallonsCounter == 0 ? PulseSensor::gallonsCounterBuffer : 0;
+    if (PulseSensor::gallonsReport.update(gallons, MonotonicClock::now(), ReportChange, PulseSensor::publishGallons))
+    {
+        // the exposed counter is now the new value and the buffer starts over
+        PulseSensor::gallonsCounter = gallons;
+        PulseSensor::gallonsCounterBuffer -= gallons;
     }
-}
-
-/**
- * @brief this should only be called, every time we get a new pulse.
- *        it increases the gallonsCounterBuffer by one
- */
-void PulseSensor::increaseGallonsCounter()
-{
-    PulseSensor::gallonsCounterBuffer++;
 }
 
 /**
  * @brief checks if the infrared sensor is changing,
  * which means, movement is taking place on the spinning dial.
  *
- * when true, it sets irSensorValue to true and false when not.
- * it debounces the sensor properly and on the first reading, it leaves it at false.
+ * when true, it sets isIrSensorActive to true and false when not.
  *
  * @see IR_SENSOR_PIN
- * @see IR_DELTA_THRESHOLD
+ * @see FlowDetector
  *
- * @return true
- * @return false
+ * @param irValue the IR sensor value, averaged over an ADC block (evenly spaced in time)
+ * @param time the time of the value
  */
-void PulseSensor::updateIrSensorActive()
+void PulseSensor::updateIrSensorActive(int irValue, Instant time)
 {
     // count cycles
     if (Switches::isDebugActive)
@@ -173,143 +133,52 @@ void PulseSensor::updateIrSensorActive()
         PulseSensor::loopCycles++;
     }
 
-    // read the input pin
-    int irValue = analogRead(IR_SENSOR_PIN);
-
-    // time passed since "first" IR delta
-    unsigned long timePassedSinceFirstIr = abs(long(millis() - PulseSensor::fistIrTime));
-
-    // only when the value has changed
-    if (PulseSensor::prevIrValue == -1)
-    {
-        // during initial run, just set the previous value to the current one
-        // isIrSensorActive should already be set to false
-        PulseSensor::prevIrValue = irValue;
-    }
-    else if (abs(irValue - PulseSensor::prevIrValue) > IR_DELTA_THRESHOLD)
-    {
-        // keep the last value
-        PulseSensor::prevIrValue = irValue;
-
-        // increase the counter
-        PulseSensor::irCounts++;
-
-        // when the IR counts have reached the threshold
-        if (!PulseSensor::isIrSensorActive && PulseSensor::irCounts > IR_COUNTS_THRESHOLD)
-        {
-            // mark our IR sensor as active
-            PulseSensor::isIrSensorActive = true;
-
-            // keep the time the active started
-            PulseSensor::lastIrTime = millis();
-        }
-        else if (PulseSensor::isIrSensorActive && PulseSensor::irCounts > IR_COUNTS_THRESHOLD_KEEP_ACTIVE)
-        {
-            // refresh the time the active started
-            PulseSensor::lastIrTime = millis();
-        }
-    }
-
-    // check to report the counts that triggered the active flow
-    if (!PulseSensor::activeCountsReported && PulseSensor::isIrSensorActive && timePassedSinceFirstIr > IR_TIMEOUT)
+    const Duration halfPeriod = FlowDetector::halfPeriod();
+    FlowDetector::update(irValue, time);
+    FlowEstimator::update();
+    IrCalibration::sample(FlowDetector::ac, time);
+    if (PulseSensor::isIrSensorActive != FlowDetector::isActive)
     {
-        PulseSensor::activeCountsReported = true;
+        PulseSensor::isIrSensorActive = FlowDetector::isActive;
 #ifdef SERIAL_DEBUG
-        Serial.print("irCounts: ");
-        Serial.println(PulseSensor::irCounts);
+        Serial.print("IR active: ");
+        Serial.println(PulseSensor::isIrSensorActive);
 #endif
         if (Switches::isDebugActive)
         {
-            Device::mqtt.publish(PULSE_SENSOR_DEBUG_MQTT_TOPIC, String("irCounts IR TRUE - " + String(PulseSensor::irCounts)).c_str());
-        }
-    }
-
-    // check for time outs (either during inactive or active)
-    if (PulseSensor::isIrSensorActive && abs(long(millis() - PulseSensor::lastIrTime)) > IR_TIMEOUT_KEEP_ACTIVE)
-    {
-        // timed out. switch to inactive
-#ifdef SERIAL_DEBUG
-        Serial.print("IR false with delta: ");
-        Serial.println(abs(irSensorValue - PulseSensor::prevIrValue));
-#endif
-        if (Switches::isDebugActive)
-        {
-            PulseSensor::deltaRounds++;
-            if (PulseSensor::irCounts < PulseSensor::minIrCounts)
-            {
-                PulseSensor::minIrCounts = PulseSensor::irCounts;
-            }
-            if (PulseSensor::irCounts > PulseSensor::maxIrCounts)
-            {
-                PulseSensor::maxIrCounts = PulseSensor::irCounts;
-            }
-            PulseSensor::avgIrCounts = PulseSensor::avgIrCounts + PulseSensor::irCounts;
-            if (PulseSensor::avgIrCounts > 0)
-            {
-                PulseSensor::avgIrCounts = PulseSensor::avgIrCounts / 2;
-            }
-            Device::mqtt.publish(PULSE_SENSOR_DEBUG_MQTT_TOPIC, String("irCounts IR FALSE - " + String(PulseSensor::irCounts) + ", min: " + String(PulseSensor::minIrCounts) + ", max: " + String(PulseSensor::maxIrCounts) + ", avg: " + String(PulseSensor::avgIrCounts) + ", rounds: " + String(PulseSensor::deltaRounds) + ", loopCycles: " + String(PulseSensor::loopCycles)).c_str());
+            char payload[DEBUG_MESSAGE_SIZE];
+            DebugFormatter(payload, sizeof(payload))
+                .text("IR ")
+                .text(PulseSensor::isIrSensorActive ? "TRUE" : "FALSE")
+                .text(" - half period (us): ")
+                .number(halfPeriod.toMicros32())
+                .text(", cycles/gallon: ")
+                // Q8 to thousandths
+                .milli(int32_t(FlowDetector::cyclesPerGallon * 1000 / 256), 2)
+                .text(", calibrated: ")
+                .text(FlowDetector::calibrated ? "yes" : "no")
+                .text(", loopCycles: ")
+                .number(PulseSensor::loopCycles);
+            Device::queueDebug(PULSE_SENSOR_DEBUG_MQTT_TOPIC, payload);
             PulseSensor::loopCycles = 0;
         }
-        PulseSensor::isIrSensorActive = false;
-        PulseSensor::activeCountsReported = false;
-    }
-    else if ((!PulseSensor::isIrSensorActive && timePassedSinceFirstIr > IR_TIMEOUT) || (PulseSensor::isIrSensorActive && timePassedSinceFirstIr > IR_TIMEOUT_KEEP_ACTIVE))
-    {
-        // reset the count, when:
-        //  - inactive and timed out OR
-        //  - active and keep active, timed out
-        // to prevent increasing counter indefinitely... (to the point that it crosses the threshold for flow)
-
-        // report how many counts we got within this period
-        {
-#ifdef SERIAL_DEBUG
-            Serial.print("irCounts reset: ");
-            Serial.print(PulseSensor::irCounts);
-            Serial.print(", IR delta: ");
-            Serial.println(delta);
-#endif
-            if (Switches::isDebugActive)
-            {
-                PulseSensor::deltaRounds++;
-                if (PulseSensor::irCounts < PulseSensor::minIrCounts)
-                {
-                    PulseSensor::minIrCounts = PulseSensor::irCounts;
-                }
-                if (PulseSensor::irCounts > PulseSensor::maxIrCounts)
-                {
-                    PulseSensor::maxIrCounts = PulseSensor::irCounts;
-                }
-                PulseSensor::avgIrCounts = PulseSensor::avgIrCounts + PulseSensor::irCounts;
-                if (PulseSensor::avgIrCounts > 0)
-                {
-                    PulseSensor::avgIrCounts = PulseSensor::avgIrCounts / 2;
-                }
-                Device::mqtt.publish(PULSE_SENSOR_DEBUG_MQTT_TOPIC, String("irCounts reset - " + String(PulseSensor::irCounts) + ", min: " + String(PulseSensor::minIrCounts) + ", max: " + String(PulseSensor::maxIrCounts) + ", avg: " + String(PulseSensor::avgIrCounts) + ", rounds: " + String(PulseSensor::deltaRounds) + ", loopCycles: " + String(PulseSensor::loopCycles)).c_str());
-                PulseSensor::loopCycles = 0;
-            }
-
-            PulseSensor::irCounts = 0;
-            PulseSensor::fistIrTime = millis();
-        }
     }
 }
 
 /**
- * @brief if the time passed is negative (ie. due to overflow) or
- * if actual=false and the lastPulseTime is zero (initial pulse) or timePassed <= 0, it will return the flowTimeout,
+ * @brief if actual=false and there was no pulse yet (initial pulse) or no time has passed since it, it will return the flowTimeout,
  * to indicate the lowest possible flow, since we need 2 pulses at least, to calculate the actual flow.
+ * the monotonic time never wraps, so unlike with millis(), the time passed is never negative (or wrong).
  *
- * @see https://www.arduino.cc/reference/en/language/functions/time/millis/
  * @param actual optional. defaults to false. if true, it will never return the flowTimeout.
- * @return milliseconds since the last pulse
+ * @return the time since the last pulse
  */
-unsigned long PulseSensor::timePassedSinceLastPulse(bool actual = false)
+Duration PulseSensor::timePassedSinceLastPulse(bool actual = false)
 {
-    if (PulseSensor::lastPulseTime > 0)
+    if (PulseSensor::lastPulseTime > Instant())
     {
-        const unsigned long timePassed = abs(long(millis() - PulseSensor::lastPulseTime));
-        if (timePassed > 0)
+        const Duration timePassed = MonotonicClock::since(PulseSensor::lastPulseTime);
+        if (timePassed > Duration())
         {
             return timePassed;
         }
@@ -317,7 +186,7 @@ unsigned long PulseSensor::timePassedSinceLastPulse(bool actual = false)
 
     if (actual)
     {
-        return 0;
+        return Duration();
     }
 
     return PulseSensor::flowTimeout;
@@ -325,10 +194,28 @@ unsigned long PulseSensor::timePassedSinceLastPulse(bool actual = false)
 
 /**
  * @brief updates the GPM based on the pulses received
+ * (from the microseconds since the last pulse, so that the high flows are not quantized by the milliseconds)
  */
 void PulseSensor::updateGPM()
 {
-    PulseSensor::gpm = TARGET_RATE_TIME / PulseSensor::timePassedSinceLastPulse() / PULSE_RATE;
+    PulseSensor::gpm = SensorMath::divide<uint32_t(TARGET_RATE_TIME * 1000.0 / PULSE_RATE)>(PulseSensor::timePassedSinceLastPulse().toMicros32());
+}
+
+/**
+ * @brief updates the GPM when we just got a pulse.
+ * when capturing pulses, it uses the exact interval between the last two pulses,
+ * unless the previous pulse is too old (flow timeout) to trust its timestamp.
+ */
+void PulseSensor::updateGPMOnPulse()
+{
+    if (PulseSensor::pulseInterval > Duration() && PulseSensor::timePassedSinceLastPulse() < PulseSensor::flowTimeout)
+    {
+        PulseSensor::gpm = SensorMath::divide<uint32_t(TARGET_RATE_TIME * 1000.0 / PULSE_RATE)>(PulseSensor::pulseInterval.toMicros32());
+    }
+    else
+    {
+        PulseSensor::updateGPM();
+    }
 }
 
 /**
@@ -336,55 +223,19 @@ void PulseSensor::updateGPM()
  *
  * @param newValue
  */
-void PulseSensor::updateGPM(float newValue)
+void PulseSensor::updateGPM(SensorReal newValue)
 {
     PulseSensor::gpm = newValue;
 }
 
-/**
- * @brief sends the water flow GPS to the controller,
- * if the previously sent value is different than the current and
- * if enough time has passed since last time we sent or if force is true.
- *
- * @param force optional. defaults to false. if true, it will ignore the frequency and send the value immediately
- */
-void PulseSensor::sendGPM(bool force = false)
+bool PulseSensor::publishGpm(SensorReal gpm)
 {
-    if (PulseSensor::lastGpmSent != PulseSensor::gpm && (abs(long(millis() - PulseSensor::lastGpmSendTime)) > SEND_GPM_FREQUENCY || force))
-    {
-        PulseSensor::lastGpmSent = gpm;
-        PulseSensor::lastGpmSendTime = millis();
-        // attempt to send it
-        PulseSensor::gpmSensor.setValue(PulseSensor::gpm);
-        // reset the resend, so that we can start resending the GPM if we want
-        PulseSensor::gpmResendTimes = 0;
-        PulseSensor::lastGpmResendTime = millis();
-    }
+    return PulseSensor::gpmSensor.setValue(SensorMath::toFloat(gpm), true);
 }
 
-/**
- * @brief checks if we need to resend te GPM and also sends it if needed.
- * currently, it only resends the already sent 0.0 GPM (stop-flow event)
- */
-void PulseSensor::checkResendGPM()
+bool PulseSensor::publishGallons(long gallons)
 {
-    if (PulseSensor::lastGpmSent == PulseSensor::gpm && PulseSensor::gpm == 0.0 && PulseSensor::gpmResendTimes < RESEND_GPM_TIMES && abs(long(millis() - PulseSensor::lastGpmResendTime)) > RESEND_GPM_FREQUENCY)
-    {
-        // reset the time, so that every retry (even failed ones) have some delay between them
-        PulseSensor::lastGpmResendTime = millis();
-        // attempt to send it
-        if (PulseSensor::gpmSensor.setValue(PulseSensor::gpm, true))
-        {
-            // increase the counter,
-            // only if the MQTT message has been published successfully
-            // otherwise, we want to keep retrying
-            PulseSensor::gpmResendTimes++;
-        }
-        if (Switches::isDebugActive)
-        {
-            Device::mqtt.publish(PULSE_SENSOR_DEBUG_MQTT_TOPIC, "gpm resend");
-        }
-    }
+    return PulseSensor::gallonsSensor.setValue(gallons, true);
 }
 
 /**
@@ -397,10 +248,18 @@ void PulseSensor::checkResendGPM()
  */
 bool PulseSensor::isPulseSensorActive()
 {
+#ifdef PULSE_SENSOR_INTERRUPT_CAPTURE
+    // the pulse may have been captured a while ago (ie. the loop stalled), it keeps the time of the interrupt
+    if (PulseCapture::nextPulse(PulseSensor::pulseTime, PulseSensor::pulseInterval))
+    {
+        return true;
+    }
+    return false;
+#else
     if (digitalRead(PULSE_SENSOR_PIN) == LOW)
     {
         // when the sensor is in active state
-        if (!PulseSensor::lastPulseSensorIsActive && abs(long(millis() - PulseSensor::lastPulseTime)) > PULSE_DEBOUNCE_FREQUENCY)
+        if (!PulseSensor::lastPulseSensorIsActive && MonotonicClock::since(PulseSensor::lastPulseTime) > Duration::millis(PULSE_DEBOUNCE_FREQUENCY))
         {
             // and it just turned active
             PulseSensor::lastPulseSensorIsActive = true;
@@ -414,6 +273,7 @@ bool PulseSensor::isPulseSensorActive()
             // }
 
             // only the first time, return true
+            PulseSensor::pulseTime = MonotonicClock::now();
             return PulseSensor::lastPulseSensorIsActive;
         }
     }
@@ -433,6 +293,7 @@ bool PulseSensor::isPulseSensorActive()
 
     // any other time, return inactive
     return false;
+#endif
 }
 
 void PulseSensor::setup()
@@ -447,51 +308,67 @@ void PulseSensor::setup()
     PulseSensor::gallonsSensor.setIcon("mdi:counter");
     PulseSensor::gallonsSensor.setDeviceClass("water");
     PulseSensor::gallonsSensor.setUnitOfMeasurement("gal");
+}
 
+/**
+ * @brief should be called once, from the setup1() function (core 1)
+ *
+ */
+void PulseSensor::setupSampling()
+{
     // calculate how much time must pass without a pulse, in order to consider no-flow
-    PulseSensor::flowTimeout = TARGET_RATE_TIME / MIN_GPM / PULSE_RATE;
+    PulseSensor::flowTimeout = Duration::millis(int64_t(TARGET_RATE_TIME / MIN_GPM / PULSE_RATE));
 
     // set the mode for the digital pins
     pinMode(LED_BUILTIN, OUTPUT);
     pinMode(PULSE_SENSOR_PIN, INPUT_PULLUP);
+#ifdef PULSE_SENSOR_INTERRUPT_CAPTURE
+    // attached from core 1, so the interrupt is also handled by core 1
+    PulseCapture::setup(PULSE_SENSOR_PIN);
+#endif
 }
 
-void PulseSensor::loop()
+/**
+ * @brief should be called for every new ADC block (core 1)
+ *
+ * @param block
+ */
+void PulseSensor::sample(const AdcBlock &block)
 {
-    if (PulseSensor::firstLoop)
-    {
-        /**
-         * @brief only on the first loop, reset the flow to zero,
-         * in case there was a previous flow that is now invalid.
-         *
-         */
-        PulseSensor::firstLoop = false;
-        PulseSensor::gpmSensor.setValue(float(0.0));
-        PulseSensor::gallonsSensor.setValue(float(0.0));
-    }
-    else if (Device::reconnected)
-    {
-        /**
-         * @brief only upon reconnection (the reconnect flag lasts only one loop)
-         * send the current GPM to the controller, in case for example, the flow stopped
-         * while we were disconnected, so that the controller gets this value "update"...
-         */
-        PulseSensor::gpmSensor.setValue(PulseSensor::gpm, true);
-    }
-
-    // update the value
-    PulseSensor::updateIrSensorActive();
+    PulseSensor::updateIrSensorActive(AdcSampler::mean(block, IR_SENSOR_PIN), block.time);
+}
 
+/**
+ * @brief should be called on every iteration of the loop1() function (core 1),
+ * after the ADC block (if any) has been sampled.
+ * it samples the pulse sensor, updates the flow and
+ * posts the result to the readings mailbox, for the loop() to report.
+ *
+ * it must never touch the network.
+ */
+void PulseSensor::sample()
+{
     if (PulseSensor::isPulseSensorActive())
     {
         // since we got a pulse, force the IR sensor to be true
         // the pulse is more reliable
+        FlowDetector::onPulse(PulseSensor::pulseTime);
+        FlowEstimator::onPulse(PulseSensor::pulseTime);
+        IrCalibration::onPulse(PulseSensor::pulseTime);
         PulseSensor::isIrSensorActive = true;
-        PulseSensor::lastIrTime = millis();
 
         // we got a pulse (this can only happen once, per pulse,
         // even if the meter stops right when the switch is on and the switch remains on)
-        PulseSensor::updateGPM();
+        const uint32_t estimate = FlowEstimator::gpm(MonotonicClock::now());
+        if (estimate > 0)
+        {
+            // the flow estimate, now corrected by the pulse
+            PulseSensor::updateGPM(SensorMath::fromMilli(estimate));
+        }
+        else
+        {
+            PulseSensor::updateGPMOnPulse();
+        }
         if (PulseSensor::gpm < MIN_GPM)
         {
             // when there's pulse but too much time has passed since the last pulse
@@ -500,20 +377,25 @@ void PulseSensor::loop()
             PulseSensor::updateGPM(MIN_GPM);
         }
 
-        PulseSensor::sendGPM(true);
         digitalWrite(LED_BUILTIN, HIGH);
-        PulseSensor::increaseGallonsCounter();
+        PulseSensor::pulses++;
 
         // keep the time passed, before we update the lastPulseTime
-        PulseSensor::prevTimePassedSinceLastPulse = PulseSensor::timePassedSinceLastPulse();
+        PulseSensor::prevTimePassedSinceLastPulse = PulseSensor::pulseInterval > Duration() ? PulseSensor::pulseInterval : PulseSensor::timePassedSinceLastPulse();
 
         // reset the timer, after we have used it (with timePassedSinceLastPulse)
-        PulseSensor::lastPulseTime = millis();
+        PulseSensor::lastPulseTime = PulseSensor::pulseTime;
     }
     else if (PulseSensor::isIrSensorActive)
     {
-        const float prevGPM = PulseSensor::gpm;
-        if (PulseSensor::timePassedSinceLastPulse(true) > PulseSensor::prevTimePassedSinceLastPulse)
+        const SensorReal prevGPM = PulseSensor::gpm;
+        const uint32_t estimate = FlowEstimator::gpm(MonotonicClock::now());
+        if (estimate > 0)
+        {
+            // between the pulses, use the flow estimate of the dial rotation (fused with the pulses)
+            PulseSensor::updateGPM(SensorMath::fromMilli(estimate));
+        }
+        else if (PulseSensor::timePassedSinceLastPulse(true) > PulseSensor::prevTimePassedSinceLastPulse)
         {
             // when the time that has passed since the last pulse
             // is greater than the time that had passed since the previous to last one and
@@ -538,12 +420,6 @@ void PulseSensor::loop()
         {
             // turn on the LED, when we just set the gpm > 0 from 0
             digitalWrite(LED_BUILTIN, HIGH);
-            PulseSensor::sendGPM(true);
-        }
-        else
-        {
-            // existing flow
-            PulseSensor::sendGPM();
         }
     }
     else if (PulseSensor::gpm > 0.0)
@@ -551,7 +427,6 @@ void PulseSensor::loop()
         // no pulse or flow (the IR sensor is inactive) but there's residual GPM
         // reset everything to 0
         PulseSensor::updateGPM(0.0);
-        PulseSensor::sendGPM(true);
         digitalWrite(LED_BUILTIN, LOW);
 
 #ifdef SERIAL_DEBUG
@@ -559,17 +434,10 @@ void PulseSensor::loop()
 #endif
         if (Switches::isDebugActive)
         {
-            Device::mqtt.publish(PULSE_SENSOR_DEBUG_MQTT_TOPIC, "gpm stop - no pulse or flow");
+            Device::queueDebug(PULSE_SENSOR_DEBUG_MQTT_TOPIC, "gpm stop - no pulse or flow");
         }
     }
 
-    // after all other checks have taken place and
-    // any data has been sent, check if we need to set/reset the gallons counter
-    PulseSensor::checkGallonsCounter();
-
-    // check if we need to resend the GPM
-    PulseSensor::checkResendGPM();
-
     // check if the debug got toggled
     if (Switches::isDebugActive != PulseSensor::lastIsDebugActive)
     {
@@ -577,11 +445,55 @@ void PulseSensor::loop()
         // when enabled, reset the debug stats
         if (Switches::isDebugActive)
         {
-            PulseSensor::minIrCounts = INT_MAX;
-            PulseSensor::maxIrCounts = 0;
-            PulseSensor::avgIrCounts = 0.0;
-            PulseSensor::deltaRounds = 0;
             PulseSensor::loopCycles = 0;
         }
     }
-}
\ No newline at end of file
+
+    // post the new state for the controller loop
+    PulseSensor::readings.write({PulseSensor::gpm, PulseSensor::pulses, PulseSensor::isIrSensorActive});
+}
+
+/**
+ * @brief should be called on every iteration of the main loop() function (core 0).
+ * it takes the latest readings of the sampling core and reports them to the controller.
+ */
+void PulseSensor::loop()
+{
+    if (PulseSensor::firstLoop)
+    {
+        /**
+         * @brief only on the first loop, reset the flow to zero,
+         * in case there was a previous flow that is now invalid.
+         * (the gallons counter gets reset to zero too, @see PulseSensor::gallonsCounter)
+         */
+        PulseSensor::firstLoop = false;
+        PulseSensor::gpmReport.update(SensorReal(0.0), MonotonicClock::now(), ReportForce, PulseSensor::publishGpm);
+    }
+    else if (Device::reconnected)
+    {
+        /**
+         * @brief only upon reconnection (the reconnect flag lasts only one loop)
+         * send the current GPM to the controller, in case for example, the flow stopped
+         * while we were disconnected, so that the controller gets this value "update"...
+         */
+        PulseSensor::gpmReport.invalidate();
+    }
+
+    if (PulseSensor::readings.read(PulseSensor::reading))
+    {
+        // the pulses (gallons) metered since the last loop
+        const unsigned long newPulses = PulseSensor::reading.pulses - PulseSensor::reportedPulses;
+        PulseSensor::reportedPulses = PulseSensor::reading.pulses;
+        PulseSensor::gallonsCounterBuffer += newPulses;
+
+        // a new pulse or a flow start/stop, must be sent immediately
+        // and the stop-flow (0.0) gets resent, for better chances of the controller processing it
+        const bool flowToggled = (PulseSensor::gpmReport.lastValue() == 0.0) != (PulseSensor::reading.gpm == 0.0);
+        const ReportEvent event = flowToggled && PulseSensor::reading.gpm == 0.0 ? ReportEdge : (flowToggled || newPulses > 0 ? ReportForce : ReportChange);
+        PulseSensor::gpmReport.update(PulseSensor::reading.gpm, MonotonicClock::now(), event, PulseSensor::publishGpm);
+    }
+
+    // after all other checks have taken place and
+    // any data has been sent, check if we need to set/reset the gallons counter
+    PulseSensor::checkGallonsCounter();
+}
@@ -1,6 +1,12 @@
 #ifndef PULSE_SENSOR
 #define PULSE_SENSOR
 
+#include "mailbox.h"
+#include "adcSampler.h"
+#include "sensorMath.h"
+#include "reportPolicy.h"
+#include "monotonicTime.h"
+
 /**
  * @brief the MQTT topic for debugging this sensor
  *
@@ -39,63 +45,36 @@
  */
 #define RESEND_GPM_TIMES 1
 
+/**
+ * @brief time in milliseconds without sending the GPM, before it gets sent again (heartbeat),
+ * so that the controller can tell the flow is still what it was (ie. zero), from the sensor being gone.
+ */
+#define SEND_GPM_MAX_SILENCE 900000
+
 // the (digital) pin that we need to connect the water meter pulse switch.
 // the other end, needs to go the ground (GND) pin
 // you may use D0-D22 which correlates to GP0-GP22
 #define PULSE_SENSOR_PIN D2
 
+/**
+ * @brief capture the pulses with a GPIO edge interrupt (@see src/pulseCapture.h),
+ * instead of polling the pulse pin once per loop iteration.
+ * that way, pulses are neither lost nor mistimed, while the loop stalls (ie. WiFi reconnect)
+ * and the GPM is calculated from the exact (microsecond) interval between the pulses.
+ *
+ * comment out, to poll the pin instead.
+ */
+#define PULSE_SENSOR_INTERRUPT_CAPTURE
+
 // the (analog) pin that we connect to the
 // InfraRed AO (analog output) pin of the sensor
 // you may use A0-A2
 #define IR_SENSOR_PIN A1
 
-/**
- * @brief the delta we must calculate between two infrared sensor values
- * in order to be considered an actual change/motion
- * (true, when greater than)
- *
- * when on computer USB/power:
- *  with 4, we get 15-20 counts within 8 secs, when there's low flow and ~5 with no flow/noise
- *
- * when on stable/clean external power:
- *  with 3, we get 10-20 counts within 8 secs, when there's low flow and ~1 with no flow/noise
- *  with delta 3, timeout 4000 and no flow, we get: 1-7
- *  with delta 3, timeout 4000 and low flow, we get: 10-13
- *  conclusion: delta 3, timeout 4000 and count 10, is probably the lowest and "safe" we can go
- *
- */
-#define IR_DELTA_THRESHOLD 3
-
-// TODO: make those parameters dynamic
+// the flow detection of the IR sensor (the spinning dial) is tuned in src/flowDetector.h
 // Note: something appears to randomly interrupt the loop, causing low count of IR
 //       even though, they probably did not really drop... Maybe Wifi reconnect?
-//       maybe we need to create a counter module that runs on its own dedicated loop/controller
-//       for truly accurate results OR find a way to perform that uninterrupted.
-
-// since there's some inherit noise in the IR "module", we need to increase the "delta duration" timeout
-// in order to get a bigger sample and therefore, normalize/avg the noise...
-#define IR_TIMEOUT 10000
-
-// number of delta counts that need to happen within the timeout period
-// for the IR sensor to be considered ON (to avoid potential noise)
-// (true, when greater than)
-// 50 with sensor at step 4 distance
-#define IR_COUNTS_THRESHOLD 50
-
-//
-// at very low flows, the Flow Indicator propeler, spins intermittently.
-// that's because the flow falls at the threshold of the Water Meter's minimum flow detection rate
-// which causes momentary stops of rotation of about 10 seconds at a time.
-//
-// therefore, in order to account for those momentary stops, we must increase the timeout
-// above them, hence the *3 IR_TIMEOUT...
-// the downside to that, is the prolonged time it will now take (~30 secs), to call a no-flow event.
-#define IR_TIMEOUT_KEEP_ACTIVE 30000
-
-// number of delta counts that need to happen within the timeout period
-// for the IR sensor to be kept ON (to avoid false positive from noise, while already active)
-// (true, when greater than)
-#define IR_COUNTS_THRESHOLD_KEEP_ACTIVE 90
+//       (the sampling now runs on its own core, @see PulseSensor::sample())
 
 // minimum gallons per minute that the water meter can detect.
 // this helps us detect no-flow, by calculating a "time-out" when
@@ -116,51 +95,60 @@
  */
 #define PULSE_DEBOUNCE_FREQUENCY 250
 
+/**
+ * @brief the state the sampling core (core 1) posts for the controller loop (core 0)
+ */
+struct PulseReading
+{
+    // current gallons per minute
+    SensorReal gpm;
+    // number of pulses (gallons) metered since boot
+    unsigned long pulses;
+    // if the IR sensor currently detects motion on the spinning dial
+    bool isIrSensorActive;
+};
+
 class PulseSensor
 {
 public:
     // properties
     static bool lastPulseSensorIsActive;
-    static unsigned long lastPulseTime;
-    static unsigned long prevTimePassedSinceLastPulse;
-    static float gpm;
-    static float lastGpmSent;
-    static unsigned long lastGpmSendTime;
-    static unsigned long lastGpmResendTime;
-    static unsigned int flowTimeout;
-    static unsigned int gpmResendTimes;
-    static unsigned long lastIrTime;
-    static unsigned long fistIrTime;
-    static int prevIrValue;
-    static unsigned int irCounts;
+    static Instant lastPulseTime;
+    static Duration prevTimePassedSinceLastPulse;
+    static Instant pulseTime;
+    static Duration pulseInterval;
+    static SensorReal gpm;
+    static ReportPolicy<SensorReal> gpmReport;
+    static Duration flowTimeout;
     static bool isIrSensorActive;
+    static unsigned long pulses;
+    static Mailbox<PulseReading> readings;
+    static PulseReading reading;
+    static unsigned long reportedPulses;
     static long gallonsCounter;
     static long gallonsCounterBuffer;
-    static unsigned long lastGallonsCounterSendTime;
+    static ReportPolicy<long> gallonsReport;
     static bool firstLoop;
     static HASensorNumber gpmSensor;
     static HASensorNumber gallonsSensor;
-    // for debug of gpm infrared counts
+    // for debug of the infrared flow detection
     static bool lastIsDebugActive;
-    static unsigned int minIrCounts;
-    static unsigned int maxIrCounts;
-    static float avgIrCounts;
-    static unsigned int deltaRounds;
     static unsigned long loopCycles;
-    static bool activeCountsReported;
 
     // methods
-    static bool shouldSendGallonsCounter();
     static void checkGallonsCounter();
-    static void checkResendGPM();
-    static void increaseGallonsCounter();
-    static void updateIrSensorActive();
-    static unsigned long timePassedSinceLastPulse(bool actual);
+    static void updateIrSensorActive(int irValue, Instant time);
+    static Duration timePassedSinceLastPulse(bool actual);
     static void updateGPM();
-    static void updateGPM(float newValue);
-    static void sendGPM(bool force);
+    static void updateGPM(SensorReal newValue);
+    static void updateGPMOnPulse();
+    static bool publishGpm(SensorReal gpm);
+    static bool publishGallons(long gallons);
     static bool isPulseSensorActive();
     static void setup();
+    static void setupSampling();
+    static void sample(const AdcBlock &block);
+    static void sample();
     static void loop();
 };
 
@@ -0,0 +1,231 @@
+#ifndef REPORT_POLICY
+#define REPORT_POLICY
+
+#include <stdint.h>
+#include "monotonicTime.h"
+
+/**
+ * @brief what a new value is about
+ */
+enum ReportEvent : uint8_t
+{
+    // a new reading, reported when it is out of the deadband (or the swinging door) and not rate limited
+    ReportChange = 0,
+    // reported right away (ie. a new pulse) and retried until delivered
+    ReportForce,
+    // an edge (ie. the flow start/stop): reported right away, retried until delivered and then repeated (@see edgeRepeats)
+    ReportEdge
+};
+
+/**
+ * @brief the report-by-exception policy of a signal: it decides when a new value gets published to the controller.
+ * - deadband: a value gets reported once it differs from the last reported one by deadband (any change, for 0)
+ * - swinging door (when compression is not 0, instead of the deadband): once a straight line from the last reported value
+ *   can no longer pass within compression of every value since, the previous value gets reported (and the door hinges on it),
+ *   so that the controller can interpolate the signal (within twice the compression), with far less reports for the slow ramps
+ * - rate limit: no more than one change every minInterval
+ * - heartbeat: the last value gets reported again after maxSilence without a report
+ * - edges and forced values (when they differ from the last reported one) skip the above and are retried on every update until delivered,
+ *   an edge is also repeated edgeRepeats times (every edgeRepeatInterval, while the value stays)
+ *
+ * the times are monotonic (@see MonotonicClock) and the publish callback returns true when delivered.
+ *
+ * @tparam T the value type (ie. SensorReal or long), with the arithmetic operators and an explicit float conversion
+ */
+template <typename T>
+class ReportPolicy
+{
+public:
+    T deadband;
+    Duration minInterval;
+    Duration maxSilence;
+    T compression;
+    unsigned int edgeRepeats;
+    Duration edgeRepeatInterval;
+
+    // the number of reports delivered and of the failed attempts
+    unsigned long reports = 0;
+    unsigned long failures = 0;
+
+    ReportPolicy(T deadband, Duration minInterval, Duration maxSilence = Duration(), T compression = T(0), unsigned int edgeRepeats = 0, Duration edgeRepeatInterval = Duration())
+        : deadband(deadband), minInterval(minInterval), maxSilence(maxSilence), compression(compression), edgeRepeats(edgeRepeats), edgeRepeatInterval(edgeRepeatInterval)
+    {
+    }
+
+    /**
+     * @brief a new value of the signal, reported (published) if the policy says so
+     *
+     * @param value
+     * @param time of the value
+     * @param event
+     * @param publish callable (T value) returning true when delivered
+     * @return true if a value got reported
+     */
+    template <typename PUBLISH>
+    bool update(T value, Instant time, ReportEvent event, PUBLISH publish)
+    {
+        if (event > this->pendingEvent)
+        {
+            this->pendingEvent = event;
+        }
+        if (this->hasReported && value == this->value)
+        {
+            // nothing new to deliver
+            this->pendingEvent = ReportChange;
+        }
+        const bool isDoorClosed = this->compression != T(0) && this->hasReported && this->swing(value, time);
+
+        // what to report (with the swinging door, the last value within the door) and when it was taken
+        T reportValue = value;
+        Instant reportTime = time;
+        bool isDue = !this->hasReported || this->pendingEvent != ReportChange;
+        if (!isDue)
+        {
+            if (this->compression != T(0))
+            {
+                // the previous value, the last one the door could pass by
+                isDue = isDoorClosed;
+                reportValue = isDoorClosed ? this->previousValue : value;
+                reportTime = isDoorClosed ? this->previousTime : time;
+            }
+            else
+            {
+                isDue = value != this->value && this->distance(value, this->value) >= this->deadband;
+            }
+            isDue = isDue && time - this->time > this->minInterval;
+        }
+        if (!isDue && this->maxSilence > Duration() && time - this->time >= this->maxSilence)
+        {
+            // heartbeat
+            isDue = true;
+            reportValue = value;
+            reportTime = time;
+        }
+        const bool isRepeat = !isDue && this->repeats > 0 && value == this->value && time - this->repeatTime > this->edgeRepeatInterval;
+        this->previousValue = value;
+        this->previousTime = time;
+        if (!isDue && !isRepeat)
+        {
+            if (value != this->value)
+            {
+                // the edge is over
+                this->repeats = 0;
+            }
+            return false;
+        }
+
+        if (isRepeat)
+        {
+            // every attempt (even a failed one) waits for the interval
+            this->repeatTime = time;
+        }
+        if (!publish(reportValue))
+        {
+            this->failures++;
+            return false;
+        }
+        this->reports++;
+        if (isRepeat)
+        {
+            this->repeats--;
+            return true;
+        }
+        this->repeats = this->pendingEvent == ReportEdge ? this->edgeRepeats : 0;
+        this->repeatTime = time;
+        this->pendingEvent = ReportChange;
+        this->hasReported = true;
+        this->value = reportValue;
+        this->time = time;
+        this->openDoor(reportValue, reportTime, value, time);
+        return true;
+    }
+
+    /**
+     * @brief the next value gets reported right away (ie. on reconnect)
+     */
+    void invalidate()
+    {
+        this->hasReported = false;
+    }
+
+    /**
+     * @brief the last reported value, or the initial one
+     */
+    T lastValue() const
+    {
+        return this->value;
+    }
+
+    /**
+     * @brief starts from a value (as if it was reported, ie. the value the controller got last)
+     */
+    void reset(T value, Instant time)
+    {
+        this->hasReported = true;
+        this->pendingEvent = ReportChange;
+        this->repeats = 0;
+        this->value = value;
+        this->time = time;
+        this->openDoor(value, time, value, time);
+    }
+
+private:
+    bool hasReported = false;
+    ReportEvent pendingEvent = ReportChange;
+    T value = T(0);
+    Instant time;
+    unsigned int repeats = 0;
+    Instant repeatTime;
+    T previousValue = T(0);
+    Instant previousTime;
+
+    // the swinging door: the point it hinges on and the (min) upper and (max) lower slopes (per millisecond) of the values since
+    float doorValue = 0.0f;
+    Instant doorTime;
+    float upperSlope = 0.0f;
+    float lowerSlope = 0.0f;
+    bool hasSlopes = false;
+
+    static T distance(T a, T b)
+    {
+        return a > b ? a - b : b - a;
+    }
+
+    /**
+     * @brief hinges the door on the reported point and swings it to the value that followed it (if any)
+     */
+    void openDoor(T reportValue, Instant reportTime, T value, Instant time)
+    {
+        this->doorValue = float(reportValue);
+        this->doorTime = reportTime;
+        this->hasSlopes = false;
+        if (time != reportTime)
+        {
+            this->swing(value, time);
+        }
+    }
+
+    /**
+     * @brief narrows the door with a value
+     *
+     * @return true if the door closed (the value cannot be on a line within compression of the values since)
+     */
+    bool swing(T value, Instant time)
+    {
+        if (time == this->doorTime)
+        {
+            return false;
+        }
+        // in milliseconds (with the fraction, the instants are in microseconds)
+        const float elapsed = float((time - this->doorTime).toMicros()) * 0.001f;
+        const float compression = float(this->compression);
+        const float upper = (float(value) + compression - this->doorValue) / elapsed;
+        const float lower = (float(value) - compression - this->doorValue) / elapsed;
+        this->upperSlope = this->hasSlopes && this->upperSlope < upper ? this->upperSlope : upper;
+        this->lowerSlope = this->hasSlopes && this->lowerSlope > lower ? this->lowerSlope : lower;
+        this->hasSlopes = true;
+        return this->lowerSlope > this->upperSlope;
+    }
+};
+
+#endif // REPORT_POLICY
@@ -0,0 +1,78 @@
+#ifndef RING_BUFFER
+#define RING_BUFFER
+
+#include <atomic>
+#include <stdint.h>
+
+/**
+ * @brief a fixed capacity, single-producer/single-consumer lock-free ring buffer.
+ *
+ * the producer (ie. an interrupt handler or the other core) only writes the head and
+ * the consumer (ie. the main loop) only writes the tail, so neither needs to disable interrupts or lock.
+ * when the buffer is full, push() drops the new item and returns false (the producer must never block).
+ *
+ * @tparam T the (trivially copyable) item type
+ * @tparam CAPACITY must be a power of 2
+ */
+template <typename T, uint32_t CAPACITY>
+class RingBuffer
+{
+    static_assert(CAPACITY > 0 && (CAPACITY & (CAPACITY - 1)) == 0, "RingBuffer CAPACITY must be a power of 2");
+
+public:
+    /**
+     * @brief producer side only
+     *
+     * @return true if the item was stored
+     * @return false if the buffer was full and the item got dropped
+     */
+    bool push(const T &item)
+    {
+        const uint32_t head = this->head.load(std::memory_order_relaxed);
+        if (head - this->tail.load(std::memory_order_acquire) >= CAPACITY)
+        {
+            return false;
+        }
+        this->items[head & (CAPACITY - 1)] = item;
+        this->head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief consumer side only
+     *
+     * @return true if an item was taken out of the buffer
+     * @return false if the buffer was empty
+     */
+    bool pop(T &item)
+    {
+        const uint32_t tail = this->tail.load(std::memory_order_relaxed);
+        if (tail == this->head.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+        item = this->items[tail & (CAPACITY - 1)];
+        this->tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief number of items currently stored (a snapshot, from either side)
+     */
+    uint32_t size() const
+    {
+        return this->head.load(std::memory_order_acquire) - this->tail.load(std::memory_order_acquire);
+    }
+
+    bool empty() const
+    {
+        return this->size() == 0;
+    }
+
+private:
+    T items[CAPACITY];
+    std::atomic<uint32_t> head{0};
+    std::atomic<uint32_t> tail{0};
+};
+
+#endif // RING_BUFFER
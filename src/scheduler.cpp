@@ -0,0 +1,153 @@
+#include <ArduinoHA.h>
+#include "device.h"
+#include "switches.h"
+#include "diagnostics.h"
+#include "scheduler.h"
+
+// the tasks, in priority order (and in the order they were added, within the same priority)
+SchedulerTask Scheduler::tasks[SCHEDULER_MAX_TASKS];
+int Scheduler::taskCount = 0;
+
+// number of loop iterations
+unsigned long Scheduler::loops = 0;
+
+// the longest and the total time (microseconds) of the loop iterations
+unsigned long Scheduler::maxLoopTime = 0;
+unsigned long long Scheduler::totalLoopTime = 0;
+
+/**
+ * @brief adds a task. it should be called from the main setup() function.
+ *
+ * @param name for the statistics, must be a string literal
+ * @param run
+ * @param period in milliseconds, 0 to run on every loop iteration. the first run is one period after adding it.
+ * @param priority
+ * @param condition the task is skipped (and postponed by a period) while it returns false. null to always run.
+ * @return false if there is no room for the task (@see SCHEDULER_MAX_TASKS)
+ */
+bool Scheduler::add(const char *name, void (*run)(), unsigned long period, SchedulerPriority priority, bool (*condition)())
+{
+    if (Scheduler::taskCount >= SCHEDULER_MAX_TASKS)
+    {
+        return false;
+    }
+    // keep the tasks sorted by priority, so that loop() only needs a single pass
+    int index = Scheduler::taskCount++;
+    for (; index > 0 && Scheduler::tasks[index - 1].priority > priority; index--)
+    {
+        Scheduler::tasks[index] = Scheduler::tasks[index - 1];
+    }
+    Scheduler::tasks[index] = {name, run, condition, Duration::millis(period), priority, MonotonicClock::now() + Duration::millis(period), 0, 0, 0, 0, 0, 0};
+    return true;
+}
+
+/**
+ * @brief runs a (due) task and updates its statistics
+ *
+ * @param task
+ * @param now the time of the loop iteration
+ */
+void Scheduler::run(SchedulerTask &task, Instant now)
+{
+    if (task.condition != nullptr && !task.condition())
+    {
+        task.due = now + task.period;
+        return;
+    }
+
+    const bool isPeriodic = task.period > Duration();
+    const Duration jitter = isPeriodic ? now - task.due : Duration();
+    const Instant start = MonotonicClock::now();
+    const uint32_t startCycles = rp2040.getCycleCount();
+    task.run();
+    task.cycles += rp2040.getCycleCount() - startCycles;
+    const unsigned long runtime = MonotonicClock::since(start).toMicros32();
+
+    task.runs++;
+    task.totalRuntime += runtime;
+    if (runtime > task.maxRuntime)
+    {
+        task.maxRuntime = runtime;
+    }
+    if (jitter.toMillis32() > task.maxJitter)
+    {
+        task.maxJitter = jitter.toMillis32();
+    }
+    const unsigned long budget = isPeriodic ? task.period.toMicros32() : SCHEDULER_LOOP_BUDGET;
+    if (runtime > budget || (isPeriodic && jitter >= task.period))
+    {
+        task.overruns++;
+    }
+
+    // keep the period steady (no drift), unless whole periods got missed
+    task.due += task.period;
+    if (now >= task.due)
+    {
+        task.due = now + task.period;
+    }
+}
+
+/**
+ * @brief should be called on every iteration of the main loop() function.
+ * it runs every task that is due (once), highest priority first and earliest due first within the same priority.
+ */
+void Scheduler::loop()
+{
+    const Instant start = MonotonicClock::now();
+    bool hasRun[SCHEDULER_MAX_TASKS] = {};
+    // the tasks are sorted by priority, so every priority is a contiguous group of them
+    int group = 0;
+    while (group < Scheduler::taskCount)
+    {
+        const Instant now = MonotonicClock::now();
+        int next = -1;
+        int end = group;
+        for (; end < Scheduler::taskCount && Scheduler::tasks[end].priority == Scheduler::tasks[group].priority; end++)
+        {
+            const SchedulerTask &task = Scheduler::tasks[end];
+            if (!hasRun[end] && now >= task.due && (next < 0 || task.due < Scheduler::tasks[next].due))
+            {
+                next = end;
+            }
+        }
+        if (next < 0)
+        {
+            group = end;
+            continue;
+        }
+        hasRun[next] = true;
+        Scheduler::run(Scheduler::tasks[next], now);
+    }
+
+    const unsigned long loopTime = MonotonicClock::since(start).toMicros32();
+    Scheduler::loops++;
+    Scheduler::totalLoopTime += loopTime;
+    if (loopTime > Scheduler::maxLoopTime)
+    {
+        Scheduler::maxLoopTime = loopTime;
+    }
+    Diagnostics::addLoopTime(loopTime);
+}
+
+/**
+ * @brief publishes the statistics of every task, when debugging is active.
+ * it is meant to be added as a (housekeeping) task itself, every SCHEDULER_DEBUG_FREQUENCY.
+ */
+void Scheduler::debugLoop()
+{
+    if (!Switches::isDebugActive)
+    {
+        return;
+    }
+    char payload[DEBUG_MESSAGE_SIZE];
+    snprintf(payload, sizeof(payload), "loops: %lu, avg: %lu us, max: %lu us",
+             Scheduler::loops, Scheduler::loops > 0 ? (unsigned long)(Scheduler::totalLoopTime / Scheduler::loops) : 0, Scheduler::maxLoopTime);
+    Device::mqtt.publish(SCHEDULER_DEBUG_MQTT_TOPIC, payload);
+    for (int i = 0; i < Scheduler::taskCount; i++)
+    {
+        const SchedulerTask &task = Scheduler::tasks[i];
+        snprintf(payload, sizeof(payload), "%s: runs: %lu, avg: %lu us, max: %lu us, jitter: %lu ms, overruns: %lu",
+                 task.name, task.runs, task.runs > 0 ? (unsigned long)(task.totalRuntime / task.runs) : 0, task.maxRuntime, task.maxJitter, task.overruns);
+        Device::mqtt.publish(SCHEDULER_DEBUG_MQTT_TOPIC, payload);
+    }
+}
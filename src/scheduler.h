@@ -0,0 +1,94 @@
+#ifndef SCHEDULER
+#define SCHEDULER
+
+#include <stdint.h>
+#include "monotonicTime.h"
+
+/**
+ * @brief the MQTT topic for debugging the scheduler (the task statistics)
+ */
+#define SCHEDULER_DEBUG_MQTT_TOPIC "debug:waterMonitor:scheduler"
+
+/**
+ * @brief max number of tasks that can be added (they are statically allocated)
+ */
+#define SCHEDULER_MAX_TASKS 20
+
+/**
+ * @brief time in microseconds a task that runs on every loop iteration (period 0) may take,
+ * before it gets counted as an overrun.
+ * tasks with a period overrun, when they take longer than it, or start a whole period late.
+ */
+#define SCHEDULER_LOOP_BUDGET 1000
+
+/**
+ * @brief frequency in milliseconds, to publish the task statistics (when debugging)
+ */
+#define SCHEDULER_DEBUG_FREQUENCY 60000
+
+/**
+ * @brief the priorities of the tasks, highest first.
+ * on every loop iteration, the due tasks run in priority order (and earliest due first, within the same priority).
+ */
+enum SchedulerPriority
+{
+    // consume the sampled readings (core 1) and report them
+    SchedulerSensing = 0,
+    // the rest of the controller updates
+    SchedulerReporting,
+    // the network, heartbit, debugging, etc.
+    SchedulerHousekeeping
+};
+
+/**
+ * @brief a task and its statistics
+ */
+struct SchedulerTask
+{
+    const char *name;
+    void (*run)();
+    // the task is skipped (and postponed) while it returns false, or always runs when null
+    bool (*condition)();
+    // zero to run on every loop iteration
+    Duration period;
+    SchedulerPriority priority;
+    // the time the task is due
+    Instant due;
+
+    // statistics
+    unsigned long runs;
+    unsigned long overruns;
+    // in microseconds
+    unsigned long long totalRuntime;
+    unsigned long maxRuntime;
+    // the CPU cycles the task took (@see src/diagnostics.h)
+    uint64_t cycles;
+    // how late (in milliseconds) the task started, after it was due
+    unsigned long maxJitter;
+};
+
+/**
+ * @brief a static allocation, cooperative scheduler (core 0).
+ * tasks register a period and a priority and every loop() iteration runs the ones that are due,
+ * while it measures their runtime, jitter and overruns.
+ */
+class Scheduler
+{
+public:
+    // properties
+    static SchedulerTask tasks[SCHEDULER_MAX_TASKS];
+    static int taskCount;
+    static unsigned long loops;
+    static unsigned long maxLoopTime;
+    static unsigned long long totalLoopTime;
+
+    // methods
+    static bool add(const char *name, void (*run)(), unsigned long period, SchedulerPriority priority, bool (*condition)() = nullptr);
+    static void loop();
+    static void debugLoop();
+
+private:
+    static void run(SchedulerTask &task, Instant now);
+};
+
+#endif // SCHEDULER
@@ -0,0 +1,126 @@
+#ifndef SENSOR_MATH
+#define SENSOR_MATH
+
+#include <stdint.h>
+#include "fixedPoint.h"
+
+/**
+ * @brief use fixed point (Q16.16) math for the sensor conversions (PSI, GPM),
+ * instead of (software emulated) float, since the RP2040 has no FPU.
+ * the values are only converted to float, when they are sent to the controller.
+ *
+ * comment out, to use float.
+ */
+#define SENSOR_MATH_FIXED_POINT
+
+#ifdef SENSOR_MATH_FIXED_POINT
+typedef Fixed<16> SensorReal;
+#else
+typedef float SensorReal;
+#endif
+
+/**
+ * @brief the sensor conversions, for either SensorReal type
+ */
+class SensorMath
+{
+public:
+    /**
+     * @brief NUMERATOR / denominator (ie. TARGET_RATE_TIME / time passed).
+     * the numerator is a compile time constant, so that with fixed point, it can be pre-scaled and
+     * the division is a single 32bit one (hardware divider), when it fits.
+     *
+     * @return the quotient, saturated to the max value
+     */
+    template <uint32_t NUMERATOR>
+    static SensorReal divide(uint32_t denominator)
+    {
+#ifdef SENSOR_MATH_FIXED_POINT
+        if (uint64_t(NUMERATOR) * SensorReal::ONE <= UINT32_MAX)
+        {
+            const uint32_t raw = uint32_t(uint64_t(NUMERATOR) * SensorReal::ONE) / denominator;
+            return SensorReal::fromRaw(raw > uint32_t(INT32_MAX) ? INT32_MAX : int32_t(raw));
+        }
+        return SensorReal::ratio(NUMERATOR, denominator);
+#else
+        return float(NUMERATOR) / denominator;
+#endif
+    }
+
+    /**
+     * @brief numerator / denominator, for the cases the numerator is not a constant
+     */
+    static SensorReal ratio(int64_t numerator, int64_t denominator)
+    {
+#ifdef SENSOR_MATH_FIXED_POINT
+        return SensorReal::ratio(numerator, denominator);
+#else
+        return float(numerator) / denominator;
+#endif
+    }
+
+    /**
+     * @brief from thousandths (ie. milli-GPM)
+     */
+    static SensorReal fromMilli(uint32_t value)
+    {
+#ifdef SENSOR_MATH_FIXED_POINT
+        // 1000 = 8 * 125, so that it fits in 32bits for up to ~524k
+        return SensorReal::fromRaw(int32_t(value * uint32_t(SensorReal::ONE / 8) / 125));
+#else
+        return value * 0.001f;
+#endif
+    }
+
+    /**
+     * @brief to thousandths (ie. milli-PSI), rounded
+     */
+    static constexpr int32_t toMilli(SensorReal value)
+    {
+#ifdef SENSOR_MATH_FIXED_POINT
+        return int32_t((int64_t(value.raw) * 1000 + (value.raw < 0 ? -(SensorReal::ONE / 2) : SensorReal::ONE / 2)) / SensorReal::ONE);
+#else
+        return int32_t(value * 1000 + (value < 0 ? -0.5f : 0.5f));
+#endif
+    }
+
+    /**
+     * @brief factor * value, ie. a calibration constant times a raw ADC value
+     */
+    static constexpr SensorReal scale(SensorReal factor, int32_t value)
+    {
+#ifdef SENSOR_MATH_FIXED_POINT
+        return SensorReal::fromRaw(factor.raw * value);
+#else
+        return factor * value;
+#endif
+    }
+
+    /**
+     * @brief value * numerator / 2^bits, ie. the fraction of a step when interpolating
+     */
+    static constexpr SensorReal fraction(SensorReal value, uint32_t numerator, int bits)
+    {
+#ifdef SENSOR_MATH_FIXED_POINT
+        return SensorReal::fromRaw(int32_t((int64_t(value.raw) * numerator) >> bits));
+#else
+        return value * numerator / float(uint32_t(1) << bits);
+#endif
+    }
+
+    static constexpr SensorReal magnitude(SensorReal value)
+    {
+        return value < SensorReal(0) ? -value : value;
+    }
+
+    static constexpr float toFloat(SensorReal value)
+    {
+#ifdef SENSOR_MATH_FIXED_POINT
+        return value.toFloat();
+#else
+        return value;
+#endif
+    }
+};
+
+#endif // SENSOR_MATH
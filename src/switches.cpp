@@ -1,6 +1,8 @@
 #include <ArduinoHA.h>
 #include "switches.h"
 #include "pressureSensor.h"
+#include "config.h"
+#include "leakTest.h"
 
 HASwitch Switches::waterLeakTestSwitch("waterMonitorLeakTest");
 HASwitch Switches::debugSwitch("waterMonitorDebug");
@@ -29,14 +31,17 @@ void Switches::setIsWaterLeakTestActive(bool state)
     if (state)
     {
         // test mode needs high accuracy and refresh rate
-        PressureSensor::pressureDelta = PRESSURE_SENSOR_DELTA_WATER_LEAK_TEST_ACTIVE;
-        PressureSensor::sendPressureFrequency = PRESSURE_SENSOR_SEND_FREQUENCY_WATER_LEAK_TEST_ACTIVE;
+        PressureSensor::psiReport.deadband = PRESSURE_SENSOR_DELTA_WATER_LEAK_TEST_ACTIVE;
+        PressureSensor::psiReport.minInterval = Duration::millis(PRESSURE_SENSOR_SEND_FREQUENCY_WATER_LEAK_TEST_ACTIVE);
+        PressureSensor::psiReport.compression = 0.0;
+        // and the pressure decay gets evaluated on the device
+        LeakTest::start();
     }
     else
     {
-        // normal mode does not need high accuracy or refresh rate
-        PressureSensor::pressureDelta = PRESSURE_SENSOR_DELTA;
-        PressureSensor::sendPressureFrequency = PRESSURE_SENSOR_SEND_FREQUENCY;
+        // normal mode does not need high accuracy or refresh rate (the tuned values, @see src/config.h)
+        Config::apply();
+        LeakTest::stop();
     }
 }
 
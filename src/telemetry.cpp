@@ -0,0 +1,178 @@
+#include <ArduinoHA.h>
+#include "device.h"
+#include "pulseSensor.h"
+#include "pressureSensor.h"
+#include "telemetry.h"
+
+// the samples waiting to be published (core 1 to core 0)
+RingBuffer<TelemetrySample, TELEMETRY_QUEUE_SIZE> Telemetry::samples;
+
+// the time of the next sample and if we took any yet (core 1)
+Instant Telemetry::nextSampleTime;
+bool Telemetry::hasSample = false;
+
+// the samples dropped, because the queue was full (written by core 1 only)
+volatile unsigned long Telemetry::droppedSamples = 0;
+
+// number of frames published
+unsigned long Telemetry::frames = 0;
+
+// a sample that did not fit in the previous frame, to start the next one
+TelemetrySample Telemetry::carry;
+bool Telemetry::hasCarry = false;
+
+static void writeUint16(uint8_t *buffer, uint16_t value)
+{
+    buffer[0] = uint8_t(value);
+    buffer[1] = uint8_t(value >> 8);
+}
+
+static uint16_t readUint16(const uint8_t *buffer)
+{
+    return uint16_t(buffer[0] | (buffer[1] << 8));
+}
+
+static uint16_t clampUint16(int32_t value)
+{
+    return value < 0 ? 0 : (value > 0xFFFF ? 0xFFFF : uint16_t(value));
+}
+
+/**
+ * @brief should be called for every new ADC block (core 1), after the sensors sampled it.
+ * it takes a sample every TELEMETRY_SAMPLE_PERIOD.
+ *
+ * @param block
+ */
+void Telemetry::sample(const AdcBlock &block)
+{
+    const Duration period = Duration::micros(TELEMETRY_SAMPLE_PERIOD);
+    if (Telemetry::hasSample && block.time < Telemetry::nextSampleTime)
+    {
+        return;
+    }
+    // keep the period steady, unless we fell behind
+    Telemetry::nextSampleTime = Telemetry::hasSample && block.time - Telemetry::nextSampleTime < period ? Telemetry::nextSampleTime + period : block.time + period;
+    Telemetry::hasSample = true;
+
+    PressureReading pressureReading = {0, 0};
+    PressureSensor::readings.read(pressureReading);
+    const TelemetrySample sample = {
+        uint32_t(block.time.toMillis()),
+        clampUint16(SensorMath::toMilli(PulseSensor::gpm)),
+        clampUint16((SensorMath::toMilli(pressureReading.psi) + 5) / 10),
+        uint16_t(AdcSampler::mean(block, PRESSURE_SENSOR_PIN)),
+        uint16_t(AdcSampler::mean(block, IR_SENSOR_PIN)),
+        PulseSensor::isIrSensorActive};
+    if (!Telemetry::samples.push(sample))
+    {
+        Telemetry::droppedSamples = Telemetry::droppedSamples + 1;
+    }
+}
+
+/**
+ * @brief packs the samples into a frame
+ *
+ * @param samples in time order, all within 65535 milliseconds from the first one
+ * @param count up to TELEMETRY_FRAME_SAMPLES
+ * @param frame of (at least) TELEMETRY_FRAME_SIZE bytes
+ * @return size_t the size of the frame in bytes
+ */
+size_t Telemetry::encode(const TelemetrySample *samples, int count, uint8_t *frame)
+{
+    const uint32_t baseTime = count > 0 ? samples[0].time : 0;
+    frame[0] = TELEMETRY_FRAME_VERSION;
+    frame[1] = uint8_t(count);
+    writeUint16(frame + 2, uint16_t(baseTime));
+    writeUint16(frame + 4, uint16_t(baseTime >> 16));
+    uint8_t *buffer = frame + TELEMETRY_HEADER_SIZE;
+    for (int i = 0; i < count; i++)
+    {
+        const TelemetrySample &sample = samples[i];
+        writeUint16(buffer, uint16_t(sample.time - baseTime));
+        writeUint16(buffer + 2, sample.milliGpm);
+        writeUint16(buffer + 4, sample.centiPsi);
+        writeUint16(buffer + 6, sample.rawPressure);
+        writeUint16(buffer + 8, uint16_t((sample.rawIr & ~TELEMETRY_IR_ACTIVE) | (sample.isIrActive ? TELEMETRY_IR_ACTIVE : 0)));
+        buffer += TELEMETRY_SAMPLE_SIZE;
+    }
+    return buffer - frame;
+}
+
+/**
+ * @brief unpacks a frame (ie. on the controller side)
+ *
+ * @param frame
+ * @param length of the frame in bytes
+ * @param samples
+ * @param maxCount
+ * @return int the number of samples, or -1 when the frame is not valid
+ */
+int Telemetry::decode(const uint8_t *frame, size_t length, TelemetrySample *samples, int maxCount)
+{
+    if (length < TELEMETRY_HEADER_SIZE || frame[0] != TELEMETRY_FRAME_VERSION)
+    {
+        return -1;
+    }
+    const int count = frame[1];
+    if (count > maxCount || length != size_t(TELEMETRY_HEADER_SIZE + count * TELEMETRY_SAMPLE_SIZE))
+    {
+        return -1;
+    }
+    const uint32_t baseTime = uint32_t(readUint16(frame + 2)) | (uint32_t(readUint16(frame + 4)) << 16);
+    const uint8_t *buffer = frame + TELEMETRY_HEADER_SIZE;
+    for (int i = 0; i < count; i++)
+    {
+        const uint16_t rawIr = readUint16(buffer + 8);
+        samples[i] = {
+            baseTime + readUint16(buffer),
+            readUint16(buffer + 2),
+            readUint16(buffer + 4),
+            readUint16(buffer + 6),
+            uint16_t(rawIr & ~TELEMETRY_IR_ACTIVE),
+            (rawIr & TELEMETRY_IR_ACTIVE) != 0};
+        buffer += TELEMETRY_SAMPLE_SIZE;
+    }
+    return count;
+}
+
+/**
+ * @brief publishes a frame of the pending samples.
+ * it is scheduled every TELEMETRY_FRAME_FREQUENCY, while connected (@see src/main.cpp)
+ */
+void Telemetry::loop()
+{
+    TelemetrySample batch[TELEMETRY_FRAME_SAMPLES];
+    int count = 0;
+    if (Telemetry::hasCarry)
+    {
+        batch[count++] = Telemetry::carry;
+        Telemetry::hasCarry = false;
+    }
+    TelemetrySample sample;
+    while (count < TELEMETRY_FRAME_SAMPLES && Telemetry::samples.pop(sample))
+    {
+        if (count > 0 && sample.time - batch[0].time > 0xFFFF)
+        {
+            // too far apart (ie. the queue filled up, while disconnected), it starts the next frame
+            Telemetry::carry = sample;
+            Telemetry::hasCarry = true;
+            break;
+        }
+        batch[count++] = sample;
+    }
+    if (count == 0)
+    {
+        return;
+    }
+
+    uint8_t frame[TELEMETRY_FRAME_SIZE];
+    const size_t length = Telemetry::encode(batch, count, frame);
+    if (Device::mqtt.beginPublish(TELEMETRY_MQTT_TOPIC, length, false))
+    {
+        Device::mqtt.writePayload((const char *)frame, length);
+        if (Device::mqtt.endPublish())
+        {
+            Telemetry::frames++;
+        }
+    }
+}
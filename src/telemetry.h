@@ -0,0 +1,103 @@
+#ifndef TELEMETRY
+#define TELEMETRY
+
+#include <stddef.h>
+#include <stdint.h>
+#include "ringBuffer.h"
+#include "adcSampler.h"
+
+// comment out to disable the high-rate telemetry channel
+#define TELEMETRY_ENABLED
+
+/**
+ * @brief the (raw, not Home Assistant) MQTT topic of the telemetry frames
+ */
+#define TELEMETRY_MQTT_TOPIC "waterMonitor:telemetry"
+
+/**
+ * @brief time in microseconds between the telemetry samples (10 Hz).
+ * the samples are taken on the ADC blocks, so they are up to a block (~26ms) late.
+ */
+#define TELEMETRY_SAMPLE_PERIOD 100000
+
+/**
+ * @brief frequency in milliseconds, to publish a frame of the samples taken since the previous one
+ */
+#define TELEMETRY_FRAME_FREQUENCY 1000
+
+/**
+ * @brief max number of samples in a frame. the rest wait for the next frame.
+ */
+#define TELEMETRY_FRAME_SAMPLES 16
+
+/**
+ * @brief number of samples that can be waiting to be published (ie. while disconnected).
+ * when full, new samples get dropped (and counted). must be a power of 2.
+ */
+#define TELEMETRY_QUEUE_SIZE 32
+
+/**
+ * @brief the version of the frame format, the first byte of every frame
+ */
+#define TELEMETRY_FRAME_VERSION 1
+
+/**
+ * @brief the sizes in bytes of the frame header and of every sample in it
+ */
+#define TELEMETRY_HEADER_SIZE 6
+#define TELEMETRY_SAMPLE_SIZE 10
+#define TELEMETRY_FRAME_SIZE (TELEMETRY_HEADER_SIZE + TELEMETRY_FRAME_SAMPLES * TELEMETRY_SAMPLE_SIZE)
+
+/**
+ * @brief the flag of the IR activity, in the top bit of the raw IR value
+ */
+#define TELEMETRY_IR_ACTIVE 0x8000
+
+/**
+ * @brief a telemetry sample
+ */
+struct TelemetrySample
+{
+    // the time (millis) of the sample
+    uint32_t time;
+    // in thousandths of a gallon per minute (up to 65.535)
+    uint16_t milliGpm;
+    // in hundredths of a PSI (up to 655.35)
+    uint16_t centiPsi;
+    // the block average of the pressure and IR pins (ADC_SAMPLER_RESOLUTION bits)
+    uint16_t rawPressure;
+    uint16_t rawIr;
+    bool isIrActive;
+};
+
+/**
+ * @brief the high-rate telemetry channel.
+ * the sampling core (core 1) takes a sample of the flow, pressure, IR activity and raw ADC values
+ * every TELEMETRY_SAMPLE_PERIOD and the main loop packs the pending ones into a single binary frame,
+ * published every TELEMETRY_FRAME_FREQUENCY.
+ *
+ * the frame (little endian):
+ * - header: version (1 byte), number of samples (1 byte), the time (millis) of the first sample (4 bytes)
+ * - every sample: milliseconds after the first sample (2 bytes), milli-GPM (2 bytes), centi-PSI (2 bytes),
+ *   raw pressure (2 bytes), raw IR with the IR activity in its top bit (2 bytes)
+ */
+class Telemetry
+{
+public:
+    // properties
+    static RingBuffer<TelemetrySample, TELEMETRY_QUEUE_SIZE> samples;
+    static Instant nextSampleTime;
+    static bool hasSample;
+    static volatile unsigned long droppedSamples;
+    static unsigned long frames;
+    static TelemetrySample carry;
+    static bool hasCarry;
+
+    // methods
+    static void sample(const AdcBlock &block);
+    static void loop();
+    static size_t encode(const TelemetrySample *samples, int count, uint8_t *frame);
+    static int decode(const uint8_t *frame, size_t length, TelemetrySample *samples, int maxCount);
+};
+
+#endif // TELEMETRY
@@ -0,0 +1,242 @@
+#include <ArduinoHA.h>
+#include <LittleFS.h>
+#include "device.h"
+#include "crc.h"
+#include "pulseSensor.h"
+#include "totalizer.h"
+
+// the lifetime gallons
+HASensorNumber Totalizer::totalSensor("waterMonitorGallonsTotal", HASensorNumber::PrecisionP0);
+
+// if the filesystem could be mounted
+bool Totalizer::isFileAvailable = false;
+
+// the latest committed record
+uint32_t Totalizer::sequence = 0;
+uint32_t Totalizer::committedPulses = 0;
+
+// the pulses metered since boot (by the sampling core) and how many of them are committed
+unsigned long Totalizer::bootPulses = 0;
+unsigned long Totalizer::committedBootPulses = 0;
+
+// the records in the log
+uint32_t Totalizer::logRecords = 0;
+
+// the number of commits and compactions (since boot), to measure the flash wear
+unsigned long Totalizer::commits = 0;
+unsigned long Totalizer::compactions = 0;
+
+// the last commit and send (the boot, until the first send)
+Instant Totalizer::lastCommitTime;
+Instant Totalizer::lastSendTime;
+
+// if the water was running on the previous loop, to commit once it stops
+bool Totalizer::wasFlowing = false;
+
+/**
+ * @brief reads a log and finds its valid record with the highest sequence
+ *
+ * @param latest the record found, or a zero sequence if none
+ * @param records the number of (complete) records in the log
+ * @return true if the log is clean (no torn or corrupt records), so that it can be appended to
+ */
+bool Totalizer::load(const char *path, TotalizerRecord &latest, uint32_t &records)
+{
+    latest = {0, 0, 0};
+    records = 0;
+    File file = LittleFS.open(path, "r");
+    if (!file)
+    {
+        return true;
+    }
+
+    bool isClean = file.size() % sizeof(TotalizerRecord) == 0;
+    TotalizerRecord chunk[16];
+    size_t read;
+    while ((read = file.read((uint8_t *)chunk, sizeof(chunk)) / sizeof(TotalizerRecord)) > 0)
+    {
+        for (size_t i = 0; i < read; i++)
+        {
+            const TotalizerRecord &record = chunk[i];
+            if (record.crc != Crc::crc32((const uint8_t *)&record, offsetof(TotalizerRecord, crc)))
+            {
+                isClean = false;
+                continue;
+            }
+            if (record.sequence > latest.sequence)
+            {
+                latest = record;
+            }
+        }
+        records += read;
+    }
+    file.close();
+    return isClean;
+}
+
+/**
+ * @brief replaces the log with a new one, holding just the record.
+ * the new log gets written aside and renamed over the old one (atomic),
+ * so the old one stays valid, until the new one is complete.
+ */
+bool Totalizer::compact(const TotalizerRecord &record)
+{
+    File file = LittleFS.open(TOTALIZER_COMPACT_FILE, "w");
+    if (!file)
+    {
+        return false;
+    }
+    const size_t written = file.write((const uint8_t *)&record, sizeof(record));
+    file.close();
+    if (written != sizeof(record) || !LittleFS.rename(TOTALIZER_COMPACT_FILE, TOTALIZER_FILE))
+    {
+        return false;
+    }
+    Totalizer::logRecords = 1;
+    Totalizer::compactions++;
+    return true;
+}
+
+/**
+ * @brief should be called once, from the setup() function.
+ * it recovers the total of the previous boots (the pulses of this boot get added on top).
+ */
+void Totalizer::setup()
+{
+    Totalizer::totalSensor.setName("Gallons Total");
+    Totalizer::totalSensor.setIcon("mdi:counter");
+    Totalizer::totalSensor.setDeviceClass("water");
+    Totalizer::totalSensor.setStateClass("total_increasing");
+    Totalizer::totalSensor.setUnitOfMeasurement("gal");
+
+    Totalizer::sequence = 0;
+    Totalizer::committedPulses = 0;
+    Totalizer::bootPulses = 0;
+    Totalizer::committedBootPulses = 0;
+    Totalizer::logRecords = 0;
+    Totalizer::lastCommitTime = MonotonicClock::now();
+    Totalizer::lastSendTime = Instant();
+    Totalizer::wasFlowing = false;
+
+    Totalizer::isFileAvailable = LittleFS.begin();
+    if (!Totalizer::isFileAvailable)
+    {
+        return;
+    }
+
+    TotalizerRecord latest;
+    const bool isClean = Totalizer::load(TOTALIZER_FILE, latest, Totalizer::logRecords);
+
+    // a compaction that did not get to replace the log (it only holds a record of the log)
+    TotalizerRecord compacted;
+    uint32_t compactedRecords;
+    Totalizer::load(TOTALIZER_COMPACT_FILE, compacted, compactedRecords);
+    if (compacted.sequence > latest.sequence)
+    {
+        latest = compacted;
+    }
+    LittleFS.remove(TOTALIZER_COMPACT_FILE);
+
+    Totalizer::sequence = latest.sequence;
+    Totalizer::committedPulses = latest.pulses;
+    if (!isClean)
+    {
+        // the new records must not be appended after a torn one
+        Totalizer::compact(latest);
+    }
+}
+
+/**
+ * @brief the lifetime total, in pulses (committed or not)
+ */
+uint32_t Totalizer::total()
+{
+    return Totalizer::committedPulses + uint32_t(Totalizer::bootPulses - Totalizer::committedBootPulses);
+}
+
+/**
+ * @brief appends the current total to the log (or compacts the log into it, once full).
+ * it is also called before an OTA update (@see src/device.cpp)
+ *
+ * @return true if the total got committed (or there was nothing to commit)
+ */
+bool Totalizer::commit()
+{
+    if (Totalizer::bootPulses == Totalizer::committedBootPulses)
+    {
+        return true;
+    }
+    if (!Totalizer::isFileAvailable)
+    {
+        return false;
+    }
+
+    TotalizerRecord record = {Totalizer::sequence + 1, Totalizer::total(), 0};
+    record.crc = Crc::crc32((const uint8_t *)&record, offsetof(TotalizerRecord, crc));
+    Totalizer::lastCommitTime = MonotonicClock::now();
+
+    bool isCommitted;
+    if (Totalizer::logRecords >= TOTALIZER_LOG_RECORDS)
+    {
+        isCommitted = Totalizer::compact(record);
+    }
+    else
+    {
+        File file = LittleFS.open(TOTALIZER_FILE, "a");
+        const size_t written = file ? file.write((const uint8_t *)&record, sizeof(record)) : 0;
+        if (file)
+        {
+            file.close();
+        }
+        isCommitted = written == sizeof(record);
+        if (isCommitted)
+        {
+            Totalizer::logRecords++;
+        }
+        else if (written > 0)
+        {
+            // a partial record, the next commit compacts the log
+            Totalizer::logRecords = TOTALIZER_LOG_RECORDS;
+        }
+    }
+    if (!isCommitted)
+    {
+        // retried on the next commit
+        return false;
+    }
+
+    Totalizer::sequence = record.sequence;
+    Totalizer::committedPulses = record.pulses;
+    Totalizer::committedBootPulses = Totalizer::bootPulses;
+    Totalizer::commits++;
+    return true;
+}
+
+/**
+ * @brief commits the metered gallons in batches: every TOTALIZER_COMMIT_GALLONS,
+ * when the water stops running, or every TOTALIZER_COMMIT_FREQUENCY.
+ * it is scheduled every TOTALIZER_LOOP_FREQUENCY, also while disconnected (@see src/main.cpp)
+ */
+void Totalizer::loop()
+{
+    PulseReading reading;
+    if (!PulseSensor::readings.read(reading))
+    {
+        return;
+    }
+    Totalizer::bootPulses = reading.pulses;
+    const bool isFlowing = reading.gpm != 0.0;
+
+    const unsigned long pending = Totalizer::bootPulses - Totalizer::committedBootPulses;
+    if (pending > 0 && (pending >= TOTALIZER_COMMIT_GALLONS * PULSE_RATE || (Totalizer::wasFlowing && !isFlowing) || MonotonicClock::hasElapsed(Totalizer::lastCommitTime, Duration::millis(TOTALIZER_COMMIT_FREQUENCY))))
+    {
+        Totalizer::commit();
+    }
+    Totalizer::wasFlowing = isFlowing;
+
+    if (Device::isConnected() && (Totalizer::lastSendTime == Instant() || MonotonicClock::hasElapsed(Totalizer::lastSendTime, Duration::millis(TOTALIZER_SEND_FREQUENCY))))
+    {
+        Totalizer::totalSensor.setValue((unsigned long)(Totalizer::total() / PULSE_RATE));
+        Totalizer::lastSendTime = MonotonicClock::now();
+    }
+}
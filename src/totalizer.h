@@ -0,0 +1,96 @@
+#ifndef TOTALIZER
+#define TOTALIZER
+
+#include <ArduinoHA.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "monotonicTime.h"
+
+/**
+ * @brief the log file (LittleFS) of the committed totals
+ */
+#define TOTALIZER_FILE "/totalizer.log"
+
+/**
+ * @brief the file the log gets compacted into, before it replaces the log (atomic rename)
+ */
+#define TOTALIZER_COMPACT_FILE "/totalizer.new"
+
+/**
+ * @brief max number of records (12 bytes each) in the log, before it gets compacted to the latest one.
+ * littlefs spreads the (copy on write) blocks of the log across the filesystem,
+ * so the bigger the log, the less often the same blocks get erased.
+ */
+#define TOTALIZER_LOG_RECORDS 1024
+
+/**
+ * @brief gallons metered since the last commit, that trigger a commit.
+ * it is (about) the most that can be lost on a power loss.
+ */
+#define TOTALIZER_COMMIT_GALLONS 10
+
+/**
+ * @brief frequency in milliseconds, to commit the gallons metered since the last commit (if any),
+ * when less than TOTALIZER_COMMIT_GALLONS and the water keeps running
+ */
+#define TOTALIZER_COMMIT_FREQUENCY 900000
+
+/**
+ * @brief frequency in milliseconds, to check if a commit is due (the period of the totalizer task)
+ */
+#define TOTALIZER_LOOP_FREQUENCY 1000
+
+/**
+ * @brief frequency in milliseconds, to send the total to the controller (when it changed)
+ */
+#define TOTALIZER_SEND_FREQUENCY 60000
+
+/**
+ * @brief a committed total, as appended to the log
+ */
+struct TotalizerRecord
+{
+    // incremented on every commit, the highest valid one wins
+    uint32_t sequence;
+    // the lifetime total
+    uint32_t pulses;
+    // CRC-32 of the above
+    uint32_t crc;
+};
+
+/**
+ * @brief the lifetime gallons totalizer (core 0).
+ * unlike the gallons counter (which starts over on every boot), the total survives reboots, power losses and updates.
+ * the total gets committed in batches (@see TOTALIZER_COMMIT_GALLONS) as CRC protected records,
+ * appended to a log in flash. on boot, the valid record with the highest sequence is the total,
+ * so a torn (or corrupt) record only loses the batch it was committing.
+ */
+class Totalizer
+{
+public:
+    // properties
+    static HASensorNumber totalSensor;
+    static bool isFileAvailable;
+    static uint32_t sequence;
+    static uint32_t committedPulses;
+    static unsigned long bootPulses;
+    static unsigned long committedBootPulses;
+    static uint32_t logRecords;
+    static unsigned long commits;
+    static unsigned long compactions;
+    static Instant lastCommitTime;
+    static Instant lastSendTime;
+    static bool wasFlowing;
+
+    // methods
+    static void setup();
+    static void loop();
+    static bool commit();
+    static uint32_t total();
+
+private:
+    static bool load(const char *path, TotalizerRecord &latest, uint32_t &records);
+    static bool compact(const TotalizerRecord &record);
+};
+
+#endif // TOTALIZER
@@ -0,0 +1,181 @@
+#include <ArduinoHA.h>
+#include "device.h"
+#include "debugFormatter.h"
+#include "usageEvents.h"
+
+// the classifier, the first rule an event matches wins (UsageOther when none).
+// the fixtures of typical (US) households: a toilet refills 1.2-3.5 gallons at 2-5 GPM, a faucet runs for a few seconds
+// to a few minutes at up to 2.2 GPM, a shower takes 5-20 minutes at 1.2-3 GPM, a tub fills faster and an irrigation zone runs longer
+const UsageFixtureRule UsageEvents::rules[USAGE_EVENTS_RULES] = {
+    {UsageToilet, 10, 150, 2.2, 5.5, 0.8, 4.0},
+    {UsageFaucet, 3, 300, 0.1, 2.2, 0.1, 4.0},
+    {UsageShower, 180, 1800, 1.2, 3.0, 4.0, 60.0},
+    {UsageBath, 180, 1200, 3.0, 8.0, 12.0, 80.0},
+    {UsageIrrigation, 1200, 14400, 3.0, 20.0, 40.0, 3000.0}};
+
+// the fixture of the last usage event
+HASensor UsageEvents::lastUsageSensor("waterMonitorLastUsage");
+
+// the current usage event: if there is one, since when, from which pulse and the last time (and pulse) the water ran
+bool UsageEvents::isFlowing = false;
+UsageEvent UsageEvents::event = {};
+Instant UsageEvents::startTime;
+unsigned long UsageEvents::startPulses = 0;
+Instant UsageEvents::lastFlowTime;
+unsigned long UsageEvents::lastFlowPulses = 0;
+
+// the time of the previous reading, to integrate the GPM
+Instant UsageEvents::lastTime;
+
+// the ended events, waiting to be published and the one being published (kept until the publish succeeds)
+RingBuffer<UsageEvent, USAGE_EVENTS_QUEUE_SIZE> UsageEvents::events;
+UsageEvent UsageEvents::pending = {};
+bool UsageEvents::hasPending = false;
+
+// the number of events ended (since boot) and the ones dropped, because the queue was full
+unsigned long UsageEvents::ended = 0;
+unsigned long UsageEvents::dropped = 0;
+
+void UsageEvents::setup()
+{
+    UsageEvents::lastUsageSensor.setName("Last Usage");
+    UsageEvents::lastUsageSensor.setIcon("mdi:water-pump");
+
+    UsageEvents::lastTime = MonotonicClock::now();
+}
+
+const char *UsageEvents::fixtureName(UsageFixture fixture)
+{
+    switch (fixture)
+    {
+    case UsageToilet:
+        return "toilet";
+    case UsageFaucet:
+        return "faucet";
+    case UsageShower:
+        return "shower";
+    case UsageBath:
+        return "bath";
+    case UsageIrrigation:
+        return "irrigation";
+    default:
+        return "other";
+    }
+}
+
+UsageFixture UsageEvents::classify(const UsageEvent &event)
+{
+    const uint32_t seconds = event.duration.toMillis32() / 1000;
+    const float meanGpm = event.duration > Duration() ? event.gallons * 60000.0f / event.duration.toMillis32() : 0.0f;
+    for (const UsageFixtureRule &rule : UsageEvents::rules)
+    {
+        if (seconds >= rule.minSeconds && seconds <= rule.maxSeconds &&
+            meanGpm >= rule.minMeanGpm && meanGpm <= rule.maxMeanGpm &&
+            event.gallons >= rule.minGallons && event.gallons <= rule.maxGallons)
+        {
+            return rule.fixture;
+        }
+    }
+    return UsageOther;
+}
+
+/**
+ * @brief segments the flow on a reading of the sampling core
+ *
+ * @param time the time of the reading
+ */
+void UsageEvents::update(const PulseReading &reading, Instant time)
+{
+    const bool isFlowing = reading.gpm != 0.0 || reading.isIrSensorActive;
+    const float gpm = SensorMath::toFloat(reading.gpm);
+    const uint32_t elapsed = (time - UsageEvents::lastTime).toMillis32();
+    UsageEvents::lastTime = time;
+
+    if (isFlowing)
+    {
+        if (!UsageEvents::isFlowing)
+        {
+            UsageEvents::isFlowing = true;
+            UsageEvents::event = {};
+            UsageEvents::startTime = time;
+            UsageEvents::startPulses = reading.pulses;
+        }
+        UsageEvents::lastFlowTime = time;
+        UsageEvents::lastFlowPulses = reading.pulses;
+    }
+    else if (UsageEvents::isFlowing && time - UsageEvents::lastFlowTime >= Duration::millis(USAGE_EVENTS_STOP_GRACE))
+    {
+        UsageEvents::isFlowing = false;
+        UsageEvent &event = UsageEvents::event;
+        event.endTime = UsageEvents::lastFlowTime;
+        event.duration = UsageEvents::lastFlowTime - UsageEvents::startTime;
+        event.pulses = UsageEvents::lastFlowPulses - UsageEvents::startPulses;
+        if (event.gallons >= USAGE_EVENTS_MIN_GALLONS)
+        {
+            event.fixture = UsageEvents::classify(event);
+            UsageEvents::ended++;
+            UsageEvents::dropped += UsageEvents::events.push(event) ? 0 : 1;
+        }
+        return;
+    }
+
+    if (UsageEvents::isFlowing)
+    {
+        UsageEvents::event.gallons += gpm * elapsed / 60000.0f;
+        UsageEvents::event.peakGpm = gpm > UsageEvents::event.peakGpm ? gpm : UsageEvents::event.peakGpm;
+    }
+}
+
+/**
+ * @brief the JSON summary of an event (@see USAGE_EVENTS_MQTT_TOPIC)
+ *
+ * @return the length of the summary
+ */
+size_t UsageEvents::describe(const UsageEvent &event, char *buffer, size_t size)
+{
+    const float meanGpm = event.duration > Duration() ? event.gallons * 60000.0f / event.duration.toMillis32() : 0.0f;
+    DebugFormatter summary(buffer, size);
+    summary.text("{\"fixture\":\"").text(UsageEvents::fixtureName(event.fixture)).text("\",\"gallons\":").real(event.gallons, 2);
+    summary.text(",\"seconds\":").number(event.duration.toMillis32() / 1000).text(",\"peakGpm\":").real(event.peakGpm, 2).text(",\"meanGpm\":").real(meanGpm, 2);
+    summary.text(",\"pulses\":").number(event.pulses).text(",\"ago\":").number(MonotonicClock::since(event.endTime).toMillis32() / 1000).text("}");
+    return summary.getLength();
+}
+
+bool UsageEvents::publish(const UsageEvent &event)
+{
+    char payload[USAGE_EVENTS_PAYLOAD_SIZE];
+    UsageEvents::describe(event, payload, sizeof(payload));
+    if (!Device::mqtt.publish(USAGE_EVENTS_MQTT_TOPIC, payload))
+    {
+        return false;
+    }
+    // once the event is out, it is not published again for the sensor (it gets the next event's fixture anyway)
+    UsageEvents::lastUsageSensor.setValue(UsageEvents::fixtureName(event.fixture));
+    return true;
+}
+
+/**
+ * @brief segments the flow on the latest reading of the sampling core and publishes the ended events (once connected),
+ * one per run, oldest first. it is scheduled every USAGE_EVENTS_LOOP_FREQUENCY, also while disconnected (@see src/main.cpp)
+ */
+void UsageEvents::loop()
+{
+    PulseReading reading;
+    if (PulseSensor::readings.read(reading))
+    {
+        UsageEvents::update(reading, MonotonicClock::now());
+    }
+
+    if (!Device::isConnected())
+    {
+        return;
+    }
+    if (!UsageEvents::hasPending)
+    {
+        UsageEvents::hasPending = UsageEvents::events.pop(UsageEvents::pending);
+    }
+    if (UsageEvents::hasPending && UsageEvents::publish(UsageEvents::pending))
+    {
+        UsageEvents::hasPending = false;
+    }
+}
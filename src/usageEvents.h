@@ -0,0 +1,125 @@
+#ifndef USAGE_EVENTS
+#define USAGE_EVENTS
+
+#include <ArduinoHA.h>
+#include <stdint.h>
+#include "ringBuffer.h"
+#include "pulseSensor.h"
+
+/**
+ * @brief the MQTT topic the usage events are published to, one message per event, once it ends (or once reconnected):
+ * {"fixture":"shower","gallons":17.25,"seconds":492,"peakGpm":2.41,"meanGpm":2.10,"pulses":17,"ago":45}
+ * where ago is the seconds since the water stopped (USAGE_EVENTS_STOP_GRACE, or more when it waited for the network)
+ */
+#define USAGE_EVENTS_MQTT_TOPIC "waterMonitor:usageEvent"
+
+/**
+ * @brief time in milliseconds without flow, for a usage event to end.
+ * the flow detection may drop for a few seconds when the flow falls, which must not split the event.
+ * it also ends the event of the leak detector's continuous flow and event volume alarms (@see LeakDetector).
+ */
+#define USAGE_EVENTS_STOP_GRACE 45000
+
+/**
+ * @brief the events of less gallons are ignored (ie. a false start of the flow detection)
+ */
+#define USAGE_EVENTS_MIN_GALLONS 0.1
+
+/**
+ * @brief frequency in milliseconds, to segment the flow (the period of the usage events task)
+ */
+#define USAGE_EVENTS_LOOP_FREQUENCY 1000
+
+/**
+ * @brief number of ended events kept while disconnected. must be a power of 2.
+ * when full, the new ones get dropped (and counted).
+ */
+#define USAGE_EVENTS_QUEUE_SIZE 16
+
+/**
+ * @brief max length (including the terminator) of an event payload
+ */
+#define USAGE_EVENTS_PAYLOAD_SIZE 160
+
+/**
+ * @brief the fixtures an event can be classified as
+ */
+enum UsageFixture : uint8_t
+{
+    UsageOther = 0,
+    UsageToilet,
+    UsageFaucet,
+    UsageShower,
+    UsageBath,
+    UsageIrrigation
+};
+
+/**
+ * @brief a rule of the classifier: the fixture of the events within all the ranges (inclusive)
+ */
+struct UsageFixtureRule
+{
+    UsageFixture fixture;
+    uint32_t minSeconds;
+    uint32_t maxSeconds;
+    float minMeanGpm;
+    float maxMeanGpm;
+    float minGallons;
+    float maxGallons;
+};
+
+#define USAGE_EVENTS_RULES 5
+
+/**
+ * @brief a usage event, from the flow start to its stop
+ */
+struct UsageEvent
+{
+    // when it ended
+    Instant endTime;
+    Duration duration;
+    float gallons;
+    float peakGpm;
+    unsigned long pulses;
+    UsageFixture fixture;
+};
+
+/**
+ * @brief the streaming segmentation of the flow into usage events (core 0).
+ * it follows the readings of the sampling core every USAGE_EVENTS_LOOP_FREQUENCY (also while disconnected),
+ * integrates the GPM into the volume of the event and once the water stops (for USAGE_EVENTS_STOP_GRACE),
+ * classifies the event to a likely fixture (the first rule it matches, @see UsageEvents::rules)
+ * and publishes one summary for it, along with the `Last Usage` sensor.
+ */
+class UsageEvents
+{
+public:
+    // properties
+    static const UsageFixtureRule rules[USAGE_EVENTS_RULES];
+    static HASensor lastUsageSensor;
+    static bool isFlowing;
+    static UsageEvent event;
+    static Instant startTime;
+    static unsigned long startPulses;
+    static Instant lastFlowTime;
+    static unsigned long lastFlowPulses;
+    static Instant lastTime;
+    static RingBuffer<UsageEvent, USAGE_EVENTS_QUEUE_SIZE> events;
+    static UsageEvent pending;
+    static bool hasPending;
+    static unsigned long ended;
+    static unsigned long dropped;
+
+    // methods
+    static void setup();
+    static void loop();
+    static void update(const PulseReading &reading, Instant time);
+    static UsageFixture classify(const UsageEvent &event);
+    static const char *fixtureName(UsageFixture fixture);
+    static size_t describe(const UsageEvent &event, char *buffer, size_t size);
+
+private:
+    static bool publish(const UsageEvent &event);
+};
+
+#endif // USAGE_EVENTS
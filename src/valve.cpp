@@ -0,0 +1,273 @@
+#include <ArduinoHA.h>
+#include "device.h"
+#include "debugFormatter.h"
+#include "leakDetector.h"
+#include "valve.h"
+
+#ifdef VALVE_ENABLED
+
+// on while the valve is (or is being) opened
+HASwitch Valve::valveSwitch("waterMonitorValve");
+
+// where the valve is, ie. "closed, leak shutoff"
+HASensor Valve::stateSensor("waterMonitorValveState");
+
+// where the valve is and where it goes (opened by default, as a valve that was not there would be)
+ValveState Valve::state = ValveStopped;
+bool Valve::isOpenTarget = true;
+
+// if the motor runs (towards the target) and since when, or since when it stopped, while reversing
+bool Valve::isMotorOn = false;
+Instant Valve::motorTime;
+
+// if the valve got shut off by a leak alarm (until it is opened from the controller) and when
+bool Valve::isLeakShutoff = false;
+Instant Valve::shutoffTime;
+
+// the last accepted command to open the valve and the last override of a leak shutoff (the boot, for none yet)
+Instant Valve::lastCommandTime;
+Instant Valve::lastOverrideTime;
+
+// the state the controller got and if it got it since (re)connecting
+ValveState Valve::publishedState = ValveStopped;
+bool Valve::publishedLeakShutoff = false;
+bool Valve::isPublished = false;
+
+// statistics (since boot)
+unsigned long Valve::shutoffs = 0;
+unsigned long Valve::overrides = 0;
+unsigned long Valve::rejectedCommands = 0;
+unsigned long Valve::faults = 0;
+
+void Valve::setup()
+{
+    digitalWrite(VALVE_OPEN_PIN, LOW);
+    digitalWrite(VALVE_CLOSE_PIN, LOW);
+    pinMode(VALVE_OPEN_PIN, OUTPUT);
+    pinMode(VALVE_CLOSE_PIN, OUTPUT);
+    pinMode(VALVE_OPENED_PIN, INPUT_PULLUP);
+    pinMode(VALVE_CLOSED_PIN, INPUT_PULLUP);
+
+    Valve::valveSwitch.setIcon("mdi:valve");
+    Valve::valveSwitch.setName("Water Valve");
+    Valve::valveSwitch.onCommand(Valve::onCommand);
+
+    Valve::stateSensor.setIcon("mdi:pipe-valve");
+    Valve::stateSensor.setName("Valve State");
+
+    // it stays where it is, until commanded (ie. closed after a leak shutoff, before a reboot)
+    Valve::state = Valve::position();
+    Valve::isOpenTarget = Valve::state != ValveClosed;
+}
+
+const char *Valve::stateName(ValveState state)
+{
+    switch (state)
+    {
+    case ValveOpening:
+        return VALVE_STATE_OPENING;
+    case ValveOpen:
+        return VALVE_STATE_OPEN;
+    case ValveClosing:
+        return VALVE_STATE_CLOSING;
+    case ValveClosed:
+        return VALVE_STATE_CLOSED;
+    case ValveFault:
+        return VALVE_STATE_FAULT;
+    default:
+        return VALVE_STATE_STOPPED;
+    }
+}
+
+/**
+ * @brief the position, from the limit switches
+ *
+ * @return ValveState open, closed, stopped (in between) or a fault (both on)
+ */
+ValveState Valve::position()
+{
+    const bool isOpened = digitalRead(VALVE_OPENED_PIN) == LOW;
+    const bool isClosed = digitalRead(VALVE_CLOSED_PIN) == LOW;
+    if (isOpened && isClosed)
+    {
+        return ValveFault;
+    }
+    return isOpened ? ValveOpen : (isClosed ? ValveClosed : ValveStopped);
+}
+
+/**
+ * @brief turns the motor off, at a position
+ */
+void Valve::stop(ValveState state)
+{
+    digitalWrite(VALVE_OPEN_PIN, LOW);
+    digitalWrite(VALVE_CLOSE_PIN, LOW);
+    Valve::isMotorOn = false;
+    Valve::faults += state == ValveFault && Valve::state != ValveFault ? 1 : 0;
+    Valve::state = state;
+}
+
+/**
+ * @brief runs the motor towards a position (unless it is there already).
+ * when it runs the other way, it stops now and reverses after VALVE_REVERSE_DELAY (@see Valve::loop())
+ *
+ * @param isOpen
+ */
+void Valve::drive(bool isOpen)
+{
+    Valve::isOpenTarget = isOpen;
+    const ValveState target = isOpen ? ValveOpen : ValveClosed;
+    if (Valve::position() == target)
+    {
+        Valve::stop(target);
+        return;
+    }
+
+    const bool isReversing = Valve::isMotorOn && Valve::state == (isOpen ? ValveClosing : ValveOpening);
+    if (Valve::isMotorOn && !isReversing)
+    {
+        // already on its way (the travel timeout keeps running)
+        return;
+    }
+    digitalWrite(isOpen ? VALVE_CLOSE_PIN : VALVE_OPEN_PIN, LOW);
+    Valve::state = isOpen ? ValveOpening : ValveClosing;
+    Valve::motorTime = MonotonicClock::now();
+    Valve::isMotorOn = !isReversing;
+    if (Valve::isMotorOn)
+    {
+        digitalWrite(isOpen ? VALVE_OPEN_PIN : VALVE_CLOSE_PIN, HIGH);
+    }
+}
+
+/**
+ * @brief closes the valve (always, even after a fault)
+ */
+void Valve::close()
+{
+    Valve::drive(false);
+}
+
+/**
+ * @brief opens the valve, unless the command is too soon after the previous one (VALVE_COMMAND_INTERVAL).
+ * after a leak shutoff, or while one of the VALVE_SHUTOFF_ALARMS is on, opening it is a manual override,
+ * which clears the shutoff and is allowed once every VALVE_OVERRIDE_INTERVAL.
+ *
+ * @return false if it got rejected
+ */
+bool Valve::open()
+{
+    const bool isOverride = Valve::isLeakShutoff || (LeakDetector::alarms & VALVE_SHUTOFF_ALARMS) != 0;
+    if ((Valve::lastCommandTime != Instant() && !MonotonicClock::hasElapsed(Valve::lastCommandTime, Duration::millis(VALVE_COMMAND_INTERVAL))) ||
+        (isOverride && Valve::lastOverrideTime != Instant() && !MonotonicClock::hasElapsed(Valve::lastOverrideTime, Duration::millis(VALVE_OVERRIDE_INTERVAL))))
+    {
+        Valve::rejectedCommands++;
+        return false;
+    }
+
+    Valve::lastCommandTime = MonotonicClock::now();
+    if (isOverride)
+    {
+        Valve::lastOverrideTime = Valve::lastCommandTime;
+        Valve::isLeakShutoff = false;
+        Valve::overrides++;
+    }
+    Valve::drive(true);
+    return true;
+}
+
+/**
+ * @brief shuts off the valve, when the leak detector raises one of the VALVE_SHUTOFF_ALARMS.
+ * it runs right after the alarm got evaluated, without waiting for the controller.
+ *
+ * @param raised the newly raised alarms (LeakAlarm flags)
+ */
+void Valve::onLeakAlarms(uint8_t raised)
+{
+    if ((raised & VALVE_SHUTOFF_ALARMS) == 0)
+    {
+        return;
+    }
+    Valve::isLeakShutoff = true;
+    Valve::shutoffTime = MonotonicClock::now();
+    Valve::shutoffs++;
+    Valve::close();
+}
+
+/**
+ * @brief called when the switch changes remotely, from the controller
+ *
+ * @param state on to open, off to close
+ */
+void Valve::onCommand(bool state, HASwitch *sender)
+{
+    if (state)
+    {
+        Valve::open();
+    }
+    else
+    {
+        Valve::close();
+    }
+
+    // report back where it goes (off, if the command got rejected)
+    sender->setState(Valve::isOpenTarget);
+}
+
+void Valve::publish()
+{
+    char description[32];
+    DebugFormatter text(description, sizeof(description));
+    text.text(Valve::stateName(Valve::state)).text(Valve::isLeakShutoff ? ", leak shutoff" : "");
+    if (Valve::stateSensor.setValue(description) && Valve::valveSwitch.setState(Valve::isOpenTarget))
+    {
+        Valve::publishedState = Valve::state;
+        Valve::publishedLeakShutoff = Valve::isLeakShutoff;
+        Valve::isPublished = true;
+    }
+}
+
+/**
+ * @brief follows the limit switches: stops the motor once the valve gets there (or the travel times out),
+ * starts it after the reverse delay and publishes the changes (once connected).
+ * it runs on every loop iteration, also while disconnected (@see src/main.cpp)
+ */
+void Valve::loop()
+{
+    const ValveState position = Valve::position();
+    if (Valve::state == ValveOpening || Valve::state == ValveClosing)
+    {
+        const bool isOpen = Valve::state == ValveOpening;
+        if (position == ValveFault || position == (isOpen ? ValveOpen : ValveClosed))
+        {
+            Valve::stop(position);
+        }
+        else if (!Valve::isMotorOn && MonotonicClock::hasElapsed(Valve::motorTime, Duration::millis(VALVE_REVERSE_DELAY)))
+        {
+            digitalWrite(isOpen ? VALVE_OPEN_PIN : VALVE_CLOSE_PIN, HIGH);
+            Valve::isMotorOn = true;
+            Valve::motorTime = MonotonicClock::now();
+        }
+        else if (Valve::isMotorOn && MonotonicClock::hasElapsed(Valve::motorTime, Duration::millis(VALVE_TRAVEL_TIMEOUT)))
+        {
+            Valve::stop(ValveFault);
+        }
+    }
+    else if (Valve::state != ValveFault && position != Valve::state)
+    {
+        // turned by hand (which also overrides a leak shutoff, once opened)
+        Valve::stop(position);
+        Valve::isOpenTarget = position != ValveClosed;
+        Valve::isLeakShutoff = Valve::isLeakShutoff && position != ValveOpen;
+    }
+
+    if (!Device::isConnected())
+    {
+        Valve::isPublished = false;
+    }
+    else if (!Valve::isPublished || Valve::state != Valve::publishedState || Valve::isLeakShutoff != Valve::publishedLeakShutoff)
+    {
+        Valve::publish();
+    }
+}
+
+#endif // VALVE_ENABLED
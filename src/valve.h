@@ -0,0 +1,122 @@
+#ifndef VALVE
+#define VALVE
+
+#include <ArduinoHA.h>
+#include <stdint.h>
+#include "monotonicTime.h"
+
+/**
+ * @brief the shutoff valve is optional (@see README.md): uncomment (or build with -D VALVE_ENABLED) once it is wired.
+ * without it, there are no valve entities and the pins stay free.
+ */
+// #define VALVE_ENABLED
+
+/**
+ * @brief the outputs that run the valve motor towards open / closed (ie. the two relays, or the H-bridge inputs of a reversing motor).
+ * HIGH runs the motor. they are never HIGH together.
+ */
+#define VALVE_OPEN_PIN D6
+#define VALVE_CLOSE_PIN D7
+
+/**
+ * @brief the position feedback: the limit switches of the fully open / fully closed positions, to ground (LOW when reached)
+ */
+#define VALVE_OPENED_PIN D8
+#define VALVE_CLOSED_PIN D9
+
+/**
+ * @brief max time in milliseconds for a full travel of the valve (a motorized ball valve takes 3-15 seconds).
+ * the motor stops and the valve reports a fault, when the limit switch is not reached by then.
+ */
+#define VALVE_TRAVEL_TIMEOUT 20000
+
+/**
+ * @brief time in milliseconds the motor stays off, before it reverses (ie. closing while it was opening)
+ */
+#define VALVE_REVERSE_DELAY 200
+
+/**
+ * @brief min time in milliseconds between two commands to open the valve, from the controller
+ * (to protect the motor from an automation that keeps toggling it). closing is never rate limited.
+ */
+#define VALVE_COMMAND_INTERVAL 10000
+
+/**
+ * @brief min time in milliseconds between two manual overrides of the leak shutoff (@see Valve::onCommand())
+ */
+#define VALVE_OVERRIDE_INTERVAL 300000
+
+/**
+ * @brief the leak alarms that shut off the valve as soon as they are raised (LeakAlarm flags, @see src/leakDetector.h), 0 for none.
+ * the micro leak one does not, as the water trickles away slowly and shutting it off would be more of a trouble than the leak.
+ */
+#define VALVE_SHUTOFF_ALARMS (LeakAlarmContinuousFlow | LeakAlarmEventVolume)
+
+#define VALVE_STATE_OPEN "open"
+#define VALVE_STATE_OPENING "opening"
+#define VALVE_STATE_CLOSED "closed"
+#define VALVE_STATE_CLOSING "closing"
+#define VALVE_STATE_STOPPED "stopped"
+#define VALVE_STATE_FAULT "fault"
+
+enum ValveState : uint8_t
+{
+    // between the limit switches, with the motor off (ie. at boot, or turned by hand)
+    ValveStopped = 0,
+    ValveOpening,
+    ValveOpen,
+    ValveClosing,
+    ValveClosed,
+    // the travel timed out, or both limit switches are on
+    ValveFault
+};
+
+/**
+ * @brief the motorized water shutoff valve (core 0), with the limit switches as its position feedback.
+ * - the `Water Valve` switch opens (on) and closes (off) it and the `Valve State` sensor shows where it is
+ * - the leak detector shuts it off right away, when it raises one of the VALVE_SHUTOFF_ALARMS,
+ *   on the device and also while disconnected (@see LeakDetector::loop())
+ * - the interlocks: the motor never runs both ways, stops at the limit switches (or after VALVE_TRAVEL_TIMEOUT)
+ *   and waits VALVE_REVERSE_DELAY before reversing
+ * - after a leak shutoff, the valve stays closed until it is opened from the controller (a manual override),
+ *   once every VALVE_OVERRIDE_INTERVAL at most. the alarms that are still active then, do not shut it off again.
+ */
+class Valve
+{
+public:
+    // properties
+    static HASwitch valveSwitch;
+    static HASensor stateSensor;
+    static ValveState state;
+    static bool isOpenTarget;
+    static bool isMotorOn;
+    static Instant motorTime;
+    static bool isLeakShutoff;
+    static Instant shutoffTime;
+    static Instant lastCommandTime;
+    static Instant lastOverrideTime;
+    static ValveState publishedState;
+    static bool publishedLeakShutoff;
+    static bool isPublished;
+    static unsigned long shutoffs;
+    static unsigned long overrides;
+    static unsigned long rejectedCommands;
+    static unsigned long faults;
+
+    // methods
+    static void setup();
+    static void loop();
+    static void onLeakAlarms(uint8_t raised);
+    static void onCommand(bool state, HASwitch *sender);
+    static bool open();
+    static void close();
+    static const char *stateName(ValveState state);
+
+private:
+    static ValveState position();
+    static void drive(bool isOpen);
+    static void stop(ValveState state);
+    static void publish();
+};
+
+#endif // VALVE